@@ -0,0 +1,312 @@
+#include "vulkan-engine/AccumulationPass.h"
+
+#include <cstring>
+
+static const VkFormat ACCUMULATION_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// push constants of accumulate.glsl
+struct AccumulatePushConstants {
+  float weight;
+};
+
+// radical inverse of index in the given base, the Halton sequence
+static float halton(int index, int base) {
+  float result = 0.0f;
+  float f = 1.0f / base;
+  for(int i = index; i > 0; i /= base) {
+    result += f * (i % base);
+    f /= base;
+  }
+  return result;
+}
+
+void vulkan_engine::AccumulationPass::init(RenderSurface* surface,
+                                           QVulkanDeviceFunctions* funcs,
+                                           VkPipelineCache pipeline_cache,
+                                           VkShaderModule vertex_shader,
+                                           VkShaderModule fragment_shader) {
+  surface_ = surface;
+  funcs_ = funcs;
+  VkDevice device = surface_->device();
+
+  // The scene is cleared, the accumulation overwrites every pixel.
+  scene_pass_ = createSampledRenderPass(surface_, funcs_, ACCUMULATION_FORMAT,
+                                        VK_ATTACHMENT_LOAD_OP_CLEAR, true);
+  accumulate_pass_ =
+    createSampledRenderPass(surface_, funcs_, ACCUMULATION_FORMAT,
+                            VK_ATTACHMENT_LOAD_OP_DONT_CARE, false);
+
+  // Samples map 1:1 to pixels, no filtering needed.
+  VkSamplerCreateInfo sampler_info;
+  memset(&sampler_info, 0, sizeof(sampler_info));
+  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sampler_info.magFilter = VK_FILTER_NEAREST;
+  sampler_info.minFilter = VK_FILTER_NEAREST;
+  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.maxLod = 0.0f;
+  VkResult err =
+    funcs_->vkCreateSampler(device, &sampler_info, nullptr, &sampler_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create sampler: %d", err);
+  }
+
+  VkDescriptorSetLayoutBinding layout_bindings[] = {
+    {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+     VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+    {1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+     VK_SHADER_STAGE_FRAGMENT_BIT, nullptr}};
+  VkDescriptorSetLayoutCreateInfo descriptor_layout_info = {
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr, 0, 2,
+    layout_bindings};
+  err = funcs_->vkCreateDescriptorSetLayout(device, &descriptor_layout_info,
+                                            nullptr, &descriptor_set_layout_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create descriptor set layout: %d", err);
+  }
+
+  VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                    8};
+  VkDescriptorPoolCreateInfo descriptor_pool_info;
+  memset(&descriptor_pool_info, 0, sizeof(descriptor_pool_info));
+  descriptor_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  descriptor_pool_info.maxSets = 4;
+  descriptor_pool_info.poolSizeCount = 1;
+  descriptor_pool_info.pPoolSizes = &pool_size;
+  err = funcs_->vkCreateDescriptorPool(device, &descriptor_pool_info, nullptr,
+                                       &descriptor_pool_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create descriptor pool: %d", err);
+  }
+
+  VkDescriptorSetLayout set_layouts[4] = {
+    descriptor_set_layout_, descriptor_set_layout_, descriptor_set_layout_,
+    descriptor_set_layout_};
+  VkDescriptorSet sets[4];
+  VkDescriptorSetAllocateInfo descriptor_set_alloc_info = {
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr, descriptor_pool_,
+    4, set_layouts};
+  err =
+    funcs_->vkAllocateDescriptorSets(device, &descriptor_set_alloc_info, sets);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate descriptor sets: %d", err);
+  }
+  accumulate_sets_[0] = sets[0];
+  accumulate_sets_[1] = sets[1];
+  present_sets_[0] = sets[2];
+  present_sets_[1] = sets[3];
+
+  VkPushConstantRange push_constant_range = {
+    VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(AccumulatePushConstants)};
+  VkPipelineLayoutCreateInfo pipeline_layout_info;
+  memset(&pipeline_layout_info, 0, sizeof(pipeline_layout_info));
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.setLayoutCount = 1;
+  pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+  pipeline_layout_info.pushConstantRangeCount = 1;
+  pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+  err = funcs_->vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
+                                       &pipeline_layout_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create pipeline layout: %d", err);
+  }
+
+  accumulate_pipeline_ = createFullscreenPipeline(
+    surface_, funcs_, pipeline_cache, pipeline_layout_, accumulate_pass_,
+    VK_SAMPLE_COUNT_1_BIT, vertex_shader, fragment_shader);
+  present_pipeline_ = createFullscreenPipeline(
+    surface_, funcs_, pipeline_cache, pipeline_layout_,
+    surface_->defaultRenderPass(), surface_->sampleCountFlagBits(),
+    vertex_shader, fragment_shader);
+}
+
+void vulkan_engine::AccumulationPass::release() {
+  if(!funcs_) {
+    return;
+  }
+  releaseImages();
+
+  VkDevice device = surface_->device();
+  if(present_pipeline_) {
+    funcs_->vkDestroyPipeline(device, present_pipeline_, nullptr);
+    present_pipeline_ = VK_NULL_HANDLE;
+  }
+  if(accumulate_pipeline_) {
+    funcs_->vkDestroyPipeline(device, accumulate_pipeline_, nullptr);
+    accumulate_pipeline_ = VK_NULL_HANDLE;
+  }
+  if(pipeline_layout_) {
+    funcs_->vkDestroyPipelineLayout(device, pipeline_layout_, nullptr);
+    pipeline_layout_ = VK_NULL_HANDLE;
+  }
+  if(descriptor_pool_) {
+    // frees the descriptor sets as well
+    funcs_->vkDestroyDescriptorPool(device, descriptor_pool_, nullptr);
+    descriptor_pool_ = VK_NULL_HANDLE;
+  }
+  if(descriptor_set_layout_) {
+    funcs_->vkDestroyDescriptorSetLayout(device, descriptor_set_layout_,
+                                         nullptr);
+    descriptor_set_layout_ = VK_NULL_HANDLE;
+  }
+  if(sampler_) {
+    funcs_->vkDestroySampler(device, sampler_, nullptr);
+    sampler_ = VK_NULL_HANDLE;
+  }
+  if(accumulate_pass_) {
+    funcs_->vkDestroyRenderPass(device, accumulate_pass_, nullptr);
+    accumulate_pass_ = VK_NULL_HANDLE;
+  }
+  if(scene_pass_) {
+    funcs_->vkDestroyRenderPass(device, scene_pass_, nullptr);
+    scene_pass_ = VK_NULL_HANDLE;
+  }
+  funcs_ = nullptr;
+}
+
+void vulkan_engine::AccumulationPass::resize(const QSize& size) {
+  size_ = size;
+  VkDevice device = surface_->device();
+
+  resizeRenderTarget(surface_, funcs_, size_, ACCUMULATION_FORMAT,
+                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                       VK_IMAGE_USAGE_SAMPLED_BIT,
+                     VK_IMAGE_ASPECT_COLOR_BIT, &scene_color_);
+  for(RenderTarget& history : history_) {
+    resizeRenderTarget(surface_, funcs_, size_, ACCUMULATION_FORMAT,
+                       VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                         VK_IMAGE_USAGE_SAMPLED_BIT,
+                       VK_IMAGE_ASPECT_COLOR_BIT, &history);
+  }
+
+  VkFramebufferCreateInfo framebuffer_info;
+  memset(&framebuffer_info, 0, sizeof(framebuffer_info));
+  framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebuffer_info.width = size_.width();
+  framebuffer_info.height = size_.height();
+  framebuffer_info.layers = 1;
+
+  // the scene framebuffer, with the depth buffer of the render graph, is
+  // left to the caller
+  framebuffer_info.renderPass = accumulate_pass_;
+  framebuffer_info.attachmentCount = 1;
+  for(RenderTarget& history : history_) {
+    framebuffer_info.pAttachments = &history.view;
+    VkResult err = funcs_->vkCreateFramebuffer(device, &framebuffer_info,
+                                               nullptr, &history.framebuffer);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create framebuffer: %d", err);
+    }
+  }
+
+  for(int p = 0; p < 2; ++p) {
+    writeDescriptorSet(accumulate_sets_[p], scene_color_.view,
+                       history_[1 - p].view);
+    writeDescriptorSet(present_sets_[p], history_[p].view, history_[p].view);
+  }
+
+  current_ = 0;
+  history_valid_ = false;
+  reset();
+}
+
+void vulkan_engine::AccumulationPass::releaseImages() {
+  if(!funcs_) {
+    return;
+  }
+  destroyRenderTarget(surface_, funcs_, &scene_color_);
+  destroyRenderTarget(surface_, funcs_, &history_[0]);
+  destroyRenderTarget(surface_, funcs_, &history_[1]);
+  size_ = QSize();
+}
+
+void vulkan_engine::AccumulationPass::writeDescriptorSet(VkDescriptorSet set,
+                                                         VkImageView current,
+                                                         VkImageView history) {
+  VkDescriptorImageInfo image_info[2] = {
+    {sampler_, current, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL},
+    {sampler_, history, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL}};
+  VkWriteDescriptorSet descriptor_write;
+  memset(&descriptor_write, 0, sizeof(descriptor_write));
+  descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptor_write.dstSet = set;
+  descriptor_write.dstBinding = 0;
+  descriptor_write.descriptorCount = 2;
+  descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  descriptor_write.pImageInfo = image_info;
+  funcs_->vkUpdateDescriptorSets(surface_->device(), 1, &descriptor_write, 0,
+                                 nullptr);
+}
+
+void vulkan_engine::AccumulationPass::jitter(float* x, float* y) const {
+  if(samples_ == 0) {
+    *x = 0.0f;
+    *y = 0.0f;
+    return;
+  }
+  // Halton (2, 3) covers the pixel evenly for any number of samples
+  *x = halton(samples_, 2) - 0.5f;
+  *y = halton(samples_, 3) - 0.5f;
+}
+
+void vulkan_engine::AccumulationPass::recordFullscreen(VkCommandBuffer cb,
+                                                       VkPipeline pipeline,
+                                                       VkDescriptorSet set,
+                                                       float weight) {
+  funcs_->vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  funcs_->vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  pipeline_layout_, 0, 1, &set, 0, nullptr);
+
+  VkViewport viewport = {
+    .x = 0,
+    .y = 0,
+    .width = static_cast<float>(size_.width()),
+    .height = static_cast<float>(size_.height()),
+    .minDepth = 0,
+    .maxDepth = 1,
+  };
+  funcs_->vkCmdSetViewport(cb, 0, 1, &viewport);
+
+  VkRect2D scissor = {
+    .offset = {.x = 0, .y = 0},
+    .extent =
+      {
+        .width = static_cast<unsigned int>(size_.width()),
+        .height = static_cast<unsigned int>(size_.height()),
+      },
+  };
+  funcs_->vkCmdSetScissor(cb, 0, 1, &scissor);
+
+  AccumulatePushConstants push_constants = {weight};
+  funcs_->vkCmdPushConstants(cb, pipeline_layout_,
+                             VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                             sizeof(push_constants), &push_constants);
+  funcs_->vkCmdDraw(cb, 3, 1, 0, 0);
+}
+
+void vulkan_engine::AccumulationPass::accumulate(VkCommandBuffer cb) {
+  const int target = 1 - current_;
+  VkRenderPassBeginInfo render_pass_begin_info;
+  memset(&render_pass_begin_info, 0, sizeof(render_pass_begin_info));
+  render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  render_pass_begin_info.renderPass = accumulate_pass_;
+  render_pass_begin_info.framebuffer = history_[target].framebuffer;
+  render_pass_begin_info.renderArea.extent.width = size_.width();
+  render_pass_begin_info.renderArea.extent.height = size_.height();
+  funcs_->vkCmdBeginRenderPass(cb, &render_pass_begin_info,
+                               VK_SUBPASS_CONTENTS_INLINE);
+  // running average: the n-th sample (from 0) has a weight of 1 / (n + 1)
+  recordFullscreen(cb, accumulate_pipeline_, accumulate_sets_[target],
+                   1.0f / (samples_ + 1));
+  funcs_->vkCmdEndRenderPass(cb);
+
+  current_ = target;
+  history_valid_ = true;
+  ++samples_;
+}
+
+void vulkan_engine::AccumulationPass::present(VkCommandBuffer cb) {
+  recordFullscreen(cb, present_pipeline_, present_sets_[current_], 1.0f);
+}
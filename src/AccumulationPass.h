@@ -0,0 +1,148 @@
+#ifndef SHIFT_GUI_ACCUMULATIONPASS_H_
+#define SHIFT_GUI_ACCUMULATIONPASS_H_
+
+#include <QSize>
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/RenderSurface.h"
+#include "vulkan-engine/RenderTarget.h"
+
+namespace vulkan_engine {
+
+/*! Progressive accumulation of frames rendered with a sub-pixel jittered
+ projection while the view is static.
+
+ The scene is rendered single-sampled into an RGBA16F target (scenePass()),
+ which accumulate() blends into one of two ping-ponged history images as the
+ running average of all samples so far. present() copies the latest history
+ into the surface's default render pass. Once maxSamples() samples are
+ accumulated the scene no longer has to be rendered at all, the history is
+ presented as is until reset(). */
+class AccumulationPass {
+public:
+  AccumulationPass() = default;
+  ~AccumulationPass() = default;
+
+  AccumulationPass(const AccumulationPass&) = delete;
+  AccumulationPass& operator=(const AccumulationPass&) = delete;
+
+  /*! Creates the render passes and pipelines, the shader modules are only
+   used during the call. */
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            VkPipelineCache pipeline_cache, VkShaderModule vertex_shader,
+            VkShaderModule fragment_shader);
+  void release();
+
+  /*! (Re)creates the render targets for the given size, in the memory of
+   the previous ones where they fit, and resets the accumulated samples.
+   The device has to be idle. */
+  void resize(const QSize& size);
+  void releaseImages();
+
+  inline bool ready() const {
+    return scene_color_.image != VK_NULL_HANDLE;
+  }
+
+  inline const QSize& size() const {
+    return size_;
+  }
+
+  /*! Discards the accumulated samples, e.g. when the view changes. */
+  inline void reset() {
+    samples_ = 0;
+  }
+
+  inline int samples() const {
+    return samples_;
+  }
+
+  inline void setMaxSamples(int max_samples) {
+    max_samples_ = max_samples > 1 ? max_samples : 1;
+  }
+
+  inline int maxSamples() const {
+    return max_samples_;
+  }
+
+  inline bool converged() const {
+    return samples_ >= max_samples_;
+  }
+
+  /*! Sub-pixel offset of the next sample in pixels, in [-0.5, 0.5). The
+   first sample is not jittered so that a single frame matches the
+   non-accumulated image. */
+  void jitter(float* x, float* y) const;
+
+  /*! Render pass the scene of the next sample is drawn into, with a
+   single-sampled color (sceneColor()) and depth attachment. */
+  inline VkRenderPass scenePass() const {
+    return scene_pass_;
+  }
+  inline const RenderTarget& sceneColor() const {
+    return scene_color_;
+  }
+
+  /*! The history images, current() holds the latest average and
+   accumulate() writes the other one. Their contents are undefined until
+   historyValid(). */
+  inline const RenderTarget& history(int index) const {
+    return history_[index];
+  }
+  inline int current() const {
+    return current_;
+  }
+  inline bool historyValid() const {
+    return history_valid_;
+  }
+
+  /*! Blends sceneColor() into the history. Must be recorded outside of a
+   render pass, with the scene color and current() history in
+   SHADER_READ_ONLY_OPTIMAL and the other history in
+   COLOR_ATTACHMENT_OPTIMAL layout. */
+  void accumulate(VkCommandBuffer cb);
+
+  /*! Draws the accumulated image, must be recorded inside the default
+   render pass of the surface with current() in SHADER_READ_ONLY_OPTIMAL
+   layout. */
+  void present(VkCommandBuffer cb);
+
+  /*! Device memory of the render targets, in bytes. */
+  inline VkDeviceSize memorySize() const {
+    return scene_color_.memory_size + history_[0].memory_size +
+           history_[1].memory_size;
+  }
+
+private:
+  void writeDescriptorSet(VkDescriptorSet set, VkImageView current,
+                          VkImageView history);
+  void recordFullscreen(VkCommandBuffer cb, VkPipeline pipeline,
+                        VkDescriptorSet set, float weight);
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+
+  VkRenderPass scene_pass_ = VK_NULL_HANDLE;
+  VkRenderPass accumulate_pass_ = VK_NULL_HANDLE;
+  VkSampler sampler_ = VK_NULL_HANDLE;
+  VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+  // accumulation into history p reads history 1 - p, presenting reads p
+  VkDescriptorSet accumulate_sets_[2] = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+  VkDescriptorSet present_sets_[2] = {VK_NULL_HANDLE, VK_NULL_HANDLE};
+  VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+  VkPipeline accumulate_pipeline_ = VK_NULL_HANDLE;
+  VkPipeline present_pipeline_ = VK_NULL_HANDLE;
+
+  RenderTarget scene_color_;
+  RenderTarget history_[2];
+  int current_ = 0;            // history holding the latest average
+  bool history_valid_ = false; // a sample was accumulated since resize()
+
+  QSize size_;
+  int samples_ = 0;
+  int max_samples_ = 64;
+};
+
+}
+
+#endif
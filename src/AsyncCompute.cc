@@ -0,0 +1,218 @@
+#include "vulkan-engine/AsyncCompute.h"
+
+#include <algorithm>
+#include <cstring>
+
+void vulkan_engine::AsyncCompute::init(RenderSurface* surface,
+                                       QVulkanDeviceFunctions* funcs) {
+  surface_ = surface;
+  funcs_ = funcs;
+  queue_ = surface_->computeQueue();
+  family_ = surface_->computeQueueFamilyIndex();
+  stats_ = Stats();
+  stats_.async = queue_ != VK_NULL_HANDLE;
+  if(!queue_) {
+    return;
+  }
+
+  VkDevice device = surface_->device();
+  frames_.resize(surface_->concurrentFrameCount());
+  for(Frame& frame : frames_) {
+    VkCommandPoolCreateInfo pool_info;
+    memset(&pool_info, 0, sizeof(pool_info));
+    pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+    pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    pool_info.queueFamilyIndex = family_;
+    VkResult err =
+      funcs_->vkCreateCommandPool(device, &pool_info, nullptr, &frame.pool);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create compute command pool: %d", err);
+    }
+    pool_info.queueFamilyIndex = surface_->graphicsQueueFamilyIndex();
+    err = funcs_->vkCreateCommandPool(device, &pool_info, nullptr,
+                                      &frame.join_pool);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create command pool: %d", err);
+    }
+
+    VkCommandBufferAllocateInfo buffer_info = {
+      VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr, frame.pool,
+      VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
+    err = funcs_->vkAllocateCommandBuffers(device, &buffer_info, &frame.cb);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to allocate compute command buffer: %d", err);
+    }
+    buffer_info.commandPool = frame.join_pool;
+    err = funcs_->vkAllocateCommandBuffers(device, &buffer_info, &frame.join);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to allocate command buffer: %d", err);
+    }
+
+    VkSemaphoreCreateInfo semaphore_info;
+    memset(&semaphore_info, 0, sizeof(semaphore_info));
+    semaphore_info.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    err = funcs_->vkCreateSemaphore(device, &semaphore_info, nullptr,
+                                    &frame.semaphore);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create semaphore: %d", err);
+    }
+  }
+
+  uint32_t family_count = 0;
+  QVulkanFunctions* f = surface_->vulkanInstance()->functions();
+  f->vkGetPhysicalDeviceQueueFamilyProperties(surface_->physicalDevice(),
+                                              &family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(family_count);
+  f->vkGetPhysicalDeviceQueueFamilyProperties(
+    surface_->physicalDevice(), &family_count, families.data());
+  if(family_ < family_count && families[family_].timestampValidBits > 0) {
+    timestamp_period_ =
+      surface_->physicalDeviceProperties()->limits.timestampPeriod;
+    VkQueryPoolCreateInfo query_info;
+    memset(&query_info, 0, sizeof(query_info));
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = 2 * frames_.size();
+    VkResult err = funcs_->vkCreateQueryPool(device, &query_info, nullptr,
+                                             &timestamp_pool_);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create query pool: %d", err);
+    }
+  }
+}
+
+void vulkan_engine::AsyncCompute::release() {
+  if(!funcs_) {
+    return;
+  }
+  VkDevice device = surface_->device();
+  for(Frame& frame : frames_) {
+    funcs_->vkDestroyCommandPool(device, frame.pool, nullptr);
+    funcs_->vkDestroyCommandPool(device, frame.join_pool, nullptr);
+    funcs_->vkDestroySemaphore(device, frame.semaphore, nullptr);
+  }
+  frames_.clear();
+  if(timestamp_pool_) {
+    funcs_->vkDestroyQueryPool(device, timestamp_pool_, nullptr);
+    timestamp_pool_ = VK_NULL_HANDLE;
+  }
+  queue_ = VK_NULL_HANDLE;
+  funcs_ = nullptr;
+}
+
+std::vector<uint32_t> vulkan_engine::AsyncCompute::queueFamilies() const {
+  std::vector<uint32_t> families(1, surface_->graphicsQueueFamilyIndex());
+  if(queue_ && family_ != families[0]) {
+    families.push_back(family_);
+  }
+  return families;
+}
+
+VkCommandBuffer vulkan_engine::AsyncCompute::begin(int current_frame) {
+  // the fence of the frame covered the last submission of its slot
+  Frame& frame = frames_[current_frame];
+  funcs_->vkResetCommandPool(surface_->device(), frame.pool, 0);
+  VkCommandBufferBeginInfo begin_info;
+  memset(&begin_info, 0, sizeof(begin_info));
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VkResult err = funcs_->vkBeginCommandBuffer(frame.cb, &begin_info);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to begin compute command buffer: %d", err);
+  }
+
+  if(timestamp_pool_) {
+    funcs_->vkCmdResetQueryPool(frame.cb, timestamp_pool_, 2 * current_frame,
+                                2);
+    funcs_->vkCmdWriteTimestamp(frame.cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                timestamp_pool_, 2 * current_frame);
+  }
+  return frame.cb;
+}
+
+void vulkan_engine::AsyncCompute::submit(int current_frame,
+                                         VkPipelineStageFlags dst_stages,
+                                         VkAccessFlags dst_access) {
+  Frame& frame = frames_[current_frame];
+  if(timestamp_pool_) {
+    funcs_->vkCmdWriteTimestamp(frame.cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                timestamp_pool_, 2 * current_frame + 1);
+    frame.timestamps_written = true;
+  }
+  VkResult err = funcs_->vkEndCommandBuffer(frame.cb);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to end compute command buffer: %d", err);
+  }
+
+  VkSubmitInfo submit_info;
+  memset(&submit_info, 0, sizeof(submit_info));
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &frame.cb;
+  submit_info.signalSemaphoreCount = 1;
+  submit_info.pSignalSemaphores = &frame.semaphore;
+  err = funcs_->vkQueueSubmit(queue_, 1, &submit_info, VK_NULL_HANDLE);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to submit compute work: %d", err);
+  }
+
+  // A semaphore wait only orders the commands of its own submission, the
+  // barrier of the join extends it to the later submission of the frame.
+  funcs_->vkResetCommandPool(surface_->device(), frame.join_pool, 0);
+  VkCommandBufferBeginInfo begin_info;
+  memset(&begin_info, 0, sizeof(begin_info));
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  err = funcs_->vkBeginCommandBuffer(frame.join, &begin_info);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to begin command buffer: %d", err);
+  }
+  VkMemoryBarrier barrier;
+  memset(&barrier, 0, sizeof(barrier));
+  barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+  barrier.dstAccessMask = dst_access;
+  funcs_->vkCmdPipelineBarrier(frame.join, dst_stages, dst_stages, 0, 1,
+                               &barrier, 0, nullptr, 0, nullptr);
+  err = funcs_->vkEndCommandBuffer(frame.join);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to end command buffer: %d", err);
+  }
+
+  submit_info.pCommandBuffers = &frame.join;
+  submit_info.signalSemaphoreCount = 0;
+  submit_info.pSignalSemaphores = nullptr;
+  submit_info.waitSemaphoreCount = 1;
+  submit_info.pWaitSemaphores = &frame.semaphore;
+  submit_info.pWaitDstStageMask = &dst_stages;
+  err = funcs_->vkQueueSubmit(surface_->graphicsQueue(), 1, &submit_info,
+                              VK_NULL_HANDLE);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to submit compute wait: %d", err);
+  }
+}
+
+void vulkan_engine::AsyncCompute::readTimestamps(int current_frame,
+                                                 const quint64* graphics,
+                                                 size_t count) {
+  if(!timestamp_pool_ || !frames_[current_frame].timestamps_written) {
+    return;
+  }
+  quint64 timestamps[2] = {0, 0};
+  VkResult err = funcs_->vkGetQueryPoolResults(
+    surface_->device(), timestamp_pool_, 2 * current_frame, 2,
+    sizeof(timestamps), timestamps, sizeof(quint64), VK_QUERY_RESULT_64_BIT);
+  if(err != VK_SUCCESS || timestamps[1] < timestamps[0]) {
+    return;
+  }
+  const float ms = timestamp_period_ * 1e-6f;
+  stats_.compute_time = (timestamps[1] - timestamps[0]) * ms;
+  quint64 overlap = 0;
+  for(size_t i = 0; i < count; ++i) {
+    const quint64 begin = std::max(timestamps[0], graphics[2 * i]);
+    const quint64 end = std::min(timestamps[1], graphics[2 * i + 1]);
+    if(end > begin) {
+      overlap += end - begin;
+    }
+  }
+  stats_.overlap_time = overlap * ms;
+}
@@ -0,0 +1,99 @@
+#ifndef SHIFT_GUI_ASYNCCOMPUTE_H_
+#define SHIFT_GUI_ASYNCCOMPUTE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/RenderSurface.h"
+
+namespace vulkan_engine {
+
+/*! Runs compute work of a frame on the compute queue of the surface, so it
+ overlaps with the graphics work still in flight from the previous frame.
+
+ Every frame in flight has a command buffer on the compute queue and a
+ semaphore it signals. submit() makes the graphics queue wait for the
+ semaphore with a barrier of its own, before the command buffer of the
+ frame is submitted, so the stages of the frame reading the results wait
+ and everything else does not. The fence of the frame covers the compute
+ work as well: once a frame slot comes around again its compute command
+ buffer can be reused.
+
+ Without a compute queue of its own (async() is false) the work has to be
+ recorded into the frame's command buffer instead. The time of the compute
+ work and how much of it overlapped with graphics work are measured with
+ timestamp queries. */
+class AsyncCompute {
+public:
+  struct Stats {
+    bool async = false;         // on a queue of its own
+    float compute_time = -1.0f; // ms, of the last completed submission
+    float overlap_time = -1.0f; // ms of that overlapping graphics work
+  };
+
+  AsyncCompute() = default;
+  ~AsyncCompute() = default;
+
+  AsyncCompute(const AsyncCompute&) = delete;
+  AsyncCompute& operator=(const AsyncCompute&) = delete;
+
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs);
+  void release();
+
+  inline bool async() const {
+    return queue_ != VK_NULL_HANDLE;
+  }
+
+  /*! Families of the queues using buffers shared between compute and
+   graphics, which are created with concurrent sharing if there are two. */
+  std::vector<uint32_t> queueFamilies() const;
+
+  /*! Begins the compute command buffer of current_frame. Only with
+   async(). */
+  VkCommandBuffer begin(int current_frame);
+
+  /*! Submits the command buffer begun for current_frame, and a wait for it
+   on the graphics queue before the stages dst_stages read its results with
+   dst_access. */
+  void submit(int current_frame, VkPipelineStageFlags dst_stages,
+              VkAccessFlags dst_access);
+
+  /*! Reads the timestamps of the last submission of current_frame, which
+   has completed, and measures its overlap with the count ranges of
+   timestamps of the graphics queue in graphics, begin and end of each.
+   Timestamps of queues of one device share their time base. */
+  void readTimestamps(int current_frame, const quint64* graphics,
+                      size_t count);
+
+  inline const Stats& stats() const {
+    return stats_;
+  }
+
+private:
+  struct Frame {
+    VkCommandPool pool = VK_NULL_HANDLE;
+    VkCommandBuffer cb = VK_NULL_HANDLE;
+    VkCommandPool join_pool = VK_NULL_HANDLE; // of the graphics family
+    VkCommandBuffer join = VK_NULL_HANDLE;
+    VkSemaphore semaphore = VK_NULL_HANDLE;
+    bool timestamps_written = false;
+  };
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+
+  VkQueue queue_ = VK_NULL_HANDLE;
+  uint32_t family_ = 0;
+  std::vector<Frame> frames_;
+
+  // two timestamps per frame in flight, if the compute family has them
+  VkQueryPool timestamp_pool_ = VK_NULL_HANDLE;
+  float timestamp_period_ = 0.0f; // ns per tick
+  Stats stats_;
+};
+
+}
+
+#endif
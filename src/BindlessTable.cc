@@ -0,0 +1,353 @@
+#include "vulkan-engine/BindlessTable.h"
+
+#include <algorithm>
+#include <cstring>
+
+void vulkan_engine::BindlessTable::init(RenderSurface* surface,
+                                        QVulkanDeviceFunctions* funcs,
+                                        DeletionQueue* deletion_queue,
+                                        uint32_t capacity) {
+  surface_ = surface;
+  funcs_ = funcs;
+  deletion_queue_ = deletion_queue;
+  VkDevice device = surface_->device();
+  descriptor_indexing_ = surface_->descriptorIndexing();
+
+  // Update after bind sets have their own, far higher limits.
+  capacity_ = capacity;
+  if(!descriptor_indexing_) {
+    const VkPhysicalDeviceLimits& limits =
+      surface_->physicalDeviceProperties()->limits;
+    capacity_ = std::min(capacity_, limits.maxPerStageDescriptorSampledImages);
+    capacity_ = std::min(capacity_, limits.maxPerStageDescriptorSamplers);
+    capacity_ = std::min(capacity_, limits.maxDescriptorSetSampledImages);
+    capacity_ = std::min(capacity_, limits.maxDescriptorSetSamplers);
+  }
+
+  VkDescriptorSetLayoutBinding binding;
+  memset(&binding, 0, sizeof(binding));
+  binding.binding = 0;
+  binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  binding.descriptorCount = capacity_;
+  binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  const VkDescriptorBindingFlagsEXT binding_flags =
+    VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT_EXT |
+    VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT_EXT |
+    VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT_EXT;
+  VkDescriptorSetLayoutBindingFlagsCreateInfoEXT binding_flags_info;
+  memset(&binding_flags_info, 0, sizeof(binding_flags_info));
+  binding_flags_info.sType =
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO_EXT;
+  binding_flags_info.bindingCount = 1;
+  binding_flags_info.pBindingFlags = &binding_flags;
+
+  VkDescriptorSetLayoutCreateInfo layout_info;
+  memset(&layout_info, 0, sizeof(layout_info));
+  layout_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layout_info.bindingCount = 1;
+  layout_info.pBindings = &binding;
+  if(descriptor_indexing_) {
+    layout_info.pNext = &binding_flags_info;
+    layout_info.flags =
+      VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT_EXT;
+  }
+  VkResult err =
+    funcs_->vkCreateDescriptorSetLayout(device, &layout_info, nullptr,
+                                        &layout_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create bindless descriptor set layout: %d", err);
+  }
+
+  const uint32_t frames = surface_->concurrentFrameCount();
+  VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                    capacity_ * frames};
+  VkDescriptorPoolCreateInfo pool_info;
+  memset(&pool_info, 0, sizeof(pool_info));
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  if(descriptor_indexing_) {
+    pool_info.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT_EXT;
+  }
+  pool_info.maxSets = frames;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  err = funcs_->vkCreateDescriptorPool(device, &pool_info, nullptr, &pool_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create bindless descriptor pool: %d", err);
+  }
+
+  sets_.resize(frames);
+  dirty_.assign(frames, std::vector<uint32_t>());
+  for(uint32_t i = 0; i < frames; ++i) {
+    VkDescriptorSetAllocateInfo set_info = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr, pool_, 1,
+      &layout_};
+    err = funcs_->vkAllocateDescriptorSets(device, &set_info, &sets_[i]);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to allocate bindless descriptor set: %d", err);
+    }
+  }
+
+  if(descriptor_indexing_) {
+    return;
+  }
+
+  // every slot has to hold a valid descriptor
+  createFallback();
+  std::vector<VkDescriptorImageInfo> image_infos(capacity_);
+  for(VkDescriptorImageInfo& image_info : image_infos) {
+    image_info.sampler = fallback_sampler_;
+    image_info.imageView = fallback_view_;
+    image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  }
+  std::vector<VkWriteDescriptorSet> writes(frames);
+  memset(writes.data(), 0, writes.size() * sizeof(VkWriteDescriptorSet));
+  for(uint32_t i = 0; i < frames; ++i) {
+    writes[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[i].dstSet = sets_[i];
+    writes[i].descriptorCount = capacity_;
+    writes[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[i].pImageInfo = image_infos.data();
+  }
+  funcs_->vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0,
+                                 nullptr);
+}
+
+void vulkan_engine::BindlessTable::release() {
+  if(!funcs_) {
+    return;
+  }
+  VkDevice device = surface_->device();
+  if(fallback_sampler_) {
+    funcs_->vkDestroySampler(device, fallback_sampler_, nullptr);
+  }
+  if(fallback_view_) {
+    funcs_->vkDestroyImageView(device, fallback_view_, nullptr);
+  }
+  if(fallback_image_) {
+    funcs_->vkDestroyImage(device, fallback_image_, nullptr);
+  }
+  if(fallback_memory_) {
+    funcs_->vkFreeMemory(device, fallback_memory_, nullptr);
+  }
+  fallback_sampler_ = VK_NULL_HANDLE;
+  fallback_view_ = VK_NULL_HANDLE;
+  fallback_image_ = VK_NULL_HANDLE;
+  fallback_memory_ = VK_NULL_HANDLE;
+  fallback_ready_ = false;
+
+  // destroying the pool frees the sets
+  if(pool_) {
+    funcs_->vkDestroyDescriptorPool(device, pool_, nullptr);
+    pool_ = VK_NULL_HANDLE;
+  }
+  if(layout_) {
+    funcs_->vkDestroyDescriptorSetLayout(device, layout_, nullptr);
+    layout_ = VK_NULL_HANDLE;
+  }
+  sets_.clear();
+  dirty_.clear();
+  slots_.clear();
+  free_.clear();
+  retired_ = 0;
+  ++generation_;
+  capacity_ = 0;
+  funcs_ = nullptr;
+  deletion_queue_ = nullptr;
+}
+
+uint32_t vulkan_engine::BindlessTable::allocate() {
+  if(!free_.empty()) {
+    const uint32_t slot = free_.back();
+    free_.pop_back();
+    return slot;
+  }
+  if(slots_.size() >= capacity_) {
+    return INVALID_SLOT;
+  }
+  slots_.push_back(Slot());
+  return slots_.size() - 1;
+}
+
+void vulkan_engine::BindlessTable::free(uint32_t slot) {
+  slots_[slot] = Slot();
+  markDirty(slot);
+  ++retired_;
+  const uint64_t generation = generation_;
+  deletion_queue_->retire([this, slot, generation]() {
+    if(generation == generation_) {
+      free_.push_back(slot);
+      --retired_;
+    }
+  });
+}
+
+void vulkan_engine::BindlessTable::set(uint32_t slot, VkImageView view,
+                                       VkSampler sampler) {
+  slots_[slot].view = view;
+  slots_[slot].sampler = sampler;
+  markDirty(slot);
+}
+
+void vulkan_engine::BindlessTable::clear() {
+  for(uint32_t slot = 0; slot < slots_.size(); ++slot) {
+    markDirty(slot);
+  }
+  slots_.clear();
+  free_.clear();
+  retired_ = 0;
+  ++generation_;
+}
+
+VkDescriptorSet vulkan_engine::BindlessTable::update(VkCommandBuffer cb,
+                                                     int current_frame) {
+  if(fallback_image_ && !fallback_ready_) {
+    VkImageMemoryBarrier barrier;
+    memset(&barrier, 0, sizeof(barrier));
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = fallback_image_;
+    barrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barrier.subresourceRange.levelCount = 1;
+    barrier.subresourceRange.layerCount = 1;
+    funcs_->vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                 VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr,
+                                 0, nullptr, 1, &barrier);
+    VkClearColorValue white;
+    white.float32[0] = white.float32[1] = white.float32[2] = 1.0f;
+    white.float32[3] = 1.0f;
+    funcs_->vkCmdClearColorImage(cb, fallback_image_,
+                                 VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, &white,
+                                 1, &barrier.subresourceRange);
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    funcs_->vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                                 nullptr, 0, nullptr, 1, &barrier);
+    fallback_ready_ = true;
+  }
+
+  // the previous submission of this set has completed
+  std::vector<uint32_t>& dirty = dirty_[current_frame];
+  if(!dirty.empty()) {
+    std::sort(dirty.begin(), dirty.end());
+    dirty.erase(std::unique(dirty.begin(), dirty.end()), dirty.end());
+    std::vector<VkDescriptorImageInfo> image_infos;
+    image_infos.reserve(dirty.size());
+    std::vector<VkWriteDescriptorSet> writes;
+    writes.reserve(dirty.size());
+    for(uint32_t slot : dirty) {
+      VkDescriptorImageInfo image_info;
+      image_info.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+      if(slot < slots_.size() && slots_[slot].view) {
+        image_info.sampler = slots_[slot].sampler;
+        image_info.imageView = slots_[slot].view;
+      } else if(fallback_view_) {
+        image_info.sampler = fallback_sampler_;
+        image_info.imageView = fallback_view_;
+      } else {
+        continue; // partially bound, the slot is not used
+      }
+      image_infos.push_back(image_info);
+
+      VkWriteDescriptorSet write;
+      memset(&write, 0, sizeof(write));
+      write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+      write.dstSet = sets_[current_frame];
+      write.dstArrayElement = slot;
+      write.descriptorCount = 1;
+      write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+      write.pImageInfo = &image_infos.back();
+      writes.push_back(write);
+    }
+    if(!writes.empty()) {
+      funcs_->vkUpdateDescriptorSets(surface_->device(), writes.size(),
+                                     writes.data(), 0, nullptr);
+    }
+    dirty.clear();
+  }
+  return sets_[current_frame];
+}
+
+void vulkan_engine::BindlessTable::createFallback() {
+  VkDevice device = surface_->device();
+
+  VkImageCreateInfo image_info;
+  memset(&image_info, 0, sizeof(image_info));
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+  image_info.extent.width = 1;
+  image_info.extent.height = 1;
+  image_info.extent.depth = 1;
+  image_info.mipLevels = 1;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage =
+    VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkResult err =
+    funcs_->vkCreateImage(device, &image_info, nullptr, &fallback_image_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create image: %d", err);
+  }
+
+  VkMemoryRequirements memory_requirements;
+  funcs_->vkGetImageMemoryRequirements(device, fallback_image_,
+                                       &memory_requirements);
+  VkMemoryAllocateInfo memory_alloc_info = {
+    VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, memory_requirements.size,
+    surface_->deviceLocalMemoryIndex()};
+  err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr,
+                                 &fallback_memory_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate image memory: %d", err);
+  }
+  err = funcs_->vkBindImageMemory(device, fallback_image_, fallback_memory_, 0);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to bind image memory: %d", err);
+  }
+
+  VkImageViewCreateInfo view_info;
+  memset(&view_info, 0, sizeof(view_info));
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.image = fallback_image_;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = VK_FORMAT_R8G8B8A8_UNORM;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  view_info.subresourceRange.levelCount = 1;
+  view_info.subresourceRange.layerCount = 1;
+  err =
+    funcs_->vkCreateImageView(device, &view_info, nullptr, &fallback_view_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create image view: %d", err);
+  }
+
+  VkSamplerCreateInfo sampler_info;
+  memset(&sampler_info, 0, sizeof(sampler_info));
+  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sampler_info.magFilter = VK_FILTER_NEAREST;
+  sampler_info.minFilter = VK_FILTER_NEAREST;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  err = funcs_->vkCreateSampler(device, &sampler_info, nullptr,
+                                &fallback_sampler_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create sampler: %d", err);
+  }
+}
+
+void vulkan_engine::BindlessTable::markDirty(uint32_t slot) {
+  for(std::vector<uint32_t>& dirty : dirty_) {
+    dirty.push_back(slot);
+  }
+}
@@ -0,0 +1,119 @@
+#ifndef SHIFT_GUI_BINDLESSTABLE_H_
+#define SHIFT_GUI_BINDLESSTABLE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/DeletionQueue.h"
+#include "vulkan-engine/RenderSurface.h"
+
+namespace vulkan_engine {
+
+/*! Bindless table of sampled textures: one descriptor array of combined
+ image samplers that shaders index with a slot number, so draws select their
+ textures through push constants or buffers instead of binding descriptor
+ sets, and adding textures never changes a set layout or pipeline.
+
+ Slots are handed out from a free list. Freed slots go through the
+ deletion queue and are only reused once the frames in flight that may
+ still index them have completed.
+
+ There is one descriptor set per frame in flight and a changed slot is
+ written into each set when the frame using it is recorded, after its
+ previous submission completed. Writes therefore never touch a set in use
+ by the GPU, and a texture keeps its slot when its image is replaced (e.g.
+ when mip levels are streamed in). On devices with descriptor indexing the
+ array is partially bound and update after bind, so it can be much larger
+ than the classic per-stage limits and unused slots need not be written.
+ Without it every slot starts out as a 1x1 white fallback texture. */
+class BindlessTable {
+public:
+  static const uint32_t INVALID_SLOT = UINT32_MAX;
+
+  BindlessTable() = default;
+  ~BindlessTable() = default;
+
+  BindlessTable(const BindlessTable&) = delete;
+  BindlessTable& operator=(const BindlessTable&) = delete;
+
+  /*! Creates the layout and sets for up to capacity slots, fewer if the
+   device limits are lower. */
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            DeletionQueue* deletion_queue, uint32_t capacity);
+  void release();
+
+  inline VkDescriptorSetLayout layout() const {
+    return layout_;
+  }
+
+  inline uint32_t capacity() const {
+    return capacity_;
+  }
+
+  inline bool descriptorIndexing() const {
+    return descriptor_indexing_;
+  }
+
+  /*! Returns a free slot, INVALID_SLOT if the table is full. */
+  uint32_t allocate();
+
+  /*! Returns slot to the free list once the frames in flight are done. */
+  void free(uint32_t slot);
+
+  /*! Points slot at view, from the next recorded frame on. */
+  void set(uint32_t slot, VkImageView view, VkSampler sampler);
+
+  /*! Frees all slots. The device must be idle. */
+  void clear();
+
+  /*! Writes the slots changed since the set of current_frame was last used
+   and returns that set. Records the initialization of the fallback texture
+   into cb the first time, so it must be called outside of a render pass. */
+  VkDescriptorSet update(VkCommandBuffer cb, int current_frame);
+
+  /*! Number of allocated slots. */
+  inline size_t size() const {
+    return slots_.size() - free_.size() - retired_;
+  }
+
+private:
+  struct Slot {
+    VkImageView view = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE;
+  };
+
+  void createFallback();
+  void markDirty(uint32_t slot);
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+  DeletionQueue* deletion_queue_ = nullptr;
+  uint32_t capacity_ = 0;
+  bool descriptor_indexing_ = false;
+
+  VkDescriptorSetLayout layout_ = VK_NULL_HANDLE;
+  VkDescriptorPool pool_ = VK_NULL_HANDLE;
+  std::vector<VkDescriptorSet> sets_; // per frame in flight
+  std::vector<std::vector<uint32_t>> dirty_; // per set, slots to write
+
+  // slots ever handed out, the free list and the number of freed slots
+  // waiting for the frames in flight. Those retired before clear() or
+  // release(), of an older generation, are dropped.
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> free_;
+  size_t retired_ = 0;
+  uint64_t generation_ = 0;
+
+  // fallback for unwritten slots without descriptor indexing
+  VkImage fallback_image_ = VK_NULL_HANDLE;
+  VkDeviceMemory fallback_memory_ = VK_NULL_HANDLE;
+  VkImageView fallback_view_ = VK_NULL_HANDLE;
+  VkSampler fallback_sampler_ = VK_NULL_HANDLE;
+  bool fallback_ready_ = false;
+};
+
+}
+
+#endif
@@ -0,0 +1,317 @@
+#include "vulkan-engine/BlockCompression.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+#include "vulkan-engine/JobSystem.h"
+
+// block rows encoded by one job
+static const size_t COMPRESS_ROWS = 8;
+
+static inline uint16_t pack565(const float* c) {
+  const int r = std::min(std::max(int(c[0] * 31.0f / 255.0f + 0.5f), 0), 31);
+  const int g = std::min(std::max(int(c[1] * 63.0f / 255.0f + 0.5f), 0), 63);
+  const int b = std::min(std::max(int(c[2] * 31.0f / 255.0f + 0.5f), 0), 31);
+  return uint16_t(r << 11 | g << 5 | b);
+}
+
+static inline void unpack565(uint16_t c, int* rgb) {
+  const int r = (c >> 11) & 31;
+  const int g = (c >> 5) & 63;
+  const int b = c & 31;
+  rgb[0] = (r << 3) | (r >> 2);
+  rgb[1] = (g << 2) | (g >> 4);
+  rgb[2] = (b << 3) | (b >> 2);
+}
+
+static inline void store16(uint16_t v, uint8_t* out) {
+  out[0] = uint8_t(v);
+  out[1] = uint8_t(v >> 8);
+}
+
+static inline uint16_t load16(const uint8_t* in) {
+  return uint16_t(in[0] | in[1] << 8);
+}
+
+static void bc1Palette(uint16_t c0, uint16_t c1, int palette[4][3]) {
+  unpack565(c0, palette[0]);
+  unpack565(c1, palette[1]);
+  for(int k = 0; k < 3; ++k) {
+    if(c0 > c1) {
+      palette[2][k] = (2 * palette[0][k] + palette[1][k]) / 3;
+      palette[3][k] = (palette[0][k] + 2 * palette[1][k]) / 3;
+    } else {
+      palette[2][k] = (palette[0][k] + palette[1][k]) / 2;
+      palette[3][k] = 0;
+    }
+  }
+}
+
+// Endpoints are the extremes of the texels along their principal axis,
+// found by power iteration on the covariance matrix, inset slightly as
+// the extremes are rarely hit exactly.
+static void compressBC1(const uint8_t* rgba, uint8_t* out) {
+  float mean[3] = {0.0f, 0.0f, 0.0f};
+  for(int i = 0; i < 16; ++i) {
+    for(int k = 0; k < 3; ++k) {
+      mean[k] += rgba[4 * i + k];
+    }
+  }
+  for(int k = 0; k < 3; ++k) {
+    mean[k] /= 16.0f;
+  }
+
+  float cov[6] = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+  for(int i = 0; i < 16; ++i) {
+    const float r = rgba[4 * i] - mean[0];
+    const float g = rgba[4 * i + 1] - mean[1];
+    const float b = rgba[4 * i + 2] - mean[2];
+    cov[0] += r * r;
+    cov[1] += r * g;
+    cov[2] += r * b;
+    cov[3] += g * g;
+    cov[4] += g * b;
+    cov[5] += b * b;
+  }
+  float axis[3] = {1.0f, 1.0f, 1.0f};
+  for(int iteration = 0; iteration < 8; ++iteration) {
+    const float x = cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2];
+    const float y = cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2];
+    const float z = cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2];
+    const float length = std::max(std::max(std::abs(x), std::abs(y)),
+                                  std::abs(z));
+    if(length < 1e-6f) {
+      break;
+    }
+    axis[0] = x / length;
+    axis[1] = y / length;
+    axis[2] = z / length;
+  }
+  const float norm =
+    std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+  for(int k = 0; k < 3; ++k) {
+    axis[k] /= norm;
+  }
+
+  float t_min = 0.0f;
+  float t_max = 0.0f;
+  for(int i = 0; i < 16; ++i) {
+    float t = 0.0f;
+    for(int k = 0; k < 3; ++k) {
+      t += (rgba[4 * i + k] - mean[k]) * axis[k];
+    }
+    t_min = std::min(t_min, t);
+    t_max = std::max(t_max, t);
+  }
+  const float inset = (t_max - t_min) / 16.0f;
+  t_min += inset;
+  t_max -= inset;
+  float e0[3], e1[3];
+  for(int k = 0; k < 3; ++k) {
+    e0[k] = mean[k] + t_max * axis[k];
+    e1[k] = mean[k] + t_min * axis[k];
+  }
+
+  // four color mode requires c0 > c1
+  uint16_t c0 = pack565(e0);
+  uint16_t c1 = pack565(e1);
+  if(c0 < c1) {
+    std::swap(c0, c1);
+  }
+  store16(c0, out);
+  store16(c1, out + 2);
+
+  uint32_t indices = 0;
+  if(c0 != c1) {
+    int palette[4][3];
+    bc1Palette(c0, c1, palette);
+    for(int i = 0; i < 16; ++i) {
+      int best = 0;
+      int best_error = INT32_MAX;
+      for(int p = 0; p < 4; ++p) {
+        int error = 0;
+        for(int k = 0; k < 3; ++k) {
+          const int d = rgba[4 * i + k] - palette[p][k];
+          error += d * d;
+        }
+        if(error < best_error) {
+          best = p;
+          best_error = error;
+        }
+      }
+      indices |= uint32_t(best) << (2 * i);
+    }
+  }
+  for(int b = 0; b < 4; ++b) {
+    out[4 + b] = uint8_t(indices >> (8 * b));
+  }
+}
+
+static void bc4Palette(int a0, int a1, int palette[8]) {
+  palette[0] = a0;
+  palette[1] = a1;
+  if(a0 > a1) {
+    for(int i = 2; i < 8; ++i) {
+      palette[i] = ((8 - i) * a0 + (i - 1) * a1) / 7;
+    }
+  } else {
+    for(int i = 2; i < 6; ++i) {
+      palette[i] = ((6 - i) * a0 + (i - 1) * a1) / 5;
+    }
+    palette[6] = 0;
+    palette[7] = 255;
+  }
+}
+
+// Eight value mode between the minimum and maximum of the channel.
+static void compressBC4(const uint8_t* rgba, int channel, uint8_t* out) {
+  int a0 = 0;
+  int a1 = 255;
+  for(int i = 0; i < 16; ++i) {
+    a0 = std::max(a0, int(rgba[4 * i + channel]));
+    a1 = std::min(a1, int(rgba[4 * i + channel]));
+  }
+  out[0] = uint8_t(a0);
+  out[1] = uint8_t(a1);
+
+  uint64_t indices = 0;
+  if(a0 != a1) {
+    int palette[8];
+    bc4Palette(a0, a1, palette);
+    for(int i = 0; i < 16; ++i) {
+      const int v = rgba[4 * i + channel];
+      int best = 0;
+      for(int p = 1; p < 8; ++p) {
+        if(std::abs(v - palette[p]) < std::abs(v - palette[best])) {
+          best = p;
+        }
+      }
+      indices |= uint64_t(best) << (3 * i);
+    }
+  }
+  for(int b = 0; b < 6; ++b) {
+    out[2 + b] = uint8_t(indices >> (8 * b));
+  }
+}
+
+static void decompressBC1(const uint8_t* in, uint8_t* rgba) {
+  int palette[4][3];
+  const uint16_t c0 = load16(in);
+  const uint16_t c1 = load16(in + 2);
+  bc1Palette(c0, c1, palette);
+  const uint32_t indices =
+    in[4] | in[5] << 8 | in[6] << 16 | uint32_t(in[7]) << 24;
+  for(int i = 0; i < 16; ++i) {
+    const int p = (indices >> (2 * i)) & 3;
+    for(int k = 0; k < 3; ++k) {
+      rgba[4 * i + k] = uint8_t(palette[p][k]);
+    }
+    rgba[4 * i + 3] = (c0 <= c1 && p == 3) ? 0 : 255;
+  }
+}
+
+static void decompressBC4(const uint8_t* in, int channel, uint8_t* rgba) {
+  int palette[8];
+  bc4Palette(in[0], in[1], palette);
+  uint64_t indices = 0;
+  for(int b = 0; b < 6; ++b) {
+    indices |= uint64_t(in[2 + b]) << (8 * b);
+  }
+  for(int i = 0; i < 16; ++i) {
+    rgba[4 * i + channel] = uint8_t(palette[(indices >> (3 * i)) & 7]);
+  }
+}
+
+size_t vulkan_engine::bc::blockSize(Format format) {
+  return (format == BC1 || format == BC4) ? 8 : 16;
+}
+
+size_t vulkan_engine::bc::imageSize(Format format, int width, int height) {
+  return size_t((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+}
+
+void vulkan_engine::bc::compressBlock(Format format, const uint8_t* rgba,
+                                      uint8_t* out) {
+  switch(format) {
+  case BC1:
+    compressBC1(rgba, out);
+    break;
+  case BC3:
+    compressBC4(rgba, 3, out);
+    compressBC1(rgba, out + 8);
+    break;
+  case BC4:
+    compressBC4(rgba, 0, out);
+    break;
+  case BC5:
+    compressBC4(rgba, 0, out);
+    compressBC4(rgba, 1, out + 8);
+    break;
+  }
+}
+
+void vulkan_engine::bc::compress(Format format, const uint8_t* rgba,
+                                 int width, int height, uint8_t* out) {
+  const int blocks_x = (width + 3) / 4;
+  const int blocks_y = (height + 3) / 4;
+  const size_t block_size = blockSize(format);
+  JobSystem::global().parallelFor(
+    0, blocks_y, COMPRESS_ROWS, [&](size_t first, size_t last) {
+      uint8_t block[64];
+      for(size_t by = first; by < last; ++by) {
+        for(int bx = 0; bx < blocks_x; ++bx) {
+          // partial blocks repeat the last row and column
+          for(int y = 0; y < 4; ++y) {
+            const int sy = std::min(int(4 * by) + y, height - 1);
+            for(int x = 0; x < 4; ++x) {
+              const int sx = std::min(4 * bx + x, width - 1);
+              memcpy(block + 4 * (4 * y + x),
+                     rgba + 4 * (size_t(sy) * width + sx), 4);
+            }
+          }
+          compressBlock(format, block,
+                        out + (by * blocks_x + bx) * block_size);
+        }
+      }
+    });
+}
+
+void vulkan_engine::bc::decompress(Format format, const uint8_t* data,
+                                   int width, int height, uint8_t* rgba) {
+  const int blocks_x = (width + 3) / 4;
+  const int blocks_y = (height + 3) / 4;
+  const size_t block_size = blockSize(format);
+  uint8_t block[64];
+  for(int by = 0; by < blocks_y; ++by) {
+    for(int bx = 0; bx < blocks_x; ++bx) {
+      const uint8_t* in = data + (size_t(by) * blocks_x + bx) * block_size;
+      memset(block, 0, sizeof(block));
+      for(int i = 0; i < 16; ++i) {
+        block[4 * i + 3] = 255;
+      }
+      switch(format) {
+      case BC1:
+        decompressBC1(in, block);
+        break;
+      case BC3:
+        decompressBC1(in + 8, block);
+        decompressBC4(in, 3, block);
+        break;
+      case BC4:
+        decompressBC4(in, 0, block);
+        break;
+      case BC5:
+        decompressBC4(in, 0, block);
+        decompressBC4(in + 8, 1, block);
+        break;
+      }
+      for(int y = 0; y < 4 && 4 * by + y < height; ++y) {
+        for(int x = 0; x < 4 && 4 * bx + x < width; ++x) {
+          memcpy(rgba + 4 * (size_t(4 * by + y) * width + 4 * bx + x),
+                 block + 4 * (4 * y + x), 4);
+        }
+      }
+    }
+  }
+}
@@ -0,0 +1,40 @@
+#ifndef SHIFT_GUI_BLOCKCOMPRESSION_H_
+#define SHIFT_GUI_BLOCKCOMPRESSION_H_
+
+#include <cstddef>
+#include <cstdint>
+
+namespace vulkan_engine {
+namespace bc {
+
+/*! Block compressed formats, all encode blocks of 4x4 texels.
+
+ BC1: RGB, 8 bytes per block
+ BC3: RGBA, a BC4 alpha block followed by a BC1 color block, 16 bytes
+ BC4: the red channel, 8 bytes
+ BC5: red and green as two BC4 blocks, 16 bytes, for normal maps */
+enum Format { BC1, BC3, BC4, BC5 };
+
+size_t blockSize(Format format);
+
+/*! Bytes of an image of width x height texels, partial blocks at the
+ right and bottom edge are padded. */
+size_t imageSize(Format format, int width, int height);
+
+/*! Encodes one 4x4 block of RGBA8 texels (row by row) into out. */
+void compressBlock(Format format, const uint8_t* rgba, uint8_t* out);
+
+/*! Encodes an RGBA8 image with rows of 4 * width bytes into out, which
+ must hold imageSize() bytes. Rows of blocks are spread over the job
+ system. */
+void compress(Format format, const uint8_t* rgba, int width, int height,
+              uint8_t* out);
+
+/*! Decodes an image, e.g. to measure the error of an encoding. */
+void decompress(Format format, const uint8_t* data, int width, int height,
+                uint8_t* rgba);
+
+}
+}
+
+#endif
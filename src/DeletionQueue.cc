@@ -0,0 +1,145 @@
+#include "vulkan-engine/DeletionQueue.h"
+
+void vulkan_engine::DeletionQueue::init(RenderSurface* surface,
+                                        QVulkanDeviceFunctions* funcs) {
+  surface_ = surface;
+  funcs_ = funcs;
+  std::lock_guard<std::mutex> lock(mutex_);
+  buckets_.resize(surface_->concurrentFrameCount());
+  current_ = 0;
+}
+
+void vulkan_engine::DeletionQueue::release() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(buckets_.empty()) {
+      return;
+    }
+  }
+  // destroying may retire more
+  while(stats().pending > 0) {
+    for(size_t i = 0; i < buckets_.size(); ++i) {
+      collect(i);
+    }
+  }
+  // the device stays until the resources of the engine are released, which
+  // may still retire some
+  std::lock_guard<std::mutex> lock(mutex_);
+  buckets_.clear();
+}
+
+void vulkan_engine::DeletionQueue::collect(int current_frame) {
+  std::vector<Entry> entries;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries.swap(buckets_[current_frame]);
+    current_ = current_frame;
+    for(const Entry& entry : entries) {
+      stats_.pending_bytes -= entry.bytes;
+    }
+    stats_.pending -= entries.size();
+    stats_.destroyed += entries.size();
+  }
+  // without the lock, destroying may retire more
+  for(Entry& entry : entries) {
+    entry.destroy();
+  }
+}
+
+void vulkan_engine::DeletionQueue::retire(std::function<void()> destroy,
+                                          VkDeviceSize bytes) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!buckets_.empty()) {
+      Entry entry;
+      entry.destroy = std::move(destroy);
+      entry.bytes = bytes;
+      buckets_[current_].push_back(std::move(entry));
+      ++stats_.pending;
+      stats_.pending_bytes += bytes;
+      return;
+    }
+  }
+  // before init() or after release() no frame is in flight
+  destroy();
+  std::lock_guard<std::mutex> lock(mutex_);
+  ++stats_.destroyed;
+}
+
+void vulkan_engine::DeletionQueue::retireBuffer(VkBuffer buffer,
+                                                VkDeviceMemory memory,
+                                                VkDeviceSize bytes) {
+  if(!buffer && !memory) {
+    return;
+  }
+  if(!funcs_) {
+    qWarning("Resource retired without a device");
+    return;
+  }
+  QVulkanDeviceFunctions* funcs = funcs_;
+  VkDevice device = surface_->device();
+  retire(
+    [funcs, device, buffer, memory] {
+      if(buffer) {
+        funcs->vkDestroyBuffer(device, buffer, nullptr);
+      }
+      if(memory) {
+        funcs->vkFreeMemory(device, memory, nullptr);
+      }
+    },
+    bytes);
+}
+
+void vulkan_engine::DeletionQueue::retireImage(VkImage image,
+                                               VkImageView view,
+                                               VkDeviceMemory memory,
+                                               VkDeviceSize bytes) {
+  if(!image && !view && !memory) {
+    return;
+  }
+  if(!funcs_) {
+    qWarning("Resource retired without a device");
+    return;
+  }
+  QVulkanDeviceFunctions* funcs = funcs_;
+  VkDevice device = surface_->device();
+  retire(
+    [funcs, device, image, view, memory] {
+      if(view) {
+        funcs->vkDestroyImageView(device, view, nullptr);
+      }
+      if(image) {
+        funcs->vkDestroyImage(device, image, nullptr);
+      }
+      if(memory) {
+        funcs->vkFreeMemory(device, memory, nullptr);
+      }
+    },
+    bytes);
+}
+
+void vulkan_engine::DeletionQueue::retirePipeline(VkPipeline pipeline) {
+  if(!pipeline) {
+    return;
+  }
+  if(!funcs_) {
+    qWarning("Resource retired without a device");
+    return;
+  }
+  QVulkanDeviceFunctions* funcs = funcs_;
+  VkDevice device = surface_->device();
+  retire([funcs, device, pipeline] {
+    funcs->vkDestroyPipeline(device, pipeline, nullptr);
+  });
+}
+
+VkDeviceSize vulkan_engine::DeletionQueue::memorySize() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_.pending_bytes;
+}
+
+vulkan_engine::DeletionQueue::Stats
+vulkan_engine::DeletionQueue::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
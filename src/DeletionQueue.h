@@ -0,0 +1,88 @@
+#ifndef SHIFT_GUI_DELETIONQUEUE_H_
+#define SHIFT_GUI_DELETIONQUEUE_H_
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/RenderSurface.h"
+
+namespace vulkan_engine {
+
+/*! Destroys resources replaced at runtime once the frames in flight that
+ may still use them have completed, instead of waiting for the device to
+ idle.
+
+ Every frame slot of the surface has a bucket. Resources retired while a
+ frame is recorded, or after it was submitted, go into the bucket of its
+ slot, and collect() destroys them when the slot comes around again: the
+ surface has then waited for the fence of the slot, which also covers
+ every submission before it. A retired resource must not be used by any
+ frame recorded afterwards. */
+class DeletionQueue {
+public:
+  struct Stats {
+    size_t pending = 0;          // resources waiting for their frame
+    VkDeviceSize pending_bytes = 0;
+    size_t destroyed = 0;        // by collect(), in total
+  };
+
+  DeletionQueue() = default;
+  ~DeletionQueue() = default;
+
+  DeletionQueue(const DeletionQueue&) = delete;
+  DeletionQueue& operator=(const DeletionQueue&) = delete;
+
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs);
+
+  /*! Destroys everything retired, the device has to be idle. Resources
+   retired afterwards are destroyed right away. */
+  void release();
+
+  /*! Destroys the resources retired by the last use of current_frame,
+   whose submission has completed. Call first thing in a frame. */
+  void collect(int current_frame);
+
+  /*! Calls destroy once the frames in flight have completed, with bytes of
+   device memory freed by it, right away if there are none. May be called
+   from any thread, but destroy of a frame in flight always runs on the
+   render thread. */
+  void retire(std::function<void()> destroy, VkDeviceSize bytes = 0);
+
+  /*! Destroys buffer and frees memory, either of which may be null. */
+  void retireBuffer(VkBuffer buffer, VkDeviceMemory memory,
+                    VkDeviceSize bytes = 0);
+
+  /*! Destroys view and image and frees memory, any of which may be
+   null. */
+  void retireImage(VkImage image, VkImageView view, VkDeviceMemory memory,
+                   VkDeviceSize bytes = 0);
+
+  void retirePipeline(VkPipeline pipeline);
+
+  /*! Device memory retired but not yet freed, in bytes. */
+  VkDeviceSize memorySize() const;
+
+  Stats stats() const;
+
+private:
+  struct Entry {
+    std::function<void()> destroy;
+    VkDeviceSize bytes;
+  };
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+
+  mutable std::mutex mutex_;
+  std::vector<std::vector<Entry>> buckets_; // per frame slot
+  int current_ = 0; // bucket of the frame recorded last
+  Stats stats_;
+};
+
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include "vulkan-engine/DynamicResolution.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+static const VkFormat SCENE_FORMAT = VK_FORMAT_R16G16B16A16_SFLOAT;
+
+// scales are rounded to multiples of this to avoid changes by a few pixels
+static const float SCALE_STEP = 1.0f / 32.0f;
+
+// largest relative growth of the scale per change
+static const float MAX_GROWTH = 1.1f;
+
+// push constants of upscale.glsl
+struct UpscalePushConstants {
+  float uv_scale[2];
+  float texel_size[2];
+  float sharpness;
+};
+
+void vulkan_engine::DynamicResolution::init(RenderSurface* surface,
+                                            QVulkanDeviceFunctions* funcs,
+                                            VkPipelineCache pipeline_cache,
+                                            VkShaderModule vertex_shader,
+                                            VkShaderModule fragment_shader) {
+  surface_ = surface;
+  funcs_ = funcs;
+  VkDevice device = surface_->device();
+
+  scene_pass_ = createSampledRenderPass(surface_, funcs_, SCENE_FORMAT,
+                                        VK_ATTACHMENT_LOAD_OP_CLEAR, true);
+
+  VkSamplerCreateInfo sampler_info;
+  memset(&sampler_info, 0, sizeof(sampler_info));
+  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sampler_info.magFilter = VK_FILTER_LINEAR;
+  sampler_info.minFilter = VK_FILTER_LINEAR;
+  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  sampler_info.maxLod = 0.0f;
+  VkResult err =
+    funcs_->vkCreateSampler(device, &sampler_info, nullptr, &sampler_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create sampler: %d", err);
+  }
+
+  VkDescriptorSetLayoutBinding layout_binding = {
+    0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1,
+    VK_SHADER_STAGE_FRAGMENT_BIT, nullptr};
+  VkDescriptorSetLayoutCreateInfo descriptor_layout_info = {
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr, 0, 1,
+    &layout_binding};
+  err = funcs_->vkCreateDescriptorSetLayout(device, &descriptor_layout_info,
+                                            nullptr, &descriptor_set_layout_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create descriptor set layout: %d", err);
+  }
+
+  VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                    1};
+  VkDescriptorPoolCreateInfo descriptor_pool_info;
+  memset(&descriptor_pool_info, 0, sizeof(descriptor_pool_info));
+  descriptor_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  descriptor_pool_info.maxSets = 1;
+  descriptor_pool_info.poolSizeCount = 1;
+  descriptor_pool_info.pPoolSizes = &pool_size;
+  err = funcs_->vkCreateDescriptorPool(device, &descriptor_pool_info, nullptr,
+                                       &descriptor_pool_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create descriptor pool: %d", err);
+  }
+
+  VkDescriptorSetAllocateInfo descriptor_set_alloc_info = {
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr, descriptor_pool_,
+    1, &descriptor_set_layout_};
+  err = funcs_->vkAllocateDescriptorSets(device, &descriptor_set_alloc_info,
+                                         &descriptor_set_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate descriptor set: %d", err);
+  }
+
+  VkPushConstantRange push_constant_range = {
+    VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(UpscalePushConstants)};
+  VkPipelineLayoutCreateInfo pipeline_layout_info;
+  memset(&pipeline_layout_info, 0, sizeof(pipeline_layout_info));
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.setLayoutCount = 1;
+  pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
+  pipeline_layout_info.pushConstantRangeCount = 1;
+  pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+  err = funcs_->vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
+                                       &pipeline_layout_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create pipeline layout: %d", err);
+  }
+
+  present_pipeline_ = createFullscreenPipeline(
+    surface_, funcs_, pipeline_cache, pipeline_layout_,
+    surface_->defaultRenderPass(), surface_->sampleCountFlagBits(),
+    vertex_shader, fragment_shader);
+}
+
+void vulkan_engine::DynamicResolution::release() {
+  if(!funcs_) {
+    return;
+  }
+  releaseImages();
+
+  VkDevice device = surface_->device();
+  if(present_pipeline_) {
+    funcs_->vkDestroyPipeline(device, present_pipeline_, nullptr);
+    present_pipeline_ = VK_NULL_HANDLE;
+  }
+  if(pipeline_layout_) {
+    funcs_->vkDestroyPipelineLayout(device, pipeline_layout_, nullptr);
+    pipeline_layout_ = VK_NULL_HANDLE;
+  }
+  if(descriptor_pool_) {
+    funcs_->vkDestroyDescriptorPool(device, descriptor_pool_, nullptr);
+    descriptor_pool_ = VK_NULL_HANDLE;
+    descriptor_set_ = VK_NULL_HANDLE;
+  }
+  if(descriptor_set_layout_) {
+    funcs_->vkDestroyDescriptorSetLayout(device, descriptor_set_layout_,
+                                         nullptr);
+    descriptor_set_layout_ = VK_NULL_HANDLE;
+  }
+  if(sampler_) {
+    funcs_->vkDestroySampler(device, sampler_, nullptr);
+    sampler_ = VK_NULL_HANDLE;
+  }
+  if(scene_pass_) {
+    funcs_->vkDestroyRenderPass(device, scene_pass_, nullptr);
+    scene_pass_ = VK_NULL_HANDLE;
+  }
+  funcs_ = nullptr;
+}
+
+void vulkan_engine::DynamicResolution::resize(const QSize& size) {
+  size_ = size;
+  VkDevice device = surface_->device();
+
+  resizeRenderTarget(surface_, funcs_, size_, SCENE_FORMAT,
+                     VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                       VK_IMAGE_USAGE_SAMPLED_BIT,
+                     VK_IMAGE_ASPECT_COLOR_BIT, &color_);
+
+  VkDescriptorImageInfo image_info = {
+    sampler_, color_.view, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+  VkWriteDescriptorSet descriptor_write;
+  memset(&descriptor_write, 0, sizeof(descriptor_write));
+  descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptor_write.dstSet = descriptor_set_;
+  descriptor_write.dstBinding = 0;
+  descriptor_write.descriptorCount = 1;
+  descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  descriptor_write.pImageInfo = &image_info;
+  funcs_->vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
+
+  metrics_.render_size = renderSize();
+}
+
+void vulkan_engine::DynamicResolution::releaseImages() {
+  if(!funcs_) {
+    return;
+  }
+  destroyRenderTarget(surface_, funcs_, &color_);
+  size_ = QSize();
+}
+
+void vulkan_engine::DynamicResolution::setSettings(const Settings& settings) {
+  settings_ = settings;
+  settings_.min_scale = std::max(settings_.min_scale, SCALE_STEP);
+  settings_.max_scale = std::min(std::max(settings_.max_scale,
+                                          settings_.min_scale),
+                                 1.0f);
+  settings_.settle_frames = std::max(settings_.settle_frames, 1);
+  metrics_.scale = std::min(std::max(metrics_.scale, settings_.min_scale),
+                            settings_.max_scale);
+  metrics_.render_size = renderSize();
+  frames_over_ = 0;
+  frames_under_ = 0;
+}
+
+QSize vulkan_engine::DynamicResolution::renderSize() const {
+  return QSize(std::max(int(std::lround(size_.width() * metrics_.scale)), 1),
+               std::max(int(std::lround(size_.height() * metrics_.scale)), 1));
+}
+
+void vulkan_engine::DynamicResolution::update(float gpu_frame_time) {
+  const float target = settings_.target_frame_time > 0.0f
+                         ? settings_.target_frame_time
+                         : 0.9f * 1000.0f / surface_->refreshRate();
+  metrics_.target_frame_time = target;
+  metrics_.gpu_frame_time = gpu_frame_time;
+  float& smoothed = metrics_.smoothed_gpu_frame_time;
+  smoothed = smoothed > 0.0f
+               ? smoothed + settings_.smoothing * (gpu_frame_time - smoothed)
+               : gpu_frame_time;
+  if(smoothed <= 0.0f) {
+    return;
+  }
+
+  const float lower = settings_.lower_threshold * target;
+  if(smoothed > target) {
+    ++frames_over_;
+    frames_under_ = 0;
+  } else if(smoothed < lower) {
+    ++frames_under_;
+    frames_over_ = 0;
+  } else {
+    frames_over_ = 0;
+    frames_under_ = 0;
+  }
+
+  // Growing takes twice as long to settle as shrinking: a frame over
+  // budget is visible, one under budget is not.
+  const bool shrink = frames_over_ >= settings_.settle_frames;
+  const bool grow = frames_under_ >= 2 * settings_.settle_frames &&
+                    metrics_.scale < settings_.max_scale;
+  if(!shrink && !grow) {
+    return;
+  }
+  frames_over_ = 0;
+  frames_under_ = 0;
+
+  // The GPU time is dominated by the pixel count, which goes with the
+  // square of the scale. Aim for the middle of the band between the lower
+  // threshold and the target.
+  const float old_scale = metrics_.scale;
+  float scale =
+    old_scale * std::sqrt(0.5f * (lower + target) / smoothed);
+  scale = std::min(scale, old_scale * MAX_GROWTH);
+  scale = std::round(scale / SCALE_STEP) * SCALE_STEP;
+  scale = std::min(std::max(scale, settings_.min_scale), settings_.max_scale);
+  if(scale == old_scale) {
+    return;
+  }
+
+  metrics_.scale = scale;
+  metrics_.render_size = renderSize();
+  ++metrics_.scale_changes;
+  // expected time at the new scale, until new measurements come in
+  smoothed *= (scale * scale) / (old_scale * old_scale);
+}
+
+void vulkan_engine::DynamicResolution::present(VkCommandBuffer cb) {
+  const QSize surface_size = surface_->swapChainImageSize();
+  const QSize render_size = renderSize();
+
+  funcs_->vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                            present_pipeline_);
+  funcs_->vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  pipeline_layout_, 0, 1, &descriptor_set_, 0,
+                                  nullptr);
+
+  VkViewport viewport = {
+    .x = 0,
+    .y = 0,
+    .width = static_cast<float>(surface_size.width()),
+    .height = static_cast<float>(surface_size.height()),
+    .minDepth = 0,
+    .maxDepth = 1,
+  };
+  funcs_->vkCmdSetViewport(cb, 0, 1, &viewport);
+
+  VkRect2D scissor = {
+    .offset = {.x = 0, .y = 0},
+    .extent =
+      {
+        .width = static_cast<unsigned int>(surface_size.width()),
+        .height = static_cast<unsigned int>(surface_size.height()),
+      },
+  };
+  funcs_->vkCmdSetScissor(cb, 0, 1, &scissor);
+
+  UpscalePushConstants push_constants;
+  push_constants.uv_scale[0] = float(render_size.width()) / size_.width();
+  push_constants.uv_scale[1] = float(render_size.height()) / size_.height();
+  push_constants.texel_size[0] = 1.0f / size_.width();
+  push_constants.texel_size[1] = 1.0f / size_.height();
+  // nothing to sharpen at full resolution
+  push_constants.sharpness =
+    render_size == size_ ? 0.0f : settings_.sharpness;
+  funcs_->vkCmdPushConstants(cb, pipeline_layout_,
+                             VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+                             sizeof(push_constants), &push_constants);
+  funcs_->vkCmdDraw(cb, 3, 1, 0, 0);
+}
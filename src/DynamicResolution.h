@@ -0,0 +1,125 @@
+#ifndef SHIFT_GUI_DYNAMICRESOLUTION_H_
+#define SHIFT_GUI_DYNAMICRESOLUTION_H_
+
+#include <QSize>
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/RenderSurface.h"
+#include "vulkan-engine/RenderTarget.h"
+
+namespace vulkan_engine {
+
+/*! Renders the scene at a resolution scaled to keep the GPU frame time
+ within a budget, then upscales and sharpens it into the surface.
+
+ The offscreen target is allocated once at the full surface size and the
+ scene is drawn into its top left renderSize() part, so changing the scale
+ never reallocates anything. The scale is adjusted by a controller with
+ hysteresis: the smoothed GPU frame time has to stay above the target (or
+ below a lower threshold) for a number of consecutive frames before the
+ scale changes, and growing is slower than shrinking, so the resolution
+ does not oscillate around the budget. */
+class DynamicResolution {
+public:
+  struct Settings {
+    float min_scale = 0.5f; // of the surface size, per axis
+    float max_scale = 1.0f;
+    // GPU frame time budget in ms, 0 for 90% of the refresh interval
+    float target_frame_time = 0.0f;
+    // the scale grows again once frames take less than this fraction of
+    // the target
+    float lower_threshold = 0.75f;
+    int settle_frames = 8; // frames beyond a threshold before a change
+    float smoothing = 0.2f; // weight of the newest frame time
+    float sharpness = 0.25f; // of the upscale filter, 0 disables it
+  };
+
+  struct Metrics {
+    float scale = 1.0f;
+    QSize render_size;
+    float gpu_frame_time = 0.0f;          // last measured, in ms
+    float smoothed_gpu_frame_time = 0.0f; // in ms
+    float target_frame_time = 0.0f;       // in ms
+    uint64_t scale_changes = 0;
+  };
+
+  DynamicResolution() = default;
+
+  DynamicResolution(const DynamicResolution&) = delete;
+  DynamicResolution& operator=(const DynamicResolution&) = delete;
+
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            VkPipelineCache pipeline_cache, VkShaderModule vertex_shader,
+            VkShaderModule fragment_shader);
+  void release();
+
+  /*! (Re)creates the target for the given surface size, in the memory of
+   the previous one if it fits. The device has to be idle. */
+  void resize(const QSize& size);
+  void releaseImages();
+
+  inline bool ready() const {
+    return color_.image != VK_NULL_HANDLE;
+  }
+
+  inline const QSize& size() const {
+    return size_;
+  }
+
+  void setSettings(const Settings& settings);
+
+  inline const Settings& settings() const {
+    return settings_;
+  }
+
+  inline const Metrics& metrics() const {
+    return metrics_;
+  }
+
+  /*! Feeds the GPU time of a completed frame in ms to the controller. */
+  void update(float gpu_frame_time);
+
+  /*! Part of the target the scene is rendered into. */
+  QSize renderSize() const;
+
+  /*! Render pass the scene is drawn into, with the color target and a
+   depth attachment of size() left to the caller. */
+  inline VkRenderPass scenePass() const {
+    return scene_pass_;
+  }
+  inline const RenderTarget& color() const {
+    return color_;
+  }
+
+  /*! Draws the upscaled scene, must be recorded inside the default render
+   pass of the surface with color() in SHADER_READ_ONLY_OPTIMAL layout. */
+  void present(VkCommandBuffer cb);
+
+  inline VkDeviceSize memorySize() const {
+    return color_.memory_size;
+  }
+
+private:
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+
+  VkRenderPass scene_pass_ = VK_NULL_HANDLE;
+  VkSampler sampler_ = VK_NULL_HANDLE;
+  VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+  VkDescriptorSet descriptor_set_ = VK_NULL_HANDLE;
+  VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+  VkPipeline present_pipeline_ = VK_NULL_HANDLE;
+
+  RenderTarget color_;
+  QSize size_;
+
+  Settings settings_;
+  Metrics metrics_;
+  int frames_over_ = 0;  // consecutive frames above the target
+  int frames_under_ = 0; // consecutive frames below the lower threshold
+};
+
+}
+
+#endif
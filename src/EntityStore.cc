@@ -0,0 +1,131 @@
+#include "vulkan-engine/EntityStore.h"
+
+#include <cstring>
+
+vulkan_engine::EntityStore::Handle
+vulkan_engine::EntityStore::create(SceneGraph::NodeId node, uint32_t mesh,
+                                   uint32_t material, uint32_t flags) {
+  uint32_t slot;
+  if(!free_slots_.empty()) {
+    slot = free_slots_.back();
+    free_slots_.pop_back();
+  } else {
+    slot = slots_.size();
+    slots_.push_back(Slot());
+  }
+
+  const uint32_t dense = mesh_.size();
+  slots_[slot].dense = dense;
+
+  math::Bounds empty_bounds;
+  memset(&empty_bounds, 0, sizeof(empty_bounds));
+  transform_.push_back(math::Mat4::identity());
+  bounds_.push_back(empty_bounds);
+  mesh_.push_back(mesh);
+  material_.push_back(material);
+  flags_.push_back(flags);
+  node_.push_back(node);
+  dense_to_slot_.push_back(slot);
+
+  if(node >= 0) {
+    if(node_to_slot_.size() <= size_t(node)) {
+      node_to_slot_.resize(node + 1, UINT32_MAX);
+    }
+    node_to_slot_[node] = slot;
+  }
+
+  Handle handle;
+  handle.slot = slot;
+  handle.generation = slots_[slot].generation;
+  return handle;
+}
+
+void vulkan_engine::EntityStore::destroy(Handle handle) {
+  if(!valid(handle)) {
+    return;
+  }
+
+  const uint32_t dense = slots_[handle.slot].dense;
+  const uint32_t last = mesh_.size() - 1;
+
+  if(node_[dense] >= 0) {
+    node_to_slot_[node_[dense]] = UINT32_MAX;
+  }
+
+  // move the last entity into the hole
+  if(dense != last) {
+    transform_[dense] = transform_[last];
+    bounds_[dense] = bounds_[last];
+    mesh_[dense] = mesh_[last];
+    material_[dense] = material_[last];
+    flags_[dense] = flags_[last];
+    node_[dense] = node_[last];
+    dense_to_slot_[dense] = dense_to_slot_[last];
+    slots_[dense_to_slot_[dense]].dense = dense;
+    // copies of the dense arrays hold another entity's transform there
+    updated_indices_.push_back(dense);
+  }
+  transform_.pop_back();
+  bounds_.pop_back();
+  mesh_.pop_back();
+  material_.pop_back();
+  flags_.pop_back();
+  node_.pop_back();
+  dense_to_slot_.pop_back();
+
+  slots_[handle.slot].dense = UINT32_MAX;
+  ++slots_[handle.slot].generation;
+  free_slots_.push_back(handle.slot);
+}
+
+void vulkan_engine::EntityStore::clear() {
+  // bump the generations so that outstanding handles become stale
+  free_slots_.clear();
+  for(uint32_t slot = 0; slot < slots_.size(); ++slot) {
+    if(slots_[slot].dense != UINT32_MAX) {
+      slots_[slot].dense = UINT32_MAX;
+      ++slots_[slot].generation;
+    }
+    free_slots_.push_back(slot);
+  }
+
+  transform_.clear();
+  bounds_.clear();
+  mesh_.clear();
+  material_.clear();
+  flags_.clear();
+  node_.clear();
+  dense_to_slot_.clear();
+  node_to_slot_.clear();
+  updated_indices_.clear();
+}
+
+vulkan_engine::EntityStore::Handle
+vulkan_engine::EntityStore::find(SceneGraph::NodeId node) const {
+  Handle handle;
+  if(node >= 0 && size_t(node) < node_to_slot_.size() &&
+     node_to_slot_[node] != UINT32_MAX) {
+    handle.slot = node_to_slot_[node];
+    handle.generation = slots_[handle.slot].generation;
+  }
+  return handle;
+}
+
+void vulkan_engine::EntityStore::updateTransforms(
+  const SceneGraph& scene_graph, const math::Bounds* mesh_bounds) {
+  const math::Mat4* worlds = scene_graph.worlds();
+  for(const SceneGraph::Range& range : scene_graph.changedRanges()) {
+    for(uint32_t i = range.first; i < range.first + range.count; ++i) {
+      const SceneGraph::NodeId node = scene_graph.node(i);
+      if(size_t(node) >= node_to_slot_.size() ||
+         node_to_slot_[node] == UINT32_MAX) {
+        continue; // node without entity, e.g. an assembly
+      }
+      const uint32_t dense = slots_[node_to_slot_[node]].dense;
+      transform_[dense] = worlds[i];
+      math::transformBounds(worlds[i], mesh_bounds[mesh_[dense]],
+                            &bounds_[dense]);
+      updated_indices_.push_back(dense);
+    }
+  }
+}
@@ -0,0 +1,135 @@
+#ifndef SHIFT_GUI_ENTITYSTORE_H_
+#define SHIFT_GUI_ENTITYSTORE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "vulkan-engine/SceneGraph.h"
+#include "vulkan-engine/SimdMath.h"
+
+namespace vulkan_engine {
+
+enum EntityFlags : uint32_t {
+  ENTITY_VISIBLE = 0x01,
+  ENTITY_CAST_SHADOWS = 0x02,
+  ENTITY_RECEIVE_SHADOWS = 0x04,
+  ENTITY_DEFAULT = ENTITY_VISIBLE | ENTITY_CAST_SHADOWS | ENTITY_RECEIVE_SHADOWS
+};
+
+/*! Component storage for the renderable entities of a scene.
+
+ Components are kept in dense, parallel arrays (world transform, world
+ bounds, mesh handle, material handle, flags and scene graph node), so loops
+ over all entities such as culling, sorting and uploads stream linearly
+ through memory instead of chasing pointers. Entities are removed by moving
+ the last entity into the hole, which keeps the arrays dense but changes the
+ dense index of the moved entity.
+
+ Entities are referred to by generational handles: a handle stays valid
+ until its entity is destroyed, after which it is recognised as stale even
+ if its slot has been reused. */
+class EntityStore {
+public:
+  struct Handle {
+    uint32_t slot = UINT32_MAX;
+    uint32_t generation = 0;
+
+    inline bool operator==(const Handle& other) const {
+      return slot == other.slot && generation == other.generation;
+    }
+    inline bool operator!=(const Handle& other) const {
+      return !(*this == other);
+    }
+  };
+
+  Handle create(SceneGraph::NodeId node, uint32_t mesh, uint32_t material,
+                uint32_t flags = ENTITY_DEFAULT);
+  void destroy(Handle handle);
+  void clear();
+
+  inline bool valid(Handle handle) const {
+    return handle.slot < slots_.size() &&
+           slots_[handle.slot].generation == handle.generation &&
+           slots_[handle.slot].dense != UINT32_MAX;
+  }
+
+  /*! Handle of the entity attached to a scene graph node, or an invalid
+   handle if there is none. */
+  Handle find(SceneGraph::NodeId node) const;
+
+  /*! position of a valid entity in the dense arrays */
+  inline uint32_t index(Handle handle) const {
+    return slots_[handle.slot].dense;
+  }
+
+  inline size_t size() const {
+    return mesh_.size();
+  }
+
+  /*! Copies the world transforms of the scene graph nodes that changed
+   since the graph's changed ranges were last cleared and recomputes the
+   world bounds of the affected entities from the local bounds of their
+   meshes. */
+  void updateTransforms(const SceneGraph& scene_graph,
+                        const math::Bounds* mesh_bounds);
+
+  inline const math::Mat4* transforms() const {
+    return transform_.data();
+  }
+  inline const math::Bounds* bounds() const {
+    return bounds_.data();
+  }
+  inline const uint32_t* meshes() const {
+    return mesh_.data();
+  }
+  inline const uint32_t* materials() const {
+    return material_.data();
+  }
+  inline const uint32_t* flags() const {
+    return flags_.data();
+  }
+  inline uint32_t* flags() {
+    return flags_.data();
+  }
+  inline const SceneGraph::NodeId* nodes() const {
+    return node_.data();
+  }
+
+  /*! Dense indices whose transform was written by updateTransforms() or
+   moved by destroy() since clearUpdatedIndices(), for uploading only those.
+   May hold duplicates and, after destroy(), indices past size(). */
+  inline const std::vector<uint32_t>& updatedIndices() const {
+    return updated_indices_;
+  }
+
+  inline void clearUpdatedIndices() {
+    updated_indices_.clear();
+  }
+
+private:
+  struct Slot {
+    uint32_t dense = UINT32_MAX;
+    uint32_t generation = 0;
+  };
+
+  // dense component arrays, all indexed by the same dense index
+  math::Mat4Array transform_;
+  math::BoundsArray bounds_;
+  std::vector<uint32_t> mesh_;
+  std::vector<uint32_t> material_;
+  std::vector<uint32_t> flags_;
+  std::vector<SceneGraph::NodeId> node_;
+  std::vector<uint32_t> dense_to_slot_;
+
+  std::vector<Slot> slots_;
+  std::vector<uint32_t> free_slots_;
+
+  // scene graph node id -> slot, UINT32_MAX for nodes without entity
+  std::vector<uint32_t> node_to_slot_;
+
+  std::vector<uint32_t> updated_indices_;
+};
+
+}
+
+#endif
@@ -0,0 +1,492 @@
+#include "vulkan-engine/FrameCapture.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+
+#include <QFileInfo>
+
+#include "vulkan-engine/JobSystem.h"
+
+namespace {
+
+QImage::Format imageFormat(VkFormat format) {
+  switch(format) {
+  // little endian 0xffRRGGBB, the alpha of the swapchain is not meaningful
+  case VK_FORMAT_B8G8R8A8_UNORM:
+  case VK_FORMAT_B8G8R8A8_SRGB:
+    return QImage::Format_RGB32;
+  case VK_FORMAT_R8G8B8A8_UNORM:
+  case VK_FORMAT_R8G8B8A8_SRGB:
+    return QImage::Format_RGBX8888;
+  default:
+    return QImage::Format_Invalid;
+  }
+}
+
+uint16_t toHalf(float value) {
+  uint32_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+  const uint16_t sign = (bits >> 16) & 0x8000;
+  const int exponent = int((bits >> 23) & 0xff) - 127 + 15;
+  uint32_t mantissa = bits & 0x7fffff;
+  if(exponent <= 0) {
+    if(exponent < -10) {
+      return sign;
+    }
+    // subnormal, with the implicit leading one
+    mantissa |= 0x800000;
+    return sign | (mantissa >> (14 - exponent));
+  }
+  if(exponent >= 31) {
+    return sign | 0x7c00;
+  }
+  // rounded to nearest, a carry into the exponent is still correct
+  return sign | ((uint32_t(exponent) << 10) + ((mantissa + 0x1000) >> 13));
+}
+
+template <typename T> void put(std::string* out, T value) {
+  out->append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+void putAttribute(std::string* out, const char* name, const char* type,
+                  const std::string& value) {
+  out->append(name, strlen(name) + 1);
+  out->append(type, strlen(type) + 1);
+  put<int32_t>(out, value.size());
+  out->append(value);
+}
+
+/*! Uncompressed scanline OpenEXR with half float B, G and R channels, in
+ linear light. Little endian like the file format. */
+bool writeExr(const QImage& source, const std::string& path) {
+  const QImage image = source.convertToFormat(QImage::Format_RGB32);
+  const int32_t width = image.width();
+  const int32_t height = image.height();
+
+  float linear[256];
+  for(int i = 0; i < 256; ++i) {
+    const float c = i / 255.0f;
+    linear[i] = c <= 0.04045f ? c / 12.92f
+                              : std::pow((c + 0.055f) / 1.055f, 2.4f);
+  }
+
+  std::string header;
+  put<uint32_t>(&header, 20000630); // magic number
+  put<uint32_t>(&header, 2);        // version, single part scanlines
+
+  std::string channels;
+  for(const char* name : {"B", "G", "R"}) {
+    channels.append(name, 2);
+    put<int32_t>(&channels, 1); // HALF
+    put<uint32_t>(&channels, 0); // pLinear and reserved
+    put<int32_t>(&channels, 1);  // x and y sampling
+    put<int32_t>(&channels, 1);
+  }
+  channels.push_back('\0');
+  putAttribute(&header, "channels", "chlist", channels);
+  putAttribute(&header, "compression", "compression", std::string(1, '\0'));
+  std::string window;
+  put<int32_t>(&window, 0);
+  put<int32_t>(&window, 0);
+  put<int32_t>(&window, width - 1);
+  put<int32_t>(&window, height - 1);
+  putAttribute(&header, "dataWindow", "box2i", window);
+  putAttribute(&header, "displayWindow", "box2i", window);
+  putAttribute(&header, "lineOrder", "lineOrder", std::string(1, '\0'));
+  std::string value;
+  put<float>(&value, 1.0f);
+  putAttribute(&header, "pixelAspectRatio", "float", value);
+  putAttribute(&header, "screenWindowWidth", "float", value);
+  value.clear();
+  put<float>(&value, 0.0f);
+  put<float>(&value, 0.0f);
+  putAttribute(&header, "screenWindowCenter", "v2f", value);
+  header.push_back('\0');
+
+  // one scanline per block without compression
+  const int32_t line_size = 3 * width * sizeof(uint16_t);
+  const uint64_t first_line = header.size() + height * sizeof(uint64_t);
+  for(int32_t y = 0; y < height; ++y) {
+    put<uint64_t>(&header, first_line + y * (8 + uint64_t(line_size)));
+  }
+
+  std::ofstream file(path, std::ios::binary);
+  file.write(header.data(), header.size());
+  std::vector<uint16_t> line(3 * width);
+  for(int32_t y = 0; y < height && file; ++y) {
+    const QRgb* pixels = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+    for(int32_t x = 0; x < width; ++x) {
+      line[x] = toHalf(linear[qBlue(pixels[x])]);
+      line[width + x] = toHalf(linear[qGreen(pixels[x])]);
+      line[2 * width + x] = toHalf(linear[qRed(pixels[x])]);
+    }
+    file.write(reinterpret_cast<const char*>(&y), sizeof(y));
+    file.write(reinterpret_cast<const char*>(&line_size), sizeof(line_size));
+    file.write(reinterpret_cast<const char*>(line.data()), line_size);
+  }
+  return bool(file);
+}
+
+}
+
+vulkan_engine::FrameCapture::~FrameCapture() {
+  release();
+}
+
+void vulkan_engine::FrameCapture::init(RenderSurface* surface,
+                                       QVulkanDeviceFunctions* funcs,
+                                       int buffer_count) {
+  surface_ = surface;
+  funcs_ = funcs;
+
+  // cached memory makes reading the copies back fast, if the device has it
+  VkPhysicalDeviceMemoryProperties properties;
+  surface_->vulkanInstance()->functions()->vkGetPhysicalDeviceMemoryProperties(
+    surface_->physicalDevice(), &properties);
+  memory_index_ = surface_->hostVisibleMemoryIndex();
+  const VkMemoryPropertyFlags cached = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                       VK_MEMORY_PROPERTY_HOST_CACHED_BIT;
+  for(uint32_t i = 0; i < properties.memoryTypeCount; ++i) {
+    if((properties.memoryTypes[i].propertyFlags & cached) == cached) {
+      memory_index_ = i;
+      break;
+    }
+  }
+  coherent_ = properties.memoryTypes[memory_index_].propertyFlags &
+              VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  slots_.resize(std::max(buffer_count, 1));
+  for(Slot& slot : slots_) {
+    VkFenceCreateInfo fence_info;
+    memset(&fence_info, 0, sizeof(fence_info));
+    fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+    VkResult err = funcs_->vkCreateFence(surface_->device(), &fence_info,
+                                         nullptr, &slot.fence);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create capture fence: %d", err);
+    }
+  }
+  recorded_ = SIZE_MAX;
+  busy_ = 0;
+  quit_ = false;
+  stats_.buffers = slots_.size();
+  thread_ = std::thread(&FrameCapture::run, this);
+}
+
+void vulkan_engine::FrameCapture::release() {
+  if(!funcs_) {
+    return;
+  }
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(recorded_ != SIZE_MAX) {
+      // recorded into a frame that was never submitted
+      Slot& slot = slots_[recorded_];
+      for(Request& request : slot.requests) {
+        requests_.push_back(std::move(request));
+      }
+      slot.requests.clear();
+      slot.state = FREE;
+      recorded_ = SIZE_MAX;
+      --busy_;
+    }
+    changed_.wait(lock, [this] { return busy_ == 0; });
+    quit_ = true;
+  }
+  changed_.notify_all();
+  thread_.join();
+
+  for(Slot& slot : slots_) {
+    destroyBuffer(&slot);
+    funcs_->vkDestroyFence(surface_->device(), slot.fence, nullptr);
+  }
+  slots_.clear();
+  funcs_ = nullptr;
+}
+
+std::future<QImage> vulkan_engine::FrameCapture::request() {
+  Request request;
+  std::future<QImage> future = request.image.get_future();
+  std::lock_guard<std::mutex> lock(mutex_);
+  requests_.push_back(std::move(request));
+  return future;
+}
+
+std::future<bool>
+vulkan_engine::FrameCapture::requestSave(const std::string& path) {
+  Request request;
+  request.path = path;
+  std::future<bool> future = request.saved.get_future();
+  std::lock_guard<std::mutex> lock(mutex_);
+  requests_.push_back(std::move(request));
+  return future;
+}
+
+bool vulkan_engine::FrameCapture::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !requests_.empty();
+}
+
+void vulkan_engine::FrameCapture::record(VkCommandBuffer cb, VkImage image,
+                                         VkImageLayout layout,
+                                         const QSize& size, VkFormat format) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if(requests_.empty() || recorded_ != SIZE_MAX) {
+    return;
+  }
+  if(busy_ == slots_.size()) {
+    ++stats_.waits;
+    changed_.wait(lock, [this] { return busy_ < slots_.size(); });
+  }
+  size_t index = 0;
+  while(slots_[index].state != FREE) {
+    ++index;
+  }
+  Slot& slot = slots_[index];
+  slot.state = RECORDED;
+  slot.requests.swap(requests_);
+  slot.image_size = size;
+  slot.format = imageFormat(format);
+  recorded_ = index;
+  ++busy_;
+  lock.unlock();
+
+  // free slots are only touched by the render thread
+  const VkDeviceSize bytes = VkDeviceSize(size.width()) * size.height() * 4;
+  if(slot.size < bytes) {
+    destroyBuffer(&slot);
+    createBuffer(bytes, &slot);
+  }
+  if(slot.format == QImage::Format_Invalid) {
+    qWarning("Cannot capture frames of format %d", format);
+    return;
+  }
+
+  VkImageMemoryBarrier barrier;
+  memset(&barrier, 0, sizeof(barrier));
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.oldLayout = layout;
+  barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = image;
+  barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  funcs_->vkCmdPipelineBarrier(
+    cb, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+    VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+  VkBufferImageCopy region;
+  memset(&region, 0, sizeof(region));
+  region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+  region.imageExtent = {uint32_t(size.width()), uint32_t(size.height()), 1};
+  funcs_->vkCmdCopyImageToBuffer(cb, image,
+                                 VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+                                 slot.buffer, 1, &region);
+
+  // back for presenting, and the copy made visible to the host
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barrier.dstAccessMask = 0;
+  barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barrier.newLayout = layout;
+  VkBufferMemoryBarrier buffer_barrier;
+  memset(&buffer_barrier, 0, sizeof(buffer_barrier));
+  buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  buffer_barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  buffer_barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  buffer_barrier.buffer = slot.buffer;
+  buffer_barrier.size = VK_WHOLE_SIZE;
+  funcs_->vkCmdPipelineBarrier(
+    cb, VK_PIPELINE_STAGE_TRANSFER_BIT,
+    VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT | VK_PIPELINE_STAGE_HOST_BIT, 0, 0,
+    nullptr, 1, &buffer_barrier, 1, &barrier);
+}
+
+void vulkan_engine::FrameCapture::submitted(VkQueue queue) {
+  std::unique_lock<std::mutex> lock(mutex_);
+  if(recorded_ == SIZE_MAX) {
+    return;
+  }
+  Slot& slot = slots_[recorded_];
+
+  // signaled once all work submitted to the queue before has completed
+  funcs_->vkResetFences(surface_->device(), 1, &slot.fence);
+  VkResult err = funcs_->vkQueueSubmit(queue, 0, nullptr, slot.fence);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to submit capture fence: %d", err);
+  }
+  slot.state = SUBMITTED;
+  submitted_.push_back(recorded_);
+  recorded_ = SIZE_MAX;
+  lock.unlock();
+  changed_.notify_all();
+}
+
+bool vulkan_engine::FrameCapture::save(const QImage& image,
+                                       const std::string& path) {
+  if(image.isNull()) {
+    return false;
+  }
+  const QString file = QString::fromStdString(path);
+  if(QFileInfo(file).suffix().compare("exr", Qt::CaseInsensitive) == 0) {
+    return writeExr(image, path);
+  }
+  return image.save(file);
+}
+
+vulkan_engine::FrameCapture::Stats
+vulkan_engine::FrameCapture::stats() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return stats_;
+}
+
+void vulkan_engine::FrameCapture::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while(true) {
+    changed_.wait(lock, [this] { return quit_ || !submitted_.empty(); });
+    if(submitted_.empty()) {
+      return;
+    }
+    const size_t index = submitted_.front();
+    submitted_.pop_front();
+    lock.unlock();
+    readBack(index);
+    lock.lock();
+  }
+}
+
+void vulkan_engine::FrameCapture::readBack(size_t index) {
+  Slot& slot = slots_[index];
+  VkResult err = funcs_->vkWaitForFences(surface_->device(), 1, &slot.fence,
+                                         VK_TRUE, UINT64_MAX);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to wait for capture fence: %d", err);
+  }
+  if(!coherent_) {
+    VkMappedMemoryRange range;
+    memset(&range, 0, sizeof(range));
+    range.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
+    range.memory = slot.memory;
+    range.size = VK_WHOLE_SIZE;
+    funcs_->vkInvalidateMappedMemoryRanges(surface_->device(), 1, &range);
+  }
+
+  // wraps the staging memory, valid until the slot is freed
+  QImage image;
+  if(slot.format != QImage::Format_Invalid) {
+    image = QImage(slot.data, slot.image_size.width(),
+                   slot.image_size.height(), slot.image_size.width() * 4,
+                   slot.format);
+  }
+  std::vector<Request> saves;
+  for(Request& request : slot.requests) {
+    if(request.path.empty()) {
+      request.image.set_value(image.copy());
+    } else {
+      saves.push_back(std::move(request));
+    }
+  }
+  slot.requests.clear();
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++stats_.captured;
+  }
+  if(saves.empty()) {
+    freeSlot(index);
+    return;
+  }
+
+  // encoded by the workers, the next frame is read back meanwhile
+  std::shared_ptr<std::vector<Request>> requests =
+    std::make_shared<std::vector<Request>>(std::move(saves));
+  const std::function<void()> encode = [this, index, image, requests] {
+    size_t saved = 0;
+    for(Request& request : *requests) {
+      const bool success = save(image, request.path);
+      if(!success) {
+        qWarning("Failed to save frame to %s", request.path.c_str());
+      }
+      saved += success;
+      request.saved.set_value(success);
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      stats_.saved += saved;
+    }
+    freeSlot(index);
+  };
+  JobSystem::global().schedule(encode);
+}
+
+void vulkan_engine::FrameCapture::freeSlot(size_t index) {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    slots_[index].state = FREE;
+    --busy_;
+  }
+  changed_.notify_all();
+}
+
+void vulkan_engine::FrameCapture::createBuffer(VkDeviceSize size,
+                                               Slot* slot) {
+  VkDevice device = surface_->device();
+  VkBufferCreateInfo buffer_info;
+  memset(&buffer_info, 0, sizeof(buffer_info));
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  VkResult err =
+    funcs_->vkCreateBuffer(device, &buffer_info, nullptr, &slot->buffer);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create capture buffer: %d", err);
+  }
+
+  VkMemoryRequirements memory_requirements;
+  funcs_->vkGetBufferMemoryRequirements(device, slot->buffer,
+                                        &memory_requirements);
+  const uint32_t memory_index =
+    (memory_requirements.memoryTypeBits & (1u << memory_index_))
+      ? memory_index_
+      : surface_->hostVisibleMemoryIndex();
+  VkMemoryAllocateInfo memory_alloc_info = {
+    VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, memory_requirements.size,
+    memory_index};
+  err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr,
+                                 &slot->memory);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate capture memory: %d", err);
+  }
+  err = funcs_->vkBindBufferMemory(device, slot->buffer, slot->memory, 0);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to bind capture memory: %d", err);
+  }
+  void* data = nullptr;
+  err = funcs_->vkMapMemory(device, slot->memory, 0, VK_WHOLE_SIZE, 0, &data);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to map capture memory: %d", err);
+  }
+  slot->data = static_cast<quint8*>(data);
+  slot->size = size;
+}
+
+void vulkan_engine::FrameCapture::destroyBuffer(Slot* slot) {
+  if(!slot->buffer) {
+    return;
+  }
+  VkDevice device = surface_->device();
+  funcs_->vkUnmapMemory(device, slot->memory);
+  funcs_->vkDestroyBuffer(device, slot->buffer, nullptr);
+  funcs_->vkFreeMemory(device, slot->memory, nullptr);
+  slot->buffer = VK_NULL_HANDLE;
+  slot->memory = VK_NULL_HANDLE;
+  slot->data = nullptr;
+  slot->size = 0;
+}
@@ -0,0 +1,131 @@
+#ifndef SHIFT_GUI_FRAMECAPTURE_H_
+#define SHIFT_GUI_FRAMECAPTURE_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <QImage>
+#include <QSize>
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/RenderSurface.h"
+
+namespace vulkan_engine {
+
+/*! Copies frames back into host memory without stalling the render
+ thread, unlike QVulkanWindow::grab().
+
+ request() and requestSave() queue a capture of the next frame recorded,
+ from any thread. record() copies the color image of that frame into a
+ free buffer of a ring of host visible staging buffers, and submitted()
+ follows the frame's submission with a fence. A readback thread waits for
+ the fences in submission order: requested images are copied out of the
+ staging buffer, saves are encoded by the workers of the job system right
+ from it, and only then is the buffer handed back. With every buffer in
+ use record() waits for the oldest one, so encoding that cannot keep up
+ throttles rendering instead of piling up images. */
+class FrameCapture {
+public:
+  struct Stats {
+    size_t captured = 0; // frames copied back
+    size_t saved = 0;    // files written
+    size_t waits = 0;    // record() calls that waited for a buffer
+    size_t buffers = 0;  // staging buffers of the ring
+  };
+
+  FrameCapture() = default;
+  ~FrameCapture();
+
+  FrameCapture(const FrameCapture&) = delete;
+  FrameCapture& operator=(const FrameCapture&) = delete;
+
+  /*! Creates a ring of buffer_count staging buffers, allocated on first
+   use, and starts the readback thread. */
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            int buffer_count = 4);
+
+  /*! Waits for the captures in flight. Requests that no frame was recorded
+   for yet are kept for the next init(). */
+  void release();
+
+  /*! The next frame recorded, ready once it was copied back. A null image
+   if its color format is not 8 bit RGBA or BGRA. */
+  std::future<QImage> request();
+
+  /*! Writes the next frame recorded to path, see save(). */
+  std::future<bool> requestSave(const std::string& path);
+
+  /*! Whether captures wait for the frame being recorded. */
+  bool pending() const;
+
+  /*! Records the copy of image, in layout and in the same layout again
+   afterwards, into a staging buffer for the pending captures. Waits for a
+   buffer if all are in use. Outside of a render pass, after the image was
+   drawn as a color attachment. */
+  void record(VkCommandBuffer cb, VkImage image, VkImageLayout layout,
+              const QSize& size, VkFormat format);
+
+  /*! Hands the buffer recorded into to the readback thread, after the
+   command buffer of the frame was submitted to queue. */
+  void submitted(VkQueue queue);
+
+  /*! Writes image to path: OpenEXR with linear half float channels for
+   .exr, decoding the sRGB encoded pixels, otherwise any format Qt writes,
+   chosen by the suffix. */
+  static bool save(const QImage& image, const std::string& path);
+
+  Stats stats() const;
+
+private:
+  enum SlotState { FREE, RECORDED, SUBMITTED };
+
+  struct Request {
+    std::string path; // empty for an image request
+    std::promise<QImage> image;
+    std::promise<bool> saved;
+  };
+
+  struct Slot {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    quint8* data = nullptr;
+    VkFence fence = VK_NULL_HANDLE;
+    SlotState state = FREE;
+    QSize image_size;
+    QImage::Format format = QImage::Format_Invalid;
+    std::vector<Request> requests;
+  };
+
+  void run();
+  void readBack(size_t slot);
+  void freeSlot(size_t slot);
+  void createBuffer(VkDeviceSize size, Slot* slot);
+  void destroyBuffer(Slot* slot);
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+  uint32_t memory_index_ = 0;
+  bool coherent_ = true;
+
+  mutable std::mutex mutex_;
+  std::condition_variable changed_;
+  std::vector<Request> requests_; // for the next frame
+  std::vector<Slot> slots_;
+  size_t recorded_ = SIZE_MAX;    // slot of the frame being recorded
+  std::deque<size_t> submitted_;  // for the readback thread, in order
+  size_t busy_ = 0;               // slots not FREE
+  bool quit_ = false;
+  std::thread thread_;
+  Stats stats_;
+};
+
+}
+
+#endif
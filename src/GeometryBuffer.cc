@@ -0,0 +1,352 @@
+#include "vulkan-engine/GeometryBuffer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
+// pages the descriptor pool has sets for
+static const uint32_t MAX_PAGES = 64;
+// staging chunks are at least this large, larger writes get their own
+static const VkDeviceSize STAGING_CHUNK = VkDeviceSize(16) << 20;
+// chunks kept for reuse once the copies reading them have completed
+static const size_t MAX_FREE_STAGING = 4;
+
+static inline VkDeviceSize aligned(VkDeviceSize v, VkDeviceSize byte_align) {
+  return (v + byte_align - 1) & ~(byte_align - 1);
+}
+
+void vulkan_engine::GeometryBuffer::init(RenderSurface* surface,
+                                         QVulkanDeviceFunctions* funcs,
+                                         DeletionQueue* deletion_queue,
+                                         VkDeviceSize page_size) {
+  surface_ = surface;
+  funcs_ = funcs;
+  deletion_queue_ = deletion_queue;
+  VkDevice device = surface_->device();
+
+  // the whole page is one storage buffer descriptor
+  max_page_size_ =
+    surface_->physicalDeviceProperties()->limits.maxStorageBufferRange &
+    ~(ALIGNMENT - 1);
+  page_size_ = std::min(aligned(page_size, ALIGNMENT), max_page_size_);
+
+  VkDescriptorSetLayoutBinding binding = {
+    0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT,
+    nullptr};
+  VkDescriptorSetLayoutCreateInfo layout_info = {
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr, 0, 1,
+    &binding};
+  VkResult err = funcs_->vkCreateDescriptorSetLayout(device, &layout_info,
+                                                     nullptr, &layout_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create geometry descriptor set layout: %d", err);
+  }
+
+  VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    MAX_PAGES};
+  VkDescriptorPoolCreateInfo pool_info;
+  memset(&pool_info, 0, sizeof(pool_info));
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.maxSets = MAX_PAGES;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  err = funcs_->vkCreateDescriptorPool(device, &pool_info, nullptr, &pool_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create geometry descriptor pool: %d", err);
+  }
+}
+
+void vulkan_engine::GeometryBuffer::release() {
+  if(!funcs_) {
+    return;
+  }
+  VkDevice device = surface_->device();
+  for(Page& page : pages_) {
+    funcs_->vkDestroyBuffer(device, page.buffer, nullptr);
+    funcs_->vkFreeMemory(device, page.memory, nullptr);
+  }
+  pages_.clear();
+  for(Staging& staging : staging_) {
+    destroyStaging(&staging);
+  }
+  staging_.clear();
+  for(Staging& staging : free_staging_) {
+    destroyStaging(&staging);
+  }
+  free_staging_.clear();
+  copies_.clear();
+  if(pool_) {
+    funcs_->vkDestroyDescriptorPool(device, pool_, nullptr);
+    pool_ = VK_NULL_HANDLE;
+  }
+  if(layout_) {
+    funcs_->vkDestroyDescriptorSetLayout(device, layout_, nullptr);
+    layout_ = VK_NULL_HANDLE;
+  }
+  used_ = 0;
+  allocations_ = 0;
+  funcs_ = nullptr;
+}
+
+bool vulkan_engine::GeometryBuffer::allocate(VkDeviceSize size,
+                                             Allocation* allocation) {
+  size = aligned(std::max<VkDeviceSize>(size, 1), ALIGNMENT);
+  if(size > max_page_size_) {
+    qWarning("Geometry of %llu bytes exceeds the storage buffer range",
+             static_cast<unsigned long long>(size));
+    return false;
+  }
+
+  for(int attempt = 0; attempt < 2; ++attempt) {
+    for(uint32_t p = 0; p < pages_.size(); ++p) {
+      std::map<VkDeviceSize, VkDeviceSize>& ranges = pages_[p].free_ranges;
+      for(auto it = ranges.begin(); it != ranges.end(); ++it) {
+        if(it->second < size) {
+          continue;
+        }
+        allocation->page = p;
+        allocation->offset = it->first;
+        allocation->size = size;
+        if(it->second > size) {
+          ranges[it->first + size] = it->second - size;
+        }
+        ranges.erase(it);
+        used_ += size;
+        ++allocations_;
+        return true;
+      }
+    }
+    // oversized allocations get a page of their own
+    if(attempt == 0 && !addPage(std::max(size, page_size_))) {
+      return false;
+    }
+  }
+  return false;
+}
+
+void vulkan_engine::GeometryBuffer::free(Allocation* allocation) {
+  if(!allocation->valid()) {
+    return;
+  }
+  std::map<VkDeviceSize, VkDeviceSize>& ranges =
+    pages_[allocation->page].free_ranges;
+  auto it =
+    ranges.insert(std::make_pair(allocation->offset, allocation->size)).first;
+  // coalesce with the following and preceding free ranges
+  auto next = std::next(it);
+  if(next != ranges.end() && it->first + it->second == next->first) {
+    it->second += next->second;
+    ranges.erase(next);
+  }
+  if(it != ranges.begin()) {
+    auto previous = std::prev(it);
+    if(previous->first + previous->second == it->first) {
+      previous->second += it->second;
+      ranges.erase(it);
+    }
+  }
+  used_ -= allocation->size;
+  --allocations_;
+  *allocation = Allocation();
+}
+
+void vulkan_engine::GeometryBuffer::clear() {
+  for(Page& page : pages_) {
+    page.free_ranges.clear();
+    page.free_ranges[0] = page.size;
+  }
+  copies_.clear();
+  for(Staging& staging : staging_) {
+    staging.used = 0;
+  }
+  used_ = 0;
+  allocations_ = 0;
+}
+
+void vulkan_engine::GeometryBuffer::write(const Allocation& allocation,
+                                          VkDeviceSize offset,
+                                          const void* data,
+                                          VkDeviceSize size) {
+  if(size == 0) {
+    return;
+  }
+  if(staging_.empty() || staging_.back().size - staging_.back().used < size) {
+    if(size <= STAGING_CHUNK && !free_staging_.empty()) {
+      staging_.push_back(free_staging_.back());
+      free_staging_.pop_back();
+    } else {
+      Staging staging;
+      staging.size = std::max(size, STAGING_CHUNK);
+      VkDeviceSize memory_size;
+      createBuffer(staging.size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                   surface_->hostVisibleMemoryIndex(), &staging.buffer,
+                   &staging.memory, &memory_size);
+      VkResult err = funcs_->vkMapMemory(
+        surface_->device(), staging.memory, 0, staging.size, 0,
+        reinterpret_cast<void**>(&staging.data));
+      if(err != VK_SUCCESS) {
+        qFatal("Failed to map memory: %d", err);
+      }
+      staging_.push_back(staging);
+    }
+  }
+
+  Staging& staging = staging_.back();
+  memcpy(staging.data + staging.used, data, size);
+  Copy copy;
+  copy.page = allocation.page;
+  copy.staging = staging_.size() - 1;
+  copy.region.srcOffset = staging.used;
+  copy.region.dstOffset = allocation.offset + offset;
+  copy.region.size = size;
+  copies_.push_back(copy);
+  staging.used += size;
+}
+
+void vulkan_engine::GeometryBuffer::flush(VkCommandBuffer cb) {
+  uploaded_ = 0;
+
+  if(!copies_.empty()) {
+    // Copies are written in order, consecutive ones of the same chunk and
+    // page are recorded together.
+    std::vector<VkBufferCopy> regions;
+    for(size_t i = 0; i < copies_.size();) {
+      size_t end = i;
+      regions.clear();
+      while(end < copies_.size() && copies_[end].page == copies_[i].page &&
+            copies_[end].staging == copies_[i].staging) {
+        regions.push_back(copies_[end].region);
+        uploaded_ += copies_[end].region.size;
+        ++end;
+      }
+      funcs_->vkCmdCopyBuffer(cb, staging_[copies_[i].staging].buffer,
+                              pages_[copies_[i].page].buffer, regions.size(),
+                              regions.data());
+      i = end;
+    }
+    copies_.clear();
+  }
+
+  // the copies of this frame read the chunks until it has completed
+  for(const Staging& staging : staging_) {
+    deletion_queue_->retire(
+      [this, staging]() mutable { recycleStaging(&staging); }, staging.size);
+  }
+  staging_.clear();
+}
+
+VkDeviceSize vulkan_engine::GeometryBuffer::memorySize() const {
+  VkDeviceSize size = 0;
+  for(const Page& page : pages_) {
+    size += page.memory_size;
+  }
+  return size;
+}
+
+vulkan_engine::GeometryBuffer::Stats
+vulkan_engine::GeometryBuffer::stats() const {
+  Stats stats;
+  stats.pages = pages_.size();
+  for(const Page& page : pages_) {
+    stats.capacity += page.size;
+  }
+  stats.used = used_;
+  stats.allocations = allocations_;
+  stats.uploaded = uploaded_;
+  return stats;
+}
+
+bool vulkan_engine::GeometryBuffer::addPage(VkDeviceSize size) {
+  if(pages_.size() == MAX_PAGES) {
+    qWarning("Geometry buffer is full");
+    return false;
+  }
+  Page page;
+  page.size = size;
+  createBuffer(size,
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                 VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+                 VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+               surface_->deviceLocalMemoryIndex(), &page.buffer, &page.memory,
+               &page.memory_size);
+  page.free_ranges[0] = size;
+
+  VkDescriptorSetAllocateInfo set_info = {
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr, pool_, 1,
+    &layout_};
+  VkResult err =
+    funcs_->vkAllocateDescriptorSets(surface_->device(), &set_info, &page.set);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate geometry descriptor set: %d", err);
+  }
+  VkDescriptorBufferInfo buffer_info = {page.buffer, 0, size};
+  VkWriteDescriptorSet descriptor_write;
+  memset(&descriptor_write, 0, sizeof(descriptor_write));
+  descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptor_write.dstSet = page.set;
+  descriptor_write.dstBinding = 0;
+  descriptor_write.descriptorCount = 1;
+  descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  descriptor_write.pBufferInfo = &buffer_info;
+  funcs_->vkUpdateDescriptorSets(surface_->device(), 1, &descriptor_write, 0,
+                                 nullptr);
+  pages_.push_back(page);
+  return true;
+}
+
+void vulkan_engine::GeometryBuffer::createBuffer(
+  VkDeviceSize size, VkBufferUsageFlags usage, uint32_t memory_index,
+  VkBuffer* buffer, VkDeviceMemory* memory, VkDeviceSize* memory_size) {
+  VkDevice device = surface_->device();
+
+  VkBufferCreateInfo buffer_info;
+  memset(&buffer_info, 0, sizeof(buffer_info));
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  VkResult err = funcs_->vkCreateBuffer(device, &buffer_info, nullptr, buffer);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create geometry buffer: %d", err);
+  }
+
+  VkMemoryRequirements memory_requirements;
+  funcs_->vkGetBufferMemoryRequirements(device, *buffer, &memory_requirements);
+  VkMemoryAllocateInfo memory_alloc_info = {
+    VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, memory_requirements.size,
+    memory_index};
+  err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr, memory);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate geometry memory: %d", err);
+  }
+  *memory_size = memory_requirements.size;
+  err = funcs_->vkBindBufferMemory(device, *buffer, *memory, 0);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to bind geometry memory: %d", err);
+  }
+}
+
+void vulkan_engine::GeometryBuffer::destroyStaging(Staging* staging) {
+  VkDevice device = surface_->device();
+  if(staging->data) {
+    funcs_->vkUnmapMemory(device, staging->memory);
+  }
+  if(staging->buffer) {
+    funcs_->vkDestroyBuffer(device, staging->buffer, nullptr);
+  }
+  if(staging->memory) {
+    funcs_->vkFreeMemory(device, staging->memory, nullptr);
+  }
+  *staging = Staging();
+}
+
+void vulkan_engine::GeometryBuffer::recycleStaging(Staging* staging) {
+  // larger chunks of single writes are rare, they are not kept
+  if(staging->size == STAGING_CHUNK &&
+     free_staging_.size() < MAX_FREE_STAGING) {
+    staging->used = 0;
+    free_staging_.push_back(*staging);
+    *staging = Staging();
+  } else {
+    destroyStaging(staging);
+  }
+}
@@ -0,0 +1,165 @@
+#ifndef SHIFT_GUI_GEOMETRYBUFFER_H_
+#define SHIFT_GUI_GEOMETRYBUFFER_H_
+
+#include <cstdint>
+#include <map>
+#include <vector>
+
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/DeletionQueue.h"
+#include "vulkan-engine/RenderSurface.h"
+
+namespace vulkan_engine {
+
+/*! Vertex and index data of all meshes, suballocated from a few large
+ device local buffers (pages).
+
+ Pages are storage buffers the vertex shader fetches attributes from by
+ offset (vertex pulling) and index buffers at the same time, so a scene
+ whose geometry fits into one page is drawn with a single buffer binding
+ and meshes with any combination of attributes share one pipeline. Each
+ page has a descriptor set of its own.
+
+ Ranges are handed out first fit from a free list per page and coalesced
+ when freed. A freed range is reused right away, the owner has to make
+ sure no frame in flight still reads it. Writes are staged in host visible
+ chunks and flush() records the copies of a frame, which the caller orders
+ against the draws, the render graph of the engine. Flushed chunks go
+ through the deletion queue back to a free list and are reused once the
+ frame that read them has completed. */
+class GeometryBuffer {
+public:
+  struct Allocation {
+    uint32_t page = UINT32_MAX;
+    VkDeviceSize offset = 0; // in bytes, a multiple of ALIGNMENT
+    VkDeviceSize size = 0;
+
+    inline bool valid() const {
+      return page != UINT32_MAX;
+    }
+  };
+
+  struct Stats {
+    size_t pages = 0;
+    VkDeviceSize capacity = 0;   // bytes of all pages
+    VkDeviceSize used = 0;       // bytes allocated
+    size_t allocations = 0;
+    VkDeviceSize uploaded = 0;   // bytes copied by the last flush()
+  };
+
+  static const VkDeviceSize ALIGNMENT = 16;
+  static const VkDeviceSize DEFAULT_PAGE_SIZE = VkDeviceSize(256) << 20;
+
+  GeometryBuffer() = default;
+  ~GeometryBuffer() = default;
+
+  GeometryBuffer(const GeometryBuffer&) = delete;
+  GeometryBuffer& operator=(const GeometryBuffer&) = delete;
+
+  /*! Pages are page_size bytes, less if the storage buffer range of the
+   device is smaller, and larger for allocations that do not fit. */
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            DeletionQueue* deletion_queue,
+            VkDeviceSize page_size = DEFAULT_PAGE_SIZE);
+  void release();
+
+  /*! Layout of the per-page sets, a storage buffer at binding 0. */
+  inline VkDescriptorSetLayout layout() const {
+    return layout_;
+  }
+
+  inline uint32_t pageCount() const {
+    return pages_.size();
+  }
+
+  inline VkBuffer buffer(uint32_t page) const {
+    return pages_[page].buffer;
+  }
+
+  inline VkDescriptorSet descriptorSet(uint32_t page) const {
+    return pages_[page].set;
+  }
+
+  /*! Allocates size bytes, adding a page if none has room. Fails for sizes
+   beyond the storage buffer range of the device. */
+  bool allocate(VkDeviceSize size, Allocation* allocation);
+
+  /*! Returns the range of allocation to its page and resets it. */
+  void free(Allocation* allocation);
+
+  /*! Frees all allocations, keeping the pages. */
+  void clear();
+
+  /*! Copies size bytes of data to offset within allocation with the next
+   flush(). */
+  void write(const Allocation& allocation, VkDeviceSize offset,
+             const void* data, VkDeviceSize size);
+
+  /*! Whether there are writes flush() has not recorded yet. */
+  inline bool pending() const {
+    return !copies_.empty();
+  }
+
+  /*! Records the writes since the last call into cb, outside of a render
+   pass and without barriers. */
+  void flush(VkCommandBuffer cb);
+
+  /*! Device memory of the pages in bytes. */
+  VkDeviceSize memorySize() const;
+
+  Stats stats() const;
+
+private:
+  struct Page {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    VkDeviceSize memory_size = 0;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    std::map<VkDeviceSize, VkDeviceSize> free_ranges; // offset to size
+  };
+
+  struct Staging {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    VkDeviceSize used = 0;
+    quint8* data = nullptr;
+  };
+
+  struct Copy {
+    uint32_t page;
+    size_t staging; // index into staging_
+    VkBufferCopy region;
+  };
+
+  bool addPage(VkDeviceSize size);
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                    uint32_t memory_index, VkBuffer* buffer,
+                    VkDeviceMemory* memory, VkDeviceSize* memory_size);
+  void destroyStaging(Staging* staging);
+  void recycleStaging(Staging* staging);
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+  DeletionQueue* deletion_queue_ = nullptr;
+  VkDeviceSize page_size_ = 0;
+  VkDeviceSize max_page_size_ = 0;
+
+  VkDescriptorSetLayout layout_ = VK_NULL_HANDLE;
+  VkDescriptorPool pool_ = VK_NULL_HANDLE;
+  std::vector<Page> pages_;
+  VkDeviceSize used_ = 0;
+  size_t allocations_ = 0;
+
+  // chunks written since the last flush(), and unused ones
+  std::vector<Staging> staging_;
+  std::vector<Staging> free_staging_;
+  std::vector<Copy> copies_;
+  VkDeviceSize uploaded_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,357 @@
+#include "vulkan-engine/GpuCulling.h"
+
+#include <algorithm>
+#include <cstring>
+
+// candidates the buffers hold at least, grown buffers at least double
+static const size_t MIN_CAPACITY = 1024;
+
+// threads per workgroup of cull.comp
+static const uint32_t LOCAL_SIZE = 64;
+
+// push constants of cull.comp (std430)
+struct CullPushConstants {
+  float planes[6][4];
+  float eye[4];
+  uint32_t count;
+};
+
+// instance of scene.glsl, written by cull.comp
+struct CulledInstance {
+  qint32 object;
+  qint32 material;
+};
+
+void vulkan_engine::GpuCulling::init(
+  RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+  VkPipelineCache pipeline_cache, VkShaderModule cull_shader,
+  const std::vector<uint32_t>& queue_families) {
+  surface_ = surface;
+  funcs_ = funcs;
+  queue_families_ = queue_families;
+  stats_ = Stats();
+  if(!cull_shader) {
+    return;
+  }
+  VkDevice device = surface_->device();
+
+  // candidates, draws and instances of a frame
+  VkDescriptorSetLayoutBinding bindings[3];
+  for(uint32_t i = 0; i < 3; ++i) {
+    bindings[i] = {i, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+                   VK_SHADER_STAGE_COMPUTE_BIT, nullptr};
+  }
+  VkDescriptorSetLayoutCreateInfo layout_info = {
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr, 0, 3,
+    bindings};
+  VkResult err = funcs_->vkCreateDescriptorSetLayout(device, &layout_info,
+                                                     nullptr, &set_layout_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create descriptor set layout: %d", err);
+  }
+
+  const uint32_t frame_count = surface_->concurrentFrameCount();
+  VkDescriptorPoolSize pool_size = {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+                                    3 * frame_count};
+  VkDescriptorPoolCreateInfo pool_info;
+  memset(&pool_info, 0, sizeof(pool_info));
+  pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  pool_info.maxSets = frame_count;
+  pool_info.poolSizeCount = 1;
+  pool_info.pPoolSizes = &pool_size;
+  err = funcs_->vkCreateDescriptorPool(device, &pool_info, nullptr,
+                                       &descriptor_pool_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create descriptor pool: %d", err);
+  }
+
+  VkPushConstantRange push_constant_range = {VK_SHADER_STAGE_COMPUTE_BIT, 0,
+                                             sizeof(CullPushConstants)};
+  VkPipelineLayoutCreateInfo pipeline_layout_info;
+  memset(&pipeline_layout_info, 0, sizeof(pipeline_layout_info));
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.setLayoutCount = 1;
+  pipeline_layout_info.pSetLayouts = &set_layout_;
+  pipeline_layout_info.pushConstantRangeCount = 1;
+  pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+  err = funcs_->vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
+                                       &pipeline_layout_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create pipeline layout: %d", err);
+  }
+
+  VkComputePipelineCreateInfo pipeline_info;
+  memset(&pipeline_info, 0, sizeof(pipeline_info));
+  pipeline_info.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+  pipeline_info.stage.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+  pipeline_info.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+  pipeline_info.stage.module = cull_shader;
+  pipeline_info.stage.pName = "main";
+  pipeline_info.layout = pipeline_layout_;
+  err = funcs_->vkCreateComputePipelines(device, pipeline_cache, 1,
+                                         &pipeline_info, nullptr, &pipeline_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create compute pipeline: %d", err);
+  }
+
+  frames_.resize(frame_count);
+  for(uint32_t i = 0; i < frame_count; ++i) {
+    VkDescriptorSetAllocateInfo set_info = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr,
+      descriptor_pool_, 1, &set_layout_};
+    err = funcs_->vkAllocateDescriptorSets(device, &set_info,
+                                           &frames_[i].set);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to allocate descriptor set: %d", err);
+    }
+    resize(i, MIN_CAPACITY);
+  }
+}
+
+void vulkan_engine::GpuCulling::release() {
+  if(!funcs_) {
+    return;
+  }
+  VkDevice device = surface_->device();
+  for(Frame& frame : frames_) {
+    destroyBuffer(&frame.candidates);
+    destroyBuffer(&frame.draws);
+    destroyBuffer(&frame.instances);
+  }
+  frames_.clear();
+  if(pipeline_) {
+    funcs_->vkDestroyPipeline(device, pipeline_, nullptr);
+    pipeline_ = VK_NULL_HANDLE;
+  }
+  if(pipeline_layout_) {
+    funcs_->vkDestroyPipelineLayout(device, pipeline_layout_, nullptr);
+    pipeline_layout_ = VK_NULL_HANDLE;
+  }
+  if(descriptor_pool_) {
+    funcs_->vkDestroyDescriptorPool(device, descriptor_pool_, nullptr);
+    descriptor_pool_ = VK_NULL_HANDLE;
+  }
+  if(set_layout_) {
+    funcs_->vkDestroyDescriptorSetLayout(device, set_layout_, nullptr);
+    set_layout_ = VK_NULL_HANDLE;
+  }
+  candidates_ = nullptr;
+  draws_ = nullptr;
+  candidate_count_ = 0;
+  draw_count_ = 0;
+  funcs_ = nullptr;
+}
+
+void vulkan_engine::GpuCulling::visibleMeshes(
+  int current_frame, std::vector<std::pair<uint32_t, float>>* visible) {
+  // the barrier recorded after the dispatch made the results visible to
+  // the host, and the frame slot's fence has been waited for
+  const Frame& frame = frames_[current_frame];
+  const GpuCullDraw* draws =
+    reinterpret_cast<const GpuCullDraw*>(frame.draws.data);
+  stats_.visible = 0;
+  for(size_t d = 0; d < frame.draw_count; ++d) {
+    const uint32_t instances = draws[d].command.instanceCount;
+    if(instances > 0) {
+      visible->push_back(std::make_pair(frame.meshes[d], draws[d].max_size));
+      stats_.visible += instances;
+    }
+  }
+}
+
+void vulkan_engine::GpuCulling::begin(int current_frame, size_t candidates,
+                                      const math::Mat4& view_projection,
+                                      const float eye[3]) {
+  Frame& frame = frames_[current_frame];
+  if(candidates > frame.capacity) {
+    resize(current_frame, std::max(candidates, 2 * frame.capacity));
+  }
+  frame_ = current_frame;
+  candidates_ = reinterpret_cast<GpuCullCandidate*>(frame.candidates.data);
+  draws_ = reinterpret_cast<GpuCullDraw*>(frame.draws.data);
+  candidate_count_ = 0;
+  draw_count_ = 0;
+  frame.draw_count = 0;
+  frame.meshes.clear();
+  frustum_ = math::frustumFromMatrix(view_projection);
+  for(int i = 0; i < 3; ++i) {
+    eye_[i] = eye[i];
+  }
+}
+
+void vulkan_engine::GpuCulling::addDraw(uint32_t mesh, uint32_t index_count,
+                                        uint32_t first_index) {
+  GpuCullDraw& draw = draws_[draw_count_++];
+  draw.command.indexCount = index_count;
+  draw.command.instanceCount = 0; // counted by the shader
+  draw.command.firstIndex = first_index;
+  draw.command.vertexOffset = 0;
+  draw.command.firstInstance = candidate_count_;
+  draw.max_size = 0.0f;
+  frames_[frame_].meshes.push_back(mesh);
+}
+
+void vulkan_engine::GpuCulling::addDraw(uint32_t mesh, uint32_t vertex_count) {
+  // vertexCount, instanceCount, firstVertex and firstInstance overlap the
+  // first four members; the shader still appends after firstInstance
+  GpuCullDraw& draw = draws_[draw_count_++];
+  draw.command.indexCount = vertex_count;
+  draw.command.instanceCount = 0;
+  draw.command.firstIndex = 0;
+  draw.command.vertexOffset = int32_t(candidate_count_);
+  draw.command.firstInstance = candidate_count_;
+  draw.max_size = 0.0f;
+  frames_[frame_].meshes.push_back(mesh);
+}
+
+void vulkan_engine::GpuCulling::record(VkCommandBuffer cb) {
+  Frame& frame = frames_[frame_];
+  frame.draw_count = draw_count_;
+  stats_.candidates = candidate_count_;
+  stats_.draws = draw_count_;
+  if(candidate_count_ == 0) {
+    return;
+  }
+
+  CullPushConstants push_constants;
+  memcpy(push_constants.planes, frustum_.planes,
+         sizeof(push_constants.planes));
+  for(int i = 0; i < 3; ++i) {
+    push_constants.eye[i] = eye_[i];
+  }
+  push_constants.eye[3] = 1.0f;
+  push_constants.count = candidate_count_;
+
+  funcs_->vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline_);
+  funcs_->vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_COMPUTE,
+                                  pipeline_layout_, 0, 1, &frame.set, 0,
+                                  nullptr);
+  funcs_->vkCmdPushConstants(cb, pipeline_layout_, VK_SHADER_STAGE_COMPUTE_BIT,
+                             0, sizeof(push_constants), &push_constants);
+  funcs_->vkCmdDispatch(cb, (candidate_count_ + LOCAL_SIZE - 1) / LOCAL_SIZE,
+                        1, 1);
+
+  // the counts and sizes are read back by visibleMeshes()
+  VkBufferMemoryBarrier barrier;
+  memset(&barrier, 0, sizeof(barrier));
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+  barrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = frame.draws.buffer;
+  barrier.size = VK_WHOLE_SIZE;
+  funcs_->vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+                               VK_PIPELINE_STAGE_HOST_BIT, 0, 0, nullptr, 1,
+                               &barrier, 0, nullptr);
+}
+
+VkDeviceSize vulkan_engine::GpuCulling::memorySize() const {
+  VkDeviceSize size = 0;
+  for(const Frame& frame : frames_) {
+    size += frame.candidates.size + frame.draws.size + frame.instances.size;
+  }
+  return size;
+}
+
+void vulkan_engine::GpuCulling::resize(int frame_index, size_t capacity) {
+  // the previous submission of the frame has completed
+  Frame& frame = frames_[frame_index];
+  destroyBuffer(&frame.candidates);
+  destroyBuffer(&frame.draws);
+  destroyBuffer(&frame.instances);
+  createBuffer(capacity * sizeof(GpuCullCandidate),
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, true, &frame.candidates);
+  createBuffer(capacity * sizeof(GpuCullDraw),
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                 VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT,
+               true, &frame.draws);
+  createBuffer(capacity * sizeof(CulledInstance),
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, false, &frame.instances);
+  frame.capacity = capacity;
+  frame.draw_count = 0;
+  frame.meshes.clear();
+  ++generation_;
+
+  VkDescriptorBufferInfo buffer_info[3] = {
+    {frame.candidates.buffer, 0, VK_WHOLE_SIZE},
+    {frame.draws.buffer, 0, VK_WHOLE_SIZE},
+    {frame.instances.buffer, 0, VK_WHOLE_SIZE}};
+  VkWriteDescriptorSet descriptor_write[3];
+  memset(descriptor_write, 0, sizeof(descriptor_write));
+  for(uint32_t i = 0; i < 3; ++i) {
+    descriptor_write[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write[i].dstSet = frame.set;
+    descriptor_write[i].dstBinding = i;
+    descriptor_write[i].descriptorCount = 1;
+    descriptor_write[i].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_write[i].pBufferInfo = &buffer_info[i];
+  }
+  funcs_->vkUpdateDescriptorSets(surface_->device(), 3, descriptor_write, 0,
+                                 nullptr);
+}
+
+void vulkan_engine::GpuCulling::createBuffer(VkDeviceSize size,
+                                             VkBufferUsageFlags usage,
+                                             bool host_visible,
+                                             Buffer* buffer) {
+  VkDevice device = surface_->device();
+
+  // written on the compute queue, read on the graphics queue
+  VkBufferCreateInfo buffer_info;
+  memset(&buffer_info, 0, sizeof(buffer_info));
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
+  if(queue_families_.size() > 1) {
+    buffer_info.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    buffer_info.queueFamilyIndexCount = queue_families_.size();
+    buffer_info.pQueueFamilyIndices = queue_families_.data();
+  }
+  VkResult err =
+    funcs_->vkCreateBuffer(device, &buffer_info, nullptr, &buffer->buffer);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create culling buffer: %d", err);
+  }
+
+  VkMemoryRequirements memory_requirements;
+  funcs_->vkGetBufferMemoryRequirements(device, buffer->buffer,
+                                        &memory_requirements);
+  VkMemoryAllocateInfo memory_alloc_info = {
+    VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, memory_requirements.size,
+    host_visible ? surface_->hostVisibleMemoryIndex()
+                 : surface_->deviceLocalMemoryIndex()};
+  err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr,
+                                 &buffer->memory);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate culling memory: %d", err);
+  }
+  err = funcs_->vkBindBufferMemory(device, buffer->buffer, buffer->memory, 0);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to bind culling memory: %d", err);
+  }
+  buffer->size = memory_requirements.size;
+
+  if(host_visible) {
+    err = funcs_->vkMapMemory(device, buffer->memory, 0, VK_WHOLE_SIZE, 0,
+                              reinterpret_cast<void**>(&buffer->data));
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to map memory: %d", err);
+    }
+  }
+}
+
+void vulkan_engine::GpuCulling::destroyBuffer(Buffer* buffer) {
+  VkDevice device = surface_->device();
+  if(buffer->data) {
+    funcs_->vkUnmapMemory(device, buffer->memory);
+  }
+  if(buffer->buffer) {
+    funcs_->vkDestroyBuffer(device, buffer->buffer, nullptr);
+  }
+  if(buffer->memory) {
+    funcs_->vkFreeMemory(device, buffer->memory, nullptr);
+  }
+  *buffer = Buffer();
+}
@@ -0,0 +1,183 @@
+#ifndef SHIFT_GUI_GPUCULLING_H_
+#define SHIFT_GUI_GPUCULLING_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/RenderSurface.h"
+#include "vulkan-engine/SimdMath.h"
+
+namespace vulkan_engine {
+
+/*! Object of the draw list as read by the culling shader (std430): its
+ world bounds, dense entity index and material, and the draw it belongs
+ to. */
+struct GpuCullCandidate {
+  float min[3];
+  uint32_t object;
+  float max[3];
+  uint32_t material;
+  uint32_t draw;
+  uint32_t padding[3];
+};
+
+/*! An indexed indirect draw as written by the culling shader, followed by
+ the largest apparent size of its visible instances. */
+struct GpuCullDraw {
+  VkDrawIndexedIndirectCommand command;
+  float max_size; // written as bits by atomicMax
+};
+
+/*! Frustum culls the draw list on the GPU.
+
+ The caller adds the draws of a frame, one per mesh, each followed by its
+ candidates, the objects drawing the mesh. record() dispatches cull.comp,
+ which appends the visible candidates of each draw to its range of a
+ device local instance buffer and counts them in the instance count of
+ its indirect draw, so the draws are recorded before it is known which
+ instances they draw. Candidates and draws are written into host visible
+ buffers per frame in flight, which grow with the draw list.
+
+ The instance counts and apparent sizes written by the GPU are read back
+ once the frame slot comes around again, by visibleMeshes(), for the
+ streaming of meshes and textures. */
+class GpuCulling {
+public:
+  struct Stats {
+    size_t candidates = 0; // added for the last frame
+    size_t draws = 0;
+    size_t visible = 0;    // instances drawn by the last completed frame
+  };
+
+  GpuCulling() = default;
+  ~GpuCulling() = default;
+
+  GpuCulling(const GpuCulling&) = delete;
+  GpuCulling& operator=(const GpuCulling&) = delete;
+
+  /*! The buffers are shared between the queue_families, e.g. of
+   AsyncCompute::queueFamilies(). Without a cull shader ready() is false. */
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            VkPipelineCache pipeline_cache, VkShaderModule cull_shader,
+            const std::vector<uint32_t>& queue_families);
+  void release();
+
+  inline bool ready() const {
+    return pipeline_ != VK_NULL_HANDLE;
+  }
+
+  /*! The meshes passed to addDraw() by the last draw list of current_frame
+   that the GPU found visible instances of, with their largest apparent
+   size. Call before begin(). */
+  void visibleMeshes(int current_frame,
+                     std::vector<std::pair<uint32_t, float>>* visible);
+
+  /*! Starts the draw list of current_frame, whose previous submission has
+   completed, for at most candidates objects seen from view_projection and
+   eye. */
+  void begin(int current_frame, size_t candidates,
+             const math::Mat4& view_projection, const float eye[3]);
+
+  /*! Adds an indirect draw of index_count indices from first_index, of
+   mesh, for the candidates added after it. */
+  void addDraw(uint32_t mesh, uint32_t index_count, uint32_t first_index);
+
+  /*! Adds a non-indexed indirect draw of vertex_count vertices of mesh, for
+   the candidates added after it. Its command is laid out so that it reads
+   as a VkDrawIndirectCommand at the same offset. */
+  void addDraw(uint32_t mesh, uint32_t vertex_count);
+
+  inline void addCandidate(const math::Bounds& bounds, uint32_t object,
+                           uint32_t material) {
+    GpuCullCandidate& candidate = candidates_[candidate_count_++];
+    for(int i = 0; i < 3; ++i) {
+      candidate.min[i] = bounds.min[i];
+      candidate.max[i] = bounds.max[i];
+    }
+    candidate.object = object;
+    candidate.material = material;
+    candidate.draw = draw_count_ - 1;
+  }
+
+  /*! Records the culling of the draw list begun last into cb, on the
+   graphics or compute queue, outside of a render pass. The indirect draws
+   and instances are written by the compute shader stage; the barrier for
+   reading them back on the host is recorded as well. */
+  void record(VkCommandBuffer cb);
+
+  /*! Indirect draws of frame, in the order of addDraw(), with a stride of
+   sizeof(GpuCullDraw). */
+  inline VkBuffer drawBuffer(int frame) const {
+    return frames_[frame].draws.buffer;
+  }
+
+  /*! Visible instances of frame, laid out like the instance buffer of
+   scene.glsl. */
+  inline VkBuffer instanceBuffer(int frame) const {
+    return frames_[frame].instances.buffer;
+  }
+
+  /*! Changes whenever a buffer of any frame is replaced. */
+  inline uint64_t generation() const {
+    return generation_;
+  }
+
+  VkDeviceSize memorySize() const;
+
+  inline const Stats& stats() const {
+    return stats_;
+  }
+
+private:
+  struct Buffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    quint8* data = nullptr; // mapped host visible buffers
+  };
+
+  struct Frame {
+    Buffer candidates;
+    Buffer draws;
+    Buffer instances;
+    size_t capacity = 0; // candidates, draws and instances
+    size_t draw_count = 0;
+    std::vector<uint32_t> meshes; // of the draws
+    VkDescriptorSet set = VK_NULL_HANDLE;
+  };
+
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                    bool host_visible, Buffer* buffer);
+  void destroyBuffer(Buffer* buffer);
+  void resize(int frame, size_t capacity);
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+  std::vector<uint32_t> queue_families_;
+
+  VkDescriptorSetLayout set_layout_ = VK_NULL_HANDLE;
+  VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
+  VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
+  VkPipeline pipeline_ = VK_NULL_HANDLE;
+
+  std::vector<Frame> frames_;
+  uint64_t generation_ = 0;
+
+  // the draw list being built
+  int frame_ = 0;
+  GpuCullCandidate* candidates_ = nullptr;
+  size_t candidate_count_ = 0;
+  GpuCullDraw* draws_ = nullptr;
+  size_t draw_count_ = 0;
+  math::Frustum frustum_;
+  float eye_[3] = {0.0f, 0.0f, 0.0f};
+
+  Stats stats_;
+};
+
+}
+
+#endif
@@ -0,0 +1,292 @@
+#include "vulkan-engine/JobSystem.h"
+
+#include <algorithm>
+
+#include <QtGlobal>
+
+// worker identity of the calling thread, workers of several job systems may
+// exist at the same time (e.g. in benchmarks)
+static thread_local const vulkan_engine::JobSystem* current_system = nullptr;
+static thread_local int current_worker = -1;
+
+vulkan_engine::JobSystem::JobSystem(int worker_count)
+  : main_thread_(std::this_thread::get_id()) {
+  if(worker_count < 0) {
+    worker_count = std::max(int(std::thread::hardware_concurrency()) - 1, 0);
+  }
+  for(int i = 0; i < worker_count; ++i) {
+    workers_.emplace_back(new Worker());
+  }
+  // workers only start once all deques exist, as they steal from each other
+  for(int i = 0; i < worker_count; ++i) {
+    workers_[i]->thread = std::thread(&JobSystem::workerLoop, this, i);
+  }
+}
+
+vulkan_engine::JobSystem::~JobSystem() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+    running_ = false;
+  }
+  work_available_.notify_all();
+  for(std::unique_ptr<Worker>& worker : workers_) {
+    worker->thread.join();
+  }
+}
+
+vulkan_engine::JobSystem& vulkan_engine::JobSystem::global() {
+  static JobSystem job_system;
+  return job_system;
+}
+
+bool vulkan_engine::JobSystem::isMainThread() const {
+  return std::this_thread::get_id() == main_thread_;
+}
+
+int vulkan_engine::JobSystem::currentWorker() const {
+  return current_system == this ? current_worker : -1;
+}
+
+vulkan_engine::JobSystem::JobHandle
+vulkan_engine::JobSystem::schedule(std::function<void()> function,
+                                   Affinity affinity) {
+  return schedule(std::move(function), std::vector<JobHandle>(), affinity);
+}
+
+vulkan_engine::JobSystem::JobHandle vulkan_engine::JobSystem::schedule(
+  std::function<void()> function, const std::vector<JobHandle>& dependencies,
+  Affinity affinity) {
+  JobHandle job = std::make_shared<Job>();
+  job->function = std::move(function);
+  job->affinity = affinity;
+  job->pending = int(dependencies.size()) + 1;
+
+  for(const JobHandle& dependency : dependencies) {
+    if(!dependency) {
+      --job->pending;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(dependency->mutex);
+    if(dependency->done) {
+      lock.unlock();
+      --job->pending;
+    } else {
+      dependency->continuations.push_back(job);
+    }
+  }
+
+  if(--job->pending == 0) {
+    enqueue(job);
+  }
+  return job;
+}
+
+bool vulkan_engine::JobSystem::finished(const JobHandle& job) {
+  return !job || job->done;
+}
+
+void vulkan_engine::JobSystem::enqueue(const JobHandle& job) {
+  if(job->affinity == MAIN_THREAD) {
+    {
+      std::lock_guard<std::mutex> lock(main_mutex_);
+      main_jobs_.push_back(job);
+    }
+    // the main thread might be waiting for something that depends on it
+    {
+      std::lock_guard<std::mutex> lock(sleep_mutex_);
+    }
+    job_finished_.notify_all();
+    return;
+  }
+
+  if(workers_.empty()) {
+    execute(job);
+    return;
+  }
+
+  // Workers keep their own jobs local, other threads spread them.
+  int target = currentWorker();
+  if(target < 0) {
+    target = next_worker_++ % workers_.size();
+  }
+  {
+    std::lock_guard<std::mutex> lock(workers_[target]->mutex);
+    workers_[target]->jobs.push_back(job);
+  }
+  ++queued_;
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+  work_available_.notify_one();
+  job_finished_.notify_all(); // waiting threads help as well
+}
+
+void vulkan_engine::JobSystem::execute(const JobHandle& job) {
+  job->function();
+  job->function = nullptr; // release captured state early
+
+  std::vector<JobHandle> continuations;
+  {
+    std::lock_guard<std::mutex> lock(job->mutex);
+    job->done = true;
+    continuations.swap(job->continuations);
+  }
+  for(const JobHandle& continuation : continuations) {
+    if(--continuation->pending == 0) {
+      enqueue(continuation);
+    }
+  }
+
+  {
+    std::lock_guard<std::mutex> lock(sleep_mutex_);
+  }
+  job_finished_.notify_all();
+}
+
+bool vulkan_engine::JobSystem::runOne(int self) {
+  JobHandle job;
+  if(self >= 0) {
+    Worker& worker = *workers_[self];
+    std::lock_guard<std::mutex> lock(worker.mutex);
+    if(!worker.jobs.empty()) {
+      job = worker.jobs.back();
+      worker.jobs.pop_back();
+    }
+  }
+
+  if(!job && isMainThread()) {
+    JobHandle main_job;
+    {
+      std::lock_guard<std::mutex> lock(main_mutex_);
+      if(!main_jobs_.empty()) {
+        main_job = main_jobs_.front();
+        main_jobs_.pop_front();
+      }
+    }
+    if(main_job) {
+      execute(main_job);
+      return true;
+    }
+  }
+
+  // steal the oldest job of another worker
+  const int count = workers_.size();
+  for(int i = 0; !job && i < count; ++i) {
+    Worker& victim = *workers_[(std::max(self, 0) + i) % count];
+    std::lock_guard<std::mutex> lock(victim.mutex);
+    if(!victim.jobs.empty()) {
+      job = victim.jobs.front();
+      victim.jobs.pop_front();
+    }
+  }
+
+  if(!job) {
+    return false;
+  }
+  --queued_;
+  execute(job);
+  return true;
+}
+
+void vulkan_engine::JobSystem::workerLoop(int index) {
+  current_system = this;
+  current_worker = index;
+
+  for(;;) {
+    if(runOne(index)) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    work_available_.wait(lock, [this]() { return queued_ > 0 || !running_; });
+    if(!running_) {
+      break;
+    }
+  }
+}
+
+void vulkan_engine::JobSystem::wait(const JobHandle& job) {
+  const int self = currentWorker();
+  while(!finished(job)) {
+    if(runOne(self)) {
+      continue;
+    }
+    // The timeout covers main thread jobs becoming ready, which are not
+    // counted in queued_.
+    std::unique_lock<std::mutex> lock(sleep_mutex_);
+    job_finished_.wait_for(lock, std::chrono::milliseconds(1), [&]() {
+      return job->done || queued_ > 0;
+    });
+  }
+}
+
+size_t vulkan_engine::JobSystem::runMainThreadJobs() {
+  if(!isMainThread()) {
+    qWarning("Main thread jobs can only be run on the main thread");
+    return 0;
+  }
+  size_t count = 0;
+  for(;;) {
+    JobHandle job;
+    {
+      std::lock_guard<std::mutex> lock(main_mutex_);
+      if(main_jobs_.empty()) {
+        break;
+      }
+      job = main_jobs_.front();
+      main_jobs_.pop_front();
+    }
+    execute(job);
+    ++count;
+  }
+  return count;
+}
+
+void vulkan_engine::JobSystem::parallelFor(
+  size_t begin, size_t end, size_t grain,
+  const std::function<void(size_t, size_t)>& function) {
+  if(end <= begin) {
+    return;
+  }
+  grain = std::max<size_t>(grain, 1);
+  const size_t chunks = (end - begin + grain - 1) / grain;
+  if(chunks == 1 || workers_.empty()) {
+    for(size_t first = begin; first < end; first += grain) {
+      function(first, std::min(first + grain, end));
+    }
+    return;
+  }
+
+  // Chunks are handed out through a shared counter to the calling thread and
+  // to helper jobs. Helpers that only start after all chunks are taken
+  // return without touching function, which is gone by then.
+  struct State {
+    std::atomic<size_t> next{0};
+    std::atomic<size_t> done{0};
+  };
+  std::shared_ptr<State> state = std::make_shared<State>();
+  const std::function<void(size_t, size_t)>* f = &function;
+  auto run = [state, f, begin, end, grain, chunks]() {
+    for(;;) {
+      const size_t chunk = state->next++;
+      if(chunk >= chunks) {
+        return;
+      }
+      const size_t first = begin + chunk * grain;
+      (*f)(first, std::min(first + grain, end));
+      ++state->done;
+    }
+  };
+
+  const size_t helpers = std::min(workers_.size(), chunks - 1);
+  for(size_t i = 0; i < helpers; ++i) {
+    schedule(run);
+  }
+  run();
+
+  const int self = currentWorker();
+  while(state->done < chunks) {
+    if(!runOne(self)) {
+      std::this_thread::yield();
+    }
+  }
+}
@@ -0,0 +1,133 @@
+#ifndef SHIFT_GUI_JOBSYSTEM_H_
+#define SHIFT_GUI_JOBSYSTEM_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace vulkan_engine {
+
+/*! Work-stealing job scheduler shared by the engine.
+
+ Every worker thread owns a deque of runnable jobs: it pushes and pops jobs
+ at the back (most recently scheduled first, which keeps data warm in its
+ cache) while idle workers steal from the front of the other deques. Jobs
+ only become runnable once all their dependencies have finished, so
+ dependency graphs and continuations never block a worker.
+
+ Threads waiting for a job, including the main thread, run other jobs in
+ the meantime instead of sleeping, so nested parallelism (a job calling
+ parallelFor) cannot deadlock and a system without workers still completes
+ all work on the waiting thread.
+
+ Jobs with MAIN_THREAD affinity, e.g. Qt calls that have to happen on the
+ GUI thread, are only run by the thread that created the job system, from
+ runMainThreadJobs() or while it waits. */
+class JobSystem {
+public:
+  enum Affinity { ANY_THREAD, MAIN_THREAD };
+
+  struct Job;
+  typedef std::shared_ptr<Job> JobHandle;
+
+  /*! Starts worker_count worker threads, or one less than the number of
+   hardware threads if worker_count is negative. The calling thread is the
+   main thread. */
+  explicit JobSystem(int worker_count = -1);
+  ~JobSystem();
+
+  JobSystem(const JobSystem&) = delete;
+  JobSystem& operator=(const JobSystem&) = delete;
+
+  /*! Job system used throughout the engine, created on first use by the
+   calling thread, which should be the GUI thread. */
+  static JobSystem& global();
+
+  JobHandle schedule(std::function<void()> function,
+                     Affinity affinity = ANY_THREAD);
+
+  /*! Schedules function to run after all dependencies have finished. */
+  JobHandle schedule(std::function<void()> function,
+                     const std::vector<JobHandle>& dependencies,
+                     Affinity affinity = ANY_THREAD);
+
+  /*! Continuation: schedules function to run after job has finished. */
+  inline JobHandle then(const JobHandle& job, std::function<void()> function,
+                        Affinity affinity = ANY_THREAD) {
+    return schedule(std::move(function), std::vector<JobHandle>(1, job),
+                    affinity);
+  }
+
+  static bool finished(const JobHandle& job);
+
+  /*! Returns once job has finished, running other jobs meanwhile. */
+  void wait(const JobHandle& job);
+
+  /*! Calls function(first, last) for consecutive chunks of at most grain
+   elements covering [begin, end) on all threads and returns once all chunks
+   are done. A single chunk is run directly on the calling thread. */
+  void parallelFor(size_t begin, size_t end, size_t grain,
+                   const std::function<void(size_t, size_t)>& function);
+
+  /*! Runs the jobs with MAIN_THREAD affinity that are ready, returns how
+   many ran. Must be called on the main thread. */
+  size_t runMainThreadJobs();
+
+  inline int workerCount() const {
+    return int(workers_.size());
+  }
+
+  /*! number of threads work is spread over, the workers and the main
+   thread */
+  inline int threadCount() const {
+    return workerCount() + 1;
+  }
+
+  bool isMainThread() const;
+
+private:
+  struct Worker {
+    std::mutex mutex;
+    std::deque<JobHandle> jobs;
+    std::thread thread;
+  };
+
+  void workerLoop(int index);
+  void enqueue(const JobHandle& job);
+  bool runOne(int self);
+  void execute(const JobHandle& job);
+  int currentWorker() const;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::thread::id main_thread_;
+
+  std::mutex main_mutex_;
+  std::deque<JobHandle> main_jobs_;
+
+  // sleeping workers wait for jobs, waiting threads for finished jobs
+  std::mutex sleep_mutex_;
+  std::condition_variable work_available_;
+  std::condition_variable job_finished_;
+  std::atomic<int> queued_{0};
+  std::atomic<unsigned> next_worker_{0};
+  bool running_ = true;
+};
+
+struct JobSystem::Job {
+  std::function<void()> function;
+  Affinity affinity = ANY_THREAD;
+  // unfinished dependencies, plus one until the job is fully scheduled
+  std::atomic<int> pending{1};
+  std::atomic<bool> done{false};
+  std::mutex mutex; // guards continuations and the transition to done
+  std::vector<JobHandle> continuations;
+};
+
+}
+
+#endif
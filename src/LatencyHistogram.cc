@@ -0,0 +1,39 @@
+#include "vulkan-engine/LatencyHistogram.h"
+
+#include <algorithm>
+
+vulkan_engine::LatencyHistogram::LatencyHistogram(double bucket_ms,
+                                                  size_t buckets)
+  : bucket_ms_(bucket_ms), buckets_(buckets + 1, 0) {}
+
+void vulkan_engine::LatencyHistogram::add(double ms) {
+  ms = std::max(ms, 0.0);
+  const size_t last = buckets_.size() - 1;
+  ++buckets_[std::min(size_t(ms / bucket_ms_), last)];
+  ++count_;
+  sum_ += ms;
+  max_ = std::max(max_, ms);
+}
+
+void vulkan_engine::LatencyHistogram::clear() {
+  std::fill(buckets_.begin(), buckets_.end(), 0);
+  count_ = 0;
+  sum_ = 0.0;
+  max_ = 0.0;
+}
+
+double vulkan_engine::LatencyHistogram::percentile(double p) const {
+  if(count_ == 0) {
+    return 0.0;
+  }
+  const size_t rank =
+    std::min(count_, std::max(size_t(1), size_t(p * count_ + 0.5)));
+  size_t seen = 0;
+  for(size_t i = 0; i + 1 < buckets_.size(); ++i) {
+    seen += buckets_[i];
+    if(seen >= rank) {
+      return std::min((i + 1) * bucket_ms_, max_);
+    }
+  }
+  return max_;
+}
@@ -0,0 +1,54 @@
+#ifndef SHIFT_GUI_LATENCYHISTOGRAM_H_
+#define SHIFT_GUI_LATENCYHISTOGRAM_H_
+
+#include <cstddef>
+#include <vector>
+
+namespace vulkan_engine {
+
+/*! Histogram of latencies in ms with buckets of a fixed width, and one more
+ for everything beyond the last. Adding is constant time, so it can record
+ every frame; percentiles are accurate to a bucket. */
+class LatencyHistogram {
+public:
+  explicit LatencyHistogram(double bucket_ms = 0.25, size_t buckets = 1000);
+
+  void add(double ms);
+  void clear();
+
+  inline size_t count() const {
+    return count_;
+  }
+
+  inline double mean() const {
+    return count_ > 0 ? sum_ / count_ : 0.0;
+  }
+
+  inline double max() const {
+    return max_;
+  }
+
+  /*! Upper bound of the bucket holding the p-th fraction of the samples,
+   the maximum for the last bucket. */
+  double percentile(double p) const;
+
+  inline double bucketWidth() const {
+    return bucket_ms_;
+  }
+
+  /*! Samples per bucket, bucket i covering [i, i + 1) * bucketWidth(). */
+  inline const std::vector<size_t>& buckets() const {
+    return buckets_;
+  }
+
+private:
+  double bucket_ms_;
+  std::vector<size_t> buckets_;
+  size_t count_ = 0;
+  double sum_ = 0.0;
+  double max_ = 0.0;
+};
+
+}
+
+#endif
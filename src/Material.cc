@@ -0,0 +1,285 @@
+#include "vulkan-engine/Material.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// entries the buffer holds at least, grown buffers double
+static const uint32_t MIN_CAPACITY = 256;
+
+vulkan_engine::GpuMaterial
+vulkan_engine::toGpuMaterial(const MaterialData& material_data) {
+  GpuMaterial material;
+  memset(&material, 0, sizeof(material));
+  for(int i = 0; i < 3; ++i) {
+    material.albedo[i] = material_data.Kd[i];
+  }
+  material.occlusion = 1.0f;
+  // Blinn-Phong exponent to Beckmann roughness, Ns = 2 / roughness^2 - 2
+  material.roughness = std::min(
+    std::max(std::sqrt(2.0f / (std::max(material_data.Ns, 0.0f) + 2.0f)),
+             0.04f),
+    1.0f);
+  material.metalness = material_data.metalness;
+  material.alpha = material_data.opacity;
+  material.albedo_texture_index = -1;
+  material.occlusion_roughness_metalness_texture_index = -1;
+  material.normal_texture_index = -1;
+  return material;
+}
+
+void vulkan_engine::MaterialTable::init(RenderSurface* surface,
+                                        QVulkanDeviceFunctions* funcs,
+                                        DeletionQueue* deletion_queue) {
+  surface_ = surface;
+  funcs_ = funcs;
+  deletion_queue_ = deletion_queue;
+  max_capacity_ = std::max<uint32_t>(
+    surface_->physicalDeviceProperties()->limits.maxStorageBufferRange /
+      sizeof(GpuMaterial),
+    1);
+  capacity_ = std::min(MIN_CAPACITY, max_capacity_);
+  full_ = false;
+  createBuffers();
+  ++generation_;
+  clear();
+}
+
+void vulkan_engine::MaterialTable::release() {
+  if(!funcs_) {
+    return;
+  }
+  VkDevice device = surface_->device();
+  if(staging_data_) {
+    funcs_->vkUnmapMemory(device, staging_memory_);
+    staging_data_ = nullptr;
+  }
+  const VkBuffer buffers[] = {buffer_, staging_buffer_};
+  const VkDeviceMemory memories[] = {memory_, staging_memory_};
+  for(int i = 0; i < 2; ++i) {
+    if(buffers[i]) {
+      funcs_->vkDestroyBuffer(device, buffers[i], nullptr);
+    }
+    if(memories[i]) {
+      funcs_->vkFreeMemory(device, memories[i], nullptr);
+    }
+  }
+  buffer_ = VK_NULL_HANDLE;
+  memory_ = VK_NULL_HANDLE;
+  staging_buffer_ = VK_NULL_HANDLE;
+  staging_memory_ = VK_NULL_HANDLE;
+
+  materials_.clear();
+  references_.clear();
+  free_.clear();
+  entries_.clear();
+  dirty_.clear();
+  capacity_ = 0;
+  max_capacity_ = 0;
+  funcs_ = nullptr;
+}
+
+vulkan_engine::MaterialTable::Handle
+vulkan_engine::MaterialTable::add(const GpuMaterial& material) {
+  auto it = entries_.find(key(material));
+  if(it != entries_.end()) {
+    ++references_[it->second];
+    return it->second;
+  }
+
+  Handle handle;
+  if(!free_.empty()) {
+    handle = free_.back();
+    free_.pop_back();
+  } else if(materials_.size() < capacity_ || grow()) {
+    handle = materials_.size();
+    materials_.push_back(GpuMaterial());
+    references_.push_back(0);
+  } else {
+    if(!full_) {
+      qWarning("Material table is full, using the default material");
+      full_ = true;
+    }
+    ++references_[0];
+    return 0;
+  }
+  setEntry(handle, material);
+  references_[handle] = 1;
+  return handle;
+}
+
+void vulkan_engine::MaterialTable::remove(Handle handle) {
+  // the default material is never freed
+  if(--references_[handle] > 0 || handle == 0) {
+    return;
+  }
+  entries_.erase(key(materials_[handle]));
+  free_.push_back(handle);
+}
+
+vulkan_engine::MaterialTable::Handle
+vulkan_engine::MaterialTable::update(Handle handle,
+                                     const GpuMaterial& material) {
+  if(memcmp(&materials_[handle], &material, sizeof(material)) == 0) {
+    return handle;
+  }
+
+  // Edited in place unless shared or another entry has the new content.
+  if(handle != 0 && references_[handle] == 1 &&
+     entries_.find(key(material)) == entries_.end()) {
+    entries_.erase(key(materials_[handle]));
+    setEntry(handle, material);
+    return handle;
+  }
+  const Handle new_handle = add(material);
+  remove(handle);
+  return new_handle;
+}
+
+void vulkan_engine::MaterialTable::clear() {
+  materials_.assign(1, GpuMaterial());
+  references_.assign(1, 1);
+  free_.clear();
+  entries_.clear();
+  dirty_.clear();
+  full_ = false;
+  setEntry(0, toGpuMaterial(MaterialData()));
+}
+
+void vulkan_engine::MaterialTable::upload(VkCommandBuffer cb,
+                                          int current_frame) {
+  uploaded_ = 0;
+  uploaded_ranges_ = 0;
+  if(dirty_.empty()) {
+    return;
+  }
+
+  // Changed entries are merged into contiguous ranges, copied to the same
+  // offsets within the staging slice of this frame, whose previous
+  // submission has completed.
+  std::sort(dirty_.begin(), dirty_.end());
+  dirty_.erase(std::unique(dirty_.begin(), dirty_.end()), dirty_.end());
+  const VkDeviceSize slice = VkDeviceSize(current_frame) * bufferSize();
+  std::vector<VkBufferCopy> copies;
+  for(size_t i = 0; i < dirty_.size();) {
+    size_t end = i + 1;
+    while(end < dirty_.size() && dirty_[end] == dirty_[end - 1] + 1) {
+      ++end;
+    }
+    const VkDeviceSize offset = dirty_[i] * sizeof(GpuMaterial);
+    const VkDeviceSize size = (end - i) * sizeof(GpuMaterial);
+    memcpy(staging_data_ + slice + offset, &materials_[dirty_[i]], size);
+    VkBufferCopy copy = {slice + offset, offset, size};
+    copies.push_back(copy);
+    uploaded_ += size;
+    i = end;
+  }
+  uploaded_ranges_ = copies.size();
+  dirty_.clear();
+
+  funcs_->vkCmdCopyBuffer(cb, staging_buffer_, buffer_, copies.size(),
+                          copies.data());
+}
+
+vulkan_engine::MaterialTable::Stats
+vulkan_engine::MaterialTable::stats() const {
+  Stats stats;
+  stats.materials = materials_.size() - free_.size();
+  for(uint32_t references : references_) {
+    stats.references += references;
+  }
+  stats.uploaded = uploaded_;
+  stats.uploaded_ranges = uploaded_ranges_;
+  return stats;
+}
+
+std::string vulkan_engine::MaterialTable::key(const GpuMaterial& material) {
+  return std::string(reinterpret_cast<const char*>(&material),
+                     sizeof(material));
+}
+
+void vulkan_engine::MaterialTable::setEntry(Handle handle,
+                                            const GpuMaterial& material) {
+  materials_[handle] = material;
+  entries_[key(material)] = handle;
+  dirty_.push_back(handle);
+}
+
+void vulkan_engine::MaterialTable::createBuffers() {
+  VkDevice device = surface_->device();
+
+  const VkDeviceSize size = bufferSize();
+  const VkDeviceSize staging_size = size * surface_->concurrentFrameCount();
+  const struct {
+    VkDeviceSize size;
+    VkBufferUsageFlags usage;
+    uint32_t memory_index;
+    VkBuffer* buffer;
+    VkDeviceMemory* memory;
+  } buffers[] = {
+    {size,
+     VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+     surface_->deviceLocalMemoryIndex(), &buffer_, &memory_},
+    {staging_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+     surface_->hostVisibleMemoryIndex(), &staging_buffer_, &staging_memory_}};
+  for(const auto& b : buffers) {
+    VkBufferCreateInfo buffer_info;
+    memset(&buffer_info, 0, sizeof(buffer_info));
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = b.size;
+    buffer_info.usage = b.usage;
+    VkResult err = funcs_->vkCreateBuffer(device, &buffer_info, nullptr,
+                                          b.buffer);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create material buffer: %d", err);
+    }
+    VkMemoryRequirements memory_requirements;
+    funcs_->vkGetBufferMemoryRequirements(device, *b.buffer,
+                                          &memory_requirements);
+    VkMemoryAllocateInfo memory_alloc_info = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr,
+      memory_requirements.size, b.memory_index};
+    err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr,
+                                   b.memory);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to allocate material memory: %d", err);
+    }
+    err = funcs_->vkBindBufferMemory(device, *b.buffer, *b.memory, 0);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to bind material memory: %d", err);
+    }
+  }
+
+  VkResult err =
+    funcs_->vkMapMemory(device, staging_memory_, 0, staging_size, 0,
+                        reinterpret_cast<void**>(&staging_data_));
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to map memory: %d", err);
+  }
+}
+
+bool vulkan_engine::MaterialTable::grow() {
+  if(capacity_ >= max_capacity_) {
+    return false;
+  }
+
+  // frames in flight still read the old buffer and their staging slices
+  VkDevice device = surface_->device();
+  funcs_->vkUnmapMemory(device, staging_memory_);
+  staging_data_ = nullptr;
+  deletion_queue_->retireBuffer(buffer_, memory_, bufferSize());
+  deletion_queue_->retireBuffer(
+    staging_buffer_, staging_memory_,
+    bufferSize() * surface_->concurrentFrameCount());
+  capacity_ = uint32_t(std::min<uint64_t>(2 * uint64_t(capacity_),
+                                          max_capacity_));
+  createBuffers();
+  ++generation_;
+
+  // the new buffer holds nothing yet
+  dirty_.resize(materials_.size());
+  for(Handle handle = 0; handle < materials_.size(); ++handle) {
+    dirty_[handle] = handle;
+  }
+  return true;
+}
@@ -1,10 +1,144 @@
-#ifndef SHIFT_GUI_MATERIAL_
-#define SHIFT_GUI_MATERIAL_
+#ifndef SHIFT_GUI_MATERIAL_H_
+#define SHIFT_GUI_MATERIAL_H_
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <QVulkanFunctions>
 
+#include "vulkan-engine/DeletionQueue.h"
+#include "vulkan-engine/MeshData.h"
+#include "vulkan-engine/RenderSurface.h"
+
 namespace vulkan_engine {
 
+/*! Material as laid out in the materials buffer of the shaders (std430):
+ metallic-roughness parameters and the bindless slots of its textures, -1
+ for none. */
+struct GpuMaterial {
+  float albedo[3];
+  float occlusion;
+  float roughness;
+  float metalness;
+  float alpha;
+  qint32 albedo_texture_index;
+  qint32 occlusion_roughness_metalness_texture_index;
+  qint32 normal_texture_index;
+  float padding[2]; // the array stride is a multiple of 16 bytes
+};
+
+/*! Converts the Phong parameters of material_data: the albedo is the
+ diffuse color and the roughness follows from the specular exponent. The
+ result has no textures and zeroed padding, so materials compare bytewise. */
+GpuMaterial toGpuMaterial(const MaterialData& material_data);
+
+/*! All materials of the scene in one device local storage buffer, indexed
+ by the draws.
+
+ Identical materials share an entry, which is reference counted and reused
+ once no longer referenced. The buffer grows as needed, up to the storage
+ buffer range of the device; entry 0 always holds the default material and
+ is handed out beyond that. Changes are collected on the CPU and upload()
+ copies only the changed ranges through a staging buffer per frame in
+ flight. The copies are ordered against the draws by the caller, the
+ render graph of the engine. */
+class MaterialTable {
+public:
+  typedef uint32_t Handle;
+  static const Handle INVALID_HANDLE = UINT32_MAX;
+
+  struct Stats {
+    size_t materials = 0;        // distinct materials, including the default
+    size_t references = 0;       // references over all entries
+    VkDeviceSize uploaded = 0;   // bytes copied by the last upload()
+    size_t uploaded_ranges = 0;  // copies recorded by the last upload()
+  };
+
+  MaterialTable() = default;
+  ~MaterialTable() = default;
+
+  MaterialTable(const MaterialTable&) = delete;
+  MaterialTable& operator=(const MaterialTable&) = delete;
+
+  /*! Replaced buffers are retired through deletion_queue. */
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            DeletionQueue* deletion_queue);
+  void release();
+
+  inline VkBuffer buffer() const {
+    return buffer_;
+  }
+
+  /*! Size of the buffer in bytes. */
+  inline VkDeviceSize bufferSize() const {
+    return VkDeviceSize(capacity_) * sizeof(GpuMaterial);
+  }
+
+  /*! Incremented whenever buffer() is replaced by a larger one. */
+  inline uint64_t generation() const {
+    return generation_;
+  }
+
+  /*! Returns a reference to an entry holding material, shared with
+   identical materials. */
+  Handle add(const GpuMaterial& material);
+
+  /*! Drops a reference returned by add() or update(). */
+  void remove(Handle handle);
+
+  /*! Replaces the material of a reference and returns the new reference.
+   The entry is changed in place if nothing else refers to it. */
+  Handle update(Handle handle, const GpuMaterial& material);
+
+  inline const GpuMaterial& material(Handle handle) const {
+    return materials_[handle];
+  }
+
+  /*! Drops all references but the default material. */
+  void clear();
+
+  /*! Whether entries changed since the last upload(). */
+  inline bool pending() const {
+    return !dirty_.empty();
+  }
+
+  /*! Records the copies of the entries changed since the last call into
+   cb, outside of a render pass and without barriers. */
+  void upload(VkCommandBuffer cb, int current_frame);
+
+  Stats stats() const;
+
+private:
+  static std::string key(const GpuMaterial& material);
+  void setEntry(Handle handle, const GpuMaterial& material);
+  void createBuffers();
+  bool grow();
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+  DeletionQueue* deletion_queue_ = nullptr;
+  uint32_t capacity_ = 0;
+  uint32_t max_capacity_ = 0; // by the storage buffer range of the device
+  uint64_t generation_ = 0;
+  bool full_ = false;         // warned about running out of entries
+
+  VkBuffer buffer_ = VK_NULL_HANDLE;
+  VkDeviceMemory memory_ = VK_NULL_HANDLE;
+  VkBuffer staging_buffer_ = VK_NULL_HANDLE; // a slice per frame in flight
+  VkDeviceMemory staging_memory_ = VK_NULL_HANDLE;
+  quint8* staging_data_ = nullptr;
+
+  // CPU copy of the entries, their reference counts and free entries
+  std::vector<GpuMaterial> materials_;
+  std::vector<uint32_t> references_;
+  std::vector<Handle> free_;
+  std::unordered_map<std::string, Handle> entries_; // by content
+  std::vector<Handle> dirty_;
+  VkDeviceSize uploaded_ = 0;
+  size_t uploaded_ranges_ = 0;
+};
 
 }
 
@@ -0,0 +1,171 @@
+#include "vulkan-engine/MeshCache.h"
+
+#include <cstring>
+#include <fstream>
+
+#include <QtGlobal>
+
+static const char MAGIC[4] = {'V', 'E', 'M', 'C'};
+static const uint32_t VERSION = 1;
+
+struct Header {
+  char magic[4];
+  uint32_t version;
+  uint32_t mesh_count;
+  uint32_t reserved;
+};
+
+bool vulkan_engine::MeshCache::write(
+  const std::string& path, const std::vector<const MeshData*>& meshes) {
+  std::ofstream file(path, std::ios::binary | std::ios::trunc);
+  if(!file) {
+    qWarning("Failed to create mesh cache %s", path.c_str());
+    return false;
+  }
+
+  Header header;
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.mesh_count = meshes.size();
+  header.reserved = 0;
+
+  std::vector<Entry> entries(meshes.size());
+  uint64_t offset = sizeof(Header) + entries.size() * sizeof(Entry);
+  for(size_t i = 0; i < meshes.size(); ++i) {
+    const MeshData& mesh = *meshes[i];
+    Entry& entry = entries[i];
+    entry.offset = offset;
+    entry.vertex_count = mesh.vertices.size() / 3;
+    entry.index_count = mesh.faces.size();
+    entry.has_normals = mesh.normals.size() == mesh.vertices.size() &&
+                        !mesh.normals.empty();
+    entry.shading_type = uint32_t(mesh.shading_type);
+    if(entry.vertex_count > 0) {
+      const math::Bounds bounds =
+        math::computeBounds(mesh.vertices.data(), entry.vertex_count);
+      memcpy(entry.bounds_min, bounds.min, sizeof(entry.bounds_min));
+      memcpy(entry.bounds_max, bounds.max, sizeof(entry.bounds_max));
+    }
+    offset += (entry.has_normals ? 2 : 1) * entry.vertex_count * 3 *
+                sizeof(float) +
+              entry.index_count * sizeof(uint32_t);
+  }
+
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(entries.data()),
+             entries.size() * sizeof(Entry));
+  for(size_t i = 0; i < meshes.size(); ++i) {
+    const MeshData& mesh = *meshes[i];
+    const Entry& entry = entries[i];
+    file.write(reinterpret_cast<const char*>(mesh.vertices.data()),
+               entry.vertex_count * 3 * sizeof(float));
+    if(entry.has_normals) {
+      file.write(reinterpret_cast<const char*>(mesh.normals.data()),
+                 entry.vertex_count * 3 * sizeof(float));
+    }
+    file.write(reinterpret_cast<const char*>(mesh.faces.data()),
+               entry.index_count * sizeof(uint32_t));
+  }
+
+  if(!file) {
+    qWarning("Failed to write mesh cache %s", path.c_str());
+    return false;
+  }
+  return true;
+}
+
+bool vulkan_engine::MeshCache::open(const std::string& path) {
+  close();
+  std::ifstream file(path, std::ios::binary | std::ios::ate);
+  if(!file) {
+    qWarning("Failed to open mesh cache %s", path.c_str());
+    return false;
+  }
+  const uint64_t file_size = uint64_t(file.tellg());
+  file.seekg(0);
+
+  Header header;
+  if(!file.read(reinterpret_cast<char*>(&header), sizeof(header)) ||
+     memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 ||
+     header.version != VERSION) {
+    qWarning("%s is not a mesh cache of version %u", path.c_str(), VERSION);
+    return false;
+  }
+
+  // the table and the data of every mesh have to lie within the file
+  const uint64_t table_end =
+    sizeof(Header) + uint64_t(header.mesh_count) * sizeof(Entry);
+  if(table_end > file_size) {
+    qWarning("Truncated mesh cache %s", path.c_str());
+    return false;
+  }
+  entries_.resize(header.mesh_count);
+  if(!file.read(reinterpret_cast<char*>(entries_.data()),
+                entries_.size() * sizeof(Entry))) {
+    qWarning("Truncated mesh cache %s", path.c_str());
+    entries_.clear();
+    return false;
+  }
+  for(uint32_t mesh = 0; mesh < size(); ++mesh) {
+    const Entry& entry = entries_[mesh];
+    if(entry.has_normals > 1 || entry.offset < table_end ||
+       entry.offset > file_size ||
+       dataSize(mesh) > file_size - entry.offset) {
+      qWarning("Mesh %u exceeds mesh cache %s", mesh, path.c_str());
+      entries_.clear();
+      return false;
+    }
+  }
+  path_ = path;
+  return true;
+}
+
+void vulkan_engine::MeshCache::close() {
+  path_.clear();
+  entries_.clear();
+}
+
+vulkan_engine::math::Bounds
+vulkan_engine::MeshCache::bounds(uint32_t mesh) const {
+  const Entry& entry = entries_[mesh];
+  math::Bounds bounds;
+  memset(&bounds, 0, sizeof(bounds));
+  memcpy(bounds.min, entry.bounds_min, sizeof(entry.bounds_min));
+  memcpy(bounds.max, entry.bounds_max, sizeof(entry.bounds_max));
+  return bounds;
+}
+
+uint64_t vulkan_engine::MeshCache::dataSize(uint32_t mesh) const {
+  const Entry& entry = entries_[mesh];
+  return (entry.has_normals ? 2 : 1) * uint64_t(entry.vertex_count) * 3 *
+           sizeof(float) +
+         uint64_t(entry.index_count) * sizeof(uint32_t);
+}
+
+bool vulkan_engine::MeshCache::read(uint32_t mesh, MeshData* mesh_data) const {
+  if(mesh >= entries_.size()) {
+    return false;
+  }
+  const Entry& entry = entries_[mesh];
+  std::ifstream file(path_, std::ios::binary);
+  if(!file.seekg(entry.offset)) {
+    qWarning("Failed to seek to mesh %u in %s", mesh, path_.c_str());
+    return false;
+  }
+
+  mesh_data->shading_type = ShadingType(entry.shading_type);
+  mesh_data->vertices.resize(entry.vertex_count * 3);
+  mesh_data->normals.resize(entry.has_normals ? entry.vertex_count * 3 : 0);
+  mesh_data->faces.resize(entry.index_count);
+  file.read(reinterpret_cast<char*>(mesh_data->vertices.data()),
+            mesh_data->vertices.size() * sizeof(float));
+  file.read(reinterpret_cast<char*>(mesh_data->normals.data()),
+            mesh_data->normals.size() * sizeof(float));
+  file.read(reinterpret_cast<char*>(mesh_data->faces.data()),
+            mesh_data->faces.size() * sizeof(uint32_t));
+  if(!file) {
+    qWarning("Failed to read mesh %u from %s", mesh, path_.c_str());
+    return false;
+  }
+  return true;
+}
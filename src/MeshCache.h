@@ -0,0 +1,69 @@
+#ifndef SHIFT_GUI_MESHCACHE_H_
+#define SHIFT_GUI_MESHCACHE_H_
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "vulkan-engine/MeshData.h"
+#include "vulkan-engine/SimdMath.h"
+
+namespace vulkan_engine {
+
+/*! Binary file of meshes that can be loaded individually.
+
+ The file starts with a header and a table with the size, bounds and file
+ offset of every mesh, followed by the mesh data: positions, normals (if
+ any) and triangle indices, stored exactly as uploaded to the GPU. Opening a
+ cache only reads the table, so the bounds of every mesh are known up front
+ and the data can be streamed in on demand. Numbers are stored in the byte
+ order of the writing machine. */
+class MeshCache {
+public:
+  struct Entry {
+    uint64_t offset = 0;
+    uint32_t vertex_count = 0;
+    uint32_t index_count = 0;
+    uint32_t has_normals = 0;
+    uint32_t shading_type = 0;
+    float bounds_min[3] = {0.0f, 0.0f, 0.0f};
+    float bounds_max[3] = {0.0f, 0.0f, 0.0f};
+  };
+
+  /*! Writes meshes (positions, normals and faces only) to path. */
+  static bool write(const std::string& path,
+                    const std::vector<const MeshData*>& meshes);
+
+  /*! Reads the table of contents of the cache at path. */
+  bool open(const std::string& path);
+  void close();
+
+  inline bool isOpen() const {
+    return !path_.empty();
+  }
+
+  inline uint32_t size() const {
+    return uint32_t(entries_.size());
+  }
+
+  inline const Entry& entry(uint32_t mesh) const {
+    return entries_[mesh];
+  }
+
+  math::Bounds bounds(uint32_t mesh) const;
+
+  /*! Bytes of vertex and index data of a mesh. */
+  uint64_t dataSize(uint32_t mesh) const;
+
+  /*! Loads a mesh. Safe to call from several threads at once, every call
+   reads through its own file handle. */
+  bool read(uint32_t mesh, MeshData* mesh_data) const;
+
+private:
+  std::string path_;
+  std::vector<Entry> entries_;
+};
+
+}
+
+#endif
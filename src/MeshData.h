@@ -36,6 +36,13 @@ namespace vulkan_engine {
     float metalness = 0.0;
   };
 
+  struct LightData {
+    float position[3] = {0.0, 0.0, 0.0};
+    float color[3] = {1.0, 1.0, 1.0};
+    bool directional = false;
+    bool cast_shadows = false;
+  };
+
 }
 
 #endif
@@ -0,0 +1,305 @@
+#include "vulkan-engine/MeshDeduplicator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// candidates of a bucket that are compared before a mesh counts as unique
+static const size_t MAX_CANDIDATES = 64;
+
+namespace {
+
+uint64_t hashBytes(uint64_t hash, const void* data, size_t size) {
+  // FNV-1a
+  const unsigned char* bytes = static_cast<const unsigned char*>(data);
+  for(size_t i = 0; i < size; ++i) {
+    hash ^= bytes[i];
+    hash *= 1099511628211ull;
+  }
+  return hash;
+}
+
+template <typename T>
+uint64_t hashVector(uint64_t hash, const std::vector<T>& values) {
+  const uint64_t size = values.size();
+  hash = hashBytes(hash, &size, sizeof(size));
+  return hashBytes(hash, values.data(), values.size() * sizeof(T));
+}
+
+uint64_t hashString(uint64_t hash, const std::string& value) {
+  const uint64_t size = value.size();
+  hash = hashBytes(hash, &size, sizeof(size));
+  return hashBytes(hash, value.data(), value.size());
+}
+
+template <typename T>
+bool equal(const std::vector<T>& a, const std::vector<T>& b) {
+  return a.size() == b.size() &&
+         (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0);
+}
+
+void centroid(const std::vector<float>& vertices, float* c) {
+  const size_t count = vertices.size() / 3;
+  double sum[3] = {0.0, 0.0, 0.0};
+  for(size_t i = 0; i < count; ++i) {
+    for(int k = 0; k < 3; ++k) {
+      sum[k] += vertices[3 * i + k];
+    }
+  }
+  for(int k = 0; k < 3; ++k) {
+    c[k] = count > 0 ? float(sum[k] / count) : 0.0f;
+  }
+}
+
+float dot(const float* a, const float* b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+/*! Orthonormal frame of the vertices a and b around the centroid c, rows
+ e0 along a, e1 towards b and e2 = e0 x e1. */
+void frame(const std::vector<float>& vertices, const float* c, int a, int b,
+           float* e) {
+  float* e0 = e;
+  float* e1 = e + 3;
+  float* e2 = e + 6;
+  for(int k = 0; k < 3; ++k) {
+    e0[k] = vertices[3 * a + k] - c[k];
+    e1[k] = vertices[3 * b + k] - c[k];
+  }
+  const float length0 = std::sqrt(dot(e0, e0));
+  for(int k = 0; k < 3; ++k) {
+    e0[k] /= length0;
+  }
+  const float projection = dot(e1, e0);
+  for(int k = 0; k < 3; ++k) {
+    e1[k] -= projection * e0[k];
+  }
+  const float length1 = std::sqrt(dot(e1, e1));
+  for(int k = 0; k < 3; ++k) {
+    e1[k] /= length1;
+  }
+  e2[0] = e0[1] * e1[2] - e0[2] * e1[1];
+  e2[1] = e0[2] * e1[0] - e0[0] * e1[2];
+  e2[2] = e0[0] * e1[1] - e0[1] * e1[0];
+}
+
+/*! Whether rotating the directions a by r gives b within tolerance. */
+bool directionsMatch(const std::vector<float>& a, const std::vector<float>& b,
+                     const float* r, float tolerance) {
+  const size_t count = a.size() / 3;
+  for(size_t i = 0; i < count; ++i) {
+    const float* v = &a[3 * i];
+    float d2 = 0.0f;
+    for(int k = 0; k < 3; ++k) {
+      const float d = dot(r + 3 * k, v) - b[3 * i + k];
+      d2 += d * d;
+    }
+    if(d2 > tolerance * tolerance) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}
+
+vulkan_engine::MeshDeduplicator::MeshDeduplicator(float tolerance)
+  : tolerance_(tolerance) {
+}
+
+vulkan_engine::MeshDeduplicator::Result
+vulkan_engine::MeshDeduplicator::add(const MeshData* mesh_data) {
+  const size_t bytes = meshBytes(*mesh_data);
+  ++stats_.meshes;
+  stats_.bytes += bytes;
+
+  Result result;
+  const uint64_t hash = contentHash(*mesh_data);
+  auto range = entries_.equal_range(hash);
+  size_t candidates = 0;
+  for(auto it = range.first; it != range.second; ++it) {
+    if(candidates++ == MAX_CANDIDATES) {
+      break;
+    }
+    const Entry& entry = it->second;
+    if(match(entry, *mesh_data, &result.transform)) {
+      result.mesh = entry.mesh;
+      if(result.transform.isIdentity()) {
+        ++stats_.identical;
+      } else {
+        ++stats_.moved;
+      }
+      return result;
+    }
+  }
+
+  entries_.insert(std::make_pair(hash, makeEntry(mesh_data)));
+  ++stats_.unique;
+  stats_.unique_bytes += bytes;
+  result.mesh = mesh_data;
+  return result;
+}
+
+void vulkan_engine::MeshDeduplicator::clear() {
+  entries_.clear();
+  stats_ = Stats();
+}
+
+size_t vulkan_engine::MeshDeduplicator::meshBytes(const MeshData& mesh_data) {
+  return (mesh_data.vertices.size() + mesh_data.normals.size() +
+          mesh_data.colors.size() + mesh_data.tangents.size() +
+          mesh_data.bitangents.size() +
+          mesh_data.texture_coordinates.size()) *
+           sizeof(float) +
+         mesh_data.faces.size() * sizeof(unsigned int);
+}
+
+uint64_t
+vulkan_engine::MeshDeduplicator::contentHash(const MeshData& mesh_data) {
+  // Positions and directions change under a rigid transform, only their
+  // counts are part of the hash.
+  uint64_t hash = 14695981039346656037ull;
+  const uint64_t counts[] = {
+    uint64_t(mesh_data.shading_type), uint64_t(mesh_data.material_index),
+    mesh_data.vertices.size(), mesh_data.normals.size(),
+    mesh_data.tangents.size(), mesh_data.bitangents.size()};
+  hash = hashBytes(hash, counts, sizeof(counts));
+  hash = hashVector(hash, mesh_data.faces);
+  hash = hashVector(hash, mesh_data.texture_coordinates);
+  hash = hashVector(hash, mesh_data.colors);
+  const std::string* maps[] = {
+    &mesh_data.diffuse_map,      &mesh_data.normal_map,
+    &mesh_data.specular_map,     &mesh_data.displacement_map,
+    &mesh_data.metalness_map,    &mesh_data.occlusion_map};
+  for(const std::string* map : maps) {
+    hash = hashString(hash, *map);
+  }
+  return hash;
+}
+
+vulkan_engine::MeshDeduplicator::Entry
+vulkan_engine::MeshDeduplicator::makeEntry(const MeshData* mesh_data) const {
+  Entry entry;
+  entry.mesh = mesh_data;
+  entry.a = -1;
+  entry.b = -1;
+  const std::vector<float>& vertices = mesh_data->vertices;
+  const size_t count = vertices.size() / 3;
+  centroid(vertices, entry.centroid);
+
+  // a is the vertex farthest from the centroid, b the one farthest from
+  // the line through both, which keeps the frame well conditioned
+  float a_distance = 0.0f;
+  for(size_t i = 0; i < count; ++i) {
+    float d[3];
+    for(int k = 0; k < 3; ++k) {
+      d[k] = vertices[3 * i + k] - entry.centroid[k];
+    }
+    const float distance = dot(d, d);
+    if(distance > a_distance) {
+      a_distance = distance;
+      entry.a = i;
+    }
+  }
+  entry.radius = std::sqrt(a_distance);
+  if(entry.a < 0) {
+    return entry;
+  }
+
+  float axis[3];
+  for(int k = 0; k < 3; ++k) {
+    axis[k] = (vertices[3 * entry.a + k] - entry.centroid[k]) / entry.radius;
+  }
+  float b_distance = 0.0f;
+  for(size_t i = 0; i < count; ++i) {
+    float d[3];
+    for(int k = 0; k < 3; ++k) {
+      d[k] = vertices[3 * i + k] - entry.centroid[k];
+    }
+    const float projection = dot(d, axis);
+    const float distance = dot(d, d) - projection * projection;
+    if(distance > b_distance) {
+      b_distance = distance;
+      entry.b = i;
+    }
+  }
+
+  // collinear meshes get no rotation, only translated copies match them
+  if(std::sqrt(b_distance) <= 1e-3f * entry.radius) {
+    entry.a = -1;
+    entry.b = -1;
+    return entry;
+  }
+  frame(vertices, entry.centroid, entry.a, entry.b, entry.frame);
+  return entry;
+}
+
+bool vulkan_engine::MeshDeduplicator::match(const Entry& entry,
+                                            const MeshData& mesh_data,
+                                            QMatrix4x4* transform) const {
+  const MeshData& reference = *entry.mesh;
+  if(reference.vertices.size() != mesh_data.vertices.size() ||
+     reference.normals.size() != mesh_data.normals.size() ||
+     reference.tangents.size() != mesh_data.tangents.size() ||
+     reference.bitangents.size() != mesh_data.bitangents.size() ||
+     !equal(reference.faces, mesh_data.faces) ||
+     !equal(reference.texture_coordinates, mesh_data.texture_coordinates) ||
+     !equal(reference.colors, mesh_data.colors)) {
+    return false;
+  }
+
+  if(equal(reference.vertices, mesh_data.vertices) &&
+     equal(reference.normals, mesh_data.normals) &&
+     equal(reference.tangents, mesh_data.tangents) &&
+     equal(reference.bitangents, mesh_data.bitangents)) {
+    transform->setToIdentity();
+    return true;
+  }
+
+  // p' = r (p - c) + c' maps the reference frame onto the one spanned by
+  // the same vertices of mesh_data, r = F'^T F with the frames as rows
+  const std::vector<float>& vertices = mesh_data.vertices;
+  float c[3];
+  centroid(vertices, c);
+  float r[9] = {1.0f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f};
+  if(entry.a >= 0) {
+    float f[9];
+    frame(vertices, c, entry.a, entry.b, f);
+    for(int i = 0; i < 3; ++i) {
+      for(int j = 0; j < 3; ++j) {
+        r[3 * i + j] = f[i] * entry.frame[j] + f[3 + i] * entry.frame[3 + j] +
+                       f[6 + i] * entry.frame[6 + j];
+      }
+    }
+  }
+  float t[3];
+  for(int k = 0; k < 3; ++k) {
+    t[k] = c[k] - dot(r + 3 * k, entry.centroid);
+  }
+
+  const float position_tolerance =
+    tolerance_ * std::max(entry.radius, 1e-6f);
+  const size_t count = vertices.size() / 3;
+  for(size_t i = 0; i < count; ++i) {
+    const float* p = &reference.vertices[3 * i];
+    float d2 = 0.0f;
+    for(int k = 0; k < 3; ++k) {
+      const float d = dot(r + 3 * k, p) + t[k] - vertices[3 * i + k];
+      d2 += d * d;
+    }
+    if(d2 > position_tolerance * position_tolerance) {
+      return false;
+    }
+  }
+  if(!directionsMatch(reference.normals, mesh_data.normals, r, tolerance_) ||
+     !directionsMatch(reference.tangents, mesh_data.tangents, r,
+                      tolerance_) ||
+     !directionsMatch(reference.bitangents, mesh_data.bitangents, r,
+                      tolerance_)) {
+    return false;
+  }
+
+  *transform = QMatrix4x4(r[0], r[1], r[2], t[0], r[3], r[4], r[5], t[1],
+                          r[6], r[7], r[8], t[2], 0.0f, 0.0f, 0.0f, 1.0f);
+  return true;
+}
@@ -0,0 +1,90 @@
+#ifndef SHIFT_GUI_MESHDEDUPLICATOR_H_
+#define SHIFT_GUI_MESHDEDUPLICATOR_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+
+#include <QMatrix4x4>
+
+#include "vulkan-engine/MeshData.h"
+
+namespace vulkan_engine {
+
+/*! Import-time deduplication of meshes by content.
+
+ CAD assemblies often contain many copies of the same part, each imported
+ as its own MeshData and often with the part's placement baked into the
+ vertices. add() finds an earlier mesh that the new one is a rigidly moved
+ copy of and returns it together with the rotation and translation that
+ maps it onto the new mesh, so the object can reference the earlier mesh
+ instead and the engine uploads and draws it once, instanced.
+
+ Meshes are bucketed by a hash of the content that does not change under a
+ rigid transform: the vertex count, triangle indices, texture coordinates
+ and texture maps. Candidates of the same bucket are matched by vertex
+ order: the rotation follows from a frame spanned by two reference
+ vertices around the centroid and every position, normal and tangent has
+ to agree within the tolerance after applying it. Mirrored copies are not
+ matched. */
+class MeshDeduplicator {
+public:
+  struct Result {
+    const MeshData* mesh = nullptr; // the mesh to draw instead
+    QMatrix4x4 transform;           // maps mesh onto the added mesh
+  };
+
+  struct Stats {
+    size_t meshes = 0;     // added
+    size_t unique = 0;     // distinct meshes returned
+    size_t identical = 0;  // duplicates with the same vertices
+    size_t moved = 0;      // duplicates under a rotation or translation
+    size_t bytes = 0;      // vertex and index data of all added meshes
+    size_t unique_bytes = 0; // vertex and index data of the distinct ones
+
+    inline size_t savedBytes() const {
+      return bytes - unique_bytes;
+    }
+  };
+
+  /*! tolerance is the largest position error relative to the size of the
+   mesh, and the largest error of unit normals and tangents. */
+  explicit MeshDeduplicator(float tolerance = 1e-4f);
+
+  /*! Returns the mesh to use for mesh_data, mesh_data itself if it is
+   unique. mesh_data has to outlive the deduplicator. */
+  Result add(const MeshData* mesh_data);
+
+  void clear();
+
+  inline const Stats& stats() const {
+    return stats_;
+  }
+
+  /*! Bytes of vertex and index data of a mesh. */
+  static size_t meshBytes(const MeshData& mesh_data);
+
+private:
+  struct Entry {
+    const MeshData* mesh;
+    float centroid[3];
+    float radius;
+    // vertices spanning the reference frame, a < 0 for degenerate meshes
+    int a;
+    int b;
+    float frame[9]; // rows e0, e1, e2
+  };
+
+  static uint64_t contentHash(const MeshData& mesh_data);
+  Entry makeEntry(const MeshData* mesh_data) const;
+  bool match(const Entry& entry, const MeshData& mesh_data,
+             QMatrix4x4* transform) const;
+
+  float tolerance_;
+  std::unordered_multimap<uint64_t, Entry> entries_;
+  Stats stats_;
+};
+
+}
+
+#endif
@@ -0,0 +1,192 @@
+#include "vulkan-engine/MeshStreamer.h"
+
+#include <algorithm>
+
+// frames before a mesh that did not fit into the budget next to the meshes
+// drawn in the same frame is requested again
+static const uint64_t RETRY_FRAMES = 60;
+
+vulkan_engine::MeshStreamer::MeshStreamer(const MeshCache* cache,
+                                          int io_threads)
+  : cache_(cache), meshes_(cache->size()), in_flight_(cache->size(), false) {
+  for(int i = 0; i < std::max(io_threads, 1); ++i) {
+    threads_.emplace_back(&MeshStreamer::run, this);
+  }
+}
+
+vulkan_engine::MeshStreamer::~MeshStreamer() {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    quit_ = true;
+  }
+  wake_.notify_all();
+  for(auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void vulkan_engine::MeshStreamer::setBudget(uint64_t bytes) {
+  budget_ = bytes;
+}
+
+void vulkan_engine::MeshStreamer::beginFrame(uint64_t frame) {
+  frame_ = frame;
+  for(const auto& request : requests_) {
+    meshes_[request.second].request = -1;
+  }
+  requests_.clear();
+}
+
+void vulkan_engine::MeshStreamer::use(uint32_t mesh, float priority) {
+  MeshState& state = meshes_[mesh];
+  if(state.resident) {
+    state.last_used = frame_;
+    lru_.splice(lru_.begin(), lru_, state.lru);
+  } else if(state.request >= 0) {
+    requests_[state.request].first =
+      std::max(requests_[state.request].first, priority);
+  } else if(state.retry_frame <= frame_) {
+    state.request = requests_.size();
+    requests_.emplace_back(priority, mesh);
+  }
+}
+
+void vulkan_engine::MeshStreamer::endFrame() {
+  std::vector<std::pair<float, uint32_t>> requests(requests_);
+  std::sort(requests.begin(), requests.end());
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    queue_.clear();
+    for(const auto& request : requests) {
+      if(!in_flight_[request.second]) {
+        queue_.push_back(request.second);
+      }
+    }
+  }
+  if(!requests.empty()) {
+    wake_.notify_all();
+  }
+}
+
+bool vulkan_engine::MeshStreamer::takeLoaded(uint32_t* mesh,
+                                             MeshData* mesh_data) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(loaded_.empty()) {
+    return false;
+  }
+  *mesh = loaded_.front().first;
+  *mesh_data = std::move(loaded_.front().second);
+  loaded_.pop_front();
+  in_flight_[*mesh] = false;
+  return true;
+}
+
+bool vulkan_engine::MeshStreamer::makeResident(
+  uint32_t mesh, uint64_t bytes, uint64_t retire,
+  std::vector<uint32_t>* evicted) {
+  MeshState& state = meshes_[mesh];
+  if(state.resident) {
+    return true;
+  }
+
+  // find out whether enough old meshes can be evicted before evicting any
+  uint64_t freed = 0;
+  auto last = lru_.end();
+  while(resident_bytes_ - freed + bytes > budget_ && last != lru_.begin()) {
+    const MeshState& old = meshes_[*std::prev(last)];
+    if(frame_ - old.last_used < retire) {
+      break;
+    }
+    freed += old.bytes;
+    --last;
+  }
+  if(resident_bytes_ - freed + bytes > budget_) {
+    // retry soon if the mesh fits once the meshes of frames in flight
+    // retire, and much later if the meshes of this frame alone fill the
+    // budget
+    while(last != lru_.begin() &&
+          meshes_[*std::prev(last)].last_used < frame_) {
+      --last;
+      freed += meshes_[*last].bytes;
+    }
+    const bool fits_later = resident_bytes_ - freed + bytes <= budget_;
+    state.retry_frame = frame_ + (fits_later ? retire : RETRY_FRAMES);
+    ++rejected_;
+    return false;
+  }
+
+  for(auto it = last; it != lru_.end(); ++it) {
+    MeshState& old = meshes_[*it];
+    old.resident = false;
+    resident_bytes_ -= old.bytes;
+    old.bytes = 0;
+    --resident_count_;
+    ++evictions_;
+    evicted->push_back(*it);
+  }
+  lru_.erase(last, lru_.end());
+
+  state.resident = true;
+  state.bytes = bytes;
+  state.last_used = frame_;
+  state.lru = lru_.insert(lru_.begin(), mesh);
+  resident_bytes_ += bytes;
+  ++resident_count_;
+  return true;
+}
+
+void vulkan_engine::MeshStreamer::reset() {
+  for(uint32_t mesh : lru_) {
+    meshes_[mesh].resident = false;
+    meshes_[mesh].bytes = 0;
+  }
+  lru_.clear();
+  resident_bytes_ = 0;
+  resident_count_ = 0;
+}
+
+bool vulkan_engine::MeshStreamer::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return !queue_.empty() || reading_ > 0 || !loaded_.empty();
+}
+
+vulkan_engine::MeshStreamer::Stats
+vulkan_engine::MeshStreamer::stats() const {
+  Stats stats;
+  stats.budget = budget_;
+  stats.resident_bytes = resident_bytes_;
+  stats.resident_meshes = resident_count_;
+  stats.evictions = evictions_;
+  stats.rejected = rejected_;
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats.pending = queue_.size() + reading_ + loaded_.size();
+  stats.loads = loads_;
+  return stats;
+}
+
+void vulkan_engine::MeshStreamer::run() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  for(;;) {
+    wake_.wait(lock, [this] { return quit_ || !queue_.empty(); });
+    if(quit_) {
+      return;
+    }
+    const uint32_t mesh = queue_.back();
+    queue_.pop_back();
+    in_flight_[mesh] = true;
+    ++reading_;
+
+    lock.unlock();
+    MeshData mesh_data;
+    const bool ok = cache_->read(mesh, &mesh_data);
+    lock.lock();
+
+    --reading_;
+    // a mesh that failed to load stays in flight, so it is not requested
+    // again
+    if(ok) {
+      loaded_.emplace_back(mesh, std::move(mesh_data));
+      ++loads_;
+    }
+  }
+}
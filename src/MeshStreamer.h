@@ -0,0 +1,124 @@
+#ifndef SHIFT_GUI_MESHSTREAMER_H_
+#define SHIFT_GUI_MESHSTREAMER_H_
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "vulkan-engine/MeshCache.h"
+#include "vulkan-engine/MeshData.h"
+
+namespace vulkan_engine {
+
+/*! Streams meshes of a MeshCache in and out of GPU memory within a budget.
+
+ Every frame the render thread reports the meshes it draws with use():
+ meshes that are resident are moved to the front of an LRU list, the others
+ are requested with a priority. endFrame() replaces the queue of the I/O
+ threads with the requests of that frame, highest priority first, so meshes
+ that went out of view are not loaded anymore. Loaded meshes are handed
+ back through takeLoaded() and made resident with makeResident(), which
+ evicts the least recently used meshes to stay within the budget. Only
+ meshes that were not used in the last retire frames are evicted, e.g. not
+ the ones drawn by the frame being recorded. The streamer only does the
+ bookkeeping, it never touches the GPU. */
+class MeshStreamer {
+public:
+  struct Stats {
+    uint64_t budget = 0;         // bytes
+    uint64_t resident_bytes = 0;
+    size_t resident_meshes = 0;
+    size_t pending = 0; // requested, loading or loaded but not resident
+    uint64_t loads = 0;
+    uint64_t evictions = 0;
+    uint64_t rejected = 0; // loaded but did not fit into the budget
+  };
+
+  /*! Starts io_threads threads reading from cache, which has to outlive
+   the streamer. */
+  MeshStreamer(const MeshCache* cache, int io_threads = 2);
+  ~MeshStreamer();
+
+  MeshStreamer(const MeshStreamer&) = delete;
+  MeshStreamer& operator=(const MeshStreamer&) = delete;
+
+  inline const MeshCache* cache() const {
+    return cache_;
+  }
+
+  void setBudget(uint64_t bytes);
+
+  inline bool resident(uint32_t mesh) const {
+    return meshes_[mesh].resident;
+  }
+
+  /*! Starts collecting the requests of frame. */
+  void beginFrame(uint64_t frame);
+
+  /*! Marks mesh as drawn in the current frame. priority is only used if the
+   mesh is not resident, the maximum over all uses of a frame counts. */
+  void use(uint32_t mesh, float priority);
+
+  /*! Hands the requests of the frame to the I/O threads. */
+  void endFrame();
+
+  /*! Pops a mesh read by the I/O threads, false if there is none. */
+  bool takeLoaded(uint32_t* mesh, MeshData* mesh_data);
+
+  /*! Accounts bytes for a loaded mesh, evicting least recently used meshes
+   not used within the last retire frames into evicted. Returns false, with
+   nothing evicted, if the mesh does not fit; it is requested again after a
+   while then. */
+  bool makeResident(uint32_t mesh, uint64_t bytes, uint64_t retire,
+                    std::vector<uint32_t>* evicted);
+
+  /*! Forgets all residency, e.g. once the engine freed all mesh buffers. */
+  void reset();
+
+  /*! Whether meshes are queued, being read or loaded but not taken. */
+  bool pending() const;
+
+  Stats stats() const;
+
+private:
+  struct MeshState {
+    bool resident = false;
+    uint64_t bytes = 0;
+    uint64_t last_used = 0;
+    uint64_t retry_frame = 0;
+    int request = -1; // index into requests_ in the current frame
+    std::list<uint32_t>::iterator lru;
+  };
+
+  void run();
+
+  const MeshCache* cache_;
+  std::vector<MeshState> meshes_; // render thread only
+  std::list<uint32_t> lru_;       // most recently used first
+  std::vector<std::pair<float, uint32_t>> requests_;
+  uint64_t frame_ = 0;
+  uint64_t budget_ = UINT64_MAX;
+  uint64_t resident_bytes_ = 0;
+  size_t resident_count_ = 0;
+  uint64_t evictions_ = 0;
+  uint64_t rejected_ = 0;
+
+  mutable std::mutex mutex_;
+  std::condition_variable wake_;
+  std::vector<uint32_t> queue_;   // highest priority last
+  std::vector<bool> in_flight_;   // being read or in loaded_
+  std::deque<std::pair<uint32_t, MeshData>> loaded_;
+  uint64_t loads_ = 0;
+  size_t reading_ = 0;
+  bool quit_ = false;
+  std::vector<std::thread> threads_;
+};
+
+}
+
+#endif
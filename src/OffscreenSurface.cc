@@ -0,0 +1,616 @@
+#include "vulkan-engine/OffscreenSurface.h"
+
+#include <cstring>
+
+#include <QVersionNumber>
+#include <QVulkanFunctions>
+
+static uint32_t findMemoryType(const VkPhysicalDeviceMemoryProperties& props,
+                               uint32_t type_bits,
+                               VkMemoryPropertyFlags flags) {
+  for(uint32_t i = 0; i < props.memoryTypeCount; ++i) {
+    if((type_bits & (1u << i)) &&
+       (props.memoryTypes[i].propertyFlags & flags) == flags) {
+      return i;
+    }
+  }
+  return UINT32_MAX;
+}
+
+vulkan_engine::OffscreenSurface::OffscreenSurface(QVulkanInstance* inst,
+                                                  const QSize& size,
+                                                  int sample_count)
+  : inst_(inst)
+  , size_(size) {
+  memset(&physical_device_properties_, 0, sizeof(physical_device_properties_));
+  switch(sample_count) {
+    case 2:
+      sample_count_ = VK_SAMPLE_COUNT_2_BIT;
+      break;
+    case 4:
+      sample_count_ = VK_SAMPLE_COUNT_4_BIT;
+      break;
+    case 8:
+      sample_count_ = VK_SAMPLE_COUNT_8_BIT;
+      break;
+    case 16:
+      sample_count_ = VK_SAMPLE_COUNT_16_BIT;
+      break;
+    default:
+      sample_count_ = VK_SAMPLE_COUNT_1_BIT;
+      break;
+  }
+}
+
+vulkan_engine::OffscreenSurface::~OffscreenSurface() {
+  destroy();
+}
+
+bool vulkan_engine::OffscreenSurface::queryDescriptorIndexing(
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT* enabled) {
+  QVulkanFunctions* f = inst_->functions();
+
+  uint32_t count = 0;
+  f->vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &count,
+                                          nullptr);
+  QVector<VkExtensionProperties> properties(count);
+  f->vkEnumerateDeviceExtensionProperties(physical_device_, nullptr, &count,
+                                          properties.data());
+  int found = 0;
+  for(const VkExtensionProperties& extension : properties) {
+    if(strcmp(extension.extensionName,
+              VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME) == 0 ||
+       strcmp(extension.extensionName, VK_KHR_MAINTENANCE3_EXTENSION_NAME) ==
+         0) {
+      ++found;
+    }
+  }
+
+  // the features are queried through the Vulkan 1.1 entry point or its
+  // extension, whichever the instance has
+  PFN_vkGetPhysicalDeviceFeatures2KHR get_features2 = nullptr;
+  if(inst_->apiVersion() >= QVersionNumber(1, 1)) {
+    get_features2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+      inst_->getInstanceProcAddr("vkGetPhysicalDeviceFeatures2"));
+  } else if(inst_->extensions().contains(
+              VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME)) {
+    get_features2 = reinterpret_cast<PFN_vkGetPhysicalDeviceFeatures2KHR>(
+      inst_->getInstanceProcAddr("vkGetPhysicalDeviceFeatures2KHR"));
+  }
+  if(found < 2 || !get_features2) {
+    return false;
+  }
+
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT supported;
+  memset(&supported, 0, sizeof(supported));
+  supported.sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  VkPhysicalDeviceFeatures2KHR features2;
+  memset(&features2, 0, sizeof(features2));
+  features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2_KHR;
+  features2.pNext = &supported;
+  get_features2(physical_device_, &features2);
+  if(!supported.shaderSampledImageArrayNonUniformIndexing ||
+     !supported.descriptorBindingSampledImageUpdateAfterBind ||
+     !supported.descriptorBindingUpdateUnusedWhilePending ||
+     !supported.descriptorBindingPartiallyBound) {
+    return false;
+  }
+
+  memset(enabled, 0, sizeof(*enabled));
+  enabled->sType =
+    VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DESCRIPTOR_INDEXING_FEATURES_EXT;
+  enabled->shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  enabled->descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+  enabled->descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+  enabled->descriptorBindingPartiallyBound = VK_TRUE;
+  return true;
+}
+
+void vulkan_engine::OffscreenSurface::create() {
+  QVulkanFunctions* f = inst_->functions();
+
+  uint32_t device_count = 0;
+  f->vkEnumeratePhysicalDevices(inst_->vkInstance(), &device_count, nullptr);
+  if(device_count == 0) {
+    qFatal("No Vulkan physical device available");
+  }
+  QVector<VkPhysicalDevice> physical_devices(device_count);
+  f->vkEnumeratePhysicalDevices(inst_->vkInstance(), &device_count,
+                                physical_devices.data());
+  physical_device_ = physical_devices[0];
+  f->vkGetPhysicalDeviceProperties(physical_device_,
+                                   &physical_device_properties_);
+
+  uint32_t family_count = 0;
+  f->vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &family_count,
+                                              nullptr);
+  QVector<VkQueueFamilyProperties> families(family_count);
+  f->vkGetPhysicalDeviceQueueFamilyProperties(physical_device_, &family_count,
+                                              families.data());
+  graphics_queue_family_index_ = UINT32_MAX;
+  for(uint32_t i = 0; i < family_count; ++i) {
+    if(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) {
+      graphics_queue_family_index_ = i;
+      timestamps_supported_ = families[i].timestampValidBits > 0;
+      break;
+    }
+  }
+  if(graphics_queue_family_index_ == UINT32_MAX) {
+    qFatal("No graphics queue family available");
+  }
+
+  // plus a queue of a compute-only family for asynchronous compute
+  const float priority = 1.0f;
+  VkDeviceQueueCreateInfo queue_info[2];
+  memset(queue_info, 0, sizeof(queue_info));
+  queue_info[0].sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+  queue_info[0].queueFamilyIndex = graphics_queue_family_index_;
+  queue_info[0].queueCount = 1;
+  queue_info[0].pQueuePriorities = &priority;
+  compute_queue_family_index_ =
+    asyncComputeQueueFamily(families.constData(), family_count);
+  queue_info[1] = queue_info[0];
+  queue_info[1].queueFamilyIndex = compute_queue_family_index_;
+
+  // block compressed and bindless textures and the geometry shader of the
+  // wireframe overlay, as QVulkanWindow enables them too
+  VkPhysicalDeviceFeatures supported;
+  f->vkGetPhysicalDeviceFeatures(physical_device_, &supported);
+  VkPhysicalDeviceFeatures features;
+  memset(&features, 0, sizeof(features));
+  features.textureCompressionBC = supported.textureCompressionBC;
+  features.shaderSampledImageArrayDynamicIndexing =
+    supported.shaderSampledImageArrayDynamicIndexing;
+  features.geometryShader = supported.geometryShader;
+
+  VkPhysicalDeviceDescriptorIndexingFeaturesEXT indexing;
+  descriptor_indexing_ = queryDescriptorIndexing(&indexing);
+  QVector<const char*> extensions;
+  if(descriptor_indexing_) {
+    extensions.append(VK_KHR_MAINTENANCE3_EXTENSION_NAME);
+    extensions.append(VK_EXT_DESCRIPTOR_INDEXING_EXTENSION_NAME);
+  }
+
+  VkDeviceCreateInfo device_info;
+  memset(&device_info, 0, sizeof(device_info));
+  device_info.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
+  device_info.pNext = descriptor_indexing_ ? &indexing : nullptr;
+  device_info.queueCreateInfoCount =
+    compute_queue_family_index_ != UINT32_MAX ? 2 : 1;
+  device_info.pQueueCreateInfos = queue_info;
+  device_info.enabledExtensionCount = extensions.size();
+  device_info.ppEnabledExtensionNames = extensions.constData();
+  device_info.pEnabledFeatures = &features;
+  VkResult err =
+    f->vkCreateDevice(physical_device_, &device_info, nullptr, &device_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create device: %d", err);
+  }
+  funcs_ = inst_->deviceFunctions(device_);
+  funcs_->vkGetDeviceQueue(device_, graphics_queue_family_index_, 0,
+                           &graphics_queue_);
+  if(compute_queue_family_index_ != UINT32_MAX) {
+    funcs_->vkGetDeviceQueue(device_, compute_queue_family_index_, 0,
+                             &compute_queue_);
+  }
+
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  f->vkGetPhysicalDeviceMemoryProperties(physical_device_, &memory_properties);
+  host_visible_memory_index_ = findMemoryType(
+    memory_properties, UINT32_MAX,
+    VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  device_local_memory_index_ = findMemoryType(
+    memory_properties, UINT32_MAX, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  if(device_local_memory_index_ == UINT32_MAX) {
+    device_local_memory_index_ = host_visible_memory_index_;
+  }
+
+  const VkFormat depth_formats[] = {VK_FORMAT_D24_UNORM_S8_UINT,
+                                    VK_FORMAT_D32_SFLOAT_S8_UINT,
+                                    VK_FORMAT_D16_UNORM_S8_UINT};
+  for(VkFormat format : depth_formats) {
+    VkFormatProperties format_properties;
+    f->vkGetPhysicalDeviceFormatProperties(physical_device_, format,
+                                           &format_properties);
+    if(format_properties.optimalTilingFeatures &
+       VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT) {
+      depth_stencil_format_ = format;
+      break;
+    }
+  }
+  if(depth_stencil_format_ == VK_FORMAT_UNDEFINED) {
+    qFatal("No supported depth-stencil format");
+  }
+
+  VkCommandPoolCreateInfo pool_info;
+  memset(&pool_info, 0, sizeof(pool_info));
+  pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  pool_info.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  pool_info.queueFamilyIndex = graphics_queue_family_index_;
+  err = funcs_->vkCreateCommandPool(device_, &pool_info, nullptr,
+                                    &command_pool_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create command pool: %d", err);
+  }
+
+  VkCommandBufferAllocateInfo command_buffer_info = {
+    VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr, command_pool_,
+    VK_COMMAND_BUFFER_LEVEL_PRIMARY, 1};
+  err = funcs_->vkAllocateCommandBuffers(device_, &command_buffer_info,
+                                         &command_buffer_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate command buffer: %d", err);
+  }
+
+  VkFenceCreateInfo fence_info = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, nullptr,
+                                  0};
+  err = funcs_->vkCreateFence(device_, &fence_info, nullptr, &fence_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create fence: %d", err);
+  }
+
+  if(timestamps_supported_) {
+    VkQueryPoolCreateInfo query_info;
+    memset(&query_info, 0, sizeof(query_info));
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = 2;
+    err = funcs_->vkCreateQueryPool(device_, &query_info, nullptr,
+                                    &query_pool_);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create query pool: %d", err);
+    }
+  }
+
+  createRenderPass();
+  createAttachments();
+}
+
+void vulkan_engine::OffscreenSurface::resize(const QSize& size) {
+  if(!device_ || size == size_) {
+    return;
+  }
+  funcs_->vkDeviceWaitIdle(device_);
+  frame_pending_ = false;
+  destroyAttachments();
+  size_ = size;
+  createAttachments();
+}
+
+void vulkan_engine::OffscreenSurface::createAttachments() {
+  createImage(color_format_,
+              VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_TRANSFER_SRC_BIT,
+              VK_SAMPLE_COUNT_1_BIT, VK_IMAGE_ASPECT_COLOR_BIT, &color_image_,
+              &color_memory_, &color_view_);
+  createImage(depth_stencil_format_,
+              VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+                VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+              sample_count_,
+              VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT,
+              &depth_image_, &depth_memory_, &depth_view_);
+  if(sample_count_ > VK_SAMPLE_COUNT_1_BIT) {
+    createImage(color_format_,
+                VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+                  VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT,
+                sample_count_, VK_IMAGE_ASPECT_COLOR_BIT, &msaa_image_,
+                &msaa_memory_, &msaa_view_);
+  }
+
+  VkImageView views[3] = {color_view_, depth_view_, msaa_view_};
+  VkFramebufferCreateInfo framebuffer_info;
+  memset(&framebuffer_info, 0, sizeof(framebuffer_info));
+  framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebuffer_info.renderPass = render_pass_;
+  framebuffer_info.attachmentCount =
+    sample_count_ > VK_SAMPLE_COUNT_1_BIT ? 3 : 2;
+  framebuffer_info.pAttachments = views;
+  framebuffer_info.width = size_.width();
+  framebuffer_info.height = size_.height();
+  framebuffer_info.layers = 1;
+  VkResult err = funcs_->vkCreateFramebuffer(device_, &framebuffer_info,
+                                             nullptr, &framebuffer_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create framebuffer: %d", err);
+  }
+}
+
+void vulkan_engine::OffscreenSurface::createImage(
+  VkFormat format, VkImageUsageFlags usage, VkSampleCountFlagBits samples,
+  VkImageAspectFlags aspect, VkImage* image, VkDeviceMemory* memory,
+  VkImageView* view) {
+  VkImageCreateInfo image_info;
+  memset(&image_info, 0, sizeof(image_info));
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = format;
+  image_info.extent.width = size_.width();
+  image_info.extent.height = size_.height();
+  image_info.extent.depth = 1;
+  image_info.mipLevels = 1;
+  image_info.arrayLayers = 1;
+  image_info.samples = samples;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage = usage;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkResult err = funcs_->vkCreateImage(device_, &image_info, nullptr, image);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create image: %d", err);
+  }
+
+  VkMemoryRequirements memory_requirements;
+  funcs_->vkGetImageMemoryRequirements(device_, *image, &memory_requirements);
+  VkPhysicalDeviceMemoryProperties memory_properties;
+  inst_->functions()->vkGetPhysicalDeviceMemoryProperties(physical_device_,
+                                                          &memory_properties);
+  // attachments that are not stored need no memory on tile-based GPUs
+  const bool transient = usage & VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+  uint32_t memory_index =
+    transient ? findMemoryType(memory_properties,
+                               memory_requirements.memoryTypeBits,
+                               VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+              : UINT32_MAX;
+  const bool lazy = memory_index != UINT32_MAX;
+  if(memory_index == UINT32_MAX) {
+    memory_index =
+      findMemoryType(memory_properties, memory_requirements.memoryTypeBits,
+                     VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  }
+  if(memory_index == UINT32_MAX) {
+    memory_index = findMemoryType(
+      memory_properties, memory_requirements.memoryTypeBits, 0);
+  }
+
+  VkMemoryAllocateInfo memory_alloc_info = {
+    VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, memory_requirements.size,
+    memory_index};
+  err = funcs_->vkAllocateMemory(device_, &memory_alloc_info, nullptr, memory);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate image memory: %d", err);
+  }
+  if(lazy) {
+    lazy_attachment_memory_ += memory_requirements.size;
+  } else {
+    attachment_memory_ += memory_requirements.size;
+  }
+
+  err = funcs_->vkBindImageMemory(device_, *image, *memory, 0);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to bind image memory: %d", err);
+  }
+
+  VkImageViewCreateInfo view_info;
+  memset(&view_info, 0, sizeof(view_info));
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.image = *image;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = format;
+  view_info.subresourceRange.aspectMask = aspect;
+  view_info.subresourceRange.levelCount = 1;
+  view_info.subresourceRange.layerCount = 1;
+  err = funcs_->vkCreateImageView(device_, &view_info, nullptr, view);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create image view: %d", err);
+  }
+}
+
+void vulkan_engine::OffscreenSurface::createRenderPass() {
+  const bool msaa = sample_count_ > VK_SAMPLE_COUNT_1_BIT;
+
+  VkAttachmentDescription attachments[3];
+  memset(attachments, 0, sizeof(attachments));
+
+  attachments[0].format = color_format_;
+  attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[0].loadOp =
+    msaa ? VK_ATTACHMENT_LOAD_OP_DONT_CARE : VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[0].finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+
+  attachments[1].format = depth_stencil_format_;
+  attachments[1].samples = sample_count_;
+  attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  attachments[2].format = color_format_;
+  attachments[2].samples = sample_count_;
+  attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[2].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[2].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference color_ref = {
+    msaa ? 2u : 0u, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference resolve_ref = {
+    0, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depth_ref = {
+    1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpass;
+  memset(&subpass, 0, sizeof(subpass));
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &color_ref;
+  subpass.pResolveAttachments = msaa ? &resolve_ref : nullptr;
+  subpass.pDepthStencilAttachment = &depth_ref;
+
+  // Make the color writes of the render pass visible to transfers reading
+  // back colorImage() afterwards.
+  VkSubpassDependency dependency;
+  memset(&dependency, 0, sizeof(dependency));
+  dependency.srcSubpass = 0;
+  dependency.dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependency.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependency.dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependency.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependency.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  VkRenderPassCreateInfo render_pass_info;
+  memset(&render_pass_info, 0, sizeof(render_pass_info));
+  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  render_pass_info.attachmentCount = msaa ? 3 : 2;
+  render_pass_info.pAttachments = attachments;
+  render_pass_info.subpassCount = 1;
+  render_pass_info.pSubpasses = &subpass;
+  render_pass_info.dependencyCount = 1;
+  render_pass_info.pDependencies = &dependency;
+  VkResult err = funcs_->vkCreateRenderPass(device_, &render_pass_info,
+                                            nullptr, &render_pass_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create render pass: %d", err);
+  }
+}
+
+void vulkan_engine::OffscreenSurface::destroy() {
+  if(!device_) {
+    return;
+  }
+
+  funcs_->vkDeviceWaitIdle(device_);
+  frame_pending_ = false;
+
+  destroyAttachments();
+  if(render_pass_) {
+    funcs_->vkDestroyRenderPass(device_, render_pass_, nullptr);
+    render_pass_ = VK_NULL_HANDLE;
+  }
+
+  if(query_pool_) {
+    funcs_->vkDestroyQueryPool(device_, query_pool_, nullptr);
+    query_pool_ = VK_NULL_HANDLE;
+  }
+
+  if(fence_) {
+    funcs_->vkDestroyFence(device_, fence_, nullptr);
+    fence_ = VK_NULL_HANDLE;
+  }
+
+  if(command_pool_) {
+    funcs_->vkDestroyCommandPool(device_, command_pool_, nullptr);
+    command_pool_ = VK_NULL_HANDLE;
+    command_buffer_ = VK_NULL_HANDLE;
+  }
+
+  inst_->resetDeviceFunctions(device_);
+  funcs_->vkDestroyDevice(device_, nullptr);
+  device_ = VK_NULL_HANDLE;
+  compute_queue_ = VK_NULL_HANDLE;
+  funcs_ = nullptr;
+}
+
+void vulkan_engine::OffscreenSurface::destroyAttachments() {
+  if(framebuffer_) {
+    funcs_->vkDestroyFramebuffer(device_, framebuffer_, nullptr);
+    framebuffer_ = VK_NULL_HANDLE;
+  }
+
+  VkImageView* views[] = {&color_view_, &depth_view_, &msaa_view_};
+  for(VkImageView* view : views) {
+    if(*view) {
+      funcs_->vkDestroyImageView(device_, *view, nullptr);
+      *view = VK_NULL_HANDLE;
+    }
+  }
+
+  VkImage* images[] = {&color_image_, &depth_image_, &msaa_image_};
+  for(VkImage* image : images) {
+    if(*image) {
+      funcs_->vkDestroyImage(device_, *image, nullptr);
+      *image = VK_NULL_HANDLE;
+    }
+  }
+
+  VkDeviceMemory* memories[] = {&color_memory_, &depth_memory_, &msaa_memory_};
+  for(VkDeviceMemory* memory : memories) {
+    if(*memory) {
+      funcs_->vkFreeMemory(device_, *memory, nullptr);
+      *memory = VK_NULL_HANDLE;
+    }
+  }
+  attachment_memory_ = 0;
+  lazy_attachment_memory_ = 0;
+}
+
+void vulkan_engine::OffscreenSurface::beginFrame() {
+  waitForFrame();
+  update_requested_ = false;
+
+  funcs_->vkResetCommandBuffer(command_buffer_, 0);
+  VkCommandBufferBeginInfo begin_info;
+  memset(&begin_info, 0, sizeof(begin_info));
+  begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+  VkResult err = funcs_->vkBeginCommandBuffer(command_buffer_, &begin_info);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to begin command buffer: %d", err);
+  }
+
+  if(query_pool_) {
+    funcs_->vkCmdResetQueryPool(command_buffer_, query_pool_, 0, 2);
+    funcs_->vkCmdWriteTimestamp(command_buffer_,
+                                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, query_pool_,
+                                0);
+  }
+}
+
+void vulkan_engine::OffscreenSurface::frameReady() {
+  if(query_pool_) {
+    funcs_->vkCmdWriteTimestamp(command_buffer_,
+                                VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                query_pool_, 1);
+  }
+
+  VkResult err = funcs_->vkEndCommandBuffer(command_buffer_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to end command buffer: %d", err);
+  }
+
+  VkSubmitInfo submit_info;
+  memset(&submit_info, 0, sizeof(submit_info));
+  submit_info.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submit_info.commandBufferCount = 1;
+  submit_info.pCommandBuffers = &command_buffer_;
+  err = funcs_->vkQueueSubmit(graphics_queue_, 1, &submit_info, fence_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to submit frame: %d", err);
+  }
+  frame_pending_ = true;
+}
+
+void vulkan_engine::OffscreenSurface::waitForFrame() {
+  if(!frame_pending_) {
+    return;
+  }
+
+  funcs_->vkWaitForFences(device_, 1, &fence_, VK_TRUE, UINT64_MAX);
+  funcs_->vkResetFences(device_, 1, &fence_);
+  frame_pending_ = false;
+
+  if(query_pool_) {
+    quint64 timestamps[2] = {0, 0};
+    VkResult err = funcs_->vkGetQueryPoolResults(
+      device_, query_pool_, 0, 2, sizeof(timestamps), timestamps,
+      sizeof(quint64), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT);
+    if(err == VK_SUCCESS) {
+      gpu_time_ = (timestamps[1] - timestamps[0]) *
+                  physical_device_properties_.limits.timestampPeriod * 1e-6;
+    }
+  }
+}
+
+QMatrix4x4 vulkan_engine::OffscreenSurface::clipCorrectionMatrix() {
+  // same correction as QVulkanWindow::clipCorrectionMatrix()
+  return QMatrix4x4(1.0f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 0.0f,
+                    0.0f, 0.5f, 0.5f, 0.0f, 0.0f, 0.0f, 1.0f);
+}
@@ -0,0 +1,212 @@
+#ifndef SHIFT_GUI_OFFSCREENSURFACE_H_
+#define SHIFT_GUI_OFFSCREENSURFACE_H_
+
+#include <atomic>
+
+#include "vulkan-engine/RenderSurface.h"
+
+namespace vulkan_engine {
+
+/*! Headless render surface. Creates its own logical device and renders into
+ a single color/depth framebuffer instead of a swapchain, so the engine can
+ run without a visible window (benchmarks, batch exports).
+
+ The render pass matches the layout of QVulkanWindow::defaultRenderPass():
+ attachment 0 is the single-sample color image, attachment 1 depth/stencil
+ and, when multisampling, attachment 2 the multisample color image which is
+ resolved into attachment 0. Depth and multisample color never leave the
+ render pass and are lazily allocated where the device supports it.
+
+ A single frame is in flight at a time: frameReady() submits the command
+ buffer and the next beginFrame() (or waitForFrame()) waits for it to
+ complete. The GPU time of every frame is measured with a pair of timestamp
+ queries. */
+class OffscreenSurface : public RenderSurface {
+public:
+  OffscreenSurface(QVulkanInstance* inst, const QSize& size,
+                   int sample_count = 1);
+  ~OffscreenSurface();
+
+  void create();
+  void destroy();
+
+  /*! Begins recording the command buffer of the next frame. Must be called
+   before the renderer's startNextFrame(). */
+  void beginFrame();
+
+  /*! Blocks until the last submitted frame has completed. */
+  void waitForFrame();
+
+  /*! Recreates the attachments at size once the device is idle, as a
+   window does with its swap chain: the renderer's swap chain resources are
+   to be released before and initialized again after. */
+  void resize(const QSize& size);
+
+  inline VkImage colorImage() const {
+    return color_image_;
+  }
+
+  /*! Layout of colorImage() once a frame has completed. */
+  inline VkImageLayout colorImageLayout() const {
+    return VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  }
+
+  /*! GPU execution time of the last completed frame in milliseconds, or a
+   negative value if the queue does not support timestamps. */
+  inline double lastGpuTime() const {
+    return gpu_time_;
+  }
+
+  inline bool updateRequested() const {
+    return update_requested_;
+  }
+
+  /*! Device memory allocated for the attachments, in bytes, without the
+   lazily allocated ones. */
+  inline VkDeviceSize attachmentMemory() const {
+    return attachment_memory_;
+  }
+
+  /*! Lazily allocated memory of the attachments, which the device commits
+   only if it needs to. */
+  inline VkDeviceSize lazyAttachmentMemory() const {
+    return lazy_attachment_memory_;
+  }
+
+  QVulkanInstance* vulkanInstance() const override {
+    return inst_;
+  }
+  VkPhysicalDevice physicalDevice() const override {
+    return physical_device_;
+  }
+  const VkPhysicalDeviceProperties* physicalDeviceProperties() const override {
+    return &physical_device_properties_;
+  }
+  VkDevice device() const override {
+    return device_;
+  }
+  VkQueue graphicsQueue() const override {
+    return graphics_queue_;
+  }
+  uint32_t graphicsQueueFamilyIndex() const override {
+    return graphics_queue_family_index_;
+  }
+  VkCommandPool graphicsCommandPool() const override {
+    return command_pool_;
+  }
+  uint32_t hostVisibleMemoryIndex() const override {
+    return host_visible_memory_index_;
+  }
+  uint32_t deviceLocalMemoryIndex() const override {
+    return device_local_memory_index_;
+  }
+  VkRenderPass defaultRenderPass() const override {
+    return render_pass_;
+  }
+  VkFormat colorFormat() const override {
+    return color_format_;
+  }
+  VkFormat depthStencilFormat() const override {
+    return depth_stencil_format_;
+  }
+  VkSampleCountFlagBits sampleCountFlagBits() const override {
+    return sample_count_;
+  }
+  int concurrentFrameCount() const override {
+    return 1;
+  }
+  int currentFrame() const override {
+    return 0;
+  }
+  VkCommandBuffer currentCommandBuffer() const override {
+    return command_buffer_;
+  }
+  VkFramebuffer currentFramebuffer() const override {
+    return framebuffer_;
+  }
+  VkImageView currentSwapChainImageView() const override {
+    return color_view_;
+  }
+  VkImage currentSwapChainImage() const override {
+    return color_image_;
+  }
+  VkImageLayout swapChainImageLayout() const override {
+    return colorImageLayout();
+  }
+  QSize swapChainImageSize() const override {
+    return size_;
+  }
+  QMatrix4x4 clipCorrectionMatrix() override;
+
+  void frameReady() override;
+  void requestUpdate() override {
+    update_requested_ = true;
+  }
+  bool descriptorIndexing() const override {
+    return descriptor_indexing_;
+  }
+  VkQueue computeQueue() const override {
+    return compute_queue_;
+  }
+  uint32_t computeQueueFamilyIndex() const override {
+    return compute_queue_ ? compute_queue_family_index_
+                          : graphics_queue_family_index_;
+  }
+
+private:
+  void createImage(VkFormat format, VkImageUsageFlags usage,
+                   VkSampleCountFlagBits samples, VkImageAspectFlags aspect,
+                   VkImage* image, VkDeviceMemory* memory, VkImageView* view);
+  void createRenderPass();
+  void createAttachments();
+  void destroyAttachments();
+  bool queryDescriptorIndexing(
+    VkPhysicalDeviceDescriptorIndexingFeaturesEXT* enabled);
+
+  QVulkanInstance* inst_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+  QSize size_;
+  VkSampleCountFlagBits sample_count_ = VK_SAMPLE_COUNT_1_BIT;
+
+  VkPhysicalDevice physical_device_ = VK_NULL_HANDLE;
+  VkPhysicalDeviceProperties physical_device_properties_;
+  VkDevice device_ = VK_NULL_HANDLE;
+  VkQueue graphics_queue_ = VK_NULL_HANDLE;
+  uint32_t graphics_queue_family_index_ = 0;
+  VkQueue compute_queue_ = VK_NULL_HANDLE; // of a compute-only family
+  uint32_t compute_queue_family_index_ = UINT32_MAX;
+  uint32_t host_visible_memory_index_ = 0;
+  uint32_t device_local_memory_index_ = 0;
+  bool timestamps_supported_ = false;
+  bool descriptor_indexing_ = false;
+
+  VkCommandPool command_pool_ = VK_NULL_HANDLE;
+  VkCommandBuffer command_buffer_ = VK_NULL_HANDLE;
+  VkFence fence_ = VK_NULL_HANDLE;
+  VkQueryPool query_pool_ = VK_NULL_HANDLE;
+
+  VkFormat color_format_ = VK_FORMAT_B8G8R8A8_UNORM;
+  VkFormat depth_stencil_format_ = VK_FORMAT_UNDEFINED;
+  VkImage color_image_ = VK_NULL_HANDLE;
+  VkDeviceMemory color_memory_ = VK_NULL_HANDLE;
+  VkImageView color_view_ = VK_NULL_HANDLE;
+  VkImage msaa_image_ = VK_NULL_HANDLE;
+  VkDeviceMemory msaa_memory_ = VK_NULL_HANDLE;
+  VkImageView msaa_view_ = VK_NULL_HANDLE;
+  VkImage depth_image_ = VK_NULL_HANDLE;
+  VkDeviceMemory depth_memory_ = VK_NULL_HANDLE;
+  VkImageView depth_view_ = VK_NULL_HANDLE;
+  VkDeviceSize attachment_memory_ = 0;
+  VkDeviceSize lazy_attachment_memory_ = 0;
+
+  VkRenderPass render_pass_ = VK_NULL_HANDLE;
+  VkFramebuffer framebuffer_ = VK_NULL_HANDLE;
+
+  double gpu_time_ = -1.0;
+  bool frame_pending_ = false;
+  std::atomic<bool> update_requested_{false};
+};
+
+}
+
+#endif
@@ -11,12 +11,54 @@ QMatrix4x4 getRotation(QMatrix4x4& mat) {
   return rotation;
 }
 
+vulkan_engine::OrbitalCamera::OrbitalCamera(VulkanEngine* engine) {
+  engine_ = engine;
+  view_.setToIdentity();
+  setLookAt(QVector3D(-2.0, -2.0, -2.0), QVector3D(0.0, 0.0, 0.0),
+            QVector3D(0.0, 0.0, -1.0));
+  if(engine_) {
+    engine_->setInputFunction([this]() { applyInput(); });
+  }
+}
+
+vulkan_engine::OrbitalCamera::~OrbitalCamera() {
+  if(engine_) {
+    engine_->setInputFunction(VulkanEngine::InputFunction());
+  }
+}
+
 void vulkan_engine::OrbitalCamera::wheelEvent(QWheelEvent* ev) {
-  float delta = ev->angleDelta().y() / 1000.f;
-  QVector3D temp = view_.transposed().column(2).toVector3D() * delta;
-  camera_distance_ += delta;
-  view_.translate(temp);
-  update();
+  wheel_delta_ += ev->angleDelta().y() / 1000.f;
+  inputReceived();
+}
+
+void vulkan_engine::OrbitalCamera::inputReceived() {
+  if(!input_pending_) {
+    input_pending_ = true;
+    input_time_ = std::chrono::steady_clock::now();
+  }
+  if(engine_) {
+    engine_->invalidate();
+  }
+}
+
+void vulkan_engine::OrbitalCamera::applyInput() {
+  if(!input_pending_) {
+    return;
+  }
+  input_pending_ = false;
+  if(wheel_delta_ != 0.0f) {
+    QVector3D temp = view_.transposed().column(2).toVector3D() * wheel_delta_;
+    camera_distance_ += wheel_delta_;
+    view_.translate(temp);
+    wheel_delta_ = 0.0f;
+  }
+  // one step from the position of the last frame to the latest one
+  move();
+  setOldPoint(new_point_);
+  if(engine_) {
+    engine_->setViewMatrix(view_, input_time_);
+  }
 }
 
 void vulkan_engine::OrbitalCamera::setLookAt(const QVector3D& pos, const QVector3D& to,
@@ -27,6 +69,8 @@ void vulkan_engine::OrbitalCamera::setLookAt(const QVector3D& pos, const QVector
 }
 
 void vulkan_engine::OrbitalCamera::mousePressEvent(QMouseEvent* ev) {
+  // what the previous drag still moved belongs to its mode
+  applyInput();
   setOldPoint(ev->pos());
   setNewPoint(ev->pos());
   switch(ev->button()) {
@@ -48,6 +92,14 @@ void vulkan_engine::OrbitalCamera::mousePressEvent(QMouseEvent* ev) {
 }
 
 void vulkan_engine::OrbitalCamera::update() {
+  move();
+  // the engine only schedules a frame if the view actually changed
+  if(engine_) {
+    engine_->setViewMatrix(view_);
+  }
+}
+
+void vulkan_engine::OrbitalCamera::move() {
   switch(mode_) {
     case OrbitalCameraMode::Translate: {
       updateTranslate();
@@ -68,11 +120,13 @@ void vulkan_engine::OrbitalCamera::update() {
 
 void vulkan_engine::OrbitalCamera::mouseMoveEvent(QMouseEvent* ev) {
   setNewPoint(ev->pos());
-  update();
-  setOldPoint(ev->pos());
+  if(mode_ != OrbitalCameraMode::None) {
+    inputReceived();
+  }
 }
 
 void vulkan_engine::OrbitalCamera::mouseReleaseEvent(QMouseEvent*) {
+  applyInput();
   setMode(OrbitalCameraMode::None);
 }
 
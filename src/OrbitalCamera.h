@@ -1,6 +1,7 @@
 #ifndef SHIFT_GUI_ORBITALCAMERA_H_
 #define SHIFT_GUI_ORBITALCAMERA_H_
 
+#include <chrono>
 #include <cmath>
 
 #include <QtGui/qevent.h>
@@ -19,15 +20,18 @@ enum class OrbitalCameraMode : int {
   Scale = 0x04
 };
 
+/*! Moves the view of an engine with the mouse.
+
+ Mouse and wheel events only accumulate: the engine calls applyInput()
+ once per frame through its input function, which updates the view from
+ the latest mouse position and the wheel steps since the last frame, and
+ passes on the time of the oldest event for the latency measurement. Events
+ and frames are expected on the same thread, as with QVulkanWindow. */
 class OrbitalCamera {
 
 public:
-  OrbitalCamera(VulkanEngine* engine) {
-    engine_ = engine;
-    view_.setToIdentity();
-    setLookAt(QVector3D(-2.0, -2.0, -2.0), QVector3D(0.0, 0.0, 0.0),
-              QVector3D(0.0, 0.0, -1.0));
-  }
+  OrbitalCamera(VulkanEngine* engine);
+  ~OrbitalCamera();
 
   void setLookAt(const QVector3D& pos, const QVector3D& to,
                  const QVector3D& up);
@@ -38,6 +42,9 @@ public:
 
   void update();
 
+  /*! Applies the input accumulated since the last call, if any. */
+  void applyInput();
+
   inline QMatrix4x4 getViewMatrix() const {
     return view_;
   }
@@ -75,6 +82,8 @@ private:
   void updateTranslate();
   void updateRotate();
   void updateScale();
+  void move();
+  void inputReceived();
 
   VulkanEngine* engine_ = nullptr;
   QMatrix4x4 view_;
@@ -84,6 +93,11 @@ private:
 
   OrbitalCameraMode mode_ = OrbitalCameraMode::None;
 
+  // input not applied yet, since input_time_
+  bool input_pending_ = false;
+  std::chrono::steady_clock::time_point input_time_;
+  float wheel_delta_ = 0.0f;
+
   float camera_distance_ = 3.0;
 };
 
@@ -0,0 +1,856 @@
+#include "vulkan-engine/RenderGraph.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+
+namespace {
+
+// the usage TRANSIENT_ATTACHMENT can be combined with
+const VkImageUsageFlags ATTACHMENT_USAGE =
+  VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT |
+  VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT |
+  VK_IMAGE_USAGE_INPUT_ATTACHMENT_BIT;
+
+// Swap chain images are drawn into in turn, so framebuffers are kept for
+// more frames than there are in flight before they are retired.
+const uint64_t FRAMEBUFFER_FRAMES = 8;
+
+const VkAccessFlags WRITE_ACCESS =
+  VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT |
+  VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+  VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+
+// what an access of the graph means for Vulkan
+struct AccessInfo {
+  uint32_t access;
+  const char* name;
+  VkPipelineStageFlags stages;
+  VkAccessFlags access_mask;
+  VkImageLayout layout; // of images, UNDEFINED for buffer only accesses
+  VkImageUsageFlags usage;
+};
+
+const AccessInfo ACCESS_INFO[] = {
+  {vulkan_engine::RenderGraph::TRANSFER_READ, "transfer read",
+   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT},
+  {vulkan_engine::RenderGraph::TRANSFER_WRITE, "transfer write",
+   VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_WRITE_BIT,
+   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_DST_BIT},
+  {vulkan_engine::RenderGraph::INDEX_READ, "index read",
+   VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT,
+   VK_IMAGE_LAYOUT_UNDEFINED, 0},
+  {vulkan_engine::RenderGraph::VERTEX_SHADER_READ, "vertex shader read",
+   VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT},
+  {vulkan_engine::RenderGraph::FRAGMENT_SHADER_READ, "fragment shader read",
+   VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT},
+  {vulkan_engine::RenderGraph::COMPUTE_SHADER_READ, "compute shader read",
+   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT,
+   VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_USAGE_SAMPLED_BIT},
+  {vulkan_engine::RenderGraph::COMPUTE_SHADER_WRITE, "compute shader write",
+   VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_WRITE_BIT,
+   VK_IMAGE_LAYOUT_GENERAL, VK_IMAGE_USAGE_STORAGE_BIT},
+  {vulkan_engine::RenderGraph::COLOR_ATTACHMENT_WRITE,
+   "color attachment write", VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+   VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+   VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
+   VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT},
+  {vulkan_engine::RenderGraph::DEPTH_ATTACHMENT_WRITE,
+   "depth attachment write",
+   VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT |
+     VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+   VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT |
+     VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
+   VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL,
+   VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT},
+  {vulkan_engine::RenderGraph::INDIRECT_READ, "indirect read",
+   VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT,
+   VK_IMAGE_LAYOUT_UNDEFINED, 0}};
+
+/*! Combines the accesses in access, an image used in different layouts by
+ the same pass is in GENERAL layout. */
+AccessInfo accessInfo(uint32_t access) {
+  AccessInfo info = {access, "", 0, 0, VK_IMAGE_LAYOUT_UNDEFINED, 0};
+  for(const AccessInfo& bit : ACCESS_INFO) {
+    if(!(access & bit.access)) {
+      continue;
+    }
+    info.stages |= bit.stages;
+    info.access_mask |= bit.access_mask;
+    info.usage |= bit.usage;
+    if(bit.layout != VK_IMAGE_LAYOUT_UNDEFINED) {
+      info.layout = info.layout == VK_IMAGE_LAYOUT_UNDEFINED ||
+                        info.layout == bit.layout
+                      ? bit.layout
+                      : VK_IMAGE_LAYOUT_GENERAL;
+    }
+  }
+  return info;
+}
+
+std::string accessNames(uint32_t access) {
+  std::string names;
+  for(const AccessInfo& bit : ACCESS_INFO) {
+    if(access & bit.access) {
+      names += names.empty() ? bit.name : std::string(", ") + bit.name;
+    }
+  }
+  return names;
+}
+
+bool sameImage(const vulkan_engine::RenderGraph::ImageDesc& a,
+               const vulkan_engine::RenderGraph::ImageDesc& b) {
+  return a.size == b.size && a.format == b.format && a.aspect == b.aspect &&
+         a.samples == b.samples && a.lazy == b.lazy;
+}
+
+}
+
+void vulkan_engine::RenderGraph::init(RenderSurface* surface,
+                                      QVulkanDeviceFunctions* funcs,
+                                      DeletionQueue* deletion_queue) {
+  surface_ = surface;
+  funcs_ = funcs;
+  deletion_queue_ = deletion_queue;
+  surface->vulkanInstance()->functions()->vkGetPhysicalDeviceMemoryProperties(
+    surface->physicalDevice(), &memory_properties_);
+}
+
+void vulkan_engine::RenderGraph::release() {
+  if(!funcs_) {
+    return;
+  }
+  releaseImages();
+  clear();
+  funcs_ = nullptr;
+}
+
+void vulkan_engine::RenderGraph::releaseImages() {
+  if(!funcs_) {
+    return;
+  }
+  destroyFramebuffers(true, frame_);
+  destroyTransients(&transients_, &slots_);
+  for(ResourceNode& node : resources_) {
+    node.transient = SIZE_MAX;
+  }
+  buffer_states_.clear();
+  image_states_.clear();
+}
+
+void vulkan_engine::RenderGraph::releaseFramebuffers() {
+  if(!funcs_) {
+    return;
+  }
+  destroyFramebuffers(true, frame_);
+  idle_ = true;
+}
+
+void vulkan_engine::RenderGraph::clear() {
+  resources_.clear();
+  passes_.clear();
+}
+
+vulkan_engine::RenderGraph::Resource
+vulkan_engine::RenderGraph::addResource(const std::string& name, Kind kind) {
+  ResourceNode node;
+  node.name = name;
+  node.kind = kind;
+  resources_.push_back(node);
+  return resources_.size() - 1;
+}
+
+vulkan_engine::RenderGraph::Resource
+vulkan_engine::RenderGraph::importBuffer(const std::string& name,
+                                         VkBuffer buffer) {
+  const Resource resource = addResource(name, BUFFER);
+  resources_[resource].buffer = buffer;
+  return resource;
+}
+
+vulkan_engine::RenderGraph::Resource vulkan_engine::RenderGraph::importImage(
+  const std::string& name, VkImage image, VkImageView view,
+  VkImageAspectFlags aspect, bool preserve) {
+  const Resource resource = addResource(name, IMAGE);
+  ResourceNode& node = resources_[resource];
+  node.image = image;
+  node.view = view;
+  node.aspect = aspect;
+  node.preserve = preserve;
+  return resource;
+}
+
+vulkan_engine::RenderGraph::Resource
+vulkan_engine::RenderGraph::createImage(const std::string& name,
+                                        const ImageDesc& desc) {
+  const Resource resource = addResource(name, TRANSIENT);
+  ResourceNode& node = resources_[resource];
+  node.desc = desc;
+  node.aspect = desc.aspect;
+  node.preserve = false;
+  return resource;
+}
+
+vulkan_engine::RenderGraph::Resource
+vulkan_engine::RenderGraph::addVirtual(const std::string& name,
+                                       VkImageView view) {
+  const Resource resource = addResource(name, VIRTUAL);
+  resources_[resource].view = view;
+  return resource;
+}
+
+void vulkan_engine::RenderGraph::markOutput(Resource resource) {
+  resources_[resource].output = true;
+}
+
+vulkan_engine::RenderGraph::Pass vulkan_engine::RenderGraph::addPass(
+  const std::string& name,
+  const std::function<void(VkCommandBuffer)>& record) {
+  PassNode pass;
+  pass.name = name;
+  pass.record = record;
+  passes_.push_back(pass);
+  return passes_.size() - 1;
+}
+
+void vulkan_engine::RenderGraph::read(Pass pass, Resource resource,
+                                      uint32_t access) {
+  use(pass, resource, access, false);
+}
+
+void vulkan_engine::RenderGraph::write(Pass pass, Resource resource,
+                                       uint32_t access) {
+  use(pass, resource, access, true);
+}
+
+void vulkan_engine::RenderGraph::use(Pass pass, Resource resource,
+                                     uint32_t access, bool write) {
+  // a pass using a resource in several ways has one barrier for all of them
+  for(Use& existing : passes_[pass].uses) {
+    if(existing.resource == resource) {
+      existing.access |= access;
+      existing.read = existing.read || !write;
+      existing.write = existing.write || write;
+      return;
+    }
+  }
+  Use use = {resource, access, !write, write};
+  passes_[pass].uses.push_back(use);
+}
+
+void vulkan_engine::RenderGraph::cull() {
+  // Passes writing outputs are kept, and with them every earlier pass
+  // writing what a kept pass reads.
+  for(PassNode& pass : passes_) {
+    pass.culled = true;
+    for(const Use& use : pass.uses) {
+      if(use.write && resources_[use.resource].output) {
+        pass.culled = false;
+      }
+    }
+  }
+  for(size_t p = passes_.size(); p-- > 0;) {
+    if(passes_[p].culled) {
+      continue;
+    }
+    for(const Use& use : passes_[p].uses) {
+      if(!use.read) {
+        continue;
+      }
+      bool written = false;
+      for(size_t q = 0; q < p; ++q) {
+        for(const Use& earlier : passes_[q].uses) {
+          if(earlier.resource == use.resource && earlier.write) {
+            passes_[q].culled = false;
+            written = true;
+          }
+        }
+      }
+      const ResourceNode& node = resources_[use.resource];
+      if(!written && node.kind == TRANSIENT) {
+        qWarning("Pass %s reads %s before it is written",
+                 passes_[p].name.c_str(), node.name.c_str());
+      }
+    }
+  }
+}
+
+void vulkan_engine::RenderGraph::allocateTransients() {
+  for(ResourceNode& node : resources_) {
+    node.first = UINT32_MAX;
+    node.last = 0;
+    node.usage = node.desc.usage;
+    node.transient = SIZE_MAX;
+  }
+  for(size_t p = 0; p < passes_.size(); ++p) {
+    if(passes_[p].culled) {
+      continue;
+    }
+    for(const Use& use : passes_[p].uses) {
+      ResourceNode& node = resources_[use.resource];
+      node.first = std::min(node.first, uint32_t(p));
+      node.last = std::max(node.last, uint32_t(p));
+      node.usage |= accessInfo(use.access).usage;
+    }
+  }
+
+  std::vector<Transient> wanted;
+  for(size_t r = 0; r < resources_.size(); ++r) {
+    ResourceNode& node = resources_[r];
+    if(node.kind != TRANSIENT || node.first == UINT32_MAX) {
+      continue;
+    }
+    Transient transient;
+    transient.desc = node.desc;
+    transient.usage = node.usage;
+    transient.first = node.first;
+    transient.last = node.last;
+    node.transient = wanted.size();
+    wanted.push_back(transient);
+  }
+
+  // The images of the last frame are kept as long as the same ones are
+  // wanted for the same passes, which is the case for most frames.
+  bool same = wanted.size() == transients_.size();
+  for(size_t i = 0; same && i < wanted.size(); ++i) {
+    const Transient& a = wanted[i];
+    const Transient& b = transients_[i];
+    same = sameImage(a.desc, b.desc) && a.usage == b.usage &&
+           a.first == b.first && a.last == b.last;
+  }
+  if(!same && idle_) {
+    // nothing is in flight, the memory of the images replaced is reused
+    recycleTransients(&transients_, &slots_);
+  } else if(!same) {
+    if(!transients_.empty()) {
+      Retired retired;
+      retired.transients.swap(transients_);
+      retired.slots.swap(slots_);
+      VkDeviceSize bytes = 0;
+      for(const Slot& slot : retired.slots) {
+        bytes += slot.size;
+      }
+      deletion_queue_->retire(
+        [this, retired]() mutable {
+          destroyTransients(&retired.transients, &retired.slots);
+        },
+        bytes);
+    }
+    transients_ = wanted;
+    createTransients();
+    std::vector<Transient> none;
+    destroyTransients(&none, &pool_);
+  }
+  idle_ = false;
+}
+
+uint32_t vulkan_engine::RenderGraph::memoryType(uint32_t type_bits,
+                                                bool lazy) const {
+  if(lazy) {
+    for(uint32_t i = 0; i < memory_properties_.memoryTypeCount; ++i) {
+      if((type_bits & (1u << i)) &&
+         (memory_properties_.memoryTypes[i].propertyFlags &
+          VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)) {
+        return i;
+      }
+    }
+  }
+  const uint32_t memory_index = surface_->deviceLocalMemoryIndex();
+  return (type_bits & (1u << memory_index)) ? memory_index : UINT32_MAX;
+}
+
+void vulkan_engine::RenderGraph::createTransients() {
+  VkDevice device = surface_->device();
+
+  for(Transient& transient : transients_) {
+    // lazy images are only possible as attachments
+    VkImageUsageFlags usage = transient.usage;
+    bool lazy = transient.desc.lazy;
+    if(lazy && (usage & ~ATTACHMENT_USAGE)) {
+      qWarning("Transient image used outside of render passes, it is not "
+               "lazily allocated");
+      lazy = false;
+    } else if(lazy) {
+      usage |= VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT;
+    }
+
+    VkImageCreateInfo image_info;
+    memset(&image_info, 0, sizeof(image_info));
+    image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    image_info.imageType = VK_IMAGE_TYPE_2D;
+    image_info.format = transient.desc.format;
+    image_info.extent.width = transient.desc.size.width();
+    image_info.extent.height = transient.desc.size.height();
+    image_info.extent.depth = 1;
+    image_info.mipLevels = 1;
+    image_info.arrayLayers = 1;
+    image_info.samples = transient.desc.samples;
+    image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+    image_info.usage = usage;
+    image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult err =
+      funcs_->vkCreateImage(device, &image_info, nullptr, &transient.image);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create transient image: %d", err);
+    }
+    funcs_->vkGetImageMemoryRequirements(device, transient.image,
+                                         &transient.requirements);
+    transient.memory_type =
+      memoryType(transient.requirements.memoryTypeBits, lazy);
+    if(transient.memory_type == UINT32_MAX) {
+      qFatal("Transient image not supported by device local memory");
+    }
+  }
+
+  // Largest images first, each into the first slot of its memory type
+  // that none of its images is alive in at the same time. All images are
+  // bound at offset 0 of their slot, so its size is that of the largest
+  // one.
+  std::vector<size_t> order(transients_.size());
+  for(size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [this](size_t a, size_t b) {
+    return transients_[a].requirements.size >
+           transients_[b].requirements.size;
+  });
+  slots_.clear();
+  std::vector<std::vector<size_t>> slot_images;
+  for(size_t i : order) {
+    Transient& transient = transients_[i];
+    size_t slot = 0;
+    for(; slot < slot_images.size(); ++slot) {
+      bool overlaps = slots_[slot].memory_type != transient.memory_type;
+      for(size_t other : slot_images[slot]) {
+        const Transient& o = transients_[other];
+        overlaps = overlaps ||
+                   !(o.last < transient.first || transient.last < o.first);
+      }
+      if(!overlaps) {
+        break;
+      }
+    }
+    if(slot == slot_images.size()) {
+      slot_images.push_back(std::vector<size_t>());
+      slots_.push_back(Slot());
+      slots_[slot].memory_type = transient.memory_type;
+      slots_[slot].lazy =
+        (memory_properties_.memoryTypes[transient.memory_type].propertyFlags &
+         VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT) != 0;
+    }
+    slot_images[slot].push_back(i);
+    slots_[slot].size =
+      std::max(slots_[slot].size, transient.requirements.size);
+    transient.slot = slot;
+  }
+
+  for(Slot& slot : slots_) {
+    // the smallest recycled block the slot fits into
+    size_t reuse = pool_.size();
+    for(size_t i = 0; i < pool_.size(); ++i) {
+      if(pool_[i].memory_type == slot.memory_type &&
+         pool_[i].size >= slot.size &&
+         (reuse == pool_.size() || pool_[i].size < pool_[reuse].size)) {
+        reuse = i;
+      }
+    }
+    if(reuse < pool_.size()) {
+      slot.memory = pool_[reuse].memory;
+      slot.size = pool_[reuse].size;
+      stats_.reused_memory += slot.size;
+      pool_.erase(pool_.begin() + reuse);
+      continue;
+    }
+    // Memory replaced because it was too small, typically while a window
+    // is resized, gets a quarter more for the next size.
+    if(!pool_.empty() && !slot.lazy) {
+      slot.size += slot.size / 4;
+    }
+    VkMemoryAllocateInfo memory_alloc_info = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, slot.size,
+      slot.memory_type};
+    VkResult err = funcs_->vkAllocateMemory(device, &memory_alloc_info,
+                                            nullptr, &slot.memory);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to allocate transient image memory: %d", err);
+    }
+  }
+
+  for(Transient& transient : transients_) {
+    VkResult err = funcs_->vkBindImageMemory(
+      device, transient.image, slots_[transient.slot].memory, 0);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to bind transient image memory: %d", err);
+    }
+
+    VkImageViewCreateInfo view_info;
+    memset(&view_info, 0, sizeof(view_info));
+    view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    view_info.image = transient.image;
+    view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    view_info.format = transient.desc.format;
+    view_info.subresourceRange.aspectMask = transient.desc.aspect;
+    view_info.subresourceRange.levelCount = 1;
+    view_info.subresourceRange.layerCount = 1;
+    err =
+      funcs_->vkCreateImageView(device, &view_info, nullptr, &transient.view);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create transient image view: %d", err);
+    }
+  }
+}
+
+void vulkan_engine::RenderGraph::destroyTransients(
+  std::vector<Transient>* transients, std::vector<Slot>* slots) {
+  VkDevice device = surface_->device();
+  for(Transient& transient : *transients) {
+    if(transient.view) {
+      funcs_->vkDestroyImageView(device, transient.view, nullptr);
+    }
+    if(transient.image) {
+      funcs_->vkDestroyImage(device, transient.image, nullptr);
+    }
+  }
+  for(Slot& slot : *slots) {
+    if(slot.memory) {
+      funcs_->vkFreeMemory(device, slot.memory, nullptr);
+    }
+  }
+  transients->clear();
+  slots->clear();
+}
+
+void vulkan_engine::RenderGraph::recycleTransients(
+  std::vector<Transient>* transients, std::vector<Slot>* slots) {
+  for(const Slot& slot : *slots) {
+    if(slot.memory) {
+      pool_.push_back(slot);
+    }
+  }
+  slots->clear();
+  destroyTransients(transients, slots);
+}
+
+void vulkan_engine::RenderGraph::destroyFramebuffers(bool all,
+                                                     uint64_t frame) {
+  // framebuffers not used for a while, e.g. of retired transients, the
+  // frames in flight may still use them unless the device is idle
+  QVulkanDeviceFunctions* funcs = funcs_;
+  VkDevice device = surface_->device();
+  size_t kept = 0;
+  for(Framebuffer& framebuffer : framebuffers_) {
+    if(all) {
+      funcs->vkDestroyFramebuffer(device, framebuffer.framebuffer, nullptr);
+    } else if(frame - framebuffer.frame >= FRAMEBUFFER_FRAMES) {
+      const VkFramebuffer retired = framebuffer.framebuffer;
+      deletion_queue_->retire([funcs, device, retired] {
+        funcs->vkDestroyFramebuffer(device, retired, nullptr);
+      });
+    } else {
+      framebuffers_[kept++] = framebuffer;
+    }
+  }
+  framebuffers_.resize(kept);
+}
+
+vulkan_engine::RenderGraph::State*
+vulkan_engine::RenderGraph::state(ResourceNode* node) {
+  // the memory of a transient image carries the state between the images
+  // sharing it
+  if(node->kind == TRANSIENT) {
+    return &slots_[transients_[node->transient].slot].state;
+  }
+  return &node->state;
+}
+
+void vulkan_engine::RenderGraph::transition(ResourceNode* node,
+                                            uint32_t access, bool write,
+                                            Batch* batch, PassNode* pass) {
+  if(node->kind == VIRTUAL) {
+    return;
+  }
+  const AccessInfo info = accessInfo(access);
+  State* s = state(node);
+  const bool image = node->kind != BUFFER;
+  const VkImageLayout layout =
+    image ? info.layout : VK_IMAGE_LAYOUT_UNDEFINED;
+  const VkPipelineStageFlags previous = s->write_stages | s->read_stages;
+
+  bool dependency = false; // execution dependency on src_stages
+  bool barrier = false;    // memory or image barrier
+  VkPipelineStageFlags src_stages = 0;
+  const bool layout_change = image && s->layout != layout;
+  if(layout_change) {
+    // a layout transition writes the image, after all earlier accesses
+    dependency = true;
+    barrier = true;
+    src_stages = previous;
+  } else if(write) {
+    // earlier writes have to be made available, reads only have to finish
+    dependency = previous != 0;
+    barrier = s->write_access != 0;
+    src_stages = previous;
+  } else if(s->write_stages && ((info.stages & ~s->visible_stages) ||
+                                (info.access_mask & ~s->visible_access))) {
+    dependency = true;
+    barrier = true;
+    src_stages = s->write_stages;
+  }
+
+  if(dependency) {
+    batch->src_stages |=
+      src_stages ? src_stages : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    batch->dst_stages |= info.stages;
+  }
+  if(barrier && image) {
+    VkImageMemoryBarrier image_barrier;
+    memset(&image_barrier, 0, sizeof(image_barrier));
+    image_barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    image_barrier.srcAccessMask = s->write_access;
+    image_barrier.dstAccessMask = info.access_mask;
+    image_barrier.oldLayout = s->layout;
+    image_barrier.newLayout = layout;
+    image_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    image_barrier.image =
+      node->kind == TRANSIENT ? transients_[node->transient].image
+                              : node->image;
+    image_barrier.subresourceRange.aspectMask = node->aspect;
+    image_barrier.subresourceRange.levelCount = VK_REMAINING_MIP_LEVELS;
+    image_barrier.subresourceRange.layerCount = VK_REMAINING_ARRAY_LAYERS;
+    batch->images.push_back(image_barrier);
+    ++pass->barriers;
+  } else if(barrier) {
+    VkBufferMemoryBarrier buffer_barrier;
+    memset(&buffer_barrier, 0, sizeof(buffer_barrier));
+    buffer_barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+    buffer_barrier.srcAccessMask = s->write_access;
+    buffer_barrier.dstAccessMask = info.access_mask;
+    buffer_barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    buffer_barrier.buffer = node->buffer;
+    buffer_barrier.size = VK_WHOLE_SIZE;
+    batch->buffers.push_back(buffer_barrier);
+    ++pass->barriers;
+  }
+
+  if(layout_change) {
+    ++pass->layout_transitions;
+    // Later accesses wait for the transition through the stages it was
+    // ordered before, its writes need no availability operation.
+    s->layout = layout;
+    s->write_stages = info.stages;
+    s->write_access = 0;
+    s->read_stages = 0;
+    s->visible_stages = info.stages;
+    s->visible_access = info.access_mask;
+  }
+  if(write) {
+    s->write_stages = info.stages;
+    s->write_access = info.access_mask & WRITE_ACCESS;
+    s->read_stages = 0;
+    s->visible_stages = 0;
+    s->visible_access = 0;
+  } else {
+    s->read_stages |= info.stages;
+    if(barrier) {
+      s->visible_stages |= info.stages;
+      s->visible_access |= info.access_mask;
+    }
+  }
+}
+
+void vulkan_engine::RenderGraph::execute(VkCommandBuffer cb, uint64_t frame) {
+  frame_ = frame;
+  stats_ = Stats();
+  stats_.passes = passes_.size();
+
+  cull();
+  allocateTransients();
+  destroyFramebuffers(false, frame);
+
+  for(ResourceNode& node : resources_) {
+    if(node.kind == BUFFER) {
+      auto it = buffer_states_.find(node.buffer);
+      node.state = it != buffer_states_.end() ? it->second : State();
+    } else if(node.kind == IMAGE) {
+      auto it = image_states_.find(node.image);
+      node.state = it != image_states_.end() ? it->second : State();
+      if(!node.preserve) {
+        node.state.layout = VK_IMAGE_LAYOUT_UNDEFINED;
+      }
+    }
+  }
+
+  for(size_t p = 0; p < passes_.size(); ++p) {
+    PassNode& pass = passes_[p];
+    if(pass.culled) {
+      ++stats_.culled;
+      continue;
+    }
+
+    Batch batch;
+    for(const Use& use : pass.uses) {
+      ResourceNode* node = &resources_[use.resource];
+      if(node->kind == TRANSIENT && node->first == p) {
+        // whatever used the memory before, the image starts out undefined
+        state(node)->layout = VK_IMAGE_LAYOUT_UNDEFINED;
+      }
+      transition(node, use.access, use.write, &batch, &pass);
+    }
+    if(batch.dst_stages) {
+      funcs_->vkCmdPipelineBarrier(
+        cb, batch.src_stages, batch.dst_stages, 0, 0, nullptr,
+        batch.buffers.size(), batch.buffers.data(), batch.images.size(),
+        batch.images.data());
+      ++stats_.barriers;
+      stats_.buffer_barriers += batch.buffers.size();
+      stats_.image_barriers += batch.images.size();
+      stats_.layout_transitions += pass.layout_transitions;
+    }
+
+    if(pass.record) {
+      pass.record(cb);
+    }
+  }
+
+  for(const ResourceNode& node : resources_) {
+    if(node.kind == BUFFER) {
+      buffer_states_[node.buffer] = node.state;
+    } else if(node.kind == IMAGE) {
+      image_states_[node.image] = node.state;
+    }
+  }
+
+  stats_.transient_images = transients_.size();
+  for(const Transient& transient : transients_) {
+    stats_.transient_bytes += transient.requirements.size;
+  }
+  for(const Slot& slot : slots_) {
+    stats_.lazy_memory += slot.lazy ? slot.size : 0;
+  }
+  stats_.lazy_committed = committedMemory();
+  stats_.transient_memory = memorySize();
+}
+
+VkImage vulkan_engine::RenderGraph::image(Resource resource) const {
+  const ResourceNode& node = resources_[resource];
+  return node.kind == TRANSIENT ? transients_[node.transient].image
+                                : node.image;
+}
+
+VkImageView vulkan_engine::RenderGraph::view(Resource resource) const {
+  const ResourceNode& node = resources_[resource];
+  return node.kind == TRANSIENT ? transients_[node.transient].view
+                                : node.view;
+}
+
+VkFramebuffer vulkan_engine::RenderGraph::framebuffer(
+  VkRenderPass render_pass, const std::vector<Resource>& attachments,
+  const QSize& size) {
+  std::vector<VkImageView> views;
+  for(Resource attachment : attachments) {
+    views.push_back(view(attachment));
+  }
+  for(Framebuffer& framebuffer : framebuffers_) {
+    if(framebuffer.render_pass == render_pass && framebuffer.views == views &&
+       framebuffer.size == size) {
+      framebuffer.frame = frame_;
+      return framebuffer.framebuffer;
+    }
+  }
+
+  VkFramebufferCreateInfo framebuffer_info;
+  memset(&framebuffer_info, 0, sizeof(framebuffer_info));
+  framebuffer_info.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+  framebuffer_info.renderPass = render_pass;
+  framebuffer_info.attachmentCount = views.size();
+  framebuffer_info.pAttachments = views.data();
+  framebuffer_info.width = size.width();
+  framebuffer_info.height = size.height();
+  framebuffer_info.layers = 1;
+  Framebuffer framebuffer;
+  VkResult err = funcs_->vkCreateFramebuffer(
+    surface_->device(), &framebuffer_info, nullptr, &framebuffer.framebuffer);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create framebuffer: %d", err);
+  }
+  framebuffer.render_pass = render_pass;
+  framebuffer.views = views;
+  framebuffer.size = size;
+  framebuffer.frame = frame_;
+  framebuffers_.push_back(framebuffer);
+  return framebuffer.framebuffer;
+}
+
+VkDeviceSize vulkan_engine::RenderGraph::committedMemory() const {
+  VkDeviceSize size = 0;
+  for(const Slot& slot : slots_) {
+    if(slot.lazy) {
+      VkDeviceSize committed = 0;
+      funcs_->vkGetDeviceMemoryCommitment(surface_->device(), slot.memory,
+                                          &committed);
+      size += committed;
+    }
+  }
+  return size;
+}
+
+VkDeviceSize vulkan_engine::RenderGraph::memorySize() const {
+  VkDeviceSize size = 0;
+  for(const Slot& slot : slots_) {
+    size += slot.lazy ? 0 : slot.size;
+  }
+  return size + committedMemory();
+}
+
+std::string vulkan_engine::RenderGraph::dump() const {
+  static const char* KIND_NAMES[] = {"buffer", "image", "transient",
+                                     "virtual"};
+  std::ostringstream out;
+  out << "digraph render_graph {\n"
+      << "  rankdir=LR;\n";
+  for(size_t p = 0; p < passes_.size(); ++p) {
+    const PassNode& pass = passes_[p];
+    out << "  pass" << p << " [shape=box, label=\"" << pass.name;
+    if(pass.culled) {
+      out << "\\nculled\", style=dashed, color=gray];\n";
+      continue;
+    }
+    out << "\\n" << pass.barriers << " barriers, " << pass.layout_transitions
+        << " layout transitions\"];\n";
+  }
+  for(size_t r = 0; r < resources_.size(); ++r) {
+    const ResourceNode& node = resources_[r];
+    out << "  resource" << r << " [shape=ellipse, label=\"" << node.name
+        << "\\n" << KIND_NAMES[node.kind];
+    if(node.kind == TRANSIENT && node.transient != SIZE_MAX) {
+      const Transient& transient = transients_[node.transient];
+      out << " " << node.desc.size.width() << "x" << node.desc.size.height()
+          << "\\nslot " << transient.slot
+          << (slots_[transient.slot].lazy ? " (lazy), " : ", ")
+          << transient.requirements.size << " bytes, passes "
+          << transient.first << "-" << transient.last;
+    }
+    out << "\"" << (node.output ? ", peripheries=2" : "") << "];\n";
+  }
+  for(size_t p = 0; p < passes_.size(); ++p) {
+    for(const Use& use : passes_[p].uses) {
+      const std::string label = accessNames(use.access);
+      if(use.read) {
+        out << "  resource" << use.resource << " -> pass" << p
+            << " [label=\"" << label << "\"];\n";
+      }
+      if(use.write) {
+        out << "  pass" << p << " -> resource" << use.resource
+            << " [label=\"" << label << "\"];\n";
+      }
+    }
+  }
+  out << "}\n";
+  return out.str();
+}
@@ -0,0 +1,296 @@
+#ifndef SHIFT_GUI_RENDERGRAPH_H_
+#define SHIFT_GUI_RENDERGRAPH_H_
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <QSize>
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/DeletionQueue.h"
+#include "vulkan-engine/RenderSurface.h"
+
+namespace vulkan_engine {
+
+/*! The passes of a frame and the buffers and images they use, rebuilt
+ every frame.
+
+ Passes declare how they access each resource instead of recording
+ barriers themselves. execute() culls the passes none of whose results
+ reach an output, then records the kept ones in the order they were added
+ with one pipeline barrier before each pass that needs one: layout
+ transitions of images, memory dependencies for reads of earlier writes
+ and execution dependencies only for writes after reads. Reads of a write
+ that was already made visible to the same stages need nothing.
+
+ Imported resources live outside of the graph, their last access and
+ layout are carried over to the next frame by handle. Transient images are
+ created by the graph and only valid during a frame: images whose
+ lifetimes (first to last pass using them) do not overlap share memory.
+ They are kept while the graph uses the same ones and retired to the
+ deletion queue when replaced. Lazy ones, attachments that never
+ leave the render pass writing them, are backed by lazily allocated memory
+ where the device has it, which tile-based GPUs never commit. dump()
+ describes the last frame in Graphviz format. */
+class RenderGraph {
+public:
+  typedef uint32_t Resource;
+  typedef uint32_t Pass;
+
+  /*! How a pass uses a resource, combined with |. */
+  enum Access : uint32_t {
+    TRANSFER_READ = 0x001,
+    TRANSFER_WRITE = 0x002,
+    INDEX_READ = 0x004,
+    VERTEX_SHADER_READ = 0x008,
+    FRAGMENT_SHADER_READ = 0x010, // sampled images are read in this layout
+    COMPUTE_SHADER_READ = 0x020,
+    COMPUTE_SHADER_WRITE = 0x040, // storage images are in GENERAL layout
+    COLOR_ATTACHMENT_WRITE = 0x080,
+    DEPTH_ATTACHMENT_WRITE = 0x100,
+    INDIRECT_READ = 0x200 // draw parameters of indirect draws
+  };
+
+  struct ImageDesc {
+    QSize size;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT;
+    VkSampleCountFlagBits samples = VK_SAMPLE_COUNT_1_BIT;
+    // in addition to the usage implied by the accesses of the passes
+    VkImageUsageFlags usage = 0;
+    // only an attachment whose contents are not stored, e.g. multisampled
+    // color resolved in the render pass: TRANSIENT_ATTACHMENT usage
+    bool lazy = false;
+  };
+
+  struct Stats {
+    size_t passes = 0;             // added
+    size_t culled = 0;             // not executed
+    size_t barriers = 0;           // vkCmdPipelineBarrier calls
+    size_t image_barriers = 0;
+    size_t buffer_barriers = 0;
+    size_t layout_transitions = 0; // image barriers changing the layout
+    size_t transient_images = 0;
+    VkDeviceSize transient_bytes = 0;  // memory without aliasing
+    VkDeviceSize transient_memory = 0; // memory allocated, see memorySize()
+    VkDeviceSize lazy_memory = 0;      // lazily allocated, at most committed
+    VkDeviceSize lazy_committed = 0;   // of that actually committed
+    VkDeviceSize reused_memory = 0;    // kept from replaced images
+  };
+
+  RenderGraph() = default;
+  ~RenderGraph() = default;
+
+  RenderGraph(const RenderGraph&) = delete;
+  RenderGraph& operator=(const RenderGraph&) = delete;
+
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            DeletionQueue* deletion_queue);
+  void release();
+
+  /*! Destroys the transient images and framebuffers and forgets the state
+   of imported resources, while the device is idle, e.g. before the
+   imported images are recreated. */
+  void releaseImages();
+
+  /*! Destroys the framebuffers, e.g. before the swap chain images whose
+   views they use are recreated, while the device is idle. The transient
+   images stay, and if the next frame wants different ones, e.g. of a new
+   size, they are replaced right away, reusing their memory where it fits,
+   instead of waiting for the frames in flight. */
+  void releaseFramebuffers();
+
+  /*! Removes all passes and resources to build the next frame. */
+  void clear();
+
+  /*! A buffer written or read by the passes as a whole. */
+  Resource importBuffer(const std::string& name, VkBuffer buffer);
+
+  /*! An image owned by someone else. Its contents are discarded at the
+   first use of the frame unless preserve is set. */
+  Resource importImage(const std::string& name, VkImage image,
+                       VkImageView view, VkImageAspectFlags aspect,
+                       bool preserve);
+
+  /*! An image created by the graph that lives for one frame. */
+  Resource createImage(const std::string& name, const ImageDesc& desc);
+
+  /*! A resource whose layouts and dependencies the graph leaves to the
+   passes, which it only orders, e.g. the swap chain image whose layouts
+   the render passes drawing into it handle. view, if any, can be an
+   attachment of framebuffer(). */
+  Resource addVirtual(const std::string& name,
+                      VkImageView view = VK_NULL_HANDLE);
+
+  /*! The writes to resource are needed after the frame, which keeps the
+   passes producing them. */
+  void markOutput(Resource resource);
+
+  /*! Adds a pass recording its commands with record when executed, outside
+   of any render pass. */
+  Pass addPass(const std::string& name,
+               const std::function<void(VkCommandBuffer)>& record);
+
+  void read(Pass pass, Resource resource, uint32_t access);
+  void write(Pass pass, Resource resource, uint32_t access);
+
+  /*! Culls and records the passes into cb. frame counts all frames
+   rendered. */
+  void execute(VkCommandBuffer cb, uint64_t frame);
+
+  /*! Image and view of an image resource, valid while recording. */
+  VkImage image(Resource resource) const;
+  VkImageView view(Resource resource) const;
+
+  /*! A framebuffer of render_pass with the views of attachments, created
+   on first use and kept while it is used. Valid while recording. */
+  VkFramebuffer framebuffer(VkRenderPass render_pass,
+                            const std::vector<Resource>& attachments,
+                            const QSize& size);
+
+  /*! Device memory of the transient images in bytes, of lazily allocated
+   memory only what is committed. */
+  VkDeviceSize memorySize() const;
+
+  inline const Stats& stats() const {
+    return stats_;
+  }
+
+  /*! The last frame in Graphviz dot format: passes with the barriers
+   recorded before them, culled ones dashed, and the resources they read
+   and write. */
+  std::string dump() const;
+
+private:
+  enum Kind { BUFFER, IMAGE, TRANSIENT, VIRTUAL };
+
+  // last access of a resource, or of the memory of a transient image
+  struct State {
+    VkPipelineStageFlags write_stages = 0;
+    VkAccessFlags write_access = 0;
+    VkPipelineStageFlags read_stages = 0; // since the last write
+    // stages and accesses the last write was made visible to
+    VkPipelineStageFlags visible_stages = 0;
+    VkAccessFlags visible_access = 0;
+    VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+  };
+
+  struct ResourceNode {
+    std::string name;
+    Kind kind;
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkImageAspectFlags aspect = 0;
+    bool preserve = true;
+    bool output = false;
+    ImageDesc desc;
+    VkImageUsageFlags usage = 0; // of transient images
+    uint32_t first = UINT32_MAX; // passes using it, in execution order
+    uint32_t last = 0;
+    size_t transient = SIZE_MAX; // index into transients_
+    State state;
+  };
+
+  struct Use {
+    Resource resource;
+    uint32_t access;
+    bool read;
+    bool write;
+  };
+
+  struct PassNode {
+    std::string name;
+    std::function<void(VkCommandBuffer)> record;
+    std::vector<Use> uses; // one per resource
+    bool culled = false;
+    size_t barriers = 0; // memory and image barriers recorded before it
+    size_t layout_transitions = 0;
+  };
+
+  // a transient image and the range of passes it is alive for
+  struct Transient {
+    ImageDesc desc;
+    VkImageUsageFlags usage = 0;
+    uint32_t first = 0;
+    uint32_t last = 0;
+    VkImage image = VK_NULL_HANDLE;
+    VkImageView view = VK_NULL_HANDLE;
+    VkMemoryRequirements requirements;
+    uint32_t memory_type = 0;
+    size_t slot = 0;
+  };
+
+  // memory shared by transient images with disjoint lifetimes
+  struct Slot {
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    uint32_t memory_type = 0;
+    bool lazy = false;
+    State state;
+  };
+
+  struct Framebuffer {
+    VkRenderPass render_pass;
+    std::vector<VkImageView> views;
+    QSize size;
+    VkFramebuffer framebuffer;
+    uint64_t frame; // last used
+  };
+
+  struct Retired {
+    std::vector<Transient> transients;
+    std::vector<Slot> slots;
+  };
+
+  struct Batch {
+    VkPipelineStageFlags src_stages = 0;
+    VkPipelineStageFlags dst_stages = 0;
+    std::vector<VkBufferMemoryBarrier> buffers;
+    std::vector<VkImageMemoryBarrier> images;
+  };
+
+  Resource addResource(const std::string& name, Kind kind);
+  void use(Pass pass, Resource resource, uint32_t access, bool write);
+  void cull();
+  void allocateTransients();
+  void createTransients();
+  void destroyTransients(std::vector<Transient>* transients,
+                         std::vector<Slot>* slots);
+  void recycleTransients(std::vector<Transient>* transients,
+                         std::vector<Slot>* slots);
+  void destroyFramebuffers(bool all, uint64_t frame);
+  uint32_t memoryType(uint32_t type_bits, bool lazy) const;
+  VkDeviceSize committedMemory() const;
+  State* state(ResourceNode* node);
+  void transition(ResourceNode* node, uint32_t access, bool write,
+                  Batch* batch, PassNode* pass);
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+  DeletionQueue* deletion_queue_ = nullptr;
+  VkPhysicalDeviceMemoryProperties memory_properties_;
+
+  std::vector<ResourceNode> resources_;
+  std::vector<PassNode> passes_;
+
+  std::vector<Transient> transients_;
+  std::vector<Slot> slots_;
+  std::vector<Slot> pool_; // memory to reuse while the device is idle
+  bool idle_ = false;      // since releaseFramebuffers()
+  std::vector<Framebuffer> framebuffers_;
+  uint64_t frame_ = 0;
+
+  // state of imported resources at the end of the last frame using them
+  std::map<VkBuffer, State> buffer_states_;
+  std::map<VkImage, State> image_states_;
+
+  Stats stats_;
+};
+
+}
+
+#endif
@@ -0,0 +1,212 @@
+#ifndef SHIFT_GUI_RENDERSURFACE_H_
+#define SHIFT_GUI_RENDERSURFACE_H_
+
+#include <QMatrix4x4>
+#include <QScreen>
+#include <QSize>
+#include <QThread>
+#include <QVulkanFunctions>
+#include <QVulkanWindow>
+
+namespace vulkan_engine {
+
+/*! A queue family with compute but without graphics support, whose queues
+ run alongside the graphics queue on most desktop GPUs, or UINT32_MAX if
+ the device has none. */
+inline uint32_t asyncComputeQueueFamily(const VkQueueFamilyProperties* families,
+                                        uint32_t count) {
+  for(uint32_t i = 0; i < count; ++i) {
+    if((families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) &&
+       !(families[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) &&
+       families[i].queueCount > 0) {
+      return i;
+    }
+  }
+  return UINT32_MAX;
+}
+
+/*! The subset of QVulkanWindow used by VulkanEngine. Allows the engine to
+ render either into the swapchain of a window (WindowSurface) or into an
+ offscreen framebuffer (OffscreenSurface) without any changes to the
+ rendering code. */
+class RenderSurface {
+public:
+  virtual ~RenderSurface() {}
+
+  virtual QVulkanInstance* vulkanInstance() const = 0;
+  virtual VkPhysicalDevice physicalDevice() const = 0;
+  virtual const VkPhysicalDeviceProperties* physicalDeviceProperties() const = 0;
+  virtual VkDevice device() const = 0;
+  virtual VkQueue graphicsQueue() const = 0;
+  virtual uint32_t graphicsQueueFamilyIndex() const = 0;
+  virtual VkCommandPool graphicsCommandPool() const = 0;
+  virtual uint32_t hostVisibleMemoryIndex() const = 0;
+  virtual uint32_t deviceLocalMemoryIndex() const = 0;
+  virtual VkRenderPass defaultRenderPass() const = 0;
+  virtual VkFormat colorFormat() const = 0;
+  virtual VkFormat depthStencilFormat() const = 0;
+  virtual VkSampleCountFlagBits sampleCountFlagBits() const = 0;
+  virtual int concurrentFrameCount() const = 0;
+  virtual int currentFrame() const = 0;
+  virtual VkCommandBuffer currentCommandBuffer() const = 0;
+  virtual VkFramebuffer currentFramebuffer() const = 0;
+  /*! View of the color image currentFramebuffer() presents, single-sampled
+   in colorFormat(). */
+  virtual VkImageView currentSwapChainImageView() const = 0;
+  /*! The image of currentSwapChainImageView(), which transfers may read. */
+  virtual VkImage currentSwapChainImage() const = 0;
+  /*! Layout a frame has to leave the image of currentSwapChainImageView()
+   in, the final layout of defaultRenderPass() for it. */
+  virtual VkImageLayout swapChainImageLayout() const = 0;
+  virtual QSize swapChainImageSize() const = 0;
+  virtual QMatrix4x4 clipCorrectionMatrix() = 0;
+
+  virtual void frameReady() = 0;
+
+  /*! Schedules a call to startNextFrame(). May be called from any thread. */
+  virtual void requestUpdate() = 0;
+
+  /*! Rate at which frames are presented, in Hz. */
+  virtual float refreshRate() const {
+    return 60.0f;
+  }
+
+  /*! Whether the device was created with the descriptor indexing features
+   used for bindless textures: partially bound and update after bind sampled
+   image arrays, indexed non-uniformly. */
+  virtual bool descriptorIndexing() const {
+    return false;
+  }
+
+  /*! A queue of a compute-only family the device was created with, so
+   compute work can overlap with the graphics queue, or VK_NULL_HANDLE. */
+  virtual VkQueue computeQueue() const {
+    return VK_NULL_HANDLE;
+  }
+
+  /*! Family of computeQueue(), the graphics family without one. */
+  virtual uint32_t computeQueueFamilyIndex() const {
+    return graphicsQueueFamilyIndex();
+  }
+};
+
+/*! Forwards every call to a QVulkanWindow. */
+class WindowSurface : public RenderSurface {
+public:
+  WindowSurface(QVulkanWindow* w) : window_(w) {}
+
+  inline QVulkanWindow* window() const {
+    return window_;
+  }
+
+  QVulkanInstance* vulkanInstance() const override {
+    return window_->vulkanInstance();
+  }
+  VkPhysicalDevice physicalDevice() const override {
+    return window_->physicalDevice();
+  }
+  const VkPhysicalDeviceProperties* physicalDeviceProperties() const override {
+    return window_->physicalDeviceProperties();
+  }
+  VkDevice device() const override {
+    return window_->device();
+  }
+  VkQueue graphicsQueue() const override {
+    return window_->graphicsQueue();
+  }
+  uint32_t graphicsQueueFamilyIndex() const override {
+    return window_->graphicsQueueFamilyIndex();
+  }
+  VkCommandPool graphicsCommandPool() const override {
+    return window_->graphicsCommandPool();
+  }
+  uint32_t hostVisibleMemoryIndex() const override {
+    return window_->hostVisibleMemoryIndex();
+  }
+  uint32_t deviceLocalMemoryIndex() const override {
+    return window_->deviceLocalMemoryIndex();
+  }
+  VkRenderPass defaultRenderPass() const override {
+    return window_->defaultRenderPass();
+  }
+  VkFormat colorFormat() const override {
+    return window_->colorFormat();
+  }
+  VkFormat depthStencilFormat() const override {
+    return window_->depthStencilFormat();
+  }
+  VkSampleCountFlagBits sampleCountFlagBits() const override {
+    return window_->sampleCountFlagBits();
+  }
+  int concurrentFrameCount() const override {
+    return window_->concurrentFrameCount();
+  }
+  int currentFrame() const override {
+    return window_->currentFrame();
+  }
+  VkCommandBuffer currentCommandBuffer() const override {
+    return window_->currentCommandBuffer();
+  }
+  VkFramebuffer currentFramebuffer() const override {
+    return window_->currentFramebuffer();
+  }
+  VkImageView currentSwapChainImageView() const override {
+    return window_->swapChainImageView(window_->currentSwapChainImageIndex());
+  }
+  VkImage currentSwapChainImage() const override {
+    return window_->swapChainImage(window_->currentSwapChainImageIndex());
+  }
+  VkImageLayout swapChainImageLayout() const override {
+    return VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  }
+  QSize swapChainImageSize() const override {
+    return window_->swapChainImageSize();
+  }
+  QMatrix4x4 clipCorrectionMatrix() override {
+    return window_->clipCorrectionMatrix();
+  }
+
+  void frameReady() override {
+    window_->frameReady();
+  }
+  void requestUpdate() override {
+    // QWindow::requestUpdate() must be called on the GUI thread
+    if(QThread::currentThread() == window_->thread()) {
+      window_->requestUpdate();
+    } else {
+      QMetaObject::invokeMethod(window_, "requestUpdate", Qt::QueuedConnection);
+    }
+  }
+
+  float refreshRate() const override {
+    return window_->screen() ? window_->screen()->refreshRate() : 60.0f;
+  }
+
+  /*! Records the compute family whose queue was added to the create infos
+   of the device of the window, see VulkanEngine. */
+  inline void setComputeQueueFamilyIndex(uint32_t family) {
+    compute_family_ = family;
+  }
+
+  VkQueue computeQueue() const override {
+    VkQueue queue = VK_NULL_HANDLE;
+    if(compute_family_ != UINT32_MAX && window_->device()) {
+      window_->vulkanInstance()
+        ->deviceFunctions(window_->device())
+        ->vkGetDeviceQueue(window_->device(), compute_family_, 0, &queue);
+    }
+    return queue;
+  }
+  uint32_t computeQueueFamilyIndex() const override {
+    return compute_family_ != UINT32_MAX ? compute_family_
+                                         : graphicsQueueFamilyIndex();
+  }
+
+private:
+  QVulkanWindow* window_ = nullptr;
+  uint32_t compute_family_ = UINT32_MAX;
+};
+
+}
+
+#endif
@@ -0,0 +1,344 @@
+#include "vulkan-engine/RenderTarget.h"
+
+#include <cstring>
+
+void vulkan_engine::createRenderTarget(RenderSurface* surface,
+                                       QVulkanDeviceFunctions* funcs,
+                                       const QSize& size, VkFormat format,
+                                       VkImageUsageFlags usage,
+                                       VkImageAspectFlags aspect,
+                                       RenderTarget* target) {
+  *target = RenderTarget();
+  resizeRenderTarget(surface, funcs, size, format, usage, aspect, target);
+}
+
+void vulkan_engine::resizeRenderTarget(RenderSurface* surface,
+                                       QVulkanDeviceFunctions* funcs,
+                                       const QSize& size, VkFormat format,
+                                       VkImageUsageFlags usage,
+                                       VkImageAspectFlags aspect,
+                                       RenderTarget* target) {
+  VkDevice device = surface->device();
+
+  VkImageCreateInfo image_info;
+  memset(&image_info, 0, sizeof(image_info));
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = format;
+  image_info.extent.width = size.width();
+  image_info.extent.height = size.height();
+  image_info.extent.depth = 1;
+  image_info.mipLevels = 1;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage = usage;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkImage image = VK_NULL_HANDLE;
+  VkResult err = funcs->vkCreateImage(device, &image_info, nullptr, &image);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create image: %d", err);
+  }
+  VkMemoryRequirements memory_requirements;
+  funcs->vkGetImageMemoryRequirements(device, image, &memory_requirements);
+  const uint32_t memory_index = surface->deviceLocalMemoryIndex();
+
+  // The memory is kept if the new image fits into it, so resizing back and
+  // forth allocates nothing.
+  VkDeviceMemory memory = target->memory;
+  const VkDeviceSize memory_size = target->memory_size;
+  target->memory = VK_NULL_HANDLE;
+  destroyRenderTarget(surface, funcs, target);
+  if(memory && memory_size >= memory_requirements.size &&
+     (memory_requirements.memoryTypeBits & (1u << memory_index))) {
+    target->memory = memory;
+    target->memory_size = memory_size;
+  } else if(memory) {
+    funcs->vkFreeMemory(device, memory, nullptr);
+  }
+  target->image = image;
+
+  if(!target->memory) {
+    // a quarter more than needed while growing, as a window being resized
+    // usually keeps growing
+    VkDeviceSize allocation_size = memory_requirements.size;
+    if(memory_size > 0 && allocation_size > memory_size) {
+      allocation_size += allocation_size / 4;
+    }
+    VkMemoryAllocateInfo memory_alloc_info = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, allocation_size,
+      memory_index};
+    err = funcs->vkAllocateMemory(device, &memory_alloc_info, nullptr,
+                                  &target->memory);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to allocate image memory: %d", err);
+    }
+    target->memory_size = allocation_size;
+  }
+
+  err = funcs->vkBindImageMemory(device, target->image, target->memory, 0);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to bind image memory: %d", err);
+  }
+
+  VkImageViewCreateInfo view_info;
+  memset(&view_info, 0, sizeof(view_info));
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.image = target->image;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = format;
+  view_info.subresourceRange.aspectMask = aspect;
+  view_info.subresourceRange.levelCount = 1;
+  view_info.subresourceRange.layerCount = 1;
+  err = funcs->vkCreateImageView(device, &view_info, nullptr, &target->view);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create image view: %d", err);
+  }
+}
+
+void vulkan_engine::destroyRenderTarget(RenderSurface* surface,
+                                        QVulkanDeviceFunctions* funcs,
+                                        RenderTarget* target) {
+  VkDevice device = surface->device();
+  if(target->framebuffer) {
+    funcs->vkDestroyFramebuffer(device, target->framebuffer, nullptr);
+  }
+  if(target->view) {
+    funcs->vkDestroyImageView(device, target->view, nullptr);
+  }
+  if(target->image) {
+    funcs->vkDestroyImage(device, target->image, nullptr);
+  }
+  if(target->memory) {
+    funcs->vkFreeMemory(device, target->memory, nullptr);
+  }
+  *target = RenderTarget();
+}
+
+VkRenderPass vulkan_engine::createSampledRenderPass(
+  RenderSurface* surface, QVulkanDeviceFunctions* funcs, VkFormat color_format,
+  VkAttachmentLoadOp color_load_op, bool depth) {
+  VkAttachmentDescription attachments[2];
+  memset(attachments, 0, sizeof(attachments));
+
+  attachments[0].format = color_format;
+  attachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[0].loadOp = color_load_op;
+  attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  attachments[1].format = surface->depthStencilFormat();
+  attachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].initialLayout =
+    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  VkAttachmentReference color_ref = {0,
+                                     VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depth_ref = {
+    1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpass;
+  memset(&subpass, 0, sizeof(subpass));
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &color_ref;
+  subpass.pDepthStencilAttachment = depth ? &depth_ref : nullptr;
+
+  VkRenderPassCreateInfo render_pass_info;
+  memset(&render_pass_info, 0, sizeof(render_pass_info));
+  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  render_pass_info.attachmentCount = depth ? 2 : 1;
+  render_pass_info.pAttachments = attachments;
+  render_pass_info.subpassCount = 1;
+  render_pass_info.pSubpasses = &subpass;
+  // layout transitions and dependencies are left to the render graph
+
+  VkRenderPass render_pass;
+  VkResult err = funcs->vkCreateRenderPass(
+    surface->device(), &render_pass_info, nullptr, &render_pass);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create render pass: %d", err);
+  }
+  return render_pass;
+}
+
+VkRenderPass vulkan_engine::createResolveRenderPass(
+  RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+  VkSampleCountFlagBits samples) {
+  VkAttachmentDescription attachments[3];
+  memset(attachments, 0, sizeof(attachments));
+
+  attachments[0].format = surface->colorFormat();
+  attachments[0].samples = samples;
+  attachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[0].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+  attachments[0].finalLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+
+  attachments[1].format = surface->depthStencilFormat();
+  attachments[1].samples = samples;
+  attachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+  attachments[1].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[1].initialLayout =
+    VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+  attachments[1].finalLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+  attachments[2].format = surface->colorFormat();
+  attachments[2].samples = VK_SAMPLE_COUNT_1_BIT;
+  attachments[2].loadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[2].storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+  attachments[2].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+  attachments[2].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+  attachments[2].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  attachments[2].finalLayout = surface->swapChainImageLayout();
+
+  VkAttachmentReference color_ref = {0,
+                                     VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference depth_ref = {
+    1, VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL};
+  VkAttachmentReference resolve_ref = {
+    2, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL};
+
+  VkSubpassDescription subpass;
+  memset(&subpass, 0, sizeof(subpass));
+  subpass.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS;
+  subpass.colorAttachmentCount = 1;
+  subpass.pColorAttachments = &color_ref;
+  subpass.pResolveAttachments = &resolve_ref;
+  subpass.pDepthStencilAttachment = &depth_ref;
+
+  // The swap chain image is acquired before the stage its semaphore is
+  // waited for, and read back by transfers offscreen.
+  VkSubpassDependency dependencies[2];
+  memset(dependencies, 0, sizeof(dependencies));
+  dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[0].dstSubpass = 0;
+  dependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].srcSubpass = 0;
+  dependencies[1].dstSubpass = VK_SUBPASS_EXTERNAL;
+  dependencies[1].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  dependencies[1].dstStageMask = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  dependencies[1].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+  dependencies[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+
+  VkRenderPassCreateInfo render_pass_info;
+  memset(&render_pass_info, 0, sizeof(render_pass_info));
+  render_pass_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
+  render_pass_info.attachmentCount = 3;
+  render_pass_info.pAttachments = attachments;
+  render_pass_info.subpassCount = 1;
+  render_pass_info.pSubpasses = &subpass;
+  render_pass_info.dependencyCount = 2;
+  render_pass_info.pDependencies = dependencies;
+
+  VkRenderPass render_pass;
+  VkResult err = funcs->vkCreateRenderPass(
+    surface->device(), &render_pass_info, nullptr, &render_pass);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create render pass: %d", err);
+  }
+  return render_pass;
+}
+
+VkPipeline vulkan_engine::createFullscreenPipeline(
+  RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+  VkPipelineCache pipeline_cache, VkPipelineLayout pipeline_layout,
+  VkRenderPass render_pass, VkSampleCountFlagBits samples,
+  VkShaderModule vertex_shader, VkShaderModule fragment_shader) {
+  VkGraphicsPipelineCreateInfo pipeline_info;
+  memset(&pipeline_info, 0, sizeof(pipeline_info));
+  pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+
+  VkPipelineShaderStageCreateInfo shader_stages[2] = {
+    {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0,
+     VK_SHADER_STAGE_VERTEX_BIT, vertex_shader, "main", nullptr},
+    {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0,
+     VK_SHADER_STAGE_FRAGMENT_BIT, fragment_shader, "main", nullptr}};
+  pipeline_info.stageCount = 2;
+  pipeline_info.pStages = shader_stages;
+
+  VkPipelineVertexInputStateCreateInfo vertex_input_info;
+  memset(&vertex_input_info, 0, sizeof(vertex_input_info));
+  vertex_input_info.sType =
+    VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+  pipeline_info.pVertexInputState = &vertex_input_info;
+
+  VkPipelineInputAssemblyStateCreateInfo ia;
+  memset(&ia, 0, sizeof(ia));
+  ia.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+  ia.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  pipeline_info.pInputAssemblyState = &ia;
+
+  VkPipelineViewportStateCreateInfo vp;
+  memset(&vp, 0, sizeof(vp));
+  vp.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+  vp.viewportCount = 1;
+  vp.scissorCount = 1;
+  pipeline_info.pViewportState = &vp;
+
+  VkPipelineRasterizationStateCreateInfo rs;
+  memset(&rs, 0, sizeof(rs));
+  rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+  rs.polygonMode = VK_POLYGON_MODE_FILL;
+  rs.cullMode = VK_CULL_MODE_NONE;
+  rs.frontFace = VK_FRONT_FACE_CLOCKWISE;
+  rs.lineWidth = 1.0f;
+  pipeline_info.pRasterizationState = &rs;
+
+  VkPipelineMultisampleStateCreateInfo ms;
+  memset(&ms, 0, sizeof(ms));
+  ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+  ms.rasterizationSamples = samples;
+  pipeline_info.pMultisampleState = &ms;
+
+  // render passes with a depth attachment need the state, even if unused
+  VkPipelineDepthStencilStateCreateInfo ds;
+  memset(&ds, 0, sizeof(ds));
+  ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+  pipeline_info.pDepthStencilState = &ds;
+
+  VkPipelineColorBlendStateCreateInfo cb;
+  memset(&cb, 0, sizeof(cb));
+  cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+  VkPipelineColorBlendAttachmentState att;
+  memset(&att, 0, sizeof(att));
+  att.colorWriteMask = 0xF;
+  cb.attachmentCount = 1;
+  cb.pAttachments = &att;
+  pipeline_info.pColorBlendState = &cb;
+
+  VkDynamicState dynamic_state[] = {VK_DYNAMIC_STATE_VIEWPORT,
+                                    VK_DYNAMIC_STATE_SCISSOR};
+  VkPipelineDynamicStateCreateInfo dyn;
+  memset(&dyn, 0, sizeof(dyn));
+  dyn.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+  dyn.dynamicStateCount = sizeof(dynamic_state) / sizeof(VkDynamicState);
+  dyn.pDynamicStates = dynamic_state;
+  pipeline_info.pDynamicState = &dyn;
+
+  pipeline_info.layout = pipeline_layout;
+  pipeline_info.renderPass = render_pass;
+
+  VkPipeline pipeline;
+  VkResult err = funcs->vkCreateGraphicsPipelines(
+    surface->device(), pipeline_cache, 1, &pipeline_info, nullptr, &pipeline);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create fullscreen pipeline: %d", err);
+  }
+  return pipeline;
+}
@@ -0,0 +1,77 @@
+#ifndef SHIFT_GUI_RENDERTARGET_H_
+#define SHIFT_GUI_RENDERTARGET_H_
+
+#include <QSize>
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/RenderSurface.h"
+
+namespace vulkan_engine {
+
+/*! Single-sampled image the engine renders into itself (instead of the
+ surface's framebuffer), with its view and an optional framebuffer. */
+struct RenderTarget {
+  VkImage image = VK_NULL_HANDLE;
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkImageView view = VK_NULL_HANDLE;
+  VkFramebuffer framebuffer = VK_NULL_HANDLE;
+  VkDeviceSize memory_size = 0;
+};
+
+/*! Creates a 2D image of the given size in device local memory and a view
+ on it. The framebuffer is left to the caller. */
+void createRenderTarget(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+                        const QSize& size, VkFormat format,
+                        VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                        RenderTarget* target);
+
+/*! Recreates the image and view of target for the given size and destroys
+ its framebuffer, keeping the memory if the new image fits into it. Memory
+ allocated for a growing target has some headroom for the next resize. The
+ device has to be idle. */
+void resizeRenderTarget(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+                        const QSize& size, VkFormat format,
+                        VkImageUsageFlags usage, VkImageAspectFlags aspect,
+                        RenderTarget* target);
+
+/*! Destroys everything in target that was created and resets it. */
+void destroyRenderTarget(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+                         RenderTarget* target);
+
+/*! Creates a single-subpass render pass with one color attachment and
+ optionally a cleared depth/stencil attachment in the surface's depth
+ format. The attachments are expected in, and left in, their attachment
+ layouts without external dependencies: a RenderGraph pass writing them
+ records the transitions and barriers around it. */
+VkRenderPass createSampledRenderPass(RenderSurface* surface,
+                                     QVulkanDeviceFunctions* funcs,
+                                     VkFormat color_format,
+                                     VkAttachmentLoadOp color_load_op,
+                                     bool depth);
+
+/*! Creates a single-subpass render pass drawing into a cleared
+ multisampled color (attachment 0) and depth/stencil attachment (1) in the
+ surface's formats, which are expected in their attachment layouts as
+ above and not stored, and resolving the color into the surface's
+ swap chain image (2) at the end of the subpass. The resolve attachment is
+ left in surface->swapChainImageLayout(); its transition waits for the
+ image to be acquired. */
+VkRenderPass createResolveRenderPass(RenderSurface* surface,
+                                     QVulkanDeviceFunctions* funcs,
+                                     VkSampleCountFlagBits samples);
+
+/*! Creates a pipeline drawing a triangle generated from gl_VertexIndex that
+ covers the viewport, without vertex input, depth test or blending. The
+ viewport and scissor are dynamic. */
+VkPipeline createFullscreenPipeline(RenderSurface* surface,
+                                    QVulkanDeviceFunctions* funcs,
+                                    VkPipelineCache pipeline_cache,
+                                    VkPipelineLayout pipeline_layout,
+                                    VkRenderPass render_pass,
+                                    VkSampleCountFlagBits samples,
+                                    VkShaderModule vertex_shader,
+                                    VkShaderModule fragment_shader);
+
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include "vulkan-engine/SceneGenerator.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#include "vulkan-engine/JobSystem.h"
+
+size_t vulkan_engine::GeneratedScene::triangleCount() const {
+  size_t count = 0;
+  for(const SceneObject& object : objects) {
+    count += meshes[object.mesh_index].faces.size() / 3;
+  }
+  return count;
+}
+
+vulkan_engine::MeshData vulkan_engine::SceneGenerator::sphere(int rings,
+                                                              int segments) {
+  rings = std::max(rings, 2);
+  segments = std::max(segments, 3);
+
+  MeshData mesh;
+  mesh.vertices.reserve(3 * (rings + 1) * (segments + 1));
+  mesh.normals.reserve(3 * (rings + 1) * (segments + 1));
+  mesh.texture_coordinates.reserve(2 * (rings + 1) * (segments + 1));
+  for(int r = 0; r <= rings; ++r) {
+    const double theta = M_PI * r / rings;
+    for(int s = 0; s <= segments; ++s) {
+      const double phi = 2.0 * M_PI * s / segments;
+      const float x = std::sin(theta) * std::cos(phi);
+      const float y = std::cos(theta);
+      const float z = std::sin(theta) * std::sin(phi);
+      mesh.vertices.push_back(x);
+      mesh.vertices.push_back(y);
+      mesh.vertices.push_back(z);
+      mesh.normals.push_back(x);
+      mesh.normals.push_back(y);
+      mesh.normals.push_back(z);
+      mesh.texture_coordinates.push_back(float(s) / segments);
+      mesh.texture_coordinates.push_back(float(r) / rings);
+    }
+  }
+
+  mesh.faces.reserve(6 * rings * segments);
+  for(int r = 0; r < rings; ++r) {
+    for(int s = 0; s < segments; ++s) {
+      const unsigned int i0 = r * (segments + 1) + s;
+      const unsigned int i1 = i0 + segments + 1;
+      mesh.faces.push_back(i0);
+      mesh.faces.push_back(i1);
+      mesh.faces.push_back(i0 + 1);
+      mesh.faces.push_back(i0 + 1);
+      mesh.faces.push_back(i1);
+      mesh.faces.push_back(i1 + 1);
+    }
+  }
+
+  return mesh;
+}
+
+vulkan_engine::MeshData vulkan_engine::SceneGenerator::box() {
+  MeshData mesh;
+  // every face gets its own four vertices for flat normals
+  for(int axis = 0; axis < 3; ++axis) {
+    for(int sign = -1; sign <= 1; sign += 2) {
+      const int u = (axis + 1) % 3;
+      const int v = (axis + 2) % 3;
+      const unsigned int first = mesh.vertices.size() / 3;
+      for(int corner = 0; corner < 4; ++corner) {
+        float position[3];
+        position[axis] = sign;
+        position[u] = (corner == 1 || corner == 2) ? 1.0f : -1.0f;
+        position[v] = (corner >= 2) ? sign : -sign;
+        float normal[3] = {0.0f, 0.0f, 0.0f};
+        normal[axis] = sign;
+        mesh.vertices.insert(mesh.vertices.end(), position, position + 3);
+        mesh.normals.insert(mesh.normals.end(), normal, normal + 3);
+      }
+      const unsigned int faces[] = {first,     first + 1, first + 2,
+                                    first + 2, first + 3, first};
+      mesh.faces.insert(mesh.faces.end(), faces, faces + 6);
+    }
+  }
+  return mesh;
+}
+
+vulkan_engine::GeneratedScene
+vulkan_engine::SceneGenerator::generate(const SceneDescription& description) {
+  GeneratedScene scene;
+  std::mt19937 rng(description.seed);
+  std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+  const int mesh_count = std::max(description.mesh_count, 1);
+  const int min_triangles = std::max(description.min_triangles, 12);
+  const int max_triangles = std::max(description.max_triangles, min_triangles);
+  // meshes are independent of the random sequence and built in parallel
+  scene.meshes.resize(mesh_count);
+  JobSystem::global().parallelFor(
+    0, mesh_count, 1, [&](size_t first, size_t last) {
+      for(size_t i = first; i < last; ++i) {
+        // spread tessellation evenly (in log space) between min and max
+        const double t = mesh_count > 1 ? double(i) / (mesh_count - 1) : 0.0;
+        const double triangles =
+          min_triangles * std::pow(double(max_triangles) / min_triangles, t);
+        // 2 * rings * segments triangles with segments = 2 * rings
+        const int rings = std::max(2, int(std::sqrt(triangles / 4.0)));
+        scene.meshes[i] = sphere(rings, 2 * rings);
+        scene.meshes[i].material_index = i;
+      }
+    });
+
+  for(int i = 0; i < mesh_count; ++i) {
+    MaterialData material;
+    material.Kd[0] = 0.2f + 0.8f * unit(rng);
+    material.Kd[1] = 0.2f + 0.8f * unit(rng);
+    material.Kd[2] = 0.2f + 0.8f * unit(rng);
+    material.metalness = unit(rng);
+    scene.materials.push_back(material);
+  }
+
+  const int object_count = std::max(description.object_count, 0);
+  const int side = std::max(1, int(std::ceil(std::cbrt(double(object_count)))));
+  const float spacing = 3.0f;
+  const float offset = 0.5f * spacing * (side - 1);
+  scene.objects.reserve(object_count);
+  for(int i = 0; i < object_count; ++i) {
+    SceneObject object;
+    object.mesh_index = int(unit(rng) * mesh_count) % mesh_count;
+    object.material_index = object.mesh_index;
+    object.transform.translate(
+      spacing * (i % side) - offset + unit(rng) - 0.5f,
+      spacing * ((i / side) % side) - offset + unit(rng) - 0.5f,
+      spacing * (i / (side * side)) - offset + unit(rng) - 0.5f);
+    object.transform.rotate(360.0f * unit(rng),
+                            QVector3D(unit(rng), unit(rng), unit(rng) + 0.1f));
+    object.transform.scale(0.5f + unit(rng));
+    scene.objects.push_back(object);
+  }
+
+  // Imported CAD assemblies often hold a copy of a part per occurrence with
+  // its placement baked into the vertices. Every object gets its own copy of
+  // its mesh, moved by a random rigid transform that its transform undoes,
+  // from a separate sequence so that the rest of the scene is unchanged.
+  if(description.duplicate_meshes) {
+    std::mt19937 placement_rng(description.seed + 1);
+    std::vector<QMatrix4x4> placements(scene.objects.size());
+    for(QMatrix4x4& placement : placements) {
+      placement.translate(10.0f * unit(placement_rng) - 5.0f,
+                          10.0f * unit(placement_rng) - 5.0f,
+                          10.0f * unit(placement_rng) - 5.0f);
+      placement.rotate(360.0f * unit(placement_rng),
+                       QVector3D(unit(placement_rng), unit(placement_rng),
+                                 unit(placement_rng) + 0.1f));
+    }
+    std::vector<MeshData> copies(scene.objects.size());
+    JobSystem::global().parallelFor(
+      0, copies.size(), 16, [&](size_t first, size_t last) {
+        for(size_t i = first; i < last; ++i) {
+          SceneObject& object = scene.objects[i];
+          const QMatrix4x4& placement = placements[i];
+          MeshData& copy = copies[i];
+          copy = scene.meshes[object.mesh_index];
+          for(size_t v = 0; v < copy.vertices.size(); v += 3) {
+            const QVector3D position = placement.map(QVector3D(
+              copy.vertices[v], copy.vertices[v + 1], copy.vertices[v + 2]));
+            const QVector3D normal = placement.mapVector(QVector3D(
+              copy.normals[v], copy.normals[v + 1], copy.normals[v + 2]));
+            for(int k = 0; k < 3; ++k) {
+              copy.vertices[v + k] = position[k];
+              copy.normals[v + k] = normal[k];
+            }
+          }
+          object.mesh_index = i;
+          object.transform = object.transform * placement.inverted();
+        }
+      });
+    scene.meshes.swap(copies);
+  }
+
+  const int light_count = std::max(description.light_count, 0);
+  for(int i = 0; i < light_count; ++i) {
+    LightData light;
+    const double angle = 2.0 * M_PI * i / std::max(light_count, 1);
+    light.position[0] = 2.0f * offset * std::cos(angle);
+    light.position[1] = 2.0f * offset + spacing;
+    light.position[2] = 2.0f * offset * std::sin(angle);
+    light.color[0] = 0.5f + 0.5f * unit(rng);
+    light.color[1] = 0.5f + 0.5f * unit(rng);
+    light.color[2] = 0.5f + 0.5f * unit(rng);
+    light.directional = i == 0;
+    scene.lights.push_back(light);
+  }
+
+  return scene;
+}
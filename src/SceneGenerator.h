@@ -0,0 +1,55 @@
+#ifndef SHIFT_GUI_SCENEGENERATOR_H_
+#define SHIFT_GUI_SCENEGENERATOR_H_
+
+#include <QMatrix4x4>
+
+#include "vulkan-engine/MeshData.h"
+
+namespace vulkan_engine {
+
+struct SceneDescription {
+  int object_count = 1000;
+  int mesh_count = 10;
+  int light_count = 4;
+  int min_triangles = 64;
+  int max_triangles = 4096;
+  unsigned int seed = 1;
+  // every object gets its own copy of its mesh, rigidly moved
+  bool duplicate_meshes = false;
+};
+
+struct SceneObject {
+  int mesh_index = 0;
+  int material_index = 0;
+  QMatrix4x4 transform = QMatrix4x4();
+};
+
+struct GeneratedScene {
+  std::vector<MeshData> meshes;
+  std::vector<MaterialData> materials;
+  std::vector<LightData> lights;
+  std::vector<SceneObject> objects;
+
+  /*! total number of triangles drawn when every object is rendered */
+  size_t triangleCount() const;
+};
+
+/*! Procedurally generates deterministic test scenes. Meshes are UV spheres
+ whose tessellation is spread evenly between the requested minimum and
+ maximum triangle counts, objects are laid out on a jittered grid and lights
+ are placed on a ring above the objects. The same description and seed
+ always produce the same scene. */
+class SceneGenerator {
+public:
+  static GeneratedScene generate(const SceneDescription& description);
+
+  /*! UV sphere of unit radius with 2 * rings * segments triangles */
+  static MeshData sphere(int rings, int segments);
+
+  /*! Cube spanning [-1, 1] with flat normals, 12 triangles */
+  static MeshData box();
+};
+
+}
+
+#endif
@@ -0,0 +1,246 @@
+#include "vulkan-engine/SceneGraph.h"
+
+#include <algorithm>
+
+#include <QtGlobal>
+
+const vulkan_engine::SceneGraph::NodeId
+  vulkan_engine::SceneGraph::INVALID_NODE;
+
+vulkan_engine::SceneGraph::NodeId
+vulkan_engine::SceneGraph::addNode(NodeId parent, const math::Mat4& local) {
+  if(parent != INVALID_NODE && !contains(parent)) {
+    qWarning("Invalid parent node %d", parent);
+    return INVALID_NODE;
+  }
+
+  // Nodes are appended, which keeps the depth-first order when the parent's
+  // subtree ends at the back (as when a hierarchy is built depth-first).
+  // Otherwise the order is restored once by the next update() or removal.
+  int32_t parent_index = -1;
+  if(parent != INVALID_NODE) {
+    parent_index = id_to_index_[parent];
+    ordered_ = ordered_ &&
+               parent_index + subtree_size_[parent_index] == size();
+  }
+
+  NodeId id;
+  if(!free_ids_.empty()) {
+    id = free_ids_.back();
+    free_ids_.pop_back();
+  } else {
+    id = id_to_index_.size();
+    id_to_index_.push_back(-1);
+  }
+
+  const uint32_t position = size();
+  parent_.push_back(parent_index);
+  subtree_size_.push_back(1);
+  local_.push_back(local);
+  world_.push_back(local);
+  index_to_id_.push_back(id);
+  id_to_index_[id] = position;
+  for(int32_t p = parent_index; p >= 0; p = parent_[p]) {
+    ++subtree_size_[p];
+  }
+
+  dirty_.push_back(id);
+  markChanged(position, 1);
+  return id;
+}
+
+void vulkan_engine::SceneGraph::restoreOrder() {
+  // Parents precede their children in the arrays, appended nodes included,
+  // so a single forward pass places every node right after the subtrees of
+  // its earlier siblings.
+  const size_t count = size();
+  std::vector<uint32_t> position(count);
+  std::vector<uint32_t> next_child(count);
+  uint32_t next_root = 0;
+  uint32_t first_moved = count;
+  for(size_t i = 0; i < count; ++i) {
+    const int32_t parent = parent_[i];
+    uint32_t& next = parent < 0 ? next_root : next_child[parent];
+    position[i] = next;
+    next += subtree_size_[i];
+    next_child[i] = position[i] + 1;
+    if(position[i] != i) {
+      first_moved = std::min(first_moved, position[i]);
+    }
+  }
+
+  std::vector<int32_t> parents(count);
+  std::vector<uint32_t> subtree_sizes(count);
+  math::Mat4Array locals(count);
+  math::Mat4Array worlds(count);
+  std::vector<NodeId> ids(count);
+  for(size_t i = 0; i < count; ++i) {
+    const uint32_t to = position[i];
+    parents[to] = parent_[i] < 0 ? -1 : int32_t(position[parent_[i]]);
+    subtree_sizes[to] = subtree_size_[i];
+    locals[to] = local_[i];
+    worlds[to] = world_[i];
+    ids[to] = index_to_id_[i];
+    id_to_index_[index_to_id_[i]] = to;
+  }
+  parent_.swap(parents);
+  subtree_size_.swap(subtree_sizes);
+  local_.swap(locals);
+  world_.swap(worlds);
+  index_to_id_.swap(ids);
+  ordered_ = true;
+
+  if(first_moved < count) {
+    markChanged(first_moved, count - first_moved);
+  }
+}
+
+void vulkan_engine::SceneGraph::removeNode(NodeId node) {
+  if(!contains(node)) {
+    return;
+  }
+  if(!ordered_) {
+    restoreOrder();
+  }
+
+  const uint32_t first = id_to_index_[node];
+  const uint32_t count = subtree_size_[first];
+  const uint32_t last = first + count;
+
+  for(int32_t p = parent_[first]; p >= 0; p = parent_[p]) {
+    subtree_size_[p] -= count;
+  }
+  for(uint32_t i = first; i < last; ++i) {
+    id_to_index_[index_to_id_[i]] = -1;
+    free_ids_.push_back(index_to_id_[i]);
+  }
+
+  parent_.erase(parent_.begin() + first, parent_.begin() + last);
+  subtree_size_.erase(subtree_size_.begin() + first,
+                      subtree_size_.begin() + last);
+  local_.erase(local_.begin() + first, local_.begin() + last);
+  world_.erase(world_.begin() + first, world_.begin() + last);
+  index_to_id_.erase(index_to_id_.begin() + first,
+                     index_to_id_.begin() + last);
+
+  for(size_t i = first; i < parent_.size(); ++i) {
+    if(parent_[i] >= int32_t(last)) {
+      parent_[i] -= count;
+    }
+    id_to_index_[index_to_id_[i]] = i;
+  }
+
+  // ranges recorded before the removal may reach past the end
+  const uint32_t end = size();
+  size_t kept = 0;
+  for(Range range : changed_ranges_) {
+    if(range.first < end) {
+      range.count = std::min(range.count, end - range.first);
+      changed_ranges_[kept++] = range;
+    }
+  }
+  changed_ranges_.resize(kept);
+  if(first < end) {
+    markChanged(first, end - first);
+  }
+}
+
+void vulkan_engine::SceneGraph::clear() {
+  parent_.clear();
+  subtree_size_.clear();
+  local_.clear();
+  world_.clear();
+  index_to_id_.clear();
+  id_to_index_.clear();
+  free_ids_.clear();
+  dirty_.clear();
+  changed_ranges_.clear();
+  ordered_ = true;
+}
+
+void vulkan_engine::SceneGraph::setLocal(NodeId node, const math::Mat4& local) {
+  if(!contains(node)) {
+    qWarning("Invalid node %d", node);
+    return;
+  }
+  local_[id_to_index_[node]] = local;
+  dirty_.push_back(node);
+}
+
+void vulkan_engine::SceneGraph::update() {
+  last_update_count_ = 0;
+  if(!ordered_) {
+    restoreOrder();
+  }
+  if(dirty_.empty()) {
+    return;
+  }
+
+  std::vector<uint32_t> dirty_indices;
+  dirty_indices.reserve(dirty_.size());
+  for(NodeId node : dirty_) {
+    // nodes removed since they were marked are skipped
+    if(contains(node)) {
+      dirty_indices.push_back(id_to_index_[node]);
+    }
+  }
+  dirty_.clear();
+  std::sort(dirty_indices.begin(), dirty_indices.end());
+
+  // Dirty nodes inside an already recomputed subtree are skipped. Parents
+  // precede their children, so world_[parent] is always up to date when a
+  // child is computed.
+  uint32_t end = 0;
+  for(uint32_t first : dirty_indices) {
+    if(first < end) {
+      continue;
+    }
+    end = first + subtree_size_[first];
+    for(uint32_t i = first; i < end; ++i) {
+      const int32_t parent = parent_[i];
+      if(parent < 0) {
+        world_[i] = local_[i];
+      } else {
+        math::multiply(world_[parent], local_[i], &world_[i]);
+      }
+    }
+    markChanged(first, end - first);
+    last_update_count_ += end - first;
+  }
+}
+
+void vulkan_engine::SceneGraph::markChanged(uint32_t first, uint32_t count) {
+  if(count == 0) {
+    return;
+  }
+
+  // common case: ranges are reported in ascending order
+  if(changed_ranges_.empty() ||
+     first >= changed_ranges_.back().first + changed_ranges_.back().count) {
+    if(!changed_ranges_.empty() &&
+       first == changed_ranges_.back().first + changed_ranges_.back().count) {
+      changed_ranges_.back().count += count;
+    } else {
+      Range range = {first, count};
+      changed_ranges_.push_back(range);
+    }
+    return;
+  }
+
+  Range range = {first, count};
+  changed_ranges_.push_back(range);
+  std::sort(changed_ranges_.begin(), changed_ranges_.end(),
+            [](const Range& a, const Range& b) { return a.first < b.first; });
+  size_t merged = 0;
+  for(size_t i = 1; i < changed_ranges_.size(); ++i) {
+    Range& last = changed_ranges_[merged];
+    const Range& next = changed_ranges_[i];
+    if(next.first <= last.first + last.count) {
+      last.count =
+        std::max(last.first + last.count, next.first + next.count) - last.first;
+    } else {
+      changed_ranges_[++merged] = next;
+    }
+  }
+  changed_ranges_.resize(merged + 1);
+}
@@ -0,0 +1,133 @@
+#ifndef SHIFT_GUI_SCENEGRAPH_H_
+#define SHIFT_GUI_SCENEGRAPH_H_
+
+#include <cstdint>
+#include <vector>
+
+#include "vulkan-engine/SimdMath.h"
+
+namespace vulkan_engine {
+
+/*! Transform hierarchy stored as depth-first ordered structure-of-arrays.
+
+ Every node has a parent index, a local and a world transform. Because the
+ arrays are in depth-first order, the subtree of a node is the contiguous
+ range [index, index + subtreeSize) and every parent precedes its children,
+ so world transforms can be computed in a single forward pass.
+
+ Changing a local transform only marks the node dirty; update() recomputes
+ the world transforms of dirty nodes and their subtrees and nothing else.
+ The index ranges whose world transforms changed are accumulated in
+ changedRanges() until clearChangedRanges(), so that GPU copies of the
+ world transforms (which use the same indices) only need to upload those.
+
+ Nodes are referred to by stable ids; indices change when nodes are added or
+ removed before them. Adding a node appends it, so building a hierarchy is
+ linear; nodes added out of depth-first order are moved into place by the
+ next update(), and indices and the per-index accessors are only valid after
+ it. */
+class SceneGraph {
+public:
+  typedef int32_t NodeId;
+  static const NodeId INVALID_NODE = -1;
+
+  struct Range {
+    uint32_t first;
+    uint32_t count;
+  };
+
+  /*! Adds a node as last child of parent (INVALID_NODE for a root node).
+   Returns INVALID_NODE if parent is not a node of the graph. */
+  NodeId addNode(NodeId parent, const math::Mat4& local);
+
+  /*! Removes a node together with its subtree. */
+  void removeNode(NodeId node);
+
+  void clear();
+
+  /*! Ignored with a warning if node is not in the graph. */
+  void setLocal(NodeId node, const math::Mat4& local);
+
+  /*! Recomputes the world transforms of all dirty subtrees. */
+  void update();
+
+  inline size_t size() const {
+    return parent_.size();
+  }
+
+  inline bool contains(NodeId node) const {
+    return node >= 0 && size_t(node) < id_to_index_.size() &&
+           id_to_index_[node] >= 0;
+  }
+
+  /*! position of a node in the depth-first arrays */
+  inline uint32_t index(NodeId node) const {
+    return id_to_index_[node];
+  }
+
+  inline NodeId node(uint32_t index) const {
+    return index_to_id_[index];
+  }
+
+  inline const math::Mat4& local(NodeId node) const {
+    return local_[id_to_index_[node]];
+  }
+
+  /*! world transform as of the last update() */
+  inline const math::Mat4& world(NodeId node) const {
+    return world_[id_to_index_[node]];
+  }
+
+  /*! parent index of every node, -1 for root nodes */
+  inline const int32_t* parents() const {
+    return parent_.data();
+  }
+
+  /*! world transforms of all nodes in depth-first order */
+  inline const math::Mat4* worlds() const {
+    return world_.data();
+  }
+
+  inline uint32_t subtreeSize(NodeId node) const {
+    return subtree_size_[id_to_index_[node]];
+  }
+
+  /*! Sorted, non-overlapping index ranges whose world transform changed
+   since the last call to clearChangedRanges(). */
+  inline const std::vector<Range>& changedRanges() const {
+    return changed_ranges_;
+  }
+
+  inline void clearChangedRanges() {
+    changed_ranges_.clear();
+  }
+
+  /*! number of world transforms recomputed by the last update() */
+  inline size_t lastUpdateCount() const {
+    return last_update_count_;
+  }
+
+private:
+  void markChanged(uint32_t first, uint32_t count);
+  void restoreOrder();
+
+  // depth-first ordered node data
+  std::vector<int32_t> parent_;
+  std::vector<uint32_t> subtree_size_;
+  math::Mat4Array local_;
+  math::Mat4Array world_;
+  std::vector<NodeId> index_to_id_;
+
+  std::vector<int32_t> id_to_index_;
+  std::vector<NodeId> free_ids_;
+
+  std::vector<NodeId> dirty_;
+  std::vector<Range> changed_ranges_;
+  size_t last_update_count_ = 0;
+  // false while appended nodes are out of depth-first order
+  bool ordered_ = true;
+};
+
+}
+
+#endif
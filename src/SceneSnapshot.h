@@ -0,0 +1,46 @@
+#ifndef SHIFT_GUI_SCENESNAPSHOT_H_
+#define SHIFT_GUI_SCENESNAPSHOT_H_
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include "vulkan-engine/MeshData.h"
+#include "vulkan-engine/SimdMath.h"
+
+namespace vulkan_engine {
+
+/*! Material of the objects sharing material data and a mesh, whose texture
+ maps it samples. */
+struct MaterialInstance {
+  const MaterialData* data; // nullptr for the default material
+  uint32_t mesh;
+};
+
+/*! Everything a frame needs from the scene, copied out of the scene graph
+ and entity store once their update is complete. Rendering only reads
+ snapshots, so the scene can be updated concurrently on another thread. The
+ arrays are the dense entity arrays of EntityStore. */
+struct SceneSnapshot {
+  uint64_t sequence = 0;         // increases with every published snapshot
+  uint64_t scene_generation = 0; // changes when the scene is cleared
+  uint32_t mesh_count = 0;       // mesh table size, above all of meshes
+  float update_time = 0.0f;      // ms spent producing the snapshot
+  // of the oldest input the view shows first, the epoch if none
+  std::chrono::steady_clock::time_point input_time;
+
+  math::Mat4 view = math::Mat4::identity();
+  math::Mat4Array transforms;
+  // dense indices whose transform changed since the previous snapshot
+  std::vector<uint32_t> updated_transforms;
+  math::BoundsArray bounds;
+  std::vector<uint32_t> meshes;
+  std::vector<uint32_t> materials; // indices into material_instances
+  std::vector<uint32_t> flags;
+  std::vector<LightData> lights;
+  std::vector<MaterialInstance> material_instances;
+};
+
+}
+
+#endif
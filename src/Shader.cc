@@ -2,17 +2,20 @@
 
 #include <QFile>
 #include <QVulkanDeviceFunctions>
-#include <QtConcurrent/QtConcurrent>
 
 void vulkan_engine::Shader::load(QVulkanInstance* inst, VkDevice dev, const QString& fn) {
   reset();
   maybe_running_ = true;
-  future_ = QtConcurrent::run([inst, dev, fn]() {
-    ShaderData sd;
+  std::shared_ptr<ShaderData> result = std::make_shared<ShaderData>();
+  result_ = result;
+  // resolved here, QVulkanInstance::deviceFunctions() is not thread-safe
+  QVulkanDeviceFunctions* funcs = inst->deviceFunctions(dev);
+  job_ = JobSystem::global().schedule([funcs, dev, fn, result]() {
+    ShaderData& sd = *result;
     QFile f(fn);
     if(!f.open(QIODevice::ReadOnly)) {
       qWarning("Failed to open %s", qPrintable(fn));
-      return sd;
+      return;
     }
     QByteArray blob = f.readAll();
     VkShaderModuleCreateInfo shader_info;
@@ -20,19 +23,19 @@ void vulkan_engine::Shader::load(QVulkanInstance* inst, VkDevice dev, const QStr
     shader_info.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     shader_info.codeSize = blob.size();
     shader_info.pCode = reinterpret_cast<const uint32_t*>(blob.constData());
-    VkResult err = inst->deviceFunctions(dev)->vkCreateShaderModule(
-      dev, &shader_info, nullptr, &sd.shader_module);
+    VkResult err =
+      funcs->vkCreateShaderModule(dev, &shader_info, nullptr, &sd.shader_module);
     if(err != VK_SUCCESS) {
       qWarning("Failed to create shader module: %d", err);
-      return sd;
     }
-    return sd;
   });
 }
 
 vulkan_engine::ShaderData* vulkan_engine::Shader::data() {
-  if(maybe_running_ && !data_.isValid())
-    data_ = future_.result();
+  if(maybe_running_ && !data_.isValid()) {
+    JobSystem::global().wait(job_);
+    data_ = *result_;
+  }
   return &data_;
 }
 
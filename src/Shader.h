@@ -1,9 +1,12 @@
 #ifndef SHIFT_GUI_SHADER_H_
 #define SHIFT_GUI_SHADER_H_
 
-#include <QFuture>
+#include <memory>
+
 #include <QVulkanInstance>
 
+#include "vulkan-engine/JobSystem.h"
+
 namespace vulkan_engine {
 
 struct ShaderData {
@@ -24,7 +27,8 @@ public:
 
 private:
   bool maybe_running_ = false;
-  QFuture<ShaderData> future_;
+  JobSystem::JobHandle job_;
+  std::shared_ptr<ShaderData> result_;
   ShaderData data_;
 };
 
@@ -0,0 +1,265 @@
+#include "vulkan-engine/SimdMath.h"
+
+#include <algorithm>
+#include <cmath>
+
+using vulkan_engine::math::Mat3x4;
+using vulkan_engine::math::Mat4;
+
+#if defined(VULKAN_ENGINE_SSE)
+static inline __m128 cross(__m128 a, __m128 b) {
+  const __m128 a_yzx = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 0, 2, 1));
+  const __m128 b_yzx = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 0, 2, 1));
+  const __m128 c = _mm_sub_ps(_mm_mul_ps(a, b_yzx), _mm_mul_ps(a_yzx, b));
+  return _mm_shuffle_ps(c, c, _MM_SHUFFLE(3, 0, 2, 1));
+}
+
+static inline float dot3(__m128 a, __m128 b) {
+  const __m128 p = _mm_mul_ps(a, b);
+  return _mm_cvtss_f32(p) +
+         _mm_cvtss_f32(_mm_shuffle_ps(p, p, _MM_SHUFFLE(1, 1, 1, 1))) +
+         _mm_cvtss_f32(_mm_shuffle_ps(p, p, _MM_SHUFFLE(2, 2, 2, 2)));
+}
+#endif
+
+#if defined(VULKAN_ENGINE_AVX)
+// Multiplies the columns held in a0..a3 with two columns of b at once.
+static inline __m256 multiplyColumns(__m256 a0, __m256 a1, __m256 a2,
+                                     __m256 a3, __m256 b) {
+#if defined(__FMA__)
+  __m256 c = _mm256_mul_ps(a0, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)));
+  c = _mm256_fmadd_ps(a1, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1)), c);
+  c = _mm256_fmadd_ps(a2, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2)), c);
+  c = _mm256_fmadd_ps(a3, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3)), c);
+#else
+  __m256 c = _mm256_mul_ps(a0, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0)));
+  c = _mm256_add_ps(
+    c, _mm256_mul_ps(a1, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1))));
+  c = _mm256_add_ps(
+    c, _mm256_mul_ps(a2, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2))));
+  c = _mm256_add_ps(
+    c, _mm256_mul_ps(a3, _mm256_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3))));
+#endif
+  return c;
+}
+#endif
+
+void vulkan_engine::math::normalMatrix(const Mat4& a, Mat3x4* r) {
+  // The inverse transpose of M = [c0 c1 c2] is
+  // [c1 x c2, c2 x c0, c0 x c1] / det(M) with det(M) = c0 . (c1 x c2).
+#if defined(VULKAN_ENGINE_SSE)
+  const __m128 c0 = _mm_load_ps(a.m + 0);
+  const __m128 c1 = _mm_load_ps(a.m + 4);
+  const __m128 c2 = _mm_load_ps(a.m + 8);
+  const __m128 r0 = cross(c1, c2);
+  const float det = dot3(c0, r0);
+  if(std::fabs(det) < 1e-30f) {
+    memset(r->m, 0, sizeof(r->m));
+    r->m[0] = r->m[5] = r->m[10] = 1.0f;
+    return;
+  }
+  const __m128 inv_det = _mm_set1_ps(1.0f / det);
+  _mm_store_ps(r->m + 0, _mm_mul_ps(r0, inv_det));
+  _mm_store_ps(r->m + 4, _mm_mul_ps(cross(c2, c0), inv_det));
+  _mm_store_ps(r->m + 8, _mm_mul_ps(cross(c0, c1), inv_det));
+#else
+  const float* c0 = a.m + 0;
+  const float* c1 = a.m + 4;
+  const float* c2 = a.m + 8;
+  const float* columns[3][2] = {{c1, c2}, {c2, c0}, {c0, c1}};
+  float n[12];
+  for(int i = 0; i < 3; ++i) {
+    const float* u = columns[i][0];
+    const float* v = columns[i][1];
+    n[4 * i + 0] = u[1] * v[2] - u[2] * v[1];
+    n[4 * i + 1] = u[2] * v[0] - u[0] * v[2];
+    n[4 * i + 2] = u[0] * v[1] - u[1] * v[0];
+    n[4 * i + 3] = 0.0f;
+  }
+  const float det = c0[0] * n[0] + c0[1] * n[1] + c0[2] * n[2];
+  if(std::fabs(det) < 1e-30f) {
+    memset(r->m, 0, sizeof(r->m));
+    r->m[0] = r->m[5] = r->m[10] = 1.0f;
+    return;
+  }
+  for(int i = 0; i < 12; ++i) {
+    r->m[i] = n[i] / det;
+  }
+#endif
+}
+
+void vulkan_engine::math::multiply(const Mat4& a, const Mat4* b, Mat4* r,
+                                   size_t count) {
+#if defined(VULKAN_ENGINE_AVX)
+  // the columns of a stay in registers for the whole batch
+  const __m256 a0 = _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a.m));
+  const __m256 a1 =
+    _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a.m + 4));
+  const __m256 a2 =
+    _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a.m + 8));
+  const __m256 a3 =
+    _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a.m + 12));
+  for(size_t i = 0; i < count; ++i) {
+    const float* bm = b[i].m;
+    float* rm = r[i].m;
+    const __m256 c01 =
+      multiplyColumns(a0, a1, a2, a3, _mm256_loadu_ps(bm + 0));
+    const __m256 c23 =
+      multiplyColumns(a0, a1, a2, a3, _mm256_loadu_ps(bm + 8));
+    _mm256_storeu_ps(rm + 0, c01);
+    _mm256_storeu_ps(rm + 8, c23);
+  }
+#else
+  const Mat4 lhs = a; // r may alias a
+  for(size_t i = 0; i < count; ++i) {
+    multiply(lhs, b[i], &r[i]);
+  }
+#endif
+}
+
+void vulkan_engine::math::multiply(const Mat4* a, const Mat4* b, Mat4* r,
+                                   size_t count) {
+#if defined(VULKAN_ENGINE_AVX)
+  for(size_t i = 0; i < count; ++i) {
+    const __m256 a0 =
+      _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a[i].m));
+    const __m256 a1 =
+      _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a[i].m + 4));
+    const __m256 a2 =
+      _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a[i].m + 8));
+    const __m256 a3 =
+      _mm256_broadcast_ps(reinterpret_cast<const __m128*>(a[i].m + 12));
+    const __m256 c01 =
+      multiplyColumns(a0, a1, a2, a3, _mm256_loadu_ps(b[i].m + 0));
+    const __m256 c23 =
+      multiplyColumns(a0, a1, a2, a3, _mm256_loadu_ps(b[i].m + 8));
+    _mm256_storeu_ps(r[i].m + 0, c01);
+    _mm256_storeu_ps(r[i].m + 8, c23);
+  }
+#else
+  for(size_t i = 0; i < count; ++i) {
+    multiply(a[i], b[i], &r[i]);
+  }
+#endif
+}
+
+void vulkan_engine::math::normalMatrices(const Mat4* a, Mat3x4* r,
+                                         size_t count) {
+  for(size_t i = 0; i < count; ++i) {
+    normalMatrix(a[i], &r[i]);
+  }
+}
+
+vulkan_engine::math::Bounds vulkan_engine::math::computeBounds(const float* xyz,
+                                                               size_t count) {
+  Bounds r;
+  memset(&r, 0, sizeof(r));
+  if(count == 0) {
+    return r;
+  }
+  for(int i = 0; i < 3; ++i) {
+    r.min[i] = r.max[i] = xyz[i];
+  }
+  for(size_t v = 1; v < count; ++v) {
+    for(int i = 0; i < 3; ++i) {
+      r.min[i] = std::min(r.min[i], xyz[3 * v + i]);
+      r.max[i] = std::max(r.max[i], xyz[3 * v + i]);
+    }
+  }
+  return r;
+}
+
+void vulkan_engine::math::transformBounds(const Mat4& a, const Bounds& b,
+                                          Bounds* r) {
+  // Transform the center and project the extents onto the world axes
+  // (Arvo's method), which avoids transforming all eight corners.
+#if defined(VULKAN_ENGINE_SSE)
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 lo = _mm_load_ps(b.min);
+  const __m128 hi = _mm_load_ps(b.max);
+  const __m128 center = _mm_mul_ps(_mm_add_ps(lo, hi), half);
+  const __m128 extent = _mm_mul_ps(_mm_sub_ps(hi, lo), half);
+  const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+  const __m128 c0 = _mm_load_ps(a.m + 0);
+  const __m128 c1 = _mm_load_ps(a.m + 4);
+  const __m128 c2 = _mm_load_ps(a.m + 8);
+  const __m128 c3 = _mm_load_ps(a.m + 12);
+
+  __m128 world_center = _mm_add_ps(
+    c3, _mm_mul_ps(c0, _mm_shuffle_ps(center, center, _MM_SHUFFLE(0, 0, 0, 0))));
+  world_center = _mm_add_ps(
+    world_center,
+    _mm_mul_ps(c1, _mm_shuffle_ps(center, center, _MM_SHUFFLE(1, 1, 1, 1))));
+  world_center = _mm_add_ps(
+    world_center,
+    _mm_mul_ps(c2, _mm_shuffle_ps(center, center, _MM_SHUFFLE(2, 2, 2, 2))));
+
+  __m128 world_extent = _mm_mul_ps(
+    _mm_and_ps(c0, abs_mask),
+    _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(0, 0, 0, 0)));
+  world_extent = _mm_add_ps(
+    world_extent,
+    _mm_mul_ps(_mm_and_ps(c1, abs_mask),
+               _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(1, 1, 1, 1))));
+  world_extent = _mm_add_ps(
+    world_extent,
+    _mm_mul_ps(_mm_and_ps(c2, abs_mask),
+               _mm_shuffle_ps(extent, extent, _MM_SHUFFLE(2, 2, 2, 2))));
+
+  // w is zero, as in the scalar path
+  const __m128 xyz_mask = _mm_castsi128_ps(_mm_set_epi32(0, -1, -1, -1));
+  _mm_store_ps(r->min,
+               _mm_and_ps(_mm_sub_ps(world_center, world_extent), xyz_mask));
+  _mm_store_ps(r->max,
+               _mm_and_ps(_mm_add_ps(world_center, world_extent), xyz_mask));
+#else
+  float center[3];
+  float extent[3];
+  for(int i = 0; i < 3; ++i) {
+    center[i] = 0.5f * (b.min[i] + b.max[i]);
+    extent[i] = 0.5f * (b.max[i] - b.min[i]);
+  }
+  for(int i = 0; i < 3; ++i) {
+    float c = a.m[12 + i];
+    float e = 0.0f;
+    for(int j = 0; j < 3; ++j) {
+      c += a.m[4 * j + i] * center[j];
+      e += std::fabs(a.m[4 * j + i]) * extent[j];
+    }
+    r->min[i] = c - e;
+    r->max[i] = c + e;
+  }
+  r->min[3] = r->max[3] = 0.0f;
+#endif
+}
+
+vulkan_engine::math::Frustum
+vulkan_engine::math::frustumFromMatrix(const Mat4& m) {
+  // Gribb/Hartmann plane extraction from the rows of the matrix
+  Frustum f;
+  for(int i = 0; i < 4; ++i) {
+    const float row0 = m(0, i);
+    const float row1 = m(1, i);
+    const float row2 = m(2, i);
+    const float row3 = m(3, i);
+    f.planes[0][i] = row3 + row0; // left
+    f.planes[1][i] = row3 - row0; // right
+    f.planes[2][i] = row3 + row1; // bottom
+    f.planes[3][i] = row3 - row1; // top
+    f.planes[4][i] = row2;        // near (0 <= z)
+    f.planes[5][i] = row3 - row2; // far
+  }
+  for(int p = 0; p < 6; ++p) {
+    const float length =
+      std::sqrt(f.planes[p][0] * f.planes[p][0] +
+                f.planes[p][1] * f.planes[p][1] +
+                f.planes[p][2] * f.planes[p][2]);
+    if(length > 0.0f) {
+      for(int i = 0; i < 4; ++i) {
+        f.planes[p][i] /= length;
+      }
+    }
+  }
+  return f;
+}
@@ -0,0 +1,249 @@
+#ifndef SHIFT_GUI_SIMDMATH_H_
+#define SHIFT_GUI_SIMDMATH_H_
+
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+#include <new>
+#include <vector>
+
+#include <QMatrix4x4>
+#include <QVector3D>
+#include <QVector4D>
+
+#if defined(__SSE2__) && !defined(VULKAN_ENGINE_NO_SIMD)
+#define VULKAN_ENGINE_SSE 1
+#include <immintrin.h>
+#if defined(__AVX__)
+#define VULKAN_ENGINE_AVX 1
+#endif
+#endif
+
+namespace vulkan_engine {
+
+/*! Small math core for the per-frame hot paths. Matrices are column-major
+ like QMatrix4x4 and the GLSL std140 layout, 16-byte aligned and carry no
+ flags, so arrays of them can be streamed with SSE (or AVX when compiled
+ with -mavx) and copied to GPU buffers as is. A scalar fallback is used when
+ SIMD is not available or VULKAN_ENGINE_NO_SIMD is defined.
+
+ Qt types are only used at the API boundary: convert with fromQt()/toQt(). */
+namespace math {
+
+struct alignas(16) Vec4 {
+  float v[4];
+};
+
+struct alignas(16) Mat4 {
+  float m[16]; // column-major, m[4 * column + row]
+
+  inline float& operator()(int row, int column) {
+    return m[4 * column + row];
+  }
+  inline float operator()(int row, int column) const {
+    return m[4 * column + row];
+  }
+
+  static inline Mat4 identity() {
+    Mat4 r;
+    memset(r.m, 0, sizeof(r.m));
+    r.m[0] = r.m[5] = r.m[10] = r.m[15] = 1.0f;
+    return r;
+  }
+};
+
+/*! 3x3 matrix with each column padded to 4 floats, matching a GLSL std140
+ mat3 (e.g. Transform::nm in pbr.glsl) */
+struct alignas(16) Mat3x4 {
+  float m[12];
+};
+
+/*! axis-aligned bounding box, the w components are unused */
+struct alignas(16) Bounds {
+  float min[4];
+  float max[4];
+};
+
+/*! six clip planes (x, y, z, d) with normals pointing inwards */
+struct alignas(16) Frustum {
+  float planes[6][4];
+};
+
+/*! std::allocator replacement honoring the alignment of the math types,
+ which std::allocator does not guarantee before C++17 */
+template<class T>
+struct AlignedAllocator {
+  typedef T value_type;
+
+  AlignedAllocator() {}
+  template<class U>
+  AlignedAllocator(const AlignedAllocator<U>&) {}
+
+  T* allocate(size_t n) {
+    void* p = nullptr;
+    const size_t alignment = alignof(T) < 32 ? 32 : alignof(T);
+#ifdef _MSC_VER
+    p = _aligned_malloc(n * sizeof(T), alignment);
+    if(!p) {
+      throw std::bad_alloc();
+    }
+#else
+    if(posix_memalign(&p, alignment, n * sizeof(T)) != 0) {
+      throw std::bad_alloc();
+    }
+#endif
+    return static_cast<T*>(p);
+  }
+  void deallocate(T* p, size_t) {
+#ifdef _MSC_VER
+    _aligned_free(p);
+#else
+    free(p);
+#endif
+  }
+};
+
+template<class T, class U>
+inline bool operator==(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+  return true;
+}
+template<class T, class U>
+inline bool operator!=(const AlignedAllocator<T>&, const AlignedAllocator<U>&) {
+  return false;
+}
+
+typedef std::vector<Mat4, AlignedAllocator<Mat4>> Mat4Array;
+typedef std::vector<Mat3x4, AlignedAllocator<Mat3x4>> Mat3x4Array;
+typedef std::vector<Bounds, AlignedAllocator<Bounds>> BoundsArray;
+
+inline Mat4 fromQt(const QMatrix4x4& q) {
+  Mat4 r;
+  memcpy(r.m, q.constData(), sizeof(r.m));
+  return r;
+}
+
+inline QMatrix4x4 toQt(const Mat4& a) {
+  QMatrix4x4 q;
+  memcpy(q.data(), a.m, sizeof(a.m));
+  q.optimize();
+  return q;
+}
+
+inline Vec4 fromQt(const QVector4D& q) {
+  Vec4 r = {{q.x(), q.y(), q.z(), q.w()}};
+  return r;
+}
+
+inline QVector4D toQt(const Vec4& a) {
+  return QVector4D(a.v[0], a.v[1], a.v[2], a.v[3]);
+}
+
+/*! r = a * b */
+inline void multiply(const Mat4& a, const Mat4& b, Mat4* r) {
+#if defined(VULKAN_ENGINE_SSE)
+  const __m128 a0 = _mm_load_ps(a.m + 0);
+  const __m128 a1 = _mm_load_ps(a.m + 4);
+  const __m128 a2 = _mm_load_ps(a.m + 8);
+  const __m128 a3 = _mm_load_ps(a.m + 12);
+  for(int j = 0; j < 4; ++j) {
+    const __m128 b_col = _mm_load_ps(b.m + 4 * j);
+    __m128 c =
+      _mm_mul_ps(a0, _mm_shuffle_ps(b_col, b_col, _MM_SHUFFLE(0, 0, 0, 0)));
+    c = _mm_add_ps(
+      c, _mm_mul_ps(a1, _mm_shuffle_ps(b_col, b_col, _MM_SHUFFLE(1, 1, 1, 1))));
+    c = _mm_add_ps(
+      c, _mm_mul_ps(a2, _mm_shuffle_ps(b_col, b_col, _MM_SHUFFLE(2, 2, 2, 2))));
+    c = _mm_add_ps(
+      c, _mm_mul_ps(a3, _mm_shuffle_ps(b_col, b_col, _MM_SHUFFLE(3, 3, 3, 3))));
+    _mm_store_ps(r->m + 4 * j, c);
+  }
+#else
+  float c[16];
+  for(int j = 0; j < 4; ++j) {
+    for(int i = 0; i < 4; ++i) {
+      c[4 * j + i] = a.m[i] * b.m[4 * j] + a.m[4 + i] * b.m[4 * j + 1] +
+                     a.m[8 + i] * b.m[4 * j + 2] +
+                     a.m[12 + i] * b.m[4 * j + 3];
+    }
+  }
+  memcpy(r->m, c, sizeof(c));
+#endif
+}
+
+inline Mat4 operator*(const Mat4& a, const Mat4& b) {
+  Mat4 r;
+  multiply(a, b, &r);
+  return r;
+}
+
+/*! r = a * v */
+inline Vec4 transform(const Mat4& a, const Vec4& v) {
+  Vec4 r;
+#if defined(VULKAN_ENGINE_SSE)
+  const __m128 x = _mm_load_ps(v.v);
+  __m128 c = _mm_mul_ps(_mm_load_ps(a.m + 0),
+                        _mm_shuffle_ps(x, x, _MM_SHUFFLE(0, 0, 0, 0)));
+  c = _mm_add_ps(c, _mm_mul_ps(_mm_load_ps(a.m + 4),
+                               _mm_shuffle_ps(x, x, _MM_SHUFFLE(1, 1, 1, 1))));
+  c = _mm_add_ps(c, _mm_mul_ps(_mm_load_ps(a.m + 8),
+                               _mm_shuffle_ps(x, x, _MM_SHUFFLE(2, 2, 2, 2))));
+  c = _mm_add_ps(c, _mm_mul_ps(_mm_load_ps(a.m + 12),
+                               _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3))));
+  _mm_store_ps(r.v, c);
+#else
+  for(int i = 0; i < 4; ++i) {
+    r.v[i] = a.m[i] * v.v[0] + a.m[4 + i] * v.v[1] + a.m[8 + i] * v.v[2] +
+             a.m[12 + i] * v.v[3];
+  }
+#endif
+  return r;
+}
+
+/*! Inverse transpose of the upper 3x3 block of a, i.e. the matrix that
+ transforms normals. Returns the identity for singular matrices. */
+void normalMatrix(const Mat4& a, Mat3x4* r);
+
+/*! Bounds of count points given as consecutive xyz triplets. */
+Bounds computeBounds(const float* xyz, size_t count);
+
+/*! Bounds of the box b transformed by the affine matrix a */
+void transformBounds(const Mat4& a, const Bounds& b, Bounds* r);
+
+/*! Extracts the clip planes of a view-projection matrix using the Vulkan
+ clip space convention (0 <= z <= w). */
+Frustum frustumFromMatrix(const Mat4& view_projection);
+
+/*! false if the box is entirely outside of one of the planes */
+inline bool intersects(const Frustum& f, const Bounds& b) {
+  for(int i = 0; i < 6; ++i) {
+    const float* p = f.planes[i];
+    // corner of the box furthest along the plane normal
+    const float x = p[0] >= 0.0f ? b.max[0] : b.min[0];
+    const float y = p[1] >= 0.0f ? b.max[1] : b.min[1];
+    const float z = p[2] >= 0.0f ? b.max[2] : b.min[2];
+    if(p[0] * x + p[1] * y + p[2] * z + p[3] < 0.0f) {
+      return false;
+    }
+  }
+  return true;
+}
+
+/*! r[i] = a * b[i] for count matrices, e.g. view-projection times every
+ model matrix of the scene */
+void multiply(const Mat4& a, const Mat4* b, Mat4* r, size_t count);
+
+/*! r[i] = a[i] * b[i] for count matrices, e.g. parent world times local
+ transforms */
+void multiply(const Mat4* a, const Mat4* b, Mat4* r, size_t count);
+
+/*! r[i] = normalMatrix(a[i]) for count matrices */
+void normalMatrices(const Mat4* a, Mat3x4* r, size_t count);
+
+}
+
+}
+
+#endif
@@ -0,0 +1,361 @@
+#include "vulkan-engine/TextureCache.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+
+#include "vulkan-engine/BlockCompression.h"
+
+// bumped whenever the encoding changes, invalidates all cached files
+static const int CACHE_VERSION = 1;
+
+static const uint8_t KTX2_IDENTIFIER[12] = {0xAB, 'K',  'T',  'X', ' ',  '2',
+                                            '0',  0xBB, '\r', '\n', 0x1A, '\n'};
+
+static const char HASH_KEY[] = "VEcontentHash";
+
+// level data is aligned to the largest block size
+static const size_t LEVEL_ALIGNMENT = 16;
+
+struct Ktx2Header {
+  uint32_t vk_format;
+  uint32_t type_size;
+  uint32_t pixel_width;
+  uint32_t pixel_height;
+  uint32_t pixel_depth;
+  uint32_t layer_count;
+  uint32_t face_count;
+  uint32_t level_count;
+  uint32_t supercompression_scheme;
+  uint32_t dfd_byte_offset;
+  uint32_t dfd_byte_length;
+  uint32_t kvd_byte_offset;
+  uint32_t kvd_byte_length;
+  uint64_t sgd_byte_offset;
+  uint64_t sgd_byte_length;
+};
+
+struct Ktx2Level {
+  uint64_t byte_offset;
+  uint64_t byte_length;
+  uint64_t uncompressed_byte_length;
+};
+
+static inline size_t alignedSize(size_t v, size_t alignment) {
+  return (v + alignment - 1) / alignment * alignment;
+}
+
+static uint64_t fnv1a(const void* data, size_t size,
+                      uint64_t hash = 14695981039346656037ull) {
+  const uint8_t* p = static_cast<const uint8_t*>(data);
+  for(size_t i = 0; i < size; ++i) {
+    hash = (hash ^ p[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static bool blockFormat(VkFormat format, vulkan_engine::bc::Format* bc) {
+  switch(format) {
+  case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    *bc = vulkan_engine::bc::BC1;
+    return true;
+  case VK_FORMAT_BC3_UNORM_BLOCK:
+    *bc = vulkan_engine::bc::BC3;
+    return true;
+  case VK_FORMAT_BC4_UNORM_BLOCK:
+    *bc = vulkan_engine::bc::BC4;
+    return true;
+  case VK_FORMAT_BC5_UNORM_BLOCK:
+    *bc = vulkan_engine::bc::BC5;
+    return true;
+  default:
+    return false;
+  }
+}
+
+vulkan_engine::TextureCache::TextureCache(const std::string& directory)
+  : directory_(directory) {}
+
+std::string vulkan_engine::TextureCache::cachePath(const std::string& source,
+                                                   Kind kind) const {
+  const QFileInfo info(QString::fromStdString(source));
+  const int64_t stamp[4] = {info.size(),
+                            info.lastModified().toMSecsSinceEpoch(),
+                            int64_t(kind), CACHE_VERSION};
+  const uint64_t hash =
+    fnv1a(stamp, sizeof(stamp), fnv1a(source.data(), source.size()));
+  char name[32];
+  snprintf(name, sizeof(name), "%016llx.ktx2",
+           static_cast<unsigned long long>(hash));
+  return directory_ + "/" + name;
+}
+
+bool vulkan_engine::TextureCache::load(const std::string& source, Kind kind,
+                                       Image* image) const {
+  const std::string path = cachePath(source, kind);
+  if(QFile::exists(QString::fromStdString(path)) && read(path, image)) {
+    return true;
+  }
+  return bake(source, kind, image);
+}
+
+bool vulkan_engine::TextureCache::bake(const std::string& source, Kind kind,
+                                       Image* image) const {
+  QImage decoded(QString::fromStdString(source));
+  if(decoded.isNull()) {
+    qWarning("Failed to load texture %s", source.c_str());
+    return false;
+  }
+  const bool alpha = kind == COLOR && decoded.hasAlphaChannel();
+  decoded = decoded.convertToFormat(QImage::Format_RGBA8888);
+
+  // color maps only pay for alpha if it is used
+  bool translucent = false;
+  for(int y = 0; alpha && !translucent && y < decoded.height(); ++y) {
+    const uint8_t* row = decoded.constScanLine(y);
+    for(int x = 0; x < decoded.width(); ++x) {
+      translucent |= row[4 * x + 3] != 255;
+    }
+  }
+  bc::Format bc_format;
+  Image result;
+  switch(kind) {
+  case COLOR:
+    bc_format = translucent ? bc::BC3 : bc::BC1;
+    result.format = translucent ? VK_FORMAT_BC3_UNORM_BLOCK
+                                : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    break;
+  case NORMAL:
+    bc_format = bc::BC5;
+    result.format = VK_FORMAT_BC5_UNORM_BLOCK;
+    break;
+  default:
+    bc_format = bc::BC4;
+    result.format = VK_FORMAT_BC4_UNORM_BLOCK;
+    break;
+  }
+  result.width = decoded.width();
+  result.height = decoded.height();
+  result.hash = contentHash(decoded);
+
+  const std::vector<QImage> chain = mipChain(decoded);
+  std::vector<size_t> offsets(chain.size() + 1, 0);
+  for(size_t l = 0; l < chain.size(); ++l) {
+    offsets[l + 1] = offsets[l] + bc::imageSize(bc_format, chain[l].width(),
+                                                chain[l].height());
+  }
+  std::shared_ptr<std::vector<uint8_t>> data(
+    new std::vector<uint8_t>(offsets.back()));
+  for(size_t l = 0; l < chain.size(); ++l) {
+    // bytesPerLine of RGBA8888 is 4 * width, rows are contiguous
+    bc::compress(bc_format, chain[l].constBits(), chain[l].width(),
+                 chain[l].height(), data->data() + offsets[l]);
+    Level level;
+    level.data = data->data() + offsets[l];
+    level.size = offsets[l + 1] - offsets[l];
+    result.levels.push_back(level);
+  }
+  result.storage = data;
+
+  const std::string path = cachePath(source, kind);
+  if(!write(path, result)) {
+    qWarning("Failed to write texture cache %s", path.c_str());
+  }
+  if(image) {
+    *image = result;
+  }
+  return true;
+}
+
+bool vulkan_engine::TextureCache::write(const std::string& path,
+                                        const Image& image) {
+  const uint32_t level_count = image.levels.size();
+  const size_t index_size = sizeof(Ktx2Header) + level_count * sizeof(Ktx2Level);
+  const uint32_t kvd_entry = sizeof(HASH_KEY) + sizeof(image.hash);
+  const size_t kvd_size = alignedSize(sizeof(uint32_t) + kvd_entry, 4);
+
+  Ktx2Header header;
+  memset(&header, 0, sizeof(header));
+  header.vk_format = image.format;
+  header.type_size = 1;
+  header.pixel_width = image.width;
+  header.pixel_height = image.height;
+  header.face_count = 1;
+  header.level_count = level_count;
+  header.kvd_byte_offset = sizeof(KTX2_IDENTIFIER) + index_size;
+  header.kvd_byte_length = kvd_size;
+
+  // smallest level first
+  std::vector<Ktx2Level> levels(level_count);
+  size_t offset = header.kvd_byte_offset + kvd_size;
+  for(uint32_t l = level_count; l-- > 0;) {
+    offset = alignedSize(offset, LEVEL_ALIGNMENT);
+    levels[l].byte_offset = offset;
+    levels[l].byte_length = image.levels[l].size;
+    levels[l].uncompressed_byte_length = image.levels[l].size;
+    offset += image.levels[l].size;
+  }
+
+  QByteArray file_data(offset, '\0');
+  char* p = file_data.data();
+  memcpy(p, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER));
+  memcpy(p + sizeof(KTX2_IDENTIFIER), &header, sizeof(header));
+  memcpy(p + sizeof(KTX2_IDENTIFIER) + sizeof(header), levels.data(),
+         levels.size() * sizeof(Ktx2Level));
+  char* kvd = p + header.kvd_byte_offset;
+  memcpy(kvd, &kvd_entry, sizeof(kvd_entry));
+  memcpy(kvd + sizeof(kvd_entry), HASH_KEY, sizeof(HASH_KEY));
+  memcpy(kvd + sizeof(kvd_entry) + sizeof(HASH_KEY), &image.hash,
+         sizeof(image.hash));
+  for(uint32_t l = 0; l < level_count; ++l) {
+    memcpy(p + levels[l].byte_offset, image.levels[l].data,
+           image.levels[l].size);
+  }
+
+  // written to a temporary file and renamed, so concurrent bakes and
+  // readers never see a partial file
+  QSaveFile file(QString::fromStdString(path));
+  if(!file.open(QIODevice::WriteOnly)) {
+    return false;
+  }
+  file.write(file_data);
+  return file.commit();
+}
+
+bool vulkan_engine::TextureCache::read(const std::string& path, Image* image) {
+  std::shared_ptr<QFile> file(new QFile(QString::fromStdString(path)));
+  if(!file->open(QIODevice::ReadOnly)) {
+    return false;
+  }
+  const size_t size = file->size();
+  const uint8_t* p = size ? file->map(0, size) : nullptr;
+  if(!p || size < sizeof(KTX2_IDENTIFIER) + sizeof(Ktx2Header) ||
+     memcmp(p, KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) != 0) {
+    qWarning("%s is not a KTX2 file", path.c_str());
+    return false;
+  }
+
+  Ktx2Header header;
+  memcpy(&header, p + sizeof(KTX2_IDENTIFIER), sizeof(header));
+  const size_t level_index = sizeof(KTX2_IDENTIFIER) + sizeof(header);
+  if(header.level_count == 0 ||
+     level_index + header.level_count * sizeof(Ktx2Level) > size ||
+     uint64_t(header.kvd_byte_offset) + header.kvd_byte_length > size) {
+    qWarning("Truncated KTX2 file %s", path.c_str());
+    return false;
+  }
+
+  Image result;
+  result.format = VkFormat(header.vk_format);
+  result.width = header.pixel_width;
+  result.height = header.pixel_height;
+  for(uint32_t l = 0; l < header.level_count; ++l) {
+    Ktx2Level level;
+    memcpy(&level, p + level_index + l * sizeof(Ktx2Level), sizeof(level));
+    if(level.byte_offset + level.byte_length > size) {
+      qWarning("Truncated KTX2 file %s", path.c_str());
+      return false;
+    }
+    Level mapped;
+    mapped.data = p + level.byte_offset;
+    mapped.size = level.byte_length;
+    result.levels.push_back(mapped);
+  }
+
+  // key/value entries: length, key, value, padding to 4 bytes
+  const uint8_t* kvd = p + header.kvd_byte_offset;
+  const uint8_t* kvd_end = kvd + header.kvd_byte_length;
+  while(kvd + sizeof(uint32_t) <= kvd_end) {
+    uint32_t length;
+    memcpy(&length, kvd, sizeof(length));
+    const uint8_t* entry = kvd + sizeof(length);
+    if(entry + length > kvd_end) {
+      break;
+    }
+    if(length == sizeof(HASH_KEY) + sizeof(result.hash) &&
+       memcmp(entry, HASH_KEY, sizeof(HASH_KEY)) == 0) {
+      memcpy(&result.hash, entry + sizeof(HASH_KEY), sizeof(result.hash));
+    }
+    kvd = entry + alignedSize(length, 4);
+  }
+
+  // the mapping lives as long as the file object
+  result.storage = file;
+  *image = result;
+  return true;
+}
+
+bool vulkan_engine::TextureCache::compressed(VkFormat format) {
+  bc::Format bc;
+  return blockFormat(format, &bc);
+}
+
+size_t vulkan_engine::TextureCache::levelSize(VkFormat format, int width,
+                                              int height) {
+  bc::Format bc;
+  if(blockFormat(format, &bc)) {
+    return bc::imageSize(bc, width, height);
+  }
+  return 4 * size_t(width) * height;
+}
+
+vulkan_engine::TextureCache::Image
+vulkan_engine::TextureCache::decompress(const Image& image) {
+  bc::Format bc;
+  if(!blockFormat(image.format, &bc)) {
+    return image;
+  }
+
+  Image result = image;
+  result.format = VK_FORMAT_R8G8B8A8_UNORM;
+  result.levels.clear();
+  std::vector<size_t> offsets(image.levels.size() + 1, 0);
+  for(size_t l = 0; l < image.levels.size(); ++l) {
+    offsets[l + 1] =
+      offsets[l] + 4 * size_t(std::max(image.width >> l, 1)) *
+                     std::max(image.height >> l, 1);
+  }
+  std::shared_ptr<std::vector<uint8_t>> data(
+    new std::vector<uint8_t>(offsets.back()));
+  for(size_t l = 0; l < image.levels.size(); ++l) {
+    Level level;
+    level.data = data->data() + offsets[l];
+    level.size = offsets[l + 1] - offsets[l];
+    if(image.levels[l].data) {
+      bc::decompress(bc, image.levels[l].data, std::max(image.width >> l, 1),
+                     std::max(image.height >> l, 1), data->data() + offsets[l]);
+    } else {
+      level = Level(); // not part of the image
+    }
+    result.levels.push_back(level);
+  }
+  result.storage = data;
+  return result;
+}
+
+std::vector<QImage> vulkan_engine::TextureCache::mipChain(const QImage& image) {
+  std::vector<QImage> chain(1, image);
+  while(chain.back().width() > 1 || chain.back().height() > 1) {
+    const QImage& level = chain.back();
+    chain.push_back(level.scaled(std::max(level.width() / 2, 1),
+                                 std::max(level.height() / 2, 1),
+                                 Qt::IgnoreAspectRatio,
+                                 Qt::SmoothTransformation)
+                      .convertToFormat(QImage::Format_RGBA8888));
+  }
+  return chain;
+}
+
+uint64_t vulkan_engine::TextureCache::contentHash(const QImage& image) {
+  const int size[2] = {image.width(), image.height()};
+  uint64_t hash = fnv1a(size, sizeof(size));
+  for(int y = 0; y < image.height(); ++y) {
+    hash = fnv1a(image.constScanLine(y), 4 * image.width(), hash);
+  }
+  return hash;
+}
@@ -0,0 +1,87 @@
+#ifndef SHIFT_GUI_TEXTURECACHE_H_
+#define SHIFT_GUI_TEXTURECACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <QImage>
+#include <QVulkanFunctions>
+
+namespace vulkan_engine {
+
+/*! On-disk cache of textures transcoded into GPU block compressed formats.
+
+ A source image is decoded, its mip chain generated and every level block
+ compressed once (BC1 or BC3 for color depending on alpha, BC5 for normal
+ maps, BC4 for single channel masks) and stored in a KTX2 container: the
+ KTX2 header, level index and key/value data (holding the hash of the
+ source pixels), with the level data stored smallest level first. No data
+ format descriptor is written, the Vulkan format in the header is all the
+ engine reads. Files are named after a hash of the source path, size,
+ modification time and kind, so changed sources are baked again.
+
+ Cached files are memory mapped when loaded, the level data is copied
+ straight from the mapping into staging memory. */
+class TextureCache {
+public:
+  enum Kind { COLOR, NORMAL, MASK };
+
+  struct Level {
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+  };
+
+  /*! Mip chain of a texture, level 0 first. storage owns the level data,
+   either a file mapping or a buffer. */
+  struct Image {
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    int width = 0;
+    int height = 0;
+    uint64_t hash = 0; // of the source pixels
+    std::vector<Level> levels;
+    std::shared_ptr<void> storage;
+  };
+
+  explicit TextureCache(const std::string& directory);
+
+  inline const std::string& directory() const {
+    return directory_;
+  }
+
+  std::string cachePath(const std::string& source, Kind kind) const;
+
+  /*! Loads the cached image of source, baking it first if there is none.
+   Safe to call from several threads at once. */
+  bool load(const std::string& source, Kind kind, Image* image) const;
+
+  /*! Transcodes source and writes it to the cache, image may be null. */
+  bool bake(const std::string& source, Kind kind, Image* image) const;
+
+  static bool write(const std::string& path, const Image& image);
+  static bool read(const std::string& path, Image* image);
+
+  /*! Whether format is one of the block compressed formats written here. */
+  static bool compressed(VkFormat format);
+
+  /*! Bytes of a level of width x height texels. */
+  static size_t levelSize(VkFormat format, int width, int height);
+
+  /*! Decodes compressed levels into RGBA8, for devices without BC support.
+   */
+  static Image decompress(const Image& image);
+
+  /*! Box filtered mip chain of an RGBA8888 image, level 0 first. */
+  static std::vector<QImage> mipChain(const QImage& image);
+
+  /*! FNV-1a hash of the size and pixels of an RGBA8888 image. */
+  static uint64_t contentHash(const QImage& image);
+
+private:
+  std::string directory_;
+};
+
+}
+
+#endif
@@ -0,0 +1,709 @@
+#include "vulkan-engine/TextureManager.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include <QDir>
+#include <QImage>
+
+// texel data copied to the GPU per frame at most
+static const VkDeviceSize UPLOAD_BYTES_PER_FRAME = 32 << 20;
+
+static inline int levelExtent(int extent, int level) {
+  return std::max(extent >> level, 1);
+}
+
+static int tailLevel(int width, int height, int levels) {
+  int level = 0;
+  while(level + 1 < levels &&
+        std::max(levelExtent(width, level), levelExtent(height, level)) >
+          vulkan_engine::TextureManager::TAIL_SIZE) {
+    ++level;
+  }
+  return level;
+}
+
+// Decodes path into an RGBA8 mip chain, used without a cache.
+static bool decodeImage(const std::string& path,
+                        vulkan_engine::TextureCache::Image* image) {
+  typedef vulkan_engine::TextureCache TextureCache;
+  QImage decoded(QString::fromStdString(path));
+  if(decoded.isNull()) {
+    qWarning("Failed to load texture %s", path.c_str());
+    return false;
+  }
+  decoded = decoded.convertToFormat(QImage::Format_RGBA8888);
+  const std::vector<QImage> chain = TextureCache::mipChain(decoded);
+  size_t size = 0;
+  for(const QImage& level : chain) {
+    size += 4 * size_t(level.width()) * level.height();
+  }
+  std::shared_ptr<std::vector<uint8_t>> data(new std::vector<uint8_t>(size));
+  image->format = VK_FORMAT_R8G8B8A8_UNORM;
+  image->width = decoded.width();
+  image->height = decoded.height();
+  image->hash = TextureCache::contentHash(decoded);
+  image->levels.clear();
+  size_t offset = 0;
+  for(const QImage& level : chain) {
+    TextureCache::Level l;
+    l.data = data->data() + offset;
+    l.size = 4 * size_t(level.width()) * level.height();
+    memcpy(data->data() + offset, level.constBits(), l.size);
+    image->levels.push_back(l);
+    offset += l.size;
+  }
+  image->storage = data;
+  return true;
+}
+
+vulkan_engine::TextureManager::~TextureManager() {
+  waitForDecodes();
+}
+
+void vulkan_engine::TextureManager::init(RenderSurface* surface,
+                                         QVulkanDeviceFunctions* funcs,
+                                         BindlessTable* bindless,
+                                         DeletionQueue* deletion_queue) {
+  surface_ = surface;
+  funcs_ = funcs;
+  bindless_ = bindless;
+  deletion_queue_ = deletion_queue;
+
+  VkSamplerCreateInfo sampler_info;
+  memset(&sampler_info, 0, sizeof(sampler_info));
+  sampler_info.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  sampler_info.magFilter = VK_FILTER_LINEAR;
+  sampler_info.minFilter = VK_FILTER_LINEAR;
+  sampler_info.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  sampler_info.addressModeU = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.addressModeV = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.addressModeW = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+  sampler_info.maxLod = VK_LOD_CLAMP_NONE;
+  VkResult err = funcs_->vkCreateSampler(surface_->device(), &sampler_info,
+                                         nullptr, &sampler_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create sampler: %d", err);
+  }
+
+  // Compressed textures are decoded on the CPU if the device can't sample
+  // them, the window and offscreen surfaces enable the feature if present.
+  VkPhysicalDeviceFeatures features;
+  surface_->vulkanInstance()->functions()->vkGetPhysicalDeviceFeatures(
+    surface_->physicalDevice(), &features);
+  std::lock_guard<std::mutex> lock(mutex_);
+  bc_supported_ = features.textureCompressionBC == VK_TRUE;
+}
+
+void vulkan_engine::TextureManager::release() {
+  if(!funcs_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  committed_bytes_ = 0;
+  for(size_t i = 0; i < textures_.size(); ++i) {
+    Texture& texture = textures_[i];
+    destroyImage(&texture.image);
+    texture.slot = BindlessTable::INVALID_SLOT;
+    texture.base = texture.levels;
+    if(!texture.decoding) {
+      texture.committed = texture.levels;
+    }
+    if(texture.alias == i) {
+      committed_bytes_ += levelBytes(texture, texture.committed);
+    }
+  }
+  if(sampler_) {
+    funcs_->vkDestroySampler(surface_->device(), sampler_, nullptr);
+    sampler_ = VK_NULL_HANDLE;
+  }
+  funcs_ = nullptr;
+  bindless_ = nullptr;
+}
+
+vulkan_engine::TextureManager::Handle
+vulkan_engine::TextureManager::load(const std::string& path,
+                                    TextureCache::Kind kind) {
+  const std::string key = std::to_string(kind) + ":" + path;
+  Handle handle;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = paths_.find(key);
+    if(it != paths_.end()) {
+      return it->second;
+    }
+    handle = textures_.size();
+    Texture texture;
+    texture.path = path;
+    texture.kind = kind;
+    texture.alias = handle;
+    texture.decoding = true;
+    textures_.push_back(texture);
+    paths_[key] = handle;
+  }
+  decode(handle, -1);
+  return handle;
+}
+
+void vulkan_engine::TextureManager::clear() {
+  waitForDecodes();
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(funcs_) {
+    // frames in flight may still sample them
+    for(Texture& texture : textures_) {
+      retire(texture.image, VK_NULL_HANDLE, VK_NULL_HANDLE);
+    }
+    bindless_->clear();
+  }
+  textures_.clear();
+  paths_.clear();
+  contents_.clear();
+  decoded_.clear();
+  requests_.clear();
+  ++generation_;
+  committed_bytes_ = 0;
+  deduplicated_ = 0;
+}
+
+void vulkan_engine::TextureManager::setCacheDirectory(
+  const std::string& directory) {
+  if(!directory.empty() &&
+     !QDir().mkpath(QString::fromStdString(directory))) {
+    qWarning("Failed to create texture cache %s", directory.c_str());
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.reset(directory.empty() ? nullptr : new TextureCache(directory));
+}
+
+void vulkan_engine::TextureManager::setBudget(VkDeviceSize bytes) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  budget_ = bytes;
+}
+
+void vulkan_engine::TextureManager::request(Handle texture,
+                                            float screen_size) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Handle handle = textures_[texture].alias;
+  Texture& t = textures_[handle];
+  if(t.requested < 0.0f) {
+    requests_.push_back(handle);
+  }
+  t.requested = std::max(t.requested, std::max(screen_size, 1.0f));
+}
+
+void vulkan_engine::TextureManager::update(VkCommandBuffer cb,
+                                           uint64_t frame) {
+  std::vector<std::pair<Handle, int>> decodes;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    frame_ = frame;
+    jobs_.erase(std::remove_if(jobs_.begin(), jobs_.end(),
+                               [](const JobSystem::JobHandle& job) {
+                                 return JobSystem::finished(job);
+                               }),
+                jobs_.end());
+
+    // finished decodes, the rest waits for the next frame
+    VkDeviceSize uploaded = 0;
+    size_t applied = 0;
+    while(applied < decoded_.size() && uploaded < UPLOAD_BYTES_PER_FRAME) {
+      Decoded& decoded = decoded_[applied++];
+      if(decoded.generation != generation_) {
+        continue;
+      }
+      Texture& texture = textures_[decoded.texture];
+      const VkDeviceSize resident = levelBytes(texture, texture.base);
+      applyDecoded(cb, decoded);
+      uploaded += levelBytes(texture, texture.base) - resident;
+    }
+    decoded_.erase(decoded_.begin(), decoded_.begin() + applied);
+
+    // The level matching the screen size is the one with about one texel
+    // per pixel.
+    for(Handle handle : requests_) {
+      Texture& texture = textures_[handle];
+      const float screen_size = texture.requested;
+      texture.requested = -1.0f;
+      texture.last_used = frame;
+      if(texture.levels == 0 || texture.decoding || texture.failed) {
+        continue;
+      }
+      int level = 0;
+      while(level + 1 < texture.levels &&
+            std::max(levelExtent(texture.width, level + 1),
+                     levelExtent(texture.height, level + 1)) >= screen_size) {
+        ++level;
+      }
+      if(level >= texture.committed) {
+        continue;
+      }
+      level = reserve(cb, handle, level);
+      if(level < texture.committed) {
+        committed_bytes_ += levelBytes(texture, level) -
+                            levelBytes(texture, texture.committed);
+        texture.committed = level;
+        texture.decoding = true;
+        decodes.push_back(std::make_pair(handle, level));
+      }
+    }
+    requests_.clear();
+  }
+
+  for(const auto& d : decodes) {
+    decode(d.first, d.second);
+  }
+}
+
+VkImageView vulkan_engine::TextureManager::view(Handle texture) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return textures_[textures_[texture].alias].image.view;
+}
+
+int vulkan_engine::TextureManager::slot(Handle texture) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Texture& t = textures_[textures_[texture].alias];
+  return t.slot != BindlessTable::INVALID_SLOT ? int(t.slot) : -1;
+}
+
+int vulkan_engine::TextureManager::residentLevel(Handle texture) const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  const Texture& t = textures_[textures_[texture].alias];
+  return t.base < t.levels ? t.base : -1;
+}
+
+bool vulkan_engine::TextureManager::pending() const {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if(!decoded_.empty()) {
+    return true;
+  }
+  for(const auto& job : jobs_) {
+    if(!JobSystem::finished(job)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+vulkan_engine::TextureManager::Stats
+vulkan_engine::TextureManager::stats() const {
+  Stats stats;
+  std::lock_guard<std::mutex> lock(mutex_);
+  stats.budget = budget_;
+  stats.resident_bytes = memory_size_;
+  stats.textures = textures_.size();
+  stats.deduplicated = deduplicated_;
+  stats.pending = decoded_.size();
+  for(const auto& job : jobs_) {
+    stats.pending += !JobSystem::finished(job);
+  }
+  stats.decodes = decodes_;
+  stats.uploaded_levels = uploaded_levels_;
+  stats.dropped_levels = dropped_levels_;
+  return stats;
+}
+
+void vulkan_engine::TextureManager::decode(Handle texture, int base) {
+  std::string path;
+  TextureCache::Kind kind;
+  std::shared_ptr<const TextureCache> cache;
+  bool bc_supported;
+  uint64_t generation;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    path = textures_[texture].path;
+    kind = textures_[texture].kind;
+    cache = cache_;
+    bc_supported = bc_supported_;
+    generation = generation_;
+  }
+
+  // base < 0 decodes the tail
+  JobSystem::JobHandle job = JobSystem::global().schedule([=]() {
+    Decoded decoded;
+    decoded.texture = texture;
+    decoded.generation = generation;
+    decoded.ok = cache ? cache->load(path, kind, &decoded.image)
+                       : decodeImage(path, &decoded.image);
+    if(decoded.ok) {
+      TextureCache::Image& image = decoded.image;
+      const int levels = image.levels.size();
+      decoded.base = base < 0 ? tailLevel(image.width, image.height, levels)
+                              : std::min(base, levels - 1);
+      if(!bc_supported && TextureCache::compressed(image.format)) {
+        for(int l = 0; l < decoded.base; ++l) {
+          image.levels[l] = TextureCache::Level();
+        }
+        image = TextureCache::decompress(image);
+      }
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    decoded_.push_back(std::move(decoded));
+    ++decodes_;
+  });
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  jobs_.push_back(job);
+}
+
+void vulkan_engine::TextureManager::applyDecoded(VkCommandBuffer cb,
+                                                 Decoded& decoded) {
+  Texture& texture = textures_[decoded.texture];
+  texture.decoding = false;
+  if(!decoded.ok) {
+    texture.failed = true;
+    committed_bytes_ -= levelBytes(texture, texture.committed) -
+                        levelBytes(texture, texture.base);
+    texture.committed = texture.base;
+    return;
+  }
+
+  // decoded before the device was known
+  if(funcs_ && !bc_supported_ &&
+     TextureCache::compressed(decoded.image.format)) {
+    for(int l = 0; l < decoded.base; ++l) {
+      decoded.image.levels[l] = TextureCache::Level();
+    }
+    decoded.image = TextureCache::decompress(decoded.image);
+  }
+
+  const TextureCache::Image& image = decoded.image;
+  if(texture.levels == 0) {
+    texture.width = image.width;
+    texture.height = image.height;
+    texture.levels = image.levels.size();
+    texture.format = image.format;
+    texture.hash = image.hash;
+    texture.base = texture.levels;
+
+    // identical content loaded through another path
+    auto it = contents_.find(image.hash);
+    if(it != contents_.end()) {
+      const Texture& other = textures_[it->second];
+      if(other.width == texture.width && other.height == texture.height &&
+         other.format == texture.format) {
+        texture.alias = it->second;
+        texture.committed = texture.levels;
+        ++deduplicated_;
+        return;
+      }
+    }
+    contents_[image.hash] = decoded.texture;
+    texture.committed = decoded.base;
+    committed_bytes_ += levelBytes(texture, decoded.base);
+  }
+
+  if(!funcs_ || decoded.base >= texture.base ||
+     image.format != texture.format) {
+    return;
+  }
+  rebuild(cb, texture, decoded.base, &decoded);
+}
+
+int vulkan_engine::TextureManager::reserve(VkCommandBuffer cb, Handle handle,
+                                           int level) {
+  Texture& texture = textures_[handle];
+  while(level < texture.committed) {
+    const VkDeviceSize needed = committed_bytes_ -
+                                levelBytes(texture, texture.committed) +
+                                levelBytes(texture, level);
+    if(needed <= budget_) {
+      return level;
+    }
+
+    // drop the least recently used texture not drawn in this frame back to
+    // its tail, or settle for fewer levels
+    Texture* victim = nullptr;
+    for(size_t i = 0; i < textures_.size(); ++i) {
+      Texture& t = textures_[i];
+      if(t.alias != i || t.decoding || t.last_used >= frame_ ||
+         t.base >= tailLevel(t.width, t.height, t.levels)) {
+        continue;
+      }
+      if(!victim || t.last_used < victim->last_used) {
+        victim = &t;
+      }
+    }
+    if(victim) {
+      const int tail = tailLevel(victim->width, victim->height, victim->levels);
+      committed_bytes_ -=
+        levelBytes(*victim, victim->committed) - levelBytes(*victim, tail);
+      victim->committed = tail;
+      rebuild(cb, *victim, tail, nullptr);
+    } else {
+      ++level;
+    }
+  }
+  return level;
+}
+
+void vulkan_engine::TextureManager::rebuild(VkCommandBuffer cb,
+                                            Texture& texture, int base,
+                                            const Decoded* decoded) {
+  VkDevice device = surface_->device();
+  const int levels = texture.levels;
+  const int old_base = texture.base;
+  const Image old_image = texture.image;
+
+  Image image;
+  createImage(texture.format, levelExtent(texture.width, base),
+              levelExtent(texture.height, base), levels - base, &image);
+
+  // levels [base, upload_end) come from the decode, the others from the old
+  // image
+  const int upload_end = decoded ? std::min(old_base, levels) : base;
+  VkBuffer buffer = VK_NULL_HANDLE;
+  VkDeviceMemory buffer_memory = VK_NULL_HANDLE;
+  std::vector<VkBufferImageCopy> uploads;
+  if(upload_end > base) {
+    VkDeviceSize size = 0;
+    for(int l = base; l < upload_end; ++l) {
+      size += decoded->image.levels[l].size;
+    }
+
+    VkBufferCreateInfo buffer_info;
+    memset(&buffer_info, 0, sizeof(buffer_info));
+    buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    buffer_info.size = size;
+    buffer_info.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    VkResult err = funcs_->vkCreateBuffer(device, &buffer_info, nullptr,
+                                          &buffer);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create staging buffer: %d", err);
+    }
+    VkMemoryRequirements memory_requirements;
+    funcs_->vkGetBufferMemoryRequirements(device, buffer,
+                                          &memory_requirements);
+    VkMemoryAllocateInfo memory_alloc_info = {
+      VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr,
+      memory_requirements.size, surface_->hostVisibleMemoryIndex()};
+    err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr,
+                                   &buffer_memory);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to allocate staging memory: %d", err);
+    }
+    err = funcs_->vkBindBufferMemory(device, buffer, buffer_memory, 0);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to bind staging memory: %d", err);
+    }
+
+    quint8* p;
+    err = funcs_->vkMapMemory(device, buffer_memory, 0, size, 0,
+                              reinterpret_cast<void**>(&p));
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to map memory: %d", err);
+    }
+    VkDeviceSize offset = 0;
+    for(int l = base; l < upload_end; ++l) {
+      // straight from the cache file mapping if there is one
+      const TextureCache::Level& level = decoded->image.levels[l];
+      memcpy(p + offset, level.data, level.size);
+
+      VkBufferImageCopy upload;
+      memset(&upload, 0, sizeof(upload));
+      upload.bufferOffset = offset;
+      upload.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      upload.imageSubresource.mipLevel = l - base;
+      upload.imageSubresource.layerCount = 1;
+      upload.imageExtent.width = levelExtent(texture.width, l);
+      upload.imageExtent.height = levelExtent(texture.height, l);
+      upload.imageExtent.depth = 1;
+      uploads.push_back(upload);
+      offset += level.size;
+    }
+    funcs_->vkUnmapMemory(device, buffer_memory);
+  }
+
+  const int copy_begin = std::max(base, old_base);
+  const bool copy = old_image.image && copy_begin < levels;
+
+  VkImageMemoryBarrier barriers[2];
+  memset(barriers, 0, sizeof(barriers));
+  for(int b = 0; b < 2; ++b) {
+    barriers[b].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barriers[b].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[b].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barriers[b].subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    barriers[b].subresourceRange.layerCount = 1;
+  }
+  barriers[0].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[0].image = image.image;
+  barriers[0].subresourceRange.levelCount = levels - base;
+  // earlier frames may still sample the old image
+  barriers[1].srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[1].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  barriers[1].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  barriers[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  barriers[1].image = old_image.image;
+  barriers[1].subresourceRange.levelCount = levels - old_base;
+  funcs_->vkCmdPipelineBarrier(cb,
+                               VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT |
+                                 VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                               VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                               nullptr, copy ? 2 : 1, barriers);
+
+  if(copy) {
+    std::vector<VkImageCopy> copies;
+    for(int l = copy_begin; l < levels; ++l) {
+      VkImageCopy region;
+      memset(&region, 0, sizeof(region));
+      region.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+      region.srcSubresource.mipLevel = l - old_base;
+      region.srcSubresource.layerCount = 1;
+      region.dstSubresource = region.srcSubresource;
+      region.dstSubresource.mipLevel = l - base;
+      region.extent.width = levelExtent(texture.width, l);
+      region.extent.height = levelExtent(texture.height, l);
+      region.extent.depth = 1;
+      copies.push_back(region);
+    }
+    funcs_->vkCmdCopyImage(cb, old_image.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, image.image,
+                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copies.size(),
+                           copies.data());
+  }
+  if(!uploads.empty()) {
+    funcs_->vkCmdCopyBufferToImage(cb, buffer, image.image,
+                                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                                   uploads.size(), uploads.data());
+  }
+
+  barriers[0].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barriers[0].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  barriers[0].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  barriers[0].newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  funcs_->vkCmdPipelineBarrier(cb, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                               VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0,
+                               nullptr, 0, nullptr, 1, barriers);
+
+  retire(old_image, buffer, buffer_memory);
+  texture.image = image;
+
+  // frames in flight keep sampling the old image through their own
+  // descriptor sets
+  if(texture.slot == BindlessTable::INVALID_SLOT) {
+    texture.slot = bindless_->allocate();
+    if(texture.slot == BindlessTable::INVALID_SLOT) {
+      qWarning("Bindless texture table is full, %s is not sampled",
+               texture.path.c_str());
+    }
+  }
+  if(texture.slot != BindlessTable::INVALID_SLOT) {
+    bindless_->set(texture.slot, image.view, sampler_);
+  }
+  texture.base = base;
+  uploaded_levels_ += upload_end - base;
+  dropped_levels_ += std::max(base - old_base, 0);
+}
+
+void vulkan_engine::TextureManager::createImage(VkFormat format, int width,
+                                                int height, int levels,
+                                                Image* image) {
+  VkDevice device = surface_->device();
+
+  VkImageCreateInfo image_info;
+  memset(&image_info, 0, sizeof(image_info));
+  image_info.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  image_info.imageType = VK_IMAGE_TYPE_2D;
+  image_info.format = format;
+  image_info.extent.width = width;
+  image_info.extent.height = height;
+  image_info.extent.depth = 1;
+  image_info.mipLevels = levels;
+  image_info.arrayLayers = 1;
+  image_info.samples = VK_SAMPLE_COUNT_1_BIT;
+  image_info.tiling = VK_IMAGE_TILING_OPTIMAL;
+  image_info.usage = VK_IMAGE_USAGE_SAMPLED_BIT |
+                     VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+                     VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  image_info.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  image_info.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+  VkResult err =
+    funcs_->vkCreateImage(device, &image_info, nullptr, &image->image);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create image: %d", err);
+  }
+
+  VkMemoryRequirements memory_requirements;
+  funcs_->vkGetImageMemoryRequirements(device, image->image,
+                                       &memory_requirements);
+  VkMemoryAllocateInfo memory_alloc_info = {
+    VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, memory_requirements.size,
+    surface_->deviceLocalMemoryIndex()};
+  err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr,
+                                 &image->memory);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate image memory: %d", err);
+  }
+  image->memory_size = memory_requirements.size;
+  memory_size_ += memory_requirements.size;
+
+  err = funcs_->vkBindImageMemory(device, image->image, image->memory, 0);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to bind image memory: %d", err);
+  }
+
+  VkImageViewCreateInfo view_info;
+  memset(&view_info, 0, sizeof(view_info));
+  view_info.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  view_info.image = image->image;
+  view_info.viewType = VK_IMAGE_VIEW_TYPE_2D;
+  view_info.format = format;
+  view_info.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+  view_info.subresourceRange.levelCount = levels;
+  view_info.subresourceRange.layerCount = 1;
+  err = funcs_->vkCreateImageView(device, &view_info, nullptr, &image->view);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create image view: %d", err);
+  }
+}
+
+void vulkan_engine::TextureManager::destroyImage(Image* image) {
+  VkDevice device = surface_->device();
+  if(image->view) {
+    funcs_->vkDestroyImageView(device, image->view, nullptr);
+  }
+  if(image->image) {
+    funcs_->vkDestroyImage(device, image->image, nullptr);
+  }
+  if(image->memory) {
+    funcs_->vkFreeMemory(device, image->memory, nullptr);
+    memory_size_ -= image->memory_size;
+  }
+  *image = Image();
+}
+
+void vulkan_engine::TextureManager::retire(const Image& image,
+                                           VkBuffer buffer,
+                                           VkDeviceMemory memory) {
+  deletion_queue_->retireImage(image.image, image.view, image.memory,
+                               image.memory_size);
+  deletion_queue_->retireBuffer(buffer, memory);
+  if(image.memory) {
+    memory_size_ -= image.memory_size;
+  }
+}
+
+void vulkan_engine::TextureManager::waitForDecodes() {
+  std::vector<JobSystem::JobHandle> jobs;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    jobs.swap(jobs_);
+  }
+  for(const auto& job : jobs) {
+    JobSystem::global().wait(job);
+  }
+}
+
+VkDeviceSize
+vulkan_engine::TextureManager::levelBytes(const Texture& texture,
+                                          int base) const {
+  VkDeviceSize bytes = 0;
+  for(int l = base; l < texture.levels; ++l) {
+    bytes += TextureCache::levelSize(texture.format,
+                                     levelExtent(texture.width, l),
+                                     levelExtent(texture.height, l));
+  }
+  return bytes;
+}
@@ -0,0 +1,202 @@
+#ifndef SHIFT_GUI_TEXTUREMANAGER_H_
+#define SHIFT_GUI_TEXTUREMANAGER_H_
+
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/BindlessTable.h"
+#include "vulkan-engine/DeletionQueue.h"
+#include "vulkan-engine/JobSystem.h"
+#include "vulkan-engine/RenderSurface.h"
+#include "vulkan-engine/TextureCache.h"
+
+namespace vulkan_engine {
+
+/*! Loads image files into sampled textures and streams their mip levels in
+ and out of device memory.
+
+ With a cache directory set, textures are read block compressed from the
+ TextureCache, baking sources without a cached file first, and uploaded as
+ is. Devices without BC support get the cached levels decompressed to RGBA8
+ instead. Without a cache, images are decoded into RGBA8.
+
+ Textures are deduplicated by path and kind when loaded and by content once decoded:
+ a texture whose pixels match an already decoded one becomes an alias of
+ it. Images are decoded and their mip chains generated by jobs on the job
+ system. The first decode of a texture only uploads its tail, the levels of
+ at most TAIL_SIZE texels, so every texture is usable right away. Higher
+ levels are decoded and uploaded once an object using the texture is large
+ enough on screen to need them, within a memory budget: if a request does
+ not fit, the least recently used textures drop back to their tail.
+
+ Every texture with an image owns a slot of the bindless table, which
+ shaders index to sample it; the slot stays the same as levels come and go.
+
+ Textures live in images holding exactly their resident levels. Adding or
+ dropping levels creates a new image, copies the levels kept over on the
+ GPU and retires the old image to the deletion queue, so views and levels
+ only change between frames. */
+class TextureManager {
+public:
+  typedef uint32_t Handle;
+
+  // largest extent of the levels uploaded by the first decode
+  static const int TAIL_SIZE = 64;
+
+  struct Stats {
+    uint64_t budget = 0; // bytes
+    uint64_t resident_bytes = 0;
+    size_t textures = 0;
+    size_t deduplicated = 0; // aliases of textures with the same content
+    size_t pending = 0;      // decoding or waiting for upload
+    uint64_t decodes = 0;
+    uint64_t uploaded_levels = 0;
+    uint64_t dropped_levels = 0;
+  };
+
+  TextureManager() = default;
+  ~TextureManager();
+
+  TextureManager(const TextureManager&) = delete;
+  TextureManager& operator=(const TextureManager&) = delete;
+
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            BindlessTable* bindless, DeletionQueue* deletion_queue);
+
+  /*! Destroys all images, textures are decoded again once requested. The
+   device must be idle. */
+  void release();
+
+  /*! Returns the texture of the image file at path, decoding starts right
+   away. kind selects the compressed format. May be called from any
+   thread. */
+  Handle load(const std::string& path,
+              TextureCache::Kind kind = TextureCache::COLOR);
+
+  /*! Reads and bakes textures loaded from now on through a cache in
+   directory, an empty directory disables the cache. */
+  void setCacheDirectory(const std::string& directory);
+
+  /*! Forgets all textures, their images are retired. Render thread
+   only. */
+  void clear();
+
+  void setBudget(VkDeviceSize bytes);
+
+  /*! Requests the levels of texture needed for an object covering
+   screen_size pixels in the current frame. Call on the render thread. */
+  void request(Handle texture, float screen_size);
+
+  /*! Records the uploads and copies of finished decodes into cb, outside
+   of a render pass, and starts decodes for the requests of the frame. */
+  void update(VkCommandBuffer cb, uint64_t frame);
+
+  /*! View of the resident levels, VK_NULL_HANDLE until the tail is
+   uploaded. Render thread only. */
+  VkImageView view(Handle texture) const;
+
+  /*! Slot of the texture in the bindless table, -1 until the tail is
+   uploaded or if the table is full. Render thread only. */
+  int slot(Handle texture) const;
+
+  /*! Highest resident level, 0 for full resolution, -1 if none. */
+  int residentLevel(Handle texture) const;
+
+  inline VkSampler sampler() const {
+    return sampler_;
+  }
+
+  inline VkDeviceSize memorySize() const {
+    return memory_size_;
+  }
+
+  /*! Whether decodes or uploads are outstanding. */
+  bool pending() const;
+
+  Stats stats() const;
+
+private:
+  struct Image {
+    VkImage image = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize memory_size = 0;
+    VkImageView view = VK_NULL_HANDLE;
+  };
+
+  struct Texture {
+    std::string path;
+    TextureCache::Kind kind;
+    Handle alias; // itself unless the content duplicates another texture
+    uint64_t hash = 0;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    int width = 0; // of level 0, 0 until decoded
+    int height = 0;
+    int levels = 0;
+    int base = 0;      // first resident level, levels if none
+    int committed = 0; // base once the running decode is uploaded
+    float requested = -1.0f; // largest screen size in the current frame
+    uint64_t last_used = 0;
+    bool decoding = false;
+    bool failed = false;
+    uint32_t slot = BindlessTable::INVALID_SLOT;
+    Image image;
+  };
+
+  // levels [base, levels) of image are valid
+  struct Decoded {
+    Handle texture;
+    uint64_t generation;
+    bool ok = false;
+    int base = 0;
+    TextureCache::Image image;
+  };
+
+  void decode(Handle texture, int base);
+  void applyDecoded(VkCommandBuffer cb, Decoded& decoded);
+  int reserve(VkCommandBuffer cb, Handle texture, int level);
+  void rebuild(VkCommandBuffer cb, Texture& texture, int base,
+               const Decoded* decoded);
+  void createImage(VkFormat format, int width, int height, int levels,
+                   Image* image);
+  void destroyImage(Image* image);
+  void retire(const Image& image, VkBuffer buffer, VkDeviceMemory memory);
+  void waitForDecodes();
+  VkDeviceSize levelBytes(const Texture& texture, int base) const;
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+  BindlessTable* bindless_ = nullptr;
+  DeletionQueue* deletion_queue_ = nullptr;
+  VkSampler sampler_ = VK_NULL_HANDLE;
+  bool bc_supported_ = false;
+
+  // textures_ and decoded_ are shared with load() and the decode jobs
+  mutable std::mutex mutex_;
+  std::vector<Texture> textures_;
+  std::shared_ptr<const TextureCache> cache_;
+  std::unordered_map<std::string, Handle> paths_; // by kind and path
+  std::unordered_map<uint64_t, Handle> contents_;
+  std::vector<Decoded> decoded_;
+  std::vector<JobSystem::JobHandle> jobs_;
+  std::vector<Handle> requests_;
+  uint64_t generation_ = 0; // of the texture table, bumped by clear()
+  uint64_t frame_ = 0;
+
+  VkDeviceSize budget_ = VkDeviceSize(-1);
+  VkDeviceSize committed_bytes_ = 0; // texel bytes of the committed levels
+  VkDeviceSize memory_size_ = 0;
+  size_t deduplicated_ = 0;
+  uint64_t decodes_ = 0;
+  uint64_t uploaded_levels_ = 0;
+  uint64_t dropped_levels_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,193 @@
+#include "vulkan-engine/TransformTable.h"
+
+#include <algorithm>
+#include <cstring>
+
+// transforms the buffer holds at least, grown buffers at least double
+static const size_t MIN_CAPACITY = 1024;
+
+void vulkan_engine::TransformTable::init(RenderSurface* surface,
+                                         QVulkanDeviceFunctions* funcs,
+                                         DeletionQueue* deletion_queue) {
+  surface_ = surface;
+  funcs_ = funcs;
+  deletion_queue_ = deletion_queue;
+  capacity_ = MIN_CAPACITY;
+  count_ = 0;
+  createBuffer(bufferSize(), false, &buffer_);
+  staging_.assign(surface_->concurrentFrameCount(), Buffer());
+  ++generation_;
+}
+
+void vulkan_engine::TransformTable::release() {
+  if(!funcs_) {
+    return;
+  }
+  destroyBuffer(&buffer_);
+  for(Buffer& staging : staging_) {
+    destroyBuffer(&staging);
+  }
+  staging_.clear();
+  capacity_ = 0;
+  count_ = 0;
+  funcs_ = nullptr;
+}
+
+void vulkan_engine::TransformTable::update(
+  int current_frame, const math::Mat4* transforms, size_t count,
+  const std::vector<uint32_t>* updated) {
+  uploaded_ = 0;
+  uploaded_ranges_ = 0;
+  copies_.clear();
+
+  if(count > capacity_) {
+    // frames in flight still read the old buffer
+    deletion_queue_->retireBuffer(buffer_.buffer, buffer_.memory);
+    buffer_ = Buffer();
+    capacity_ = std::max(count, 2 * capacity_);
+    createBuffer(bufferSize(), false, &buffer_);
+    ++generation_;
+    updated = nullptr;
+  }
+
+  // Changed indices are merged into contiguous ranges. Once most of the
+  // table changed one copy of everything is cheaper.
+  indices_.clear();
+  if(updated) {
+    for(uint32_t index : *updated) {
+      if(index < std::min(count, count_)) {
+        indices_.push_back(index);
+      }
+    }
+    for(size_t index = count_; index < count; ++index) {
+      indices_.push_back(index);
+    }
+    if(2 * indices_.size() > count) {
+      updated = nullptr;
+    }
+  }
+  if(!updated) {
+    indices_.resize(count);
+    for(size_t index = 0; index < count; ++index) {
+      indices_[index] = index;
+    }
+  } else {
+    std::sort(indices_.begin(), indices_.end());
+    indices_.erase(std::unique(indices_.begin(), indices_.end()),
+                   indices_.end());
+  }
+  count_ = count;
+  if(indices_.empty()) {
+    return;
+  }
+
+  // the previous submission of this frame's staging buffer has completed
+  Buffer& staging = staging_[current_frame];
+  const VkDeviceSize size = indices_.size() * sizeof(GpuTransform);
+  if(staging.size < size) {
+    const VkDeviceSize staging_size = std::max(size, 2 * staging.size);
+    destroyBuffer(&staging);
+    createBuffer(staging_size, true, &staging);
+  }
+
+  GpuTransform* out = reinterpret_cast<GpuTransform*>(staging.data);
+  copy_source_ = staging.buffer;
+  for(size_t i = 0; i < indices_.size();) {
+    size_t end = i + 1;
+    while(end < indices_.size() && indices_[end] == indices_[end - 1] + 1) {
+      ++end;
+    }
+    VkBufferCopy copy = {i * sizeof(GpuTransform),
+                         indices_[i] * sizeof(GpuTransform),
+                         (end - i) * sizeof(GpuTransform)};
+    copies_.push_back(copy);
+    for(; i < end; ++i) {
+      const math::Mat4& m = transforms[indices_[i]];
+      for(int r = 0; r < 3; ++r) {
+        for(int c = 0; c < 4; ++c) {
+          out[i].rows[r][c] = m(r, c);
+        }
+      }
+    }
+  }
+  uploaded_ = indices_.size();
+  uploaded_ranges_ = copies_.size();
+}
+
+void vulkan_engine::TransformTable::upload(VkCommandBuffer cb) {
+  if(copies_.empty()) {
+    return;
+  }
+  funcs_->vkCmdCopyBuffer(cb, copy_source_, buffer_.buffer, copies_.size(),
+                          copies_.data());
+  copies_.clear();
+}
+
+vulkan_engine::TransformTable::Stats
+vulkan_engine::TransformTable::stats() const {
+  Stats stats;
+  stats.capacity = capacity_;
+  stats.uploaded = uploaded_;
+  stats.uploaded_ranges = uploaded_ranges_;
+  return stats;
+}
+
+void vulkan_engine::TransformTable::createBuffer(VkDeviceSize size,
+                                                 bool staging,
+                                                 Buffer* buffer) {
+  VkDevice device = surface_->device();
+
+  VkBufferCreateInfo buffer_info;
+  memset(&buffer_info, 0, sizeof(buffer_info));
+  buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage =
+    staging ? VK_BUFFER_USAGE_TRANSFER_SRC_BIT
+            : VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+                VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+  VkResult err =
+    funcs_->vkCreateBuffer(device, &buffer_info, nullptr, &buffer->buffer);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create transform buffer: %d", err);
+  }
+
+  VkMemoryRequirements memory_requirements;
+  funcs_->vkGetBufferMemoryRequirements(device, buffer->buffer,
+                                        &memory_requirements);
+  VkMemoryAllocateInfo memory_alloc_info = {
+    VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, memory_requirements.size,
+    staging ? surface_->hostVisibleMemoryIndex()
+            : surface_->deviceLocalMemoryIndex()};
+  err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr,
+                                 &buffer->memory);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to allocate transform memory: %d", err);
+  }
+  err = funcs_->vkBindBufferMemory(device, buffer->buffer, buffer->memory, 0);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to bind transform memory: %d", err);
+  }
+  buffer->size = size;
+
+  if(staging) {
+    err = funcs_->vkMapMemory(device, buffer->memory, 0, size, 0,
+                              reinterpret_cast<void**>(&buffer->data));
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to map memory: %d", err);
+    }
+  }
+}
+
+void vulkan_engine::TransformTable::destroyBuffer(Buffer* buffer) {
+  VkDevice device = surface_->device();
+  if(buffer->data) {
+    funcs_->vkUnmapMemory(device, buffer->memory);
+  }
+  if(buffer->buffer) {
+    funcs_->vkDestroyBuffer(device, buffer->buffer, nullptr);
+  }
+  if(buffer->memory) {
+    funcs_->vkFreeMemory(device, buffer->memory, nullptr);
+  }
+  *buffer = Buffer();
+}
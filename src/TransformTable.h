@@ -0,0 +1,111 @@
+#ifndef SHIFT_GUI_TRANSFORMTABLE_H_
+#define SHIFT_GUI_TRANSFORMTABLE_H_
+
+#include <cstdint>
+#include <vector>
+
+#include <QVulkanFunctions>
+
+#include "vulkan-engine/DeletionQueue.h"
+#include "vulkan-engine/RenderSurface.h"
+#include "vulkan-engine/SimdMath.h"
+
+namespace vulkan_engine {
+
+/*! World transform of an object as laid out in the transforms buffer of
+ the shaders (std430): the upper three rows of the affine matrix, the last
+ row is always (0, 0, 0, 1). Normal matrices are derived in the shader. */
+struct GpuTransform {
+  float rows[3][4];
+};
+
+/*! The world transforms of all entities in one device local storage
+ buffer, indexed by the dense entity index of the draws, so the number of
+ objects is only limited by memory.
+
+ update() stages only the transforms that changed since the last call in
+ a staging buffer per frame in flight and upload() copies them, merged
+ into contiguous ranges. The copies are ordered against the draws by the
+ caller, the render graph of the engine. The buffer grows with the scene;
+ a grown buffer gets all transforms and the old one is retired to the
+ deletion queue. */
+class TransformTable {
+public:
+  struct Stats {
+    size_t capacity = 0;        // transforms the buffer holds
+    size_t uploaded = 0;        // transforms copied by the last update()
+    size_t uploaded_ranges = 0; // copies recorded by the last update()
+  };
+
+  TransformTable() = default;
+  ~TransformTable() = default;
+
+  TransformTable(const TransformTable&) = delete;
+  TransformTable& operator=(const TransformTable&) = delete;
+
+  void init(RenderSurface* surface, QVulkanDeviceFunctions* funcs,
+            DeletionQueue* deletion_queue);
+  void release();
+
+  inline VkBuffer buffer() const {
+    return buffer_.buffer;
+  }
+
+  inline VkDeviceSize bufferSize() const {
+    return VkDeviceSize(capacity_) * sizeof(GpuTransform);
+  }
+
+  /*! Changes whenever buffer() is replaced, descriptors referring to it
+   have to be written again. */
+  inline uint64_t generation() const {
+    return generation_;
+  }
+
+  /*! Makes the table hold the count transforms. Stages those at the dense
+   indices in updated and any beyond the previous count, or all of them if
+   updated is nullptr. */
+  void update(int current_frame, const math::Mat4* transforms, size_t count,
+              const std::vector<uint32_t>* updated);
+
+  /*! Whether update() staged transforms that upload() has not copied. */
+  inline bool pending() const {
+    return !copies_.empty();
+  }
+
+  /*! Records the copies staged by the last update() into cb, outside of a
+   render pass and without barriers. */
+  void upload(VkCommandBuffer cb);
+
+  Stats stats() const;
+
+private:
+  struct Buffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize size = 0;
+    quint8* data = nullptr; // mapped staging buffers
+  };
+
+  void createBuffer(VkDeviceSize size, bool staging, Buffer* buffer);
+  void destroyBuffer(Buffer* buffer);
+
+  RenderSurface* surface_ = nullptr;
+  QVulkanDeviceFunctions* funcs_ = nullptr;
+  DeletionQueue* deletion_queue_ = nullptr;
+
+  Buffer buffer_;
+  size_t capacity_ = 0;
+  size_t count_ = 0; // transforms in the buffer
+  uint64_t generation_ = 0;
+  std::vector<Buffer> staging_; // per frame in flight, grown as needed
+
+  std::vector<uint32_t> indices_; // scratch
+  std::vector<VkBufferCopy> copies_; // staged by update()
+  VkBuffer copy_source_ = VK_NULL_HANDLE;
+  size_t uploaded_ = 0;
+  size_t uploaded_ranges_ = 0;
+};
+
+}
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef SHIFT_GUI_TRIPLEBUFFER_H_
+#define SHIFT_GUI_TRIPLEBUFFER_H_
+
+#include <atomic>
+
+namespace vulkan_engine {
+
+/*! Lock-free single producer, single consumer triple buffer.
+
+ The producer fills back() and publish()es it; the consumer calls acquire()
+ to swap in the latest published buffer, if there is a newer one, and reads
+ front(). Neither side ever waits for the other: the producer always has a
+ buffer to write to and the consumer always has the most recent complete
+ one. Buffers are recycled, so the producer has to overwrite all of back(),
+ which holds data from two publications ago. */
+template<class T>
+class TripleBuffer {
+public:
+  inline T& back() {
+    return buffers_[back_];
+  }
+
+  inline const T& front() const {
+    return buffers_[front_];
+  }
+
+  /*! Makes back() available to the consumer and returns a fresh back(). */
+  inline void publish() {
+    back_ = middle_.exchange(back_ | FRESH, std::memory_order_acq_rel) & INDEX;
+  }
+
+  /*! Swaps the latest published buffer to front() and returns true if one
+   was published since the last call. */
+  inline bool acquire() {
+    if(!(middle_.load(std::memory_order_relaxed) & FRESH)) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) & INDEX;
+    return true;
+  }
+
+private:
+  static const int INDEX = 0x3;
+  static const int FRESH = 0x4;
+
+  T buffers_[3];
+  int back_ = 0;  // owned by the producer
+  int front_ = 1; // owned by the consumer
+  std::atomic<int> middle_{2};
+};
+
+}
+
+#endif
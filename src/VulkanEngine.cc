@@ -1,36 +1,167 @@
 #include "vulkan-engine/VulkanEngine.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include <QFile>
 #include <QVulkanFunctions>
 
+#include "vulkan-engine/JobSystem.h"
+#include "vulkan-engine/SceneGenerator.h"
+
 // Note that the vertex data and the projection matrix assume OpenGL. With
 // Vulkan Y is negated in clip space and the near/far plane is at 0/1 instead
 // of -1/1. These will be corrected for by an extra transformation when
-// calculating the modelview-projection matrix.
-static float vertex_data[] = {0.0f, 0.5f, 1.0f, 0.0f,  0.0f, -0.5f, -0.5f, 0.0f,
-                              1.0f, 0.0f, 0.5f, -0.5f, 0.0f, 0.0f,  1.0f};
-
-static const int UNIFORM_DATA_SIZE = 16 * sizeof(float);
+// calculating the projection matrix.
+
+static const int MAX_LIGHTS = 16;
+
+// slots of the bindless texture table, fewer if the device limits are lower
+static const uint32_t MAX_TEXTURES = 4096;
+
+// missing texture maps of meshes
+static const uint32_t NO_TEXTURE = UINT32_MAX;
+
+// entities culled by one job
+static const size_t CULL_CHUNK = 8192;
+
+// minimum number of draws recorded by one job
+static const size_t PARALLEL_RECORD_DRAWS = 1024;
+// instances the per-frame instance buffers hold at least
+static const size_t MIN_INSTANCES = 1024;
+
+// mesh handles not referring to a mesh of the mesh cache
+static const uint32_t NO_CACHE_MESH = UINT32_MAX;
+
+// streamed mesh data copied to the GPU per frame at most
+static const VkDeviceSize MESH_UPLOAD_BYTES_PER_FRAME = 64 << 20;
+
+// std140 layouts of the uniform blocks and push constants in scene.glsl, the
+// storage buffers hold GpuMaterials, GpuTransforms and GpuInstances
+struct CameraUniform {
+  float v[16];
+  float p[16];
+  float vp[16];
+  float viewport[4]; // width, height and their reciprocals in pixels
+};
+
+struct LightUniform {
+  float position[4]; // w == 0 for directional lights
+  float color[4];
+};
+
+struct LightsUniform {
+  qint32 count;
+  qint32 padding[3];
+  LightUniform light[MAX_LIGHTS];
+};
+
+// instance of a draw (std430), in draw key order
+struct GpuInstance {
+  qint32 object; // dense entity index into the transforms buffer
+  qint32 material;
+};
+
+struct PushConstants {
+  qint32 textured; // 0 for bounding box placeholders
+  // offsets of the vertex attributes of the mesh in the geometry page in
+  // floats, -1 if missing
+  qint32 position_offset;
+  qint32 normal_offset;
+  qint32 uv_offset;
+  // object space scale and offset applied to the vertices, of the bounding
+  // box for placeholders
+  float scale[4];
+  float offset[4];
+  qint32 first_index; // of the segments of line draws
+  float line_width;   // in pixels
+};
+
+// The edges of a triangle list as pairs of indices, edges shared by
+// triangles once.
+static void wireframeEdges(const std::vector<unsigned int>& faces,
+                           std::vector<unsigned int>* edges) {
+  std::vector<uint64_t> keys;
+  keys.reserve(faces.size());
+  for(size_t i = 0; i + 2 < faces.size(); i += 3) {
+    for(int k = 0; k < 3; ++k) {
+      const uint64_t a = faces[i + k];
+      const uint64_t b = faces[i + (k + 1) % 3];
+      keys.push_back(a < b ? a << 32 | b : b << 32 | a);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+  edges->resize(2 * keys.size());
+  for(size_t i = 0; i < keys.size(); ++i) {
+    (*edges)[2 * i] = uint32_t(keys[i] >> 32);
+    (*edges)[2 * i + 1] = uint32_t(keys[i]);
+  }
+}
 
 static inline VkDeviceSize aligned(VkDeviceSize v, VkDeviceSize byteAlign) {
   return (v + byteAlign - 1) & ~(byteAlign - 1);
 }
 
+// eye position of a view matrix, which is a rigid transform
+static void eyePosition(const vulkan_engine::math::Mat4& view, float eye[3]) {
+  for(int i = 0; i < 3; ++i) {
+    eye[i] = -(view(0, i) * view(0, 3) + view(1, i) * view(1, 3) +
+               view(2, i) * view(2, 3));
+  }
+}
+
 vulkan_engine::VulkanEngine::VulkanEngine(QVulkanWindow* w, bool msaa)
-  : window_(w) {
+  : window_surface_(new WindowSurface(w))
+  , surface_(window_surface_.get()) {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 15, 0)
+  // A queue of a compute-only family for asynchronous compute, next to the
+  // graphics queue QVulkanWindow creates.
+  WindowSurface* surface = window_surface_.get();
+  w->setQueueCreateInfoModifier(
+    [surface](const VkQueueFamilyProperties* families, uint32_t count,
+              QVector<VkDeviceQueueCreateInfo>& infos) {
+      static const float priority = 1.0f;
+      const uint32_t family = asyncComputeQueueFamily(families, count);
+      surface->setComputeQueueFamilyIndex(family);
+      if(family != UINT32_MAX) {
+        VkDeviceQueueCreateInfo info;
+        memset(&info, 0, sizeof(info));
+        info.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO;
+        info.queueFamilyIndex = family;
+        info.queueCount = 1;
+        info.pQueuePriorities = &priority;
+        infos.append(info);
+      }
+    });
+#endif
+  // The window stays single-sampled, the engine renders the scene into its
+  // own multisampled attachments.
   if(msaa) {
     const QVector<int> counts = w->supportedSampleCounts();
-
-    // qDebug() << "Supported sample counts:" << counts;
-
     for(int s = 16; s >= 4; s /= 2) {
       if(counts.contains(s)) {
-        // qDebug("Requesting sample count %d", s);
-        window_->setSampleCount(s);
+        sample_count_ = s;
         break;
       }
     }
   }
+  QMatrix4x4 view;
+  view.lookAt(QVector3D(0, 0, 4), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
+  view_ = math::fromQt(view);
+}
+
+vulkan_engine::VulkanEngine::VulkanEngine(RenderSurface* surface,
+                                          int sample_count)
+  : surface_(surface)
+  , sample_count_(sample_count) {
+  QMatrix4x4 view;
+  view.lookAt(QVector3D(0, 0, 4), QVector3D(0, 0, 0), QVector3D(0, 1, 0));
+  view_ = math::fromQt(view);
+}
+
+vulkan_engine::VulkanEngine::~VulkanEngine() {
+  stopUpdateThread();
 }
 
 VkShaderModule vulkan_engine::VulkanEngine::createShader(const QString& name) {
@@ -48,7 +179,7 @@ VkShaderModule vulkan_engine::VulkanEngine::createShader(const QString& name) {
   shader_info.codeSize = blob.size();
   shader_info.pCode = reinterpret_cast<const uint32_t*>(blob.constData());
   VkShaderModule shader_module;
-  VkResult err = funcs_->vkCreateShaderModule(window_->device(), &shader_info,
+  VkResult err = funcs_->vkCreateShaderModule(surface_->device(), &shader_info,
                                               nullptr, &shader_module);
   if(err != VK_SUCCESS) {
     qWarning("Failed to create shader module: %d", err);
@@ -58,203 +189,97 @@ VkShaderModule vulkan_engine::VulkanEngine::createShader(const QString& name) {
   return shader_module;
 }
 
-void vulkan_engine::VulkanEngine::initResources() {
-  // qDebug("initResources");
-
-  VkDevice device = window_->device();
-  funcs_ = window_->vulkanInstance()->deviceFunctions(device);
-
-  // Prepare the vertex and uniform data. The vertex data will never
-  // change so one buffer is sufficient regardless of the value of
-  // QVulkanWindow::CONCURRENT_FRAME_COUNT. Uniform data is changing per
-  // frame however so active frames have to have a dedicated copy.
-
-  // Use just one memory allocation and one buffer. We will then specify the
-  // appropriate offsets for uniform buffers in the VkDescriptorBufferInfo.
-  // Have to watch out for
-  // VkPhysicalDeviceLimits::minUniformBufferOffsetAlignment, though.
-
-  // The uniform buffer is not strictly required in this example, we could
-  // have used push constants as well since our single matrix (64 bytes) fits
-  // into the spec mandated minimum limit of 128 bytes. However, once that
-  // limit is not sufficient, the per-frame buffers, as shown below, will
-  // become necessary.
-
-  const int concurrent_frame_count = window_->concurrentFrameCount();
-  const VkPhysicalDeviceLimits* device_limits =
-    &window_->physicalDeviceProperties()->limits;
-  const VkDeviceSize uniform_align =
-    device_limits->minUniformBufferOffsetAlignment;
+void vulkan_engine::VulkanEngine::createBuffer(VkDeviceSize size,
+                                               VkBufferUsageFlags usage,
+                                               uint32_t memory_index,
+                                               VkBuffer* buffer,
+                                               VkDeviceMemory* memory,
+                                               VkDeviceSize* memory_size) {
+  VkDevice device = surface_->device();
 
-  // qDebug("uniform buffer offset alignment is %u", (uint)uniform_align);
   VkBufferCreateInfo buffer_info;
   memset(&buffer_info, 0, sizeof(buffer_info));
   buffer_info.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  buffer_info.size = size;
+  buffer_info.usage = usage;
 
-  // Our internal layout is vertex, uniform, uniform, ... with each uniform
-  // buffer start offset aligned to unform_align.
-  const VkDeviceSize vertex_alloc_size =
-    aligned(sizeof(vertex_data), uniform_align);
-  const VkDeviceSize uniform_alloc_size =
-    aligned(UNIFORM_DATA_SIZE, uniform_align);
-  buffer_info.size =
-    vertex_alloc_size + concurrent_frame_count * uniform_alloc_size;
-  buffer_info.usage =
-    VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT;
-
-  VkResult err =
-    funcs_->vkCreateBuffer(device, &buffer_info, nullptr, &buffer_);
+  VkResult err = funcs_->vkCreateBuffer(device, &buffer_info, nullptr, buffer);
   if(err != VK_SUCCESS) {
     qFatal("Failed to create buffer: %d", err);
   }
 
   VkMemoryRequirements memory_requirements;
-  funcs_->vkGetBufferMemoryRequirements(device, buffer_, &memory_requirements);
+  funcs_->vkGetBufferMemoryRequirements(device, *buffer, &memory_requirements);
 
   VkMemoryAllocateInfo memory_alloc_info = {
     VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO, nullptr, memory_requirements.size,
-    window_->hostVisibleMemoryIndex()};
+    memory_index};
 
-  err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr,
-                                 &buffer_memory_);
+  err = funcs_->vkAllocateMemory(device, &memory_alloc_info, nullptr, memory);
   if(err != VK_SUCCESS) {
     qFatal("Failed to allocate memory: %d", err);
   }
+  *memory_size = memory_requirements.size;
+  device_memory_usage_ += memory_requirements.size;
 
-  err = funcs_->vkBindBufferMemory(device, buffer_, buffer_memory_, 0);
+  err = funcs_->vkBindBufferMemory(device, *buffer, *memory, 0);
   if(err != VK_SUCCESS) {
     qFatal("Failed to bind buffer memory: %d", err);
   }
+}
 
-  quint8* p;
-  err = funcs_->vkMapMemory(device, buffer_memory_, 0, memory_requirements.size,
-                            0, reinterpret_cast<void**>(&p));
-  if(err != VK_SUCCESS) {
-    qFatal("Failed to map memory: %d", err);
-  }
-  memcpy(p, vertex_data, sizeof(vertex_data));
-  QMatrix4x4 ident;
-  memset(uniform_buffer_info_, 0, sizeof(uniform_buffer_info_));
-  for(int i = 0; i < concurrent_frame_count; ++i) {
-    const VkDeviceSize offset = vertex_alloc_size + i * uniform_alloc_size;
-    memcpy(p + offset, ident.constData(), 16 * sizeof(float));
-    uniform_buffer_info_[i].buffer = buffer_;
-    uniform_buffer_info_[i].offset = offset;
-    uniform_buffer_info_[i].range = uniform_alloc_size;
-  }
-  funcs_->vkUnmapMemory(device, buffer_memory_);
-
-  VkVertexInputBindingDescription vertex_binding_description = {
-    .binding = 0, // binding
-    .stride = 5 * sizeof(float),
-    .inputRate = VK_VERTEX_INPUT_RATE_VERTEX};
-  VkVertexInputAttributeDescription vertex_attribute_description[] = {
-    {               // position
-     .location = 0, // shader binding location
-     .binding = 0,  // binding number for the attribute
-     .format = VK_FORMAT_R32G32_SFLOAT,
-     .offset = 0},
-    {// color
-     .location = 1,
-     .binding = 0,
-     .format = VK_FORMAT_R32G32B32_SFLOAT,
-     .offset = 2 * sizeof(float)}};
+VkPipeline
+vulkan_engine::VulkanEngine::createScenePipeline(VkRenderPass render_pass,
+                                                 VkSampleCountFlagBits samples,
+                                                 PipelineKind kind) {
+  VkDevice device = surface_->device();
 
+  // Vertex attributes are fetched from the geometry buffer by the vertex
+  // shader, there is no fixed-function vertex input.
   VkPipelineVertexInputStateCreateInfo vertex_input_info;
+  memset(&vertex_input_info, 0, sizeof(vertex_input_info));
   vertex_input_info.sType =
     VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertex_input_info.pNext = nullptr;
-  vertex_input_info.flags = 0;
-  vertex_input_info.vertexBindingDescriptionCount = 1;
-  vertex_input_info.pVertexBindingDescriptions = &vertex_binding_description;
-  vertex_input_info.vertexAttributeDescriptionCount = 2;
-  vertex_input_info.pVertexAttributeDescriptions = vertex_attribute_description;
-
-  // Set up descriptor set and its layout.
-  VkDescriptorPoolSize descPoolSizes = {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER,
-                                        uint32_t(concurrent_frame_count)};
-  VkDescriptorPoolCreateInfo descriptor_pool_info;
-  memset(&descriptor_pool_info, 0, sizeof(descriptor_pool_info));
-  descriptor_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-  descriptor_pool_info.maxSets = concurrent_frame_count;
-  descriptor_pool_info.poolSizeCount = 1;
-  descriptor_pool_info.pPoolSizes = &descPoolSizes;
-  err = funcs_->vkCreateDescriptorPool(device, &descriptor_pool_info, nullptr,
-                                       &descriptor_pool_);
-  if(err != VK_SUCCESS) {
-    qFatal("Failed to create descriptor pool: %d", err);
-  }
-
-  VkDescriptorSetLayoutBinding layoutBinding = {
-    0, // binding
-    VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT, nullptr};
-  VkDescriptorSetLayoutCreateInfo descriptor_layout_info = {
-    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr, 0, 1,
-    &layoutBinding};
-  err = funcs_->vkCreateDescriptorSetLayout(device, &descriptor_layout_info,
-                                            nullptr, &descriptor_set_layout_);
-  if(err != VK_SUCCESS)
-    qFatal("Failed to create descriptor set layout: %d", err);
-
-  for(int i = 0; i < concurrent_frame_count; ++i) {
-    VkDescriptorSetAllocateInfo descriptor_set_alloc_info = {
-      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr, descriptor_pool_,
-      1, &descriptor_set_layout_};
-    err = funcs_->vkAllocateDescriptorSets(device, &descriptor_set_alloc_info,
-                                           &descriptor_set_[i]);
-    if(err != VK_SUCCESS) {
-      qFatal("Failed to allocate descriptor set: %d", err);
-    }
 
-    VkWriteDescriptorSet descriptor_write;
-    memset(&descriptor_write, 0, sizeof(descriptor_write));
-    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-    descriptor_write.dstSet = descriptor_set_[i];
-    descriptor_write.descriptorCount = 1;
-    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-    descriptor_write.pBufferInfo = &uniform_buffer_info_[i];
-    funcs_->vkUpdateDescriptorSets(device, 1, &descriptor_write, 0, nullptr);
-  }
-
-  // Pipeline cache
-  VkPipelineCacheCreateInfo pipeline_cache_info;
-  memset(&pipeline_cache_info, 0, sizeof(pipeline_cache_info));
-  pipeline_cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
-  err = funcs_->vkCreatePipelineCache(device, &pipeline_cache_info, nullptr,
-                                      &pipeline_cache_);
-  if(err != VK_SUCCESS) {
-    qFatal("Failed to create pipeline cache: %d", err);
-  }
-
-  // Pipeline layout
-  VkPipelineLayoutCreateInfo pipeline_layout_info;
-  memset(&pipeline_layout_info, 0, sizeof(pipeline_layout_info));
-  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-  pipeline_layout_info.setLayoutCount = 1;
-  pipeline_layout_info.pSetLayouts = &descriptor_set_layout_;
-  err = funcs_->vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
-                                       &pipeline_layout_);
-  if(err != VK_SUCCESS) {
-    qFatal("Failed to create pipeline layout: %d", err);
-  }
-
-  // Shaders
+  // Shaders, lines are expanded into quads by a vertex shader of their own
+  // and the wireframe overlay adds a geometry shader
+  const bool lines = kind == PipelineKind::Lines;
+  const bool wireframe = kind == PipelineKind::Wireframe;
   VkShaderModule vertShaderModule =
-    createShader(QStringLiteral(":/shaders/color.vert.spv"));
+    createShader(lines ? QStringLiteral(":/shaders/lines.vert.spv")
+                       : QStringLiteral(":/shaders/scene.vert.spv"));
+  VkShaderModule geomShaderModule =
+    wireframe ? createShader(QStringLiteral(":/shaders/scene.geom.spv"))
+              : VK_NULL_HANDLE;
   VkShaderModule fragShaderModule =
-    createShader(QStringLiteral(":/shaders/color.frag.spv"));
+    createShader(lines ? QStringLiteral(":/shaders/lines.frag.spv")
+                       : QStringLiteral(":/shaders/scene.frag.spv"));
 
   // Graphics pipeline
   VkGraphicsPipelineCreateInfo pipeline_info;
   memset(&pipeline_info, 0, sizeof(pipeline_info));
   pipeline_info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
 
-  VkPipelineShaderStageCreateInfo shader_stages[2] = {
+  // the size of the bindless texture array, and whether the fragment
+  // shader draws the edges of the geometry shader
+  const qint32 specialization_data[2] = {qint32(bindless_.capacity()),
+                                         qint32(wireframe)};
+  VkSpecializationMapEntry specialization_entries[2] = {
+    {1, 0, sizeof(qint32)}, {2, sizeof(qint32), sizeof(VkBool32)}};
+  VkSpecializationInfo specialization_info = {2, specialization_entries,
+                                              sizeof(specialization_data),
+                                              specialization_data};
+  VkPipelineShaderStageCreateInfo shader_stages[3] = {
+    {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0,
+     VK_SHADER_STAGE_VERTEX_BIT, vertShaderModule, "main",
+     &specialization_info},
     {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0,
-     VK_SHADER_STAGE_VERTEX_BIT, vertShaderModule, "main", nullptr},
+     VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderModule, "main",
+     &specialization_info},
     {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO, nullptr, 0,
-     VK_SHADER_STAGE_FRAGMENT_BIT, fragShaderModule, "main", nullptr}};
-  pipeline_info.stageCount = 2;
+     VK_SHADER_STAGE_GEOMETRY_BIT, geomShaderModule, "main",
+     &specialization_info}};
+  pipeline_info.stageCount = wireframe ? 3 : 2;
   pipeline_info.pStages = shader_stages;
 
   pipeline_info.pVertexInputState = &vertex_input_info;
@@ -278,10 +303,10 @@ void vulkan_engine::VulkanEngine::initResources() {
   VkPipelineRasterizationStateCreateInfo rs;
   memset(&rs, 0, sizeof(rs));
   rs.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-  rs.polygonMode = VK_POLYGON_MODE_LINE; // FILL
-  rs.cullMode = VK_CULL_MODE_NONE;       // we want the back face as well
+  rs.polygonMode = VK_POLYGON_MODE_FILL;
+  rs.cullMode = VK_CULL_MODE_NONE; // we want the back face as well
   rs.frontFace = VK_FRONT_FACE_CLOCKWISE;
-  rs.lineWidth = 5.0f;
+  rs.lineWidth = 1.0f;
   pipeline_info.pRasterizationState = &rs;
 
   VkPipelineMultisampleStateCreateInfo ms;
@@ -289,14 +314,16 @@ void vulkan_engine::VulkanEngine::initResources() {
   ms.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
 
   // Enable multisampling.
-  ms.rasterizationSamples = window_->sampleCountFlagBits();
+  ms.rasterizationSamples = samples;
   pipeline_info.pMultisampleState = &ms;
 
   VkPipelineDepthStencilStateCreateInfo ds;
   memset(&ds, 0, sizeof(ds));
   ds.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
   ds.depthTestEnable = VK_TRUE;
-  ds.depthWriteEnable = VK_TRUE;
+  // blended lines are tested against the triangles but do not hide each
+  // other
+  ds.depthWriteEnable = lines ? VK_FALSE : VK_TRUE;
   ds.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
   pipeline_info.pDepthStencilState = &ds;
 
@@ -304,10 +331,20 @@ void vulkan_engine::VulkanEngine::initResources() {
   memset(&cb, 0, sizeof(cb));
   cb.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
 
-  // no blend, write out all of rgba
+  // no blend, write out all of rgba; the antialiased edges of lines are
+  // blended over the scene
   VkPipelineColorBlendAttachmentState att;
   memset(&att, 0, sizeof(att));
   att.colorWriteMask = 0xF;
+  if(lines) {
+    att.blendEnable = VK_TRUE;
+    att.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+    att.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    att.colorBlendOp = VK_BLEND_OP_ADD;
+    att.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    att.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+    att.alphaBlendOp = VK_BLEND_OP_ADD;
+  }
   cb.attachmentCount = 1;
   cb.pAttachments = &att;
   pipeline_info.pColorBlendState = &cb;
@@ -322,43 +359,472 @@ void vulkan_engine::VulkanEngine::initResources() {
   pipeline_info.pDynamicState = &dyn;
 
   pipeline_info.layout = pipeline_layout_;
-  pipeline_info.renderPass = window_->defaultRenderPass();
+  pipeline_info.renderPass = render_pass;
 
-  err = funcs_->vkCreateGraphicsPipelines(device, pipeline_cache_, 1,
-                                          &pipeline_info, nullptr, &pipeline_);
+  VkPipeline pipeline;
+  VkResult err = funcs_->vkCreateGraphicsPipelines(
+    device, pipeline_cache_, 1, &pipeline_info, nullptr, &pipeline);
   if(err != VK_SUCCESS)
     qFatal("Failed to create graphics pipeline: %d", err);
 
   if(vertShaderModule) {
     funcs_->vkDestroyShaderModule(device, vertShaderModule, nullptr);
   }
+  if(geomShaderModule) {
+    funcs_->vkDestroyShaderModule(device, geomShaderModule, nullptr);
+  }
   if(fragShaderModule) {
     funcs_->vkDestroyShaderModule(device, fragShaderModule, nullptr);
   }
+
+  return pipeline;
+}
+
+void vulkan_engine::VulkanEngine::createScenePipelines(
+  VkRenderPass render_pass, VkSampleCountFlagBits samples,
+  ScenePipelines* pipelines) {
+  pipelines->shaded =
+    createScenePipeline(render_pass, samples, PipelineKind::Shaded);
+  pipelines->wireframe =
+    geometry_shader_
+      ? createScenePipeline(render_pass, samples, PipelineKind::Wireframe)
+      : VK_NULL_HANDLE;
+  pipelines->lines =
+    createScenePipeline(render_pass, samples, PipelineKind::Lines);
+}
+
+void vulkan_engine::VulkanEngine::destroyScenePipelines(
+  ScenePipelines* pipelines) {
+  VkPipeline* all[] = {&pipelines->shaded, &pipelines->wireframe,
+                       &pipelines->lines};
+  for(VkPipeline* pipeline : all) {
+    if(*pipeline) {
+      funcs_->vkDestroyPipeline(surface_->device(), *pipeline, nullptr);
+      *pipeline = VK_NULL_HANDLE;
+    }
+  }
+}
+
+void vulkan_engine::VulkanEngine::initResources() {
+  // qDebug("initResources");
+
+  VkDevice device = surface_->device();
+  funcs_ = surface_->vulkanInstance()->deviceFunctions(device);
+
+  // Uniform data is changing per frame so active frames have to have a
+  // dedicated copy. Use just one memory allocation and one buffer, kept
+  // mapped for the lifetime of the resources. We will then specify the
+  // appropriate offsets for uniform buffers in the VkDescriptorBufferInfo.
+  // Have to watch out for
+  // VkPhysicalDeviceLimits::minUniformBufferOffsetAlignment, though.
+
+  const int concurrent_frame_count = surface_->concurrentFrameCount();
+  deletion_queue_.init(surface_, funcs_);
+  const VkPhysicalDeviceLimits* device_limits =
+    &surface_->physicalDeviceProperties()->limits;
+  const VkDeviceSize uniform_align =
+    device_limits->minUniformBufferOffsetAlignment;
+
+  // Our internal layout is camera, lights, camera, lights, ... with each
+  // uniform buffer start offset aligned to uniform_align.
+  const VkDeviceSize camera_alloc_size =
+    aligned(sizeof(CameraUniform), uniform_align);
+  const VkDeviceSize lights_alloc_size =
+    aligned(sizeof(LightsUniform), uniform_align);
+  const VkDeviceSize frame_alloc_size = camera_alloc_size + lights_alloc_size;
+
+  createBuffer(concurrent_frame_count * frame_alloc_size,
+               VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+               surface_->hostVisibleMemoryIndex(), &buffer_, &buffer_memory_,
+               &buffer_memory_size_);
+
+  VkResult err =
+    funcs_->vkMapMemory(device, buffer_memory_, 0, buffer_memory_size_, 0,
+                        reinterpret_cast<void**>(&uniform_data_));
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to map memory: %d", err);
+  }
+  memset(uniform_data_, 0, buffer_memory_size_);
+  memset(camera_buffer_info_, 0, sizeof(camera_buffer_info_));
+  memset(lights_buffer_info_, 0, sizeof(lights_buffer_info_));
+  for(int i = 0; i < concurrent_frame_count; ++i) {
+    const VkDeviceSize offset = i * frame_alloc_size;
+    camera_buffer_info_[i].buffer = buffer_;
+    camera_buffer_info_[i].offset = offset;
+    camera_buffer_info_[i].range = sizeof(CameraUniform);
+    lights_buffer_info_[i].buffer = buffer_;
+    lights_buffer_info_[i].offset = offset + camera_alloc_size;
+    lights_buffer_info_[i].range = sizeof(LightsUniform);
+  }
+
+  // The materials and transforms of all frames live in storage buffers.
+  material_table_.init(surface_, funcs_, &deletion_queue_);
+  VkDescriptorBufferInfo materials_buffer_info = {
+    material_table_.buffer(), 0, material_table_.bufferSize()};
+  transform_table_.init(surface_, funcs_, &deletion_queue_);
+  transforms_uploaded_ = false;
+  VkDescriptorBufferInfo transforms_buffer_info = {
+    transform_table_.buffer(), 0, transform_table_.bufferSize()};
+  for(int i = 0; i < concurrent_frame_count; ++i) {
+    createInstanceBuffer(i, MIN_INSTANCES);
+  }
+
+  // Set up descriptor set and its layout.
+  VkDescriptorPoolSize descPoolSizes[] = {
+    {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, uint32_t(2 * concurrent_frame_count)},
+    {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+     uint32_t(3 * concurrent_frame_count)}};
+  VkDescriptorPoolCreateInfo descriptor_pool_info;
+  memset(&descriptor_pool_info, 0, sizeof(descriptor_pool_info));
+  descriptor_pool_info.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  descriptor_pool_info.maxSets = concurrent_frame_count;
+  descriptor_pool_info.poolSizeCount = 2;
+  descriptor_pool_info.pPoolSizes = descPoolSizes;
+  err = funcs_->vkCreateDescriptorPool(device, &descriptor_pool_info, nullptr,
+                                       &descriptor_pool_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create descriptor pool: %d", err);
+  }
+
+  // The geometry shader of the wireframe overlay reads the viewport of the
+  // camera, devices without the feature draw no overlay.
+  VkPhysicalDeviceFeatures features;
+  surface_->vulkanInstance()->functions()->vkGetPhysicalDeviceFeatures(
+    surface_->physicalDevice(), &features);
+  geometry_shader_ = features.geometryShader == VK_TRUE;
+  if(wireframe_overlay_ && !geometry_shader_) {
+    qWarning("The wireframe overlay requires geometry shaders");
+  }
+  VkShaderStageFlags camera_stages =
+    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT;
+  if(geometry_shader_) {
+    camera_stages |= VK_SHADER_STAGE_GEOMETRY_BIT;
+  }
+  VkDescriptorSetLayoutBinding layout_bindings[] = {
+    {0, // binding
+     VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, camera_stages, nullptr},
+    {1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1,
+     VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+    {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1,
+     VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, nullptr},
+    {3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT,
+     nullptr},
+    {4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT,
+     nullptr}};
+  VkDescriptorSetLayoutCreateInfo descriptor_layout_info = {
+    VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO, nullptr, 0, 5,
+    layout_bindings};
+  err = funcs_->vkCreateDescriptorSetLayout(device, &descriptor_layout_info,
+                                            nullptr, &descriptor_set_layout_);
+  if(err != VK_SUCCESS)
+    qFatal("Failed to create descriptor set layout: %d", err);
+
+  for(int i = 0; i < concurrent_frame_count; ++i) {
+    VkDescriptorSetAllocateInfo descriptor_set_alloc_info = {
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO, nullptr, descriptor_pool_,
+      1, &descriptor_set_layout_};
+    err = funcs_->vkAllocateDescriptorSets(device, &descriptor_set_alloc_info,
+                                           &descriptor_set_[i]);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to allocate descriptor set: %d", err);
+    }
+
+    VkDescriptorBufferInfo instances_buffer_info = {
+      instance_buffers_[i].buffer, 0,
+      instance_buffers_[i].capacity * sizeof(GpuInstance)};
+    VkWriteDescriptorSet descriptor_write[5];
+    memset(descriptor_write, 0, sizeof(descriptor_write));
+    descriptor_write[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write[0].dstSet = descriptor_set_[i];
+    descriptor_write[0].dstBinding = 0;
+    descriptor_write[0].descriptorCount = 1;
+    descriptor_write[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    descriptor_write[0].pBufferInfo = &camera_buffer_info_[i];
+    descriptor_write[1] = descriptor_write[0];
+    descriptor_write[1].dstBinding = 1;
+    descriptor_write[1].pBufferInfo = &lights_buffer_info_[i];
+    descriptor_write[2] = descriptor_write[0];
+    descriptor_write[2].dstBinding = 2;
+    descriptor_write[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_write[2].pBufferInfo = &materials_buffer_info;
+    descriptor_write[3] = descriptor_write[2];
+    descriptor_write[3].dstBinding = 3;
+    descriptor_write[3].pBufferInfo = &transforms_buffer_info;
+    descriptor_write[4] = descriptor_write[2];
+    descriptor_write[4].dstBinding = 4;
+    descriptor_write[4].pBufferInfo = &instances_buffer_info;
+    funcs_->vkUpdateDescriptorSets(device, 5, descriptor_write, 0, nullptr);
+    material_set_generation_[i] = material_table_.generation();
+    transform_set_generation_[i] = transform_table_.generation();
+  }
+
+  // Pipeline cache
+  VkPipelineCacheCreateInfo pipeline_cache_info;
+  memset(&pipeline_cache_info, 0, sizeof(pipeline_cache_info));
+  pipeline_cache_info.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  err = funcs_->vkCreatePipelineCache(device, &pipeline_cache_info, nullptr,
+                                      &pipeline_cache_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create pipeline cache: %d", err);
+  }
+
+  // Textures are sampled through the bindless table in set 1, vertices
+  // are fetched from the geometry buffer pages in set 2.
+  bindless_.init(surface_, funcs_, &deletion_queue_, MAX_TEXTURES);
+  geometry_.init(surface_, funcs_, &deletion_queue_);
+
+  // Pipeline layout, the object and material of each instance are read from
+  // the instance buffer, the rest of a draw is passed as push constants
+  VkPushConstantRange push_constant_range = {
+    VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+    sizeof(PushConstants)};
+  VkDescriptorSetLayout set_layouts[] = {
+    descriptor_set_layout_, bindless_.layout(), geometry_.layout()};
+  VkPipelineLayoutCreateInfo pipeline_layout_info;
+  memset(&pipeline_layout_info, 0, sizeof(pipeline_layout_info));
+  pipeline_layout_info.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipeline_layout_info.setLayoutCount = 3;
+  pipeline_layout_info.pSetLayouts = set_layouts;
+  pipeline_layout_info.pushConstantRangeCount = 1;
+  pipeline_layout_info.pPushConstantRanges = &push_constant_range;
+  err = funcs_->vkCreatePipelineLayout(device, &pipeline_layout_info, nullptr,
+                                       &pipeline_layout_);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to create pipeline layout: %d", err);
+  }
+
+  // A multisampled surface resolves itself, otherwise the scene is drawn
+  // into the engine's own multisampled attachments.
+  samples_ = surface_->sampleCountFlagBits();
+  if(samples_ == VK_SAMPLE_COUNT_1_BIT) {
+    const VkPhysicalDeviceLimits& limits =
+      surface_->physicalDeviceProperties()->limits;
+    const VkSampleCountFlags supported =
+      limits.framebufferColorSampleCounts & limits.framebufferDepthSampleCounts;
+    for(int s = sample_count_; s > 1; s /= 2) {
+      if(supported & s) {
+        samples_ = VkSampleCountFlagBits(s);
+        break;
+      }
+    }
+  }
+  if(samples_ > surface_->sampleCountFlagBits()) {
+    resolve_pass_ = createResolveRenderPass(surface_, funcs_, samples_);
+  }
+  createScenePipelines(resolve_pass_ ? resolve_pass_
+                                     : surface_->defaultRenderPass(),
+                       samples_, &pipelines_);
+
+  // Progressive accumulation renders the scene single-sampled into its own
+  // render pass. The render targets are only allocated once enabled.
+  VkShaderModule accumulate_vert =
+    createShader(QStringLiteral(":/shaders/accumulate.vert.spv"));
+  VkShaderModule accumulate_frag =
+    createShader(QStringLiteral(":/shaders/accumulate.frag.spv"));
+  accumulation_.init(surface_, funcs_, pipeline_cache_, accumulate_vert,
+                     accumulate_frag);
+  if(accumulate_vert) {
+    funcs_->vkDestroyShaderModule(device, accumulate_vert, nullptr);
+  }
+  if(accumulate_frag) {
+    funcs_->vkDestroyShaderModule(device, accumulate_frag, nullptr);
+  }
+
+  VkShaderModule upscale_vert =
+    createShader(QStringLiteral(":/shaders/upscale.vert.spv"));
+  VkShaderModule upscale_frag =
+    createShader(QStringLiteral(":/shaders/upscale.frag.spv"));
+  dynamic_resolution_.init(surface_, funcs_, pipeline_cache_, upscale_vert,
+                           upscale_frag);
+  if(upscale_vert) {
+    funcs_->vkDestroyShaderModule(device, upscale_vert, nullptr);
+  }
+  if(upscale_frag) {
+    funcs_->vkDestroyShaderModule(device, upscale_frag, nullptr);
+  }
+  createScenePipelines(accumulation_.scenePass(), VK_SAMPLE_COUNT_1_BIT,
+                       &offscreen_pipelines_);
+  render_graph_.init(surface_, funcs_, &deletion_queue_);
+
+  // Culling on the GPU, on the compute queue if there is one. The instance
+  // bindings refer to the CPU culled instances until it is enabled.
+  async_compute_.init(surface_, funcs_);
+  VkShaderModule cull_shader =
+    createShader(QStringLiteral(":/shaders/cull.comp.spv"));
+  culling_.init(surface_, funcs_, pipeline_cache_, cull_shader,
+                async_compute_.queueFamilies());
+  if(cull_shader) {
+    funcs_->vkDestroyShaderModule(device, cull_shader, nullptr);
+  }
+  capture_.init(surface_, funcs_);
+  VkFenceCreateInfo fence_info;
+  memset(&fence_info, 0, sizeof(fence_info));
+  fence_info.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+  memset(frame_fences_, 0, sizeof(frame_fences_));
+  memset(frame_fence_pending_, 0, sizeof(frame_fence_pending_));
+  for(int i = 0; i < concurrent_frame_count; ++i) {
+    err = funcs_->vkCreateFence(device, &fence_info, nullptr,
+                                &frame_fences_[i]);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create fence: %d", err);
+    }
+  }
+  memset(instance_set_culled_, 0, sizeof(instance_set_culled_));
+  memset(instance_set_generation_, 0, sizeof(instance_set_generation_));
+  for(int i = 0; i < QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT; ++i) {
+    gpu_cull_generation_[i] = UINT64_MAX;
+  }
+  indirect_buffer_ = VK_NULL_HANDLE;
+
+  textures_.init(surface_, funcs_, &bindless_, &deletion_queue_);
+
+  // Timestamps at the start and end of every frame measure its GPU time,
+  // if the graphics queue supports them.
+  uint32_t family_count = 0;
+  QVulkanFunctions* f = surface_->vulkanInstance()->functions();
+  f->vkGetPhysicalDeviceQueueFamilyProperties(surface_->physicalDevice(),
+                                              &family_count, nullptr);
+  std::vector<VkQueueFamilyProperties> families(family_count);
+  f->vkGetPhysicalDeviceQueueFamilyProperties(
+    surface_->physicalDevice(), &family_count, families.data());
+  memset(timestamps_written_, 0, sizeof(timestamps_written_));
+  memset(graphics_timestamps_, 0, sizeof(graphics_timestamps_));
+  gpu_frame_time_ = -1.0f;
+  if(surface_->graphicsQueueFamilyIndex() < family_count &&
+     families[surface_->graphicsQueueFamilyIndex()].timestampValidBits > 0) {
+    timestamp_period_ = device_limits->timestampPeriod;
+    VkQueryPoolCreateInfo query_info;
+    memset(&query_info, 0, sizeof(query_info));
+    query_info.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    query_info.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    query_info.queryCount = 2 * concurrent_frame_count;
+    err = funcs_->vkCreateQueryPool(device, &query_info, nullptr,
+                                    &timestamp_pool_);
+    if(err != VK_SUCCESS) {
+      qFatal("Failed to create query pool: %d", err);
+    }
+  }
+
+  // Command pools and secondary command buffers for recording in parallel,
+  // one per thread of the job system and frame in flight, and one more per
+  // frame for the lines drawn after all triangles.
+  record_chunks_ = JobSystem::global().threadCount();
+  if(record_chunks_ > 1) {
+    record_pools_.resize(concurrent_frame_count * (record_chunks_ + 1));
+    record_buffers_.resize(concurrent_frame_count * (record_chunks_ + 1));
+    for(size_t i = 0; i < record_pools_.size(); ++i) {
+      VkCommandPoolCreateInfo pool_info;
+      memset(&pool_info, 0, sizeof(pool_info));
+      pool_info.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+      pool_info.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+      pool_info.queueFamilyIndex = surface_->graphicsQueueFamilyIndex();
+      err = funcs_->vkCreateCommandPool(device, &pool_info, nullptr,
+                                        &record_pools_[i]);
+      if(err != VK_SUCCESS) {
+        qFatal("Failed to create command pool: %d", err);
+      }
+
+      VkCommandBufferAllocateInfo buffer_info = {
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO, nullptr,
+        record_pools_[i], VK_COMMAND_BUFFER_LEVEL_SECONDARY, 1};
+      err = funcs_->vkAllocateCommandBuffers(device, &buffer_info,
+                                             &record_buffers_[i]);
+      if(err != VK_SUCCESS) {
+        qFatal("Failed to allocate command buffer: %d", err);
+      }
+    }
+  }
 }
 
 void vulkan_engine::VulkanEngine::initSwapChainResources() {
+  invalidate();
+
   // Projection matrix
-  projection_ = window_->clipCorrectionMatrix(); // adjust for Vulkan-OpenGL
-                                                 // clip space differences
-  const QSize sz = window_->swapChainImageSize();
-  projection_.perspective(45.0f, sz.width() / (float)sz.height(), 0.01f,
-                          100.0f);
-  projection_.translate(0, 0, -4);
+  QMatrix4x4 projection =
+    surface_->clipCorrectionMatrix(); // adjust for Vulkan-OpenGL clip space
+                                      // differences
+  const QSize sz = surface_->swapChainImageSize();
+  projection.perspective(45.0f, sz.width() / (float)sz.height(), 0.01f,
+                         1000.0f);
+  projection_ = math::fromQt(projection);
+
+  // only a swap chain recreated at another size is a resize, not one
+  // shown again after being hidden
+  if(released_size_.isValid() && released_size_ != sz) {
+    resizing_ = true;
+  }
+  released_size_ = QSize();
 }
 
 void vulkan_engine::VulkanEngine::releaseSwapChainResources() {
   // qDebug("releaseSwapChainResources");
+  released_size_ = surface_->swapChainImageSize();
+  resize_start_ = std::chrono::steady_clock::now();
+  // The pipelines have a dynamic viewport and survive, the render targets
+  // are resized in place by the next frame while the device is still idle.
+  // Only the framebuffers refer to the swap chain images.
+  if(!accumulate_) {
+    accumulation_.releaseImages();
+  }
+  if(!dynamic_resolution_enabled_) {
+    dynamic_resolution_.releaseImages();
+  }
+  render_graph_.releaseFramebuffers();
 }
 
 void vulkan_engine::VulkanEngine::releaseResources() {
   // qDebug("releaseResources");
 
-  VkDevice device = window_->device();
+  VkDevice device = surface_->device();
+
+  releaseMeshes();
+  releaseMesh(&placeholder_mesh_);
+  deletion_queue_.release();
+  geometry_.release();
+
+  for(VkCommandPool pool : record_pools_) {
+    funcs_->vkDestroyCommandPool(device, pool, nullptr);
+  }
+  record_pools_.clear();
+  record_buffers_.clear();
+  record_chunks_ = 0;
+
+  destroyScenePipelines(&pipelines_);
 
-  if(pipeline_) {
-    funcs_->vkDestroyPipeline(device, pipeline_, nullptr);
-    pipeline_ = VK_NULL_HANDLE;
+  if(resolve_pass_) {
+    funcs_->vkDestroyRenderPass(device, resolve_pass_, nullptr);
+    resolve_pass_ = VK_NULL_HANDLE;
+  }
+
+  destroyScenePipelines(&offscreen_pipelines_);
+  accumulation_.release();
+  dynamic_resolution_.release();
+  render_graph_.release();
+  culling_.release();
+  async_compute_.release();
+  capture_.release();
+  indirect_buffer_ = VK_NULL_HANDLE;
+  textures_.release();
+  bindless_.release();
+  material_table_.release();
+  material_entries_.clear();
+  transform_table_.release();
+  for(int i = 0; i < QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT; ++i) {
+    releaseInstanceBuffer(i);
+  }
+  batches_.clear();
+
+  if(timestamp_pool_) {
+    funcs_->vkDestroyQueryPool(device, timestamp_pool_, nullptr);
+    timestamp_pool_ = VK_NULL_HANDLE;
+  }
+
+  for(int i = 0; i < QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT; ++i) {
+    if(frame_fences_[i]) {
+      funcs_->vkDestroyFence(device, frame_fences_[i], nullptr);
+      frame_fences_[i] = VK_NULL_HANDLE;
+    }
+    frame_fence_pending_[i] = false;
   }
 
   if(pipeline_layout_) {
@@ -388,80 +854,908 @@ void vulkan_engine::VulkanEngine::releaseResources() {
   }
 
   if(buffer_memory_) {
+    funcs_->vkUnmapMemory(device, buffer_memory_);
+    uniform_data_ = nullptr;
     funcs_->vkFreeMemory(device, buffer_memory_, nullptr);
     buffer_memory_ = VK_NULL_HANDLE;
+    device_memory_usage_ -= buffer_memory_size_;
+    buffer_memory_size_ = 0;
   }
 }
 
-void vulkan_engine::VulkanEngine::startNextFrame() {
+vulkan_engine::SceneGraph::NodeId vulkan_engine::VulkanEngine::addRenderObject(
+  MeshData* mesh_data, MaterialData* material_data, const QMatrix4x4& transform,
+  SceneGraph::NodeId parent) {
+  std::lock_guard<std::mutex> lock(scene_mutex_);
+  const SceneGraph::NodeId node =
+    scene_graph_.addNode(parent, math::fromQt(transform));
+  if(node == SceneGraph::INVALID_NODE) {
+    return node;
+  }
+  const uint32_t mesh = meshHandle(mesh_data);
+  entities_.create(node, mesh, materialHandle(material_data, mesh));
+  scene_changed_ = true;
+  invalidate();
+  return node;
+}
 
-  VkDevice device = window_->device();
-  VkCommandBuffer cb = window_->currentCommandBuffer();
-  const QSize sz = window_->swapChainImageSize();
+void vulkan_engine::VulkanEngine::setVisible(SceneGraph::NodeId node,
+                                             bool visible) {
+  std::lock_guard<std::mutex> lock(scene_mutex_);
+  const EntityStore::Handle handle = entities_.find(node);
+  if(!entities_.valid(handle)) {
+    return;
+  }
+  uint32_t& flags = entities_.flags()[entities_.index(handle)];
+  flags = visible ? flags | ENTITY_VISIBLE : flags & ~ENTITY_VISIBLE;
+  scene_changed_ = true;
+  invalidate();
+}
 
-  VkClearColorValue clear_color = {.uint32 = {0, 0, 0, 1}};
-  VkClearDepthStencilValue clear_ds = {.depth = 1, .stencil = 0};
+uint32_t vulkan_engine::VulkanEngine::meshHandle(MeshData* mesh_data) {
+  auto it = mesh_handles_.find(mesh_data);
+  if(it != mesh_handles_.end()) {
+    return it->second;
+  }
 
-  VkClearValue clear_values[] = {{
-                                   .color = clear_color,
-                                 },
-                                 {
-                                   .depthStencil = clear_ds,
-                                 },
-                                 {
-                                   .color = clear_color,
-                                 }};
+  const uint32_t handle = mesh_data_.size();
+  mesh_data_.push_back(mesh_data);
+  mesh_handles_[mesh_data] = handle;
+  mesh_cache_index_.push_back(NO_CACHE_MESH);
+  if(mesh_data && !mesh_data->vertices.empty()) {
+    mesh_bounds_.push_back(math::computeBounds(mesh_data->vertices.data(),
+                                               mesh_data->vertices.size() / 3));
+  } else {
+    math::Bounds empty_bounds;
+    memset(&empty_bounds, 0, sizeof(empty_bounds));
+    mesh_bounds_.push_back(empty_bounds);
+  }
+  return handle;
+}
 
-  VkRenderPassBeginInfo render_pass_begin_info = {
-    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
-    .pNext = 0,
-    .renderPass = window_->defaultRenderPass(),
-    .framebuffer = window_->currentFramebuffer(),
-    .renderArea =
-      {
-        .offset = {.x = 0, .y = 0},
-        .extent =
-          {
-            .width = static_cast<unsigned int>(sz.width()),
-            .height = static_cast<unsigned int>(sz.height()),
-          },
-      },
-    .clearValueCount = static_cast<unsigned int>(
-      window_->sampleCountFlagBits() > VK_SAMPLE_COUNT_1_BIT ? 3 : 2),
-    .pClearValues = clear_values,
-  };
-  VkCommandBuffer command_buffer = window_->currentCommandBuffer();
-  funcs_->vkCmdBeginRenderPass(command_buffer, &render_pass_begin_info,
-                               VK_SUBPASS_CONTENTS_INLINE);
+uint32_t vulkan_engine::VulkanEngine::cachedMeshHandle(uint32_t cache_mesh) {
+  if(cached_handles_[cache_mesh] != NO_CACHE_MESH) {
+    return cached_handles_[cache_mesh];
+  }
 
-  quint8* p;
-  VkResult err =
-    funcs_->vkMapMemory(device, buffer_memory_,
-                        uniform_buffer_info_[window_->currentFrame()].offset,
-                        UNIFORM_DATA_SIZE, 0, reinterpret_cast<void**>(&p));
-  if(err != VK_SUCCESS) {
-    qFatal("Failed to map memory: %d", err);
+  // the mesh data only exists while the mesh is resident
+  const uint32_t handle = mesh_data_.size();
+  mesh_data_.push_back(nullptr);
+  mesh_cache_index_.push_back(cache_mesh);
+  cached_handles_[cache_mesh] = handle;
+  mesh_bounds_.push_back(mesh_cache_->bounds(cache_mesh));
+  return handle;
+}
+
+uint32_t vulkan_engine::VulkanEngine::materialHandle(
+  MaterialData* material_data, uint32_t mesh) {
+  // The texture maps belong to the mesh, so the same material data used
+  // with different meshes gives different materials.
+  const std::pair<const MaterialData*, uint32_t> key(material_data, mesh);
+  auto it = material_handles_.find(key);
+  if(it != material_handles_.end()) {
+    return it->second;
   }
-  QMatrix4x4 m = projection_;
-  m.rotate(rotation_, 0, 1, 0);
-  memcpy(p, m.constData(), 16 * sizeof(float));
-  funcs_->vkUnmapMemory(device, buffer_memory_);
 
-  // Not exactly a real animation system, just advance on every frame for now.
-  rotation_ += 1.0f;
+  const uint32_t handle = material_instances_.size();
+  material_instances_.push_back(MaterialInstance{material_data, mesh});
+  material_handles_[key] = handle;
+  return handle;
+}
 
-  funcs_->vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_);
-  funcs_->vkCmdBindDescriptorSets(
-    cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline_layout_, 0, 1,
-    &descriptor_set_[window_->currentFrame()], 0, nullptr);
-  VkDeviceSize vb_offset = 0;
-  funcs_->vkCmdBindVertexBuffers(cb, 0, 1, &buffer_, &vb_offset);
+void vulkan_engine::VulkanEngine::setMeshCache(const MeshCache* cache,
+                                               int io_threads) {
+  clearScene();
+  std::lock_guard<std::mutex> lock(scene_mutex_);
+  mesh_cache_ = cache;
+  cached_handles_.assign(cache ? cache->size() : 0, NO_CACHE_MESH);
+
+  // the streamer belongs to the render thread, which switches over before
+  // it draws the first snapshot with meshes of cache
+  render_jobs_.push_back([this, cache, io_threads]() {
+    mesh_streamer_.reset();
+    streamed_cache_ = cache;
+    streamed_handles_.assign(cache ? cache->size() : 0, NO_CACHE_MESH);
+    if(cache) {
+      mesh_streamer_.reset(new MeshStreamer(cache, io_threads));
+      mesh_streamer_->setBudget(mesh_budget_);
+    }
+  });
+}
+
+vulkan_engine::SceneGraph::NodeId vulkan_engine::VulkanEngine::addCachedObject(
+  uint32_t cache_mesh, MaterialData* material_data, const QMatrix4x4& transform,
+  SceneGraph::NodeId parent) {
+  if(!mesh_cache_ || cache_mesh >= mesh_cache_->size()) {
+    qWarning("Mesh %u is not in the mesh cache", cache_mesh);
+    return SceneGraph::INVALID_NODE;
+  }
+  std::lock_guard<std::mutex> lock(scene_mutex_);
+  const SceneGraph::NodeId node =
+    scene_graph_.addNode(parent, math::fromQt(transform));
+  if(node == SceneGraph::INVALID_NODE) {
+    return node;
+  }
+  const uint32_t mesh = cachedMeshHandle(cache_mesh);
+  entities_.create(node, mesh, materialHandle(material_data, mesh));
+  scene_changed_ = true;
+  invalidate();
+  return node;
+}
+
+void vulkan_engine::VulkanEngine::setMeshBudget(VkDeviceSize bytes) {
+  mesh_budget_ = bytes;
+  if(mesh_streamer_) {
+    mesh_streamer_->setBudget(bytes);
+  }
+}
+
+void vulkan_engine::VulkanEngine::setTextureBudget(VkDeviceSize bytes) {
+  textures_.setBudget(bytes);
+}
+
+vulkan_engine::MeshStreamer::Stats
+vulkan_engine::VulkanEngine::meshStreamingStats() const {
+  return mesh_streamer_ ? mesh_streamer_->stats() : MeshStreamer::Stats();
+}
+
+vulkan_engine::SceneGraph::NodeId
+vulkan_engine::VulkanEngine::addNode(const QMatrix4x4& transform,
+                                     SceneGraph::NodeId parent) {
+  std::lock_guard<std::mutex> lock(scene_mutex_);
+  scene_changed_ = true;
+  invalidate();
+  return scene_graph_.addNode(parent, math::fromQt(transform));
+}
+
+void vulkan_engine::VulkanEngine::setTransform(SceneGraph::NodeId node,
+                                               const QMatrix4x4& transform) {
+  std::lock_guard<std::mutex> lock(scene_mutex_);
+  scene_graph_.setLocal(node, math::fromQt(transform));
+  scene_changed_ = true;
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::setViewMatrix(const QMatrix4x4& view) {
+  const math::Mat4 new_view = math::fromQt(view);
+  std::lock_guard<std::mutex> lock(scene_mutex_);
+  if(memcmp(&new_view, &view_, sizeof(view_)) == 0) {
+    return;
+  }
+  view_ = new_view;
+  scene_changed_ = true;
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::setViewMatrix(
+  const QMatrix4x4& view, std::chrono::steady_clock::time_point input_time) {
+  {
+    std::lock_guard<std::mutex> lock(scene_mutex_);
+    if(view_input_time_.time_since_epoch().count() == 0) {
+      view_input_time_ = input_time;
+    }
+  }
+  setViewMatrix(view);
+}
+
+QMatrix4x4 vulkan_engine::VulkanEngine::viewMatrix() {
+  std::lock_guard<std::mutex> lock(scene_mutex_);
+  return math::toQt(view_);
+}
+
+void vulkan_engine::VulkanEngine::addLight(const LightData& light) {
+  std::lock_guard<std::mutex> lock(scene_mutex_);
+  if(lights_.size() >= MAX_LIGHTS) {
+    qWarning("Ignoring light, at most %d lights are supported", MAX_LIGHTS);
+    return;
+  }
+  lights_.push_back(light);
+  scene_changed_ = true;
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::clearScene() {
+  {
+    std::lock_guard<std::mutex> lock(scene_mutex_);
+    entities_.clear();
+    scene_graph_.clear();
+    lights_.clear();
+    mesh_data_.clear();
+    mesh_handles_.clear();
+    mesh_bounds_.clear();
+    mesh_cache_index_.clear();
+    std::fill(cached_handles_.begin(), cached_handles_.end(), NO_CACHE_MESH);
+    material_instances_.clear();
+    material_handles_.clear();
+    // snapshots taken before this refer to the old mesh and material tables
+    const uint64_t generation = ++scene_generation_;
+    scene_changed_ = true;
+
+    // the renderer drops its copies before it draws the cleared scene
+    render_jobs_.push_back([this, generation]() {
+      draw_keys_.clear();
+      batches_.clear();
+      material_entries_.clear();
+      if(funcs_) {
+        releaseMeshes();
+        material_table_.clear();
+      }
+      textures_.clear();
+      render_generation_ = generation;
+    });
+  }
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::uploadMesh(const MeshData& mesh_data,
+                                             Mesh* mesh) {
+  // Positions, normals, texture coordinates and indices are stored
+  // back-to-back in one range of the geometry buffer. The vertex shader
+  // fetches them by offset, missing attributes have none.
+  const VkDeviceSize vertex_size = mesh_data.vertices.size() * sizeof(float);
+  const VkDeviceSize normal_size =
+    mesh_data.normals.size() == mesh_data.vertices.size()
+      ? mesh_data.normals.size() * sizeof(float)
+      : 0;
+  const VkDeviceSize uv_size =
+    mesh_data.texture_coordinates.size() == 2 * mesh_data.vertices.size() / 3
+      ? mesh_data.texture_coordinates.size() * sizeof(float)
+      : 0;
+  // LINE meshes list the index pairs of their segments, WIREFRAME meshes
+  // draw the edges of their triangles as lines
+  std::vector<unsigned int> edges;
+  const std::vector<unsigned int>* indices = &mesh_data.faces;
+  mesh->lines = mesh_data.shading_type == ShadingType::LINE ||
+                mesh_data.shading_type == ShadingType::WIREFRAME;
+  if(mesh_data.shading_type == ShadingType::WIREFRAME) {
+    wireframeEdges(mesh_data.faces, &edges);
+    indices = &edges;
+  }
+  mesh->index_count = mesh->lines ? indices->size() & ~size_t(1)
+                                  : indices->size();
+  const VkDeviceSize index_size = mesh->index_count * sizeof(unsigned int);
+  if(vertex_size == 0 || index_size == 0 ||
+     !geometry_.allocate(vertex_size + normal_size + uv_size + index_size,
+                         &mesh->allocation)) {
+    return;
+  }
+
+  const GeometryBuffer::Allocation& allocation = mesh->allocation;
+  const qint32 base = allocation.offset / sizeof(float);
+  mesh->position_offset = base;
+  mesh->normal_offset = normal_size ? base + vertex_size / sizeof(float) : -1;
+  mesh->uv_offset =
+    uv_size ? base + (vertex_size + normal_size) / sizeof(float) : -1;
+  mesh->first_index =
+    (allocation.offset + vertex_size + normal_size + uv_size) /
+    sizeof(unsigned int);
+  geometry_.write(allocation, 0, mesh_data.vertices.data(), vertex_size);
+  geometry_.write(allocation, vertex_size, mesh_data.normals.data(),
+                  normal_size);
+  geometry_.write(allocation, vertex_size + normal_size,
+                  mesh_data.texture_coordinates.data(), uv_size);
+  geometry_.write(allocation, vertex_size + normal_size + uv_size,
+                  indices->data(), index_size);
+}
+
+void vulkan_engine::VulkanEngine::releaseMesh(Mesh* mesh) {
+  geometry_.free(&mesh->allocation);
+}
+
+void vulkan_engine::VulkanEngine::retireMesh(Mesh* mesh) {
+  // frames in flight may still draw it, its geometry is reused once those
+  // have completed
+  if(mesh->resident()) {
+    Mesh retired = *mesh;
+    deletion_queue_.retire([this, retired]() mutable {
+      releaseMesh(&retired);
+    });
+    mesh->allocation = GeometryBuffer::Allocation();
+  }
+}
+
+void vulkan_engine::VulkanEngine::syncMeshes(const SceneSnapshot& snapshot) {
+  // Jobs posted by the scene, e.g. by clearScene(), come first, so the
+  // render thread copies are of the snapshot's generation.
+  std::vector<std::function<void()>> jobs;
+  {
+    std::lock_guard<std::mutex> lock(scene_mutex_);
+    jobs.swap(render_jobs_);
+  }
+  for(const std::function<void()>& job : jobs) {
+    job();
+  }
+  if(snapshot.scene_generation != render_generation_ ||
+     meshes_.size() >= snapshot.mesh_count) {
+    return;
+  }
+
+  // The mesh tables are only appended to until the scene is cleared again,
+  // so the entries up to the snapshot's mesh count are still the ones it
+  // refers to unless the generation changed meanwhile.
+  const size_t first = meshes_.size();
+  std::vector<MeshData*> mesh_data;
+  std::vector<uint32_t> cache_index;
+  {
+    std::lock_guard<std::mutex> lock(scene_mutex_);
+    if(scene_generation_ != render_generation_) {
+      return;
+    }
+    mesh_data.assign(mesh_data_.begin() + first,
+                     mesh_data_.begin() + snapshot.mesh_count);
+    cache_index.assign(mesh_cache_index_.begin() + first,
+                       mesh_cache_index_.begin() + snapshot.mesh_count);
+  }
+  for(size_t i = 0; i < mesh_data.size(); ++i) {
+    Mesh mesh;
+    if(cache_index[i] != NO_CACHE_MESH) {
+      // uploaded by streamMeshes() once visible
+      const MeshCache::Entry& entry = streamed_cache_->entry(cache_index[i]);
+      mesh.cache_mesh = cache_index[i];
+      for(int k = 0; k < 3; ++k) {
+        mesh.center[k] = 0.5f * (entry.bounds_min[k] + entry.bounds_max[k]);
+        mesh.half_extent[k] =
+          0.5f * (entry.bounds_max[k] - entry.bounds_min[k]);
+      }
+      streamed_handles_[cache_index[i]] = meshes_.size();
+    } else if(mesh_data[i]) {
+      uploadMesh(*mesh_data[i], &mesh);
+    }
+    meshes_.push_back(mesh);
+    loadMeshTextures(mesh_data[i]);
+  }
+}
+
+void vulkan_engine::VulkanEngine::loadMeshTextures(const MeshData* mesh_data) {
+  // Texture handles are only valid until textures_ is cleared, which
+  // happens on the render thread as well.
+  std::vector<TextureManager::Handle> textures;
+  MaterialMaps material_maps = {NO_TEXTURE, NO_TEXTURE};
+  if(mesh_data) {
+    const std::pair<const std::string*, TextureCache::Kind> maps[] = {
+      {&mesh_data->diffuse_map, TextureCache::COLOR},
+      {&mesh_data->normal_map, TextureCache::NORMAL},
+      {&mesh_data->specular_map, TextureCache::COLOR},
+      {&mesh_data->displacement_map, TextureCache::MASK},
+      {&mesh_data->metalness_map, TextureCache::MASK},
+      {&mesh_data->occlusion_map, TextureCache::MASK}};
+    for(const auto& map : maps) {
+      if(!map.first->empty()) {
+        textures.push_back(textures_.load(*map.first, map.second));
+        if(map.first == &mesh_data->diffuse_map) {
+          material_maps.albedo = textures.back();
+        } else if(map.first == &mesh_data->normal_map) {
+          material_maps.normal = textures.back();
+        }
+      }
+    }
+  }
+  mesh_textures_.push_back(textures);
+  mesh_material_maps_.push_back(material_maps);
+}
+
+void vulkan_engine::VulkanEngine::releaseMeshes() {
+  for(Mesh& mesh : meshes_) {
+    retireMesh(&mesh);
+  }
+  meshes_.clear();
+  mesh_textures_.clear();
+  mesh_material_maps_.clear();
+  std::fill(streamed_handles_.begin(), streamed_handles_.end(),
+            NO_CACHE_MESH);
+  if(mesh_streamer_) {
+    mesh_streamer_->reset();
+  }
+}
+
+void vulkan_engine::VulkanEngine::measureVisibleMeshes(
+  int current_frame, const SceneSnapshot& snapshot) {
+  visible_meshes_.clear();
+  if(snapshot.scene_generation != render_generation_) {
+    return;
+  }
+
+  // The draw keys are not frustum culled with GPU culling, the GPU found
+  // the visible meshes of the frame that used this slot last instead.
+  if(gpu_culling_ && culling_.ready()) {
+    if(gpu_cull_generation_[current_frame] == render_generation_) {
+      culling_.visibleMeshes(current_frame, &visible_meshes_);
+    }
+    return;
+  }
+
+  float eye[3];
+  eyePosition(snapshot.view, eye);
+
+  // the draw keys are sorted by mesh
+  for(size_t k = 0; k < draw_keys_.size(); ++k) {
+    const uint32_t handle = draw_keys_[k] >> 32;
+    const math::Bounds& bounds = snapshot.bounds[uint32_t(draw_keys_[k])];
+    float radius = 0.0f;
+    float distance = 0.0f;
+    for(int i = 0; i < 3; ++i) {
+      const float half = 0.5f * (bounds.max[i] - bounds.min[i]);
+      const float d = 0.5f * (bounds.max[i] + bounds.min[i]) - eye[i];
+      radius += half * half;
+      distance += d * d;
+    }
+    const float size = std::sqrt(radius / std::max(distance, 1e-6f));
+    if(visible_meshes_.empty() || visible_meshes_.back().first != handle) {
+      visible_meshes_.push_back(std::make_pair(handle, size));
+    } else {
+      visible_meshes_.back().second =
+        std::max(visible_meshes_.back().second, size);
+    }
+  }
+}
+
+void vulkan_engine::VulkanEngine::streamMeshes() {
+  if(!mesh_streamer_) {
+    return;
+  }
+
+  // Visible meshes that are not resident are requested with the largest
+  // apparent size of their objects.
+  mesh_streamer_->beginFrame(frames_rendered_);
+  for(const auto& visible : visible_meshes_) {
+    const Mesh& mesh = meshes_[visible.first];
+    if(mesh.streamed()) {
+      mesh_streamer_->use(mesh.cache_mesh, visible.second);
+    }
+  }
+  mesh_streamer_->endFrame();
+
+  if(!placeholder_mesh_.resident()) {
+    uploadMesh(SceneGenerator::box(), &placeholder_mesh_);
+  }
+
+  // Meshes drawn by this frame are not evicted, the geometry of those
+  // evicted is retired for the frames in flight.
+  const uint64_t retire = 1;
+  VkDeviceSize uploaded = 0;
+  uint32_t cache_mesh;
+  MeshData mesh_data;
+  std::vector<uint32_t> evicted;
+  while(uploaded < MESH_UPLOAD_BYTES_PER_FRAME &&
+        mesh_streamer_->takeLoaded(&cache_mesh, &mesh_data)) {
+    const uint32_t handle = streamed_handles_[cache_mesh];
+    if(handle == NO_CACHE_MESH || handle >= meshes_.size()) {
+      continue; // loaded for a scene that was cleared meanwhile
+    }
+    const VkDeviceSize size = streamed_cache_->dataSize(cache_mesh);
+    evicted.clear();
+    if(!mesh_streamer_->makeResident(cache_mesh, size, retire, &evicted)) {
+      continue;
+    }
+    for(uint32_t old : evicted) {
+      retireMesh(&meshes_[streamed_handles_[old]]);
+    }
+    uploadMesh(mesh_data, &meshes_[handle]);
+    uploaded += size;
+  }
+}
+
+void vulkan_engine::VulkanEngine::streamTextures(VkCommandBuffer cb,
+                                                 const QSize& size) {
+  // apparent size to pixels covered by the bounding sphere
+  const float pixels = std::abs(projection_(1, 1)) * size.height();
+  for(const auto& visible : visible_meshes_) {
+    for(TextureManager::Handle texture : mesh_textures_[visible.first]) {
+      textures_.request(texture, visible.second * pixels);
+    }
+  }
+  textures_.update(cb, frames_rendered_);
+}
+
+void vulkan_engine::VulkanEngine::updateMaterials(
+  int current_frame, const SceneSnapshot& snapshot) {
+  // Every material is converted again, with the current texture slots of
+  // its mesh, and compared against its entry: edits of the material data
+  // and newly resident textures change the entry, everything else is left
+  // alone and not uploaded.
+  if(snapshot.scene_generation == render_generation_) {
+    const std::vector<MaterialInstance>& instances =
+      snapshot.material_instances;
+    for(size_t i = instances.size(); i < material_entries_.size(); ++i) {
+      if(material_entries_[i] != MaterialTable::INVALID_HANDLE) {
+        material_table_.remove(material_entries_[i]);
+      }
+    }
+    material_entries_.resize(instances.size(), MaterialTable::INVALID_HANDLE);
+    const MaterialData default_material;
+    for(size_t i = 0; i < instances.size(); ++i) {
+      GpuMaterial material = toGpuMaterial(
+        instances[i].data ? *instances[i].data : default_material);
+      // untextured until the render thread has a copy of the mesh
+      const uint32_t mesh = instances[i].mesh;
+      const MaterialMaps maps = mesh < mesh_material_maps_.size()
+                                  ? mesh_material_maps_[mesh]
+                                  : MaterialMaps{NO_TEXTURE, NO_TEXTURE};
+      if(maps.albedo != NO_TEXTURE) {
+        material.albedo_texture_index = textures_.slot(maps.albedo);
+      }
+      if(maps.normal != NO_TEXTURE) {
+        material.normal_texture_index = textures_.slot(maps.normal);
+      }
+
+      MaterialTable::Handle& entry = material_entries_[i];
+      if(entry == MaterialTable::INVALID_HANDLE) {
+        entry = material_table_.add(material);
+      } else {
+        entry = material_table_.update(entry, material);
+      }
+    }
+  }
+
+  // the set of this frame is not in use, the grown buffer is written into
+  // it before recording
+  if(material_set_generation_[current_frame] !=
+     material_table_.generation()) {
+    writeStorageDescriptor(current_frame, 2, material_table_.buffer(),
+                           material_table_.bufferSize());
+    material_set_generation_[current_frame] = material_table_.generation();
+  }
+}
+
+void vulkan_engine::VulkanEngine::updateTransforms(
+  int current_frame, const SceneSnapshot& snapshot) {
+  // Only the transforms updated by the snapshot following the uploaded one
+  // are copied, all of them after skipped snapshots or a cleared scene.
+  static const std::vector<uint32_t> unchanged;
+  const std::vector<uint32_t>* updated = nullptr;
+  if(transforms_uploaded_ &&
+     snapshot.scene_generation == transforms_scene_generation_) {
+    if(snapshot.sequence == transforms_sequence_) {
+      updated = &unchanged;
+    } else if(snapshot.sequence == transforms_sequence_ + 1) {
+      updated = &snapshot.updated_transforms;
+    }
+  }
+  transform_table_.update(current_frame, snapshot.transforms.data(),
+                          snapshot.transforms.size(), updated);
+  transforms_uploaded_ = true;
+  transforms_sequence_ = snapshot.sequence;
+  transforms_scene_generation_ = snapshot.scene_generation;
+
+  // the set of this frame is not in use, the grown buffer is written into
+  // it before recording
+  if(transform_set_generation_[current_frame] !=
+     transform_table_.generation()) {
+    writeStorageDescriptor(current_frame, 3, transform_table_.buffer(),
+                           transform_table_.bufferSize());
+    transform_set_generation_[current_frame] = transform_table_.generation();
+  }
+}
+
+void vulkan_engine::VulkanEngine::writeStorageDescriptor(int current_frame,
+                                                         uint32_t binding,
+                                                         VkBuffer buffer,
+                                                         VkDeviceSize size) {
+  VkDescriptorBufferInfo buffer_info = {buffer, 0, size};
+  VkWriteDescriptorSet descriptor_write;
+  memset(&descriptor_write, 0, sizeof(descriptor_write));
+  descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  descriptor_write.dstSet = descriptor_set_[current_frame];
+  descriptor_write.dstBinding = binding;
+  descriptor_write.descriptorCount = 1;
+  descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+  descriptor_write.pBufferInfo = &buffer_info;
+  funcs_->vkUpdateDescriptorSets(surface_->device(), 1, &descriptor_write, 0,
+                                 nullptr);
+}
+
+void vulkan_engine::VulkanEngine::updateInstances(
+  int current_frame, const SceneSnapshot& snapshot,
+  const math::Mat4& view_projection) {
+  // Draw keys are sorted by mesh, the objects of a mesh become one draw
+  // whose instances are consecutive in the instance buffer. With GPU
+  // culling they are candidates of an indirect draw instead, whose visible
+  // instances the compute shader writes.
+  batches_.clear();
+  line_segments_ = 0;
+  const bool culled = gpu_culling_ && culling_.ready();
+  InstanceBuffer& instances = instance_buffers_[current_frame];
+  bool rebind = instance_set_culled_[current_frame] != culled;
+  if(!culled && draw_keys_.size() > instances.capacity) {
+    // the previous submission of this frame has completed
+    const size_t capacity = std::max(draw_keys_.size(), 2 * instances.capacity);
+    releaseInstanceBuffer(current_frame);
+    createInstanceBuffer(current_frame, capacity);
+    rebind = true;
+  }
+  indirect_buffer_ = VK_NULL_HANDLE;
+  gpu_cull_generation_[current_frame] = UINT64_MAX;
+  if(culled) {
+    float eye[3];
+    eyePosition(snapshot.view, eye);
+    culling_.begin(current_frame, draw_keys_.size(), view_projection, eye);
+    indirect_buffer_ = culling_.drawBuffer(current_frame);
+    gpu_cull_generation_[current_frame] = render_generation_;
+    rebind = rebind ||
+             instance_set_generation_[current_frame] != culling_.generation();
+  }
+  if(rebind) {
+    VkDescriptorBufferInfo buffer_info = {
+      culled ? culling_.instanceBuffer(current_frame) : instances.buffer, 0,
+      culled ? VK_WHOLE_SIZE : instances.capacity * sizeof(GpuInstance)};
+    VkWriteDescriptorSet descriptor_write;
+    memset(&descriptor_write, 0, sizeof(descriptor_write));
+    descriptor_write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    descriptor_write.dstSet = descriptor_set_[current_frame];
+    descriptor_write.dstBinding = 4;
+    descriptor_write.descriptorCount = 1;
+    descriptor_write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    descriptor_write.pBufferInfo = &buffer_info;
+    funcs_->vkUpdateDescriptorSets(surface_->device(), 1, &descriptor_write,
+                                   0, nullptr);
+    instance_set_culled_[current_frame] = culled;
+    instance_set_generation_[current_frame] = culling_.generation();
+  }
+
+  const uint32_t* materials = snapshot.materials.data();
+  GpuInstance* out = reinterpret_cast<GpuInstance*>(instances.data);
+  uint32_t count = 0;
+  uint32_t batch_mesh = UINT32_MAX;
+  for(size_t k = 0; k < draw_keys_.size(); ++k) {
+    const uint64_t key = draw_keys_[k];
+    const uint32_t handle = key >> 32;
+    const uint32_t i = uint32_t(key);
+    const Mesh* mesh = &meshes_[handle];
+    // streamed meshes are drawn as their bounding box until loaded
+    const bool placeholder = !mesh->resident() && mesh->streamed();
+    if(!(placeholder ? placeholder_mesh_ : *mesh).resident()) {
+      continue;
+    }
+
+    if(handle != batch_mesh) {
+      Batch batch;
+      batch.mesh = mesh;
+      batch.placeholder = placeholder;
+      batch.first_instance = count;
+      batch.instance_count = 0;
+      batches_.push_back(batch);
+      batch_mesh = handle;
+      if(culled) {
+        const Mesh& drawn = placeholder ? placeholder_mesh_ : *mesh;
+        if(drawn.lines) {
+          culling_.addDraw(handle, 3 * drawn.index_count);
+        } else {
+          culling_.addDraw(handle, drawn.index_count, drawn.first_index);
+        }
+      }
+    }
+    const uint32_t material = materials[i] < material_entries_.size()
+                                ? material_entries_[materials[i]]
+                                : 0;
+    if(culled) {
+      culling_.addCandidate(snapshot.bounds[i], i, material);
+    } else {
+      out[count].object = i;
+      out[count].material = material;
+    }
+    ++batches_.back().instance_count;
+    ++count;
+    if(!placeholder && mesh->lines) {
+      line_segments_ += mesh->index_count / 2;
+    }
+  }
+}
+
+void vulkan_engine::VulkanEngine::createInstanceBuffer(int frame,
+                                                       size_t capacity) {
+  InstanceBuffer& instances = instance_buffers_[frame];
+  createBuffer(capacity * sizeof(GpuInstance),
+               VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+               surface_->hostVisibleMemoryIndex(), &instances.buffer,
+               &instances.memory, &instances.memory_size);
+  VkResult err = funcs_->vkMapMemory(surface_->device(), instances.memory, 0,
+                                     instances.memory_size, 0,
+                                     reinterpret_cast<void**>(&instances.data));
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to map memory: %d", err);
+  }
+  instances.capacity = capacity;
+}
+
+void vulkan_engine::VulkanEngine::releaseInstanceBuffer(int frame) {
+  InstanceBuffer& instances = instance_buffers_[frame];
+  VkDevice device = surface_->device();
+  if(instances.buffer) {
+    funcs_->vkDestroyBuffer(device, instances.buffer, nullptr);
+  }
+  if(instances.memory) {
+    funcs_->vkUnmapMemory(device, instances.memory);
+    funcs_->vkFreeMemory(device, instances.memory, nullptr);
+    device_memory_usage_ -= instances.memory_size;
+  }
+  instances = InstanceBuffer();
+}
+
+void vulkan_engine::VulkanEngine::startUpdateThread(
+  const UpdateFunction& update, double rate) {
+  if(update_thread_.joinable()) {
+    qWarning("Update thread is already running");
+    return;
+  }
+  update_function_ = update;
+  update_rate_ = rate;
+  update_running_ = true;
+  update_thread_ = std::thread(&VulkanEngine::updateLoop, this);
+}
+
+void vulkan_engine::VulkanEngine::stopUpdateThread() {
+  if(!update_thread_.joinable()) {
+    return;
+  }
+  update_running_ = false;
+  consumed_condition_.notify_one();
+  update_thread_.join();
+  update_function_ = UpdateFunction();
+}
+
+void vulkan_engine::VulkanEngine::updateLoop() {
+  typedef std::chrono::steady_clock Clock;
+  Clock::time_point last = Clock::now();
+  while(update_running_) {
+    const Clock::time_point start = Clock::now();
+    bool produced = false;
+    {
+      std::lock_guard<std::mutex> lock(scene_mutex_);
+      const double dt = std::chrono::duration<double>(start - last).count();
+      if(update_function_ && update_function_(scene_graph_, view_, dt)) {
+        scene_changed_ = true;
+      }
+      if(scene_changed_) {
+        produceSnapshot(start);
+        produced = true;
+      }
+    }
+    last = start;
+    if(produced) {
+      invalidate();
+    }
+
+    if(update_rate_ > 0.0) {
+      std::this_thread::sleep_until(
+        start + std::chrono::duration_cast<Clock::duration>(
+                  std::chrono::duration<double>(1.0 / update_rate_)));
+    } else {
+      // Wait for the snapshot to be picked up, so the next one is computed
+      // while that frame is recorded. The timeout covers a notification
+      // sent just before waiting, and polls the update function while the
+      // scene is idle.
+      std::unique_lock<std::mutex> lock(consumed_mutex_);
+      consumed_condition_.wait_for(
+        lock, std::chrono::milliseconds(5),
+        [this]() { return snapshot_consumed_ || !update_running_; });
+      snapshot_consumed_ = false;
+    }
+  }
+}
+
+void vulkan_engine::VulkanEngine::produceSnapshot(
+  const std::chrono::steady_clock::time_point& start) {
+  // Only the entities of changed nodes get their world transform and bounds
+  // refreshed.
+  scene_graph_.update();
+  entities_.updateTransforms(scene_graph_, mesh_bounds_.data());
+  scene_graph_.clearChangedRanges();
+  scene_changed_ = false;
+
+  // The back buffer holds a snapshot from two publications ago, all of it
+  // is overwritten. The copies are plain memcpys of the dense arrays.
+  SceneSnapshot& snapshot = snapshots_.back();
+  const size_t count = entities_.size();
+  snapshot.sequence = ++snapshot_sequence_;
+  snapshot.scene_generation = scene_generation_;
+  snapshot.mesh_count = mesh_data_.size();
+  snapshot.view = view_;
+  snapshot.input_time = view_input_time_;
+  view_input_time_ = std::chrono::steady_clock::time_point();
+  snapshot.transforms.assign(entities_.transforms(),
+                             entities_.transforms() + count);
+  snapshot.updated_transforms.clear();
+  for(uint32_t i : entities_.updatedIndices()) {
+    if(i < count) {
+      snapshot.updated_transforms.push_back(i);
+    }
+  }
+  entities_.clearUpdatedIndices();
+  snapshot.bounds.assign(entities_.bounds(), entities_.bounds() + count);
+  snapshot.meshes.assign(entities_.meshes(), entities_.meshes() + count);
+  snapshot.materials.assign(entities_.materials(),
+                            entities_.materials() + count);
+  snapshot.flags.assign(entities_.flags(), entities_.flags() + count);
+  snapshot.lights = lights_;
+  snapshot.material_instances = material_instances_;
+  snapshot.update_time =
+    std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() -
+                                             start)
+      .count();
+  snapshots_.publish();
+}
+
+void vulkan_engine::VulkanEngine::cullAndSort(
+  const SceneSnapshot& snapshot, const math::Mat4& view_projection,
+  bool frustum_cull) {
+  draw_keys_.clear();
+  if(snapshot.scene_generation != render_generation_) {
+    return;
+  }
+
+  const math::Frustum frustum = math::frustumFromMatrix(view_projection);
+  const math::Bounds* bounds = snapshot.bounds.data();
+  const uint32_t* flags = snapshot.flags.data();
+  const uint32_t* meshes = snapshot.meshes.data();
+  const uint32_t count = snapshot.meshes.size();
+  // every key refers to a mesh the render thread has a copy of
+  const uint32_t mesh_count = meshes_.size();
+
+  // Every chunk of entities is culled and sorted by one job, sorting by mesh
+  // minimizes vertex and index buffer binds. The sorted chunks are merged
+  // pairwise afterwards.
+  const size_t chunks =
+    std::max<size_t>((count + CULL_CHUNK - 1) / CULL_CHUNK, 1);
+  chunk_keys_.resize(chunks);
+  JobSystem& jobs = JobSystem::global();
+  jobs.parallelFor(0, chunks, 1, [&](size_t first_chunk, size_t last_chunk) {
+    for(size_t c = first_chunk; c < last_chunk; ++c) {
+      std::vector<uint64_t>& keys = chunk_keys_[c];
+      keys.clear();
+      const uint32_t last = std::min<uint32_t>((c + 1) * CULL_CHUNK, count);
+      for(uint32_t i = c * CULL_CHUNK; i < last; ++i) {
+        if((flags[i] & ENTITY_VISIBLE) && meshes[i] < mesh_count &&
+           (!frustum_cull || math::intersects(frustum, bounds[i]))) {
+          keys.push_back(uint64_t(meshes[i]) << 32 | i);
+        }
+      }
+      std::sort(keys.begin(), keys.end());
+    }
+  });
+
+  if(chunks == 1) {
+    draw_keys_.swap(chunk_keys_[0]);
+    return;
+  }
+
+  std::vector<size_t> offsets(chunks + 1, 0);
+  for(size_t c = 0; c < chunks; ++c) {
+    offsets[c + 1] = offsets[c] + chunk_keys_[c].size();
+  }
+  draw_keys_.resize(offsets[chunks]);
+  for(size_t c = 0; c < chunks; ++c) {
+    std::copy(chunk_keys_[c].begin(), chunk_keys_[c].end(),
+              draw_keys_.begin() + offsets[c]);
+  }
+  for(size_t width = 1; width < chunks; width *= 2) {
+    const size_t pairs = (chunks + 2 * width - 1) / (2 * width);
+    jobs.parallelFor(0, pairs, 1, [&](size_t first_pair, size_t last_pair) {
+      for(size_t p = first_pair; p < last_pair; ++p) {
+        const size_t first = 2 * width * p;
+        const size_t middle = std::min(first + width, chunks);
+        const size_t last = std::min(first + 2 * width, chunks);
+        std::inplace_merge(draw_keys_.begin() + offsets[first],
+                           draw_keys_.begin() + offsets[middle],
+                           draw_keys_.begin() + offsets[last]);
+      }
+    });
+  }
+}
+
+void vulkan_engine::VulkanEngine::recordState(VkCommandBuffer cb,
+                                              int current_frame,
+                                              const QSize& size,
+                                              VkPipeline pipeline) {
+  funcs_->vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+  VkDescriptorSet sets[] = {descriptor_set_[current_frame], bindless_set_};
+  funcs_->vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                  pipeline_layout_, 0, 2, sets, 0, nullptr);
 
   VkViewport viewport = {
     .x = 0,
     .y = 0,
-    .width = static_cast<float>(sz.width()),
-    .height = static_cast<float>(sz.height()),
+    .width = static_cast<float>(size.width()),
+    .height = static_cast<float>(size.height()),
     .minDepth = 0,
     .maxDepth = 1,
   };
@@ -471,28 +1765,792 @@ void vulkan_engine::VulkanEngine::startNextFrame() {
     .offset = {.x = 0, .y = 0},
     .extent =
       {
-        .width = static_cast<unsigned int>(sz.width()),
-        .height = static_cast<unsigned int>(sz.height()),
+        .width = static_cast<unsigned int>(size.width()),
+        .height = static_cast<unsigned int>(size.height()),
       },
   };
 
   funcs_->vkCmdSetScissor(cb, 0, 1, &scissor);
-  funcs_->vkCmdDraw(cb, /* vertex count */ 3, /* instance count */ 1,
-                    /* first vertex */ 0, /* first instance */ 0);
-  funcs_->vkCmdEndRenderPass(command_buffer);
+}
+
+void vulkan_engine::VulkanEngine::recordDraws(
+  VkCommandBuffer cb, const ScenePipelines& pipelines, size_t first,
+  size_t last, bool lines) {
+  // Triangles are drawn with the pipeline bound by recordState(), lines
+  // with their own pipeline, blended over all triangles, so they are
+  // recorded after those of every range. The pipelines share their layout,
+  // the bound descriptor sets stay valid.
+  if(lines && line_segments_ == 0) {
+    return;
+  }
+  // the geometry of a page is bound once for all of its meshes
+  uint32_t bound_page = UINT32_MAX;
+  bool lines_bound = false;
+  for(size_t b = first; b < last; ++b) {
+    const Batch& batch = batches_[b];
+    const Mesh& mesh = batch.placeholder ? placeholder_mesh_ : *batch.mesh;
+    if(mesh.lines != lines) {
+      continue;
+    }
+    if(lines && !lines_bound) {
+      funcs_->vkCmdBindPipeline(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                pipelines.lines);
+      lines_bound = true;
+    }
+    const uint32_t page = mesh.allocation.page;
+    if(page != bound_page) {
+      VkDescriptorSet set = geometry_.descriptorSet(page);
+      funcs_->vkCmdBindDescriptorSets(cb, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                      pipeline_layout_, 2, 1, &set, 0, nullptr);
+      funcs_->vkCmdBindIndexBuffer(cb, geometry_.buffer(page), 0,
+                                   VK_INDEX_TYPE_UINT32);
+      bound_page = page;
+    }
+
+    PushConstants push_constants;
+    push_constants.position_offset = mesh.position_offset;
+    push_constants.normal_offset = mesh.normal_offset;
+    push_constants.uv_offset = mesh.uv_offset;
+    for(int r = 0; r < 4; ++r) {
+      push_constants.scale[r] = 1.0f;
+      push_constants.offset[r] = 0.0f;
+    }
+    if(batch.placeholder) {
+      for(int r = 0; r < 3; ++r) {
+        push_constants.scale[r] = std::max(batch.mesh->half_extent[r], 1e-6f);
+        push_constants.offset[r] = batch.mesh->center[r];
+      }
+    }
+    push_constants.textured = !batch.placeholder;
+    push_constants.first_index = mesh.first_index;
+    push_constants.line_width = line_width_;
+    funcs_->vkCmdPushConstants(
+      cb, pipeline_layout_,
+      VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0,
+      sizeof(push_constants), &push_constants);
+
+    // lines are six vertices per segment, expanded from the indices by the
+    // vertex shader
+    if(indirect_buffer_ && mesh.lines) {
+      funcs_->vkCmdDrawIndirect(cb, indirect_buffer_,
+                                b * sizeof(GpuCullDraw), 1,
+                                sizeof(GpuCullDraw));
+    } else if(indirect_buffer_) {
+      // the instance count is written by the culling shader
+      funcs_->vkCmdDrawIndexedIndirect(cb, indirect_buffer_,
+                                       b * sizeof(GpuCullDraw), 1,
+                                       sizeof(GpuCullDraw));
+    } else if(mesh.lines) {
+      funcs_->vkCmdDraw(cb, 3 * mesh.index_count, batch.instance_count, 0,
+                        batch.first_instance);
+    } else {
+      funcs_->vkCmdDrawIndexed(cb, mesh.index_count, batch.instance_count,
+                               mesh.first_index, /* vertex offset */ 0,
+                               batch.first_instance);
+    }
+  }
+}
+
+void vulkan_engine::VulkanEngine::recordParallel(
+  int current_frame, const QSize& size, VkRenderPass render_pass,
+  VkFramebuffer framebuffer, const ScenePipelines& pipelines) {
+  // one secondary command buffer (with its own pool, as pools must not be
+  // used from several threads at once) per chunk of triangle draws, and a
+  // last one with the lines of all chunks
+  const size_t chunks = std::min<size_t>(
+    record_chunks_,
+    (batches_.size() + PARALLEL_RECORD_DRAWS - 1) / PARALLEL_RECORD_DRAWS);
+  const size_t chunk_size = (batches_.size() + chunks - 1) / chunks;
+  const size_t buffer_count = line_segments_ > 0 ? chunks + 1 : chunks;
+  const VkPipeline shaded = wireframe_overlay_ && pipelines.wireframe
+                              ? pipelines.wireframe
+                              : pipelines.shaded;
+  const size_t frame_buffers = record_chunks_ + 1;
+  VkCommandPool* pools = &record_pools_[current_frame * frame_buffers];
+  VkCommandBuffer* buffers = &record_buffers_[current_frame * frame_buffers];
+
+  VkDevice device = surface_->device();
+  JobSystem::global().parallelFor(0, buffer_count, 1, [&](size_t first_chunk,
+                                                          size_t last_chunk) {
+    for(size_t c = first_chunk; c < last_chunk; ++c) {
+      funcs_->vkResetCommandPool(device, pools[c], 0);
+
+      VkCommandBufferInheritanceInfo inheritance_info;
+      memset(&inheritance_info, 0, sizeof(inheritance_info));
+      inheritance_info.sType =
+        VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+      inheritance_info.renderPass = render_pass;
+      inheritance_info.subpass = 0;
+      inheritance_info.framebuffer = framebuffer;
+
+      VkCommandBufferBeginInfo begin_info;
+      memset(&begin_info, 0, sizeof(begin_info));
+      begin_info.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+      begin_info.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                         VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+      begin_info.pInheritanceInfo = &inheritance_info;
+      VkResult err = funcs_->vkBeginCommandBuffer(buffers[c], &begin_info);
+      if(err != VK_SUCCESS) {
+        qFatal("Failed to begin secondary command buffer: %d", err);
+      }
+
+      recordState(buffers[c], current_frame, size, shaded);
+      if(c < chunks) {
+        recordDraws(buffers[c], pipelines, c * chunk_size,
+                    std::min((c + 1) * chunk_size, batches_.size()), false);
+      } else {
+        recordDraws(buffers[c], pipelines, 0, batches_.size(), true);
+      }
+
+      err = funcs_->vkEndCommandBuffer(buffers[c]);
+      if(err != VK_SUCCESS) {
+        qFatal("Failed to end secondary command buffer: %d", err);
+      }
+    }
+  });
+
+  funcs_->vkCmdExecuteCommands(surface_->currentCommandBuffer(), buffer_count,
+                               buffers);
+}
+
+void vulkan_engine::VulkanEngine::recordScene(VkRenderPass render_pass,
+                                              VkFramebuffer framebuffer,
+                                              const ScenePipelines& pipelines,
+                                              const QSize& size) {
+  const int current_frame = surface_->currentFrame();
+  VkCommandBuffer cb = surface_->currentCommandBuffer();
+
+  VkClearColorValue clear_color = {.uint32 = {0, 0, 0, 1}};
+  VkClearDepthStencilValue clear_ds = {.depth = 1, .stencil = 0};
+
+  VkClearValue clear_values[] = {{
+                                   .color = clear_color,
+                                 },
+                                 {
+                                   .depthStencil = clear_ds,
+                                 },
+                                 {
+                                   .color = clear_color,
+                                 }};
+
+  // only a multisampled default render pass clears a third attachment, the
+  // resolve pass clears the first two
+  const bool msaa = render_pass == surface_->defaultRenderPass() &&
+                    surface_->sampleCountFlagBits() > VK_SAMPLE_COUNT_1_BIT;
+  VkRenderPassBeginInfo render_pass_begin_info = {
+    .sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO,
+    .pNext = 0,
+    .renderPass = render_pass,
+    .framebuffer = framebuffer,
+    .renderArea =
+      {
+        .offset = {.x = 0, .y = 0},
+        .extent =
+          {
+            .width = static_cast<unsigned int>(size.width()),
+            .height = static_cast<unsigned int>(size.height()),
+          },
+      },
+    .clearValueCount = static_cast<unsigned int>(msaa ? 3 : 2),
+    .pClearValues = clear_values,
+  };
+  // Large draw lists are recorded into secondary command buffers in
+  // parallel.
+  const bool parallel = record_chunks_ > 1 &&
+                        batches_.size() >= 2 * PARALLEL_RECORD_DRAWS;
+  funcs_->vkCmdBeginRenderPass(cb, &render_pass_begin_info,
+                               parallel
+                                 ? VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS
+                                 : VK_SUBPASS_CONTENTS_INLINE);
+  if(parallel) {
+    recordParallel(current_frame, size, render_pass, framebuffer, pipelines);
+  } else {
+    recordState(cb, current_frame, size,
+                wireframe_overlay_ && pipelines.wireframe
+                  ? pipelines.wireframe
+                  : pipelines.shaded);
+    recordDraws(cb, pipelines, 0, batches_.size(), false);
+    recordDraws(cb, pipelines, 0, batches_.size(), true);
+  }
+
+  funcs_->vkCmdEndRenderPass(cb);
+}
+
+void vulkan_engine::VulkanEngine::presentOffscreen(VkCommandBuffer cb,
+                                                   bool accumulated) {
+  const QSize sz = surface_->swapChainImageSize();
+  VkClearValue clear_values[3];
+  memset(clear_values, 0, sizeof(clear_values));
+  clear_values[1].depthStencil.depth = 1.0f;
+  VkRenderPassBeginInfo render_pass_begin_info;
+  memset(&render_pass_begin_info, 0, sizeof(render_pass_begin_info));
+  render_pass_begin_info.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
+  render_pass_begin_info.renderPass = surface_->defaultRenderPass();
+  render_pass_begin_info.framebuffer = surface_->currentFramebuffer();
+  render_pass_begin_info.renderArea.extent.width = sz.width();
+  render_pass_begin_info.renderArea.extent.height = sz.height();
+  render_pass_begin_info.clearValueCount =
+    surface_->sampleCountFlagBits() > VK_SAMPLE_COUNT_1_BIT ? 3 : 2;
+  render_pass_begin_info.pClearValues = clear_values;
+  funcs_->vkCmdBeginRenderPass(cb, &render_pass_begin_info,
+                               VK_SUBPASS_CONTENTS_INLINE);
+  if(accumulated) {
+    accumulation_.present(cb);
+  } else {
+    dynamic_resolution_.present(cb);
+  }
+  funcs_->vkCmdEndRenderPass(cb);
+}
+
+void vulkan_engine::VulkanEngine::recordFrame(VkCommandBuffer cb,
+                                              bool accumulate,
+                                              bool render_scene,
+                                              bool scale_resolution) {
+  const int current_frame = surface_->currentFrame();
+  const QSize sz = surface_->swapChainImageSize();
+  RenderGraph& graph = render_graph_;
+  graph.clear();
+
+  // The tables are read by later frames as well, so their writes are
+  // always needed. The surface's render pass handles the layouts of the
+  // swap chain image, it only orders the passes drawing into it.
+  const RenderGraph::Resource materials =
+    graph.importBuffer("materials", material_table_.buffer());
+  const RenderGraph::Resource transforms =
+    graph.importBuffer("transforms", transform_table_.buffer());
+  std::vector<RenderGraph::Resource> pages;
+  for(uint32_t page = 0; page < geometry_.pageCount(); ++page) {
+    pages.push_back(graph.importBuffer(
+      "geometry page " + std::to_string(page), geometry_.buffer(page)));
+    graph.markOutput(pages.back());
+  }
+  const RenderGraph::Resource backbuffer =
+    graph.addVirtual("backbuffer", surface_->currentSwapChainImageView());
+  graph.markOutput(materials);
+  graph.markOutput(transforms);
+  graph.markOutput(backbuffer);
+
+  if(material_table_.pending()) {
+    const RenderGraph::Pass pass = graph.addPass(
+      "upload materials", [this, current_frame](VkCommandBuffer cb) {
+        material_table_.upload(cb, current_frame);
+      });
+    graph.write(pass, materials, RenderGraph::TRANSFER_WRITE);
+  }
+  if(transform_table_.pending()) {
+    const RenderGraph::Pass pass =
+      graph.addPass("upload transforms", [this](VkCommandBuffer cb) {
+        transform_table_.upload(cb);
+      });
+    graph.write(pass, transforms, RenderGraph::TRANSFER_WRITE);
+  }
+  if(geometry_.pending()) {
+    const RenderGraph::Pass pass =
+      graph.addPass("upload geometry", [this](VkCommandBuffer cb) {
+        geometry_.flush(cb);
+      });
+    for(RenderGraph::Resource page : pages) {
+      graph.write(pass, page, RenderGraph::TRANSFER_WRITE);
+    }
+  } else {
+    // records nothing, frees the staging memory of completed frames
+    geometry_.flush(cb);
+  }
+
+  // GPU culling writes the indirect draws and their instances, on the
+  // compute queue they are ordered by the semaphore of AsyncCompute
+  RenderGraph::Resource indirect_draws = 0;
+  RenderGraph::Resource culled_instances = 0;
+  if(indirect_buffer_) {
+    indirect_draws = graph.importBuffer("indirect draws", indirect_buffer_);
+    culled_instances = graph.importBuffer(
+      "culled instances", culling_.instanceBuffer(current_frame));
+    if(!async_compute_.async()) {
+      const RenderGraph::Pass pass = graph.addPass(
+        "cull", [this](VkCommandBuffer cb) { culling_.record(cb); });
+      graph.write(pass, indirect_draws, RenderGraph::COMPUTE_SHADER_WRITE);
+      graph.write(pass, culled_instances, RenderGraph::COMPUTE_SHADER_WRITE);
+    }
+  }
+
+  // the draws of a scene pass and its depth buffer, which never leaves it
+  auto add_scene_pass = [&](const std::function<void(VkCommandBuffer)>&
+                              record) -> RenderGraph::Pass {
+      const RenderGraph::Pass pass = graph.addPass("scene", record);
+      graph.read(pass, materials, RenderGraph::FRAGMENT_SHADER_READ);
+      graph.read(pass, transforms, RenderGraph::VERTEX_SHADER_READ);
+      if(indirect_buffer_) {
+        graph.read(pass, indirect_draws, RenderGraph::INDIRECT_READ);
+        graph.read(pass, culled_instances, RenderGraph::VERTEX_SHADER_READ);
+      }
+      for(RenderGraph::Resource page : pages) {
+        graph.read(pass, page,
+                   RenderGraph::INDEX_READ | RenderGraph::VERTEX_SHADER_READ);
+      }
+      return pass;
+    };
+  RenderGraph::ImageDesc depth_desc;
+  depth_desc.size = sz;
+  depth_desc.format = surface_->depthStencilFormat();
+  depth_desc.aspect = VK_IMAGE_ASPECT_DEPTH_BIT | VK_IMAGE_ASPECT_STENCIL_BIT;
+  depth_desc.lazy = true;
+
+  if(accumulate) {
+    const int current = accumulation_.current();
+    const RenderTarget& history = accumulation_.history(current);
+    RenderGraph::Resource latest =
+      graph.importImage("history " + std::to_string(current), history.image,
+                        history.view, VK_IMAGE_ASPECT_COLOR_BIT,
+                        accumulation_.historyValid());
+    if(render_scene) {
+      const RenderTarget& scene_color = accumulation_.sceneColor();
+      const RenderGraph::Resource color =
+        graph.importImage("scene color", scene_color.image, scene_color.view,
+                          VK_IMAGE_ASPECT_COLOR_BIT, false);
+      const RenderGraph::Resource depth =
+        graph.createImage("scene depth", depth_desc);
+      const RenderGraph::Pass scene =
+        add_scene_pass([this, color, depth, sz](VkCommandBuffer) {
+          const VkRenderPass render_pass = accumulation_.scenePass();
+          recordScene(render_pass,
+                      render_graph_.framebuffer(render_pass, {color, depth},
+                                                sz),
+                      offscreen_pipelines_, sz);
+        });
+      graph.write(scene, color, RenderGraph::COLOR_ATTACHMENT_WRITE);
+      graph.write(scene, depth, RenderGraph::DEPTH_ATTACHMENT_WRITE);
+
+      // the other history is overwritten as a whole
+      const RenderTarget& target = accumulation_.history(1 - current);
+      const RenderGraph::Resource next =
+        graph.importImage("history " + std::to_string(1 - current),
+                          target.image, target.view,
+                          VK_IMAGE_ASPECT_COLOR_BIT, false);
+      const RenderGraph::Pass pass =
+        graph.addPass("accumulate", [this](VkCommandBuffer cb) {
+          accumulation_.accumulate(cb);
+        });
+      graph.read(pass, color, RenderGraph::FRAGMENT_SHADER_READ);
+      graph.read(pass, latest, RenderGraph::FRAGMENT_SHADER_READ);
+      graph.write(pass, next, RenderGraph::COLOR_ATTACHMENT_WRITE);
+      graph.markOutput(next);
+      latest = next;
+    }
+    const RenderGraph::Pass pass =
+      graph.addPass("present", [this](VkCommandBuffer cb) {
+        presentOffscreen(cb, true);
+      });
+    graph.read(pass, latest, RenderGraph::FRAGMENT_SHADER_READ);
+    graph.write(pass, backbuffer, RenderGraph::COLOR_ATTACHMENT_WRITE);
+  } else if(scale_resolution) {
+    const RenderTarget& target = dynamic_resolution_.color();
+    const RenderGraph::Resource color =
+      graph.importImage("scene color", target.image, target.view,
+                        VK_IMAGE_ASPECT_COLOR_BIT, false);
+    depth_desc.size = dynamic_resolution_.size();
+    const RenderGraph::Resource depth =
+      graph.createImage("scene depth", depth_desc);
+    // the projection is unchanged, only the viewport shrinks
+    const RenderGraph::Pass scene =
+      add_scene_pass([this, color, depth](VkCommandBuffer) {
+        const VkRenderPass render_pass = dynamic_resolution_.scenePass();
+        recordScene(render_pass,
+                    render_graph_.framebuffer(render_pass, {color, depth},
+                                              dynamic_resolution_.size()),
+                    offscreen_pipelines_, dynamic_resolution_.renderSize());
+      });
+    graph.write(scene, color, RenderGraph::COLOR_ATTACHMENT_WRITE);
+    graph.write(scene, depth, RenderGraph::DEPTH_ATTACHMENT_WRITE);
+
+    const RenderGraph::Pass pass =
+      graph.addPass("upscale", [this](VkCommandBuffer cb) {
+        presentOffscreen(cb, false);
+      });
+    graph.read(pass, color, RenderGraph::FRAGMENT_SHADER_READ);
+    graph.write(pass, backbuffer, RenderGraph::COLOR_ATTACHMENT_WRITE);
+  } else if(resolve_pass_) {
+    // the multisampled attachments are resolved within the render pass
+    RenderGraph::ImageDesc color_desc;
+    color_desc.size = sz;
+    color_desc.format = surface_->colorFormat();
+    color_desc.samples = samples_;
+    color_desc.lazy = true;
+    const RenderGraph::Resource color =
+      graph.createImage("multisampled color", color_desc);
+    depth_desc.samples = samples_;
+    const RenderGraph::Resource depth =
+      graph.createImage("multisampled depth", depth_desc);
+    const RenderGraph::Pass scene =
+      add_scene_pass([this, color, depth, backbuffer, sz](VkCommandBuffer) {
+        recordScene(resolve_pass_,
+                    render_graph_.framebuffer(
+                      resolve_pass_, {color, depth, backbuffer}, sz),
+                    pipelines_, sz);
+      });
+    graph.write(scene, color, RenderGraph::COLOR_ATTACHMENT_WRITE);
+    graph.write(scene, depth, RenderGraph::DEPTH_ATTACHMENT_WRITE);
+    graph.write(scene, backbuffer, RenderGraph::COLOR_ATTACHMENT_WRITE);
+  } else {
+    const RenderGraph::Pass scene =
+      add_scene_pass([this, sz](VkCommandBuffer) {
+        recordScene(surface_->defaultRenderPass(),
+                    surface_->currentFramebuffer(), pipelines_, sz);
+      });
+    graph.write(scene, backbuffer, RenderGraph::COLOR_ATTACHMENT_WRITE);
+  }
+
+  // The backbuffer is left in the layout of the surface by the passes, the
+  // copy transitions it itself.
+  if(capture_.pending()) {
+    const RenderGraph::Resource staging = graph.addVirtual("capture");
+    graph.markOutput(staging);
+    const RenderGraph::Pass pass =
+      graph.addPass("readback", [this](VkCommandBuffer cb) {
+        capture_.record(cb, surface_->currentSwapChainImage(),
+                        surface_->swapChainImageLayout(),
+                        surface_->swapChainImageSize(),
+                        surface_->colorFormat());
+      });
+    graph.read(pass, backbuffer, RenderGraph::TRANSFER_READ);
+    graph.write(pass, staging, RenderGraph::TRANSFER_WRITE);
+  }
+
+  graph.execute(cb, frames_rendered_);
+}
+
+void vulkan_engine::VulkanEngine::readTimestamps(int current_frame) {
+  // QVulkanWindow waited for the previous submission of this frame slot, so
+  // its timestamps are available
+  if(timestamps_written_[current_frame]) {
+    quint64 timestamps[2] = {0, 0};
+    VkResult err = funcs_->vkGetQueryPoolResults(
+      surface_->device(), timestamp_pool_, 2 * current_frame, 2,
+      sizeof(timestamps), timestamps, sizeof(quint64),
+      VK_QUERY_RESULT_64_BIT);
+    if(err == VK_SUCCESS && timestamps[1] >= timestamps[0]) {
+      gpu_frame_time_ =
+        (timestamps[1] - timestamps[0]) * timestamp_period_ * 1e-6f;
+      if(dynamic_resolution_enabled_) {
+        dynamic_resolution_.update(gpu_frame_time_);
+      }
+      // the compute work of the frame overlaps with the end of the frame
+      // before it and the start of its own
+      graphics_timestamps_[0] = graphics_timestamps_[2];
+      graphics_timestamps_[1] = graphics_timestamps_[3];
+      graphics_timestamps_[2] = timestamps[0];
+      graphics_timestamps_[3] = timestamps[1];
+    }
+  }
+  async_compute_.readTimestamps(current_frame, graphics_timestamps_, 2);
+}
+
+std::future<QImage> vulkan_engine::VulkanEngine::captureFrame() {
+  std::future<QImage> future = capture_.request();
+  invalidate();
+  return future;
+}
+
+std::future<bool>
+vulkan_engine::VulkanEngine::saveFrame(const std::string& path) {
+  std::future<bool> future = capture_.requestSave(path);
+  invalidate();
+  return future;
+}
+
+void vulkan_engine::VulkanEngine::setGpuCulling(bool enabled) {
+  gpu_culling_ = enabled;
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::setLineWidth(float pixels) {
+  line_width_ = std::max(pixels, 0.0f);
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::setWireframeOverlay(bool enabled) {
+  if(enabled && pipelines_.shaded && !pipelines_.wireframe) {
+    qWarning("The wireframe overlay requires geometry shaders");
+  }
+  wireframe_overlay_ = enabled;
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::setDynamicResolution(bool enabled) {
+  dynamic_resolution_enabled_ = enabled;
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::setDynamicResolution(
+  bool enabled, const DynamicResolution::Settings& settings) {
+  dynamic_resolution_.setSettings(settings);
+  setDynamicResolution(enabled);
+}
+
+void vulkan_engine::VulkanEngine::setProgressiveAccumulation(bool enabled,
+                                                             int max_samples) {
+  accumulation_max_samples_ = max_samples;
+  accumulate_ = enabled;
+  if(!enabled) {
+    accumulated_samples_ = 0;
+  }
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::setRenderMode(RenderMode mode) {
+  on_demand_ = mode == RenderMode::OnDemand;
+  // picks up the continuous loop again, or draws the current state once
+  frame_requested_ = false;
+  invalidate();
+}
+
+void vulkan_engine::VulkanEngine::invalidate() {
+  // requests coalesce until the next frame starts
+  if(!frame_requested_.exchange(true) && surface_) {
+    surface_->requestUpdate();
+  }
+}
+
+uint64_t vulkan_engine::VulkanEngine::framesSkipped() const {
+  uint64_t skipped = frames_skipped_;
+  if(on_demand_ && frames_rendered_ > 0 && !frame_requested_) {
+    // the idle period that is still going on
+    const double idle = std::chrono::duration<double>(
+                          std::chrono::steady_clock::now() - last_frame_time_)
+                          .count();
+    skipped += uint64_t(std::max(idle * surface_->refreshRate() - 1.0, 0.0));
+  }
+  return skipped;
+}
 
-  window_->frameReady();
-  window_->requestUpdate(); // render continuously, throttled by the
-                            // presentation rate
+void vulkan_engine::VulkanEngine::resetFrameCounters() {
+  frames_rendered_ = 0;
+  frames_skipped_ = 0;
+}
+
+void vulkan_engine::VulkanEngine::startNextFrame() {
+  frame_requested_ = false;
+
+  const std::chrono::steady_clock::time_point now =
+    std::chrono::steady_clock::now();
+  if(on_demand_ && frames_rendered_ > 0) {
+    // refresh intervals that passed without a frame
+    const double interval =
+      std::chrono::duration<double>(now - last_frame_time_).count();
+    const double intervals =
+      std::floor(interval * surface_->refreshRate() + 0.5);
+    frames_skipped_ += uint64_t(std::max(intervals - 1.0, 0.0));
+  }
+  last_frame_time_ = now;
+  ++frames_rendered_;
+
+  const int current_frame = surface_->currentFrame();
+  VkCommandBuffer cb = surface_->currentCommandBuffer();
+  const QSize sz = surface_->swapChainImageSize();
+  deletion_queue_.collect(current_frame);
+  if(frame_fence_pending_[current_frame]) {
+    waitFrameFence(current_frame);
+  }
+
+  if(timestamp_pool_) {
+    readTimestamps(current_frame);
+    funcs_->vkCmdResetQueryPool(cb, timestamp_pool_, 2 * current_frame, 2);
+    funcs_->vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                                timestamp_pool_, 2 * current_frame);
+  }
+
+  // e.g. uploads scheduled by jobs on other threads
+  JobSystem::global().runMainThreadJobs();
+
+  if(input_function_) {
+    input_function_();
+  }
+  if(!update_thread_.joinable()) {
+    std::lock_guard<std::mutex> lock(scene_mutex_);
+    if(scene_changed_) {
+      produceSnapshot(std::chrono::steady_clock::now());
+    }
+  }
+  // Without a new snapshot the previous one is drawn again.
+  const bool new_snapshot = snapshots_.acquire();
+  if(new_snapshot) {
+    snapshot_consumed_ = true;
+    consumed_condition_.notify_one();
+  }
+  const SceneSnapshot& snapshot = snapshots_.front();
+  last_update_time_ = snapshot.update_time;
+  syncMeshes(snapshot);
+
+  const bool accumulate = accumulate_ && offscreen_pipelines_.shaded;
+  if(accumulate) {
+    if(!accumulation_.ready() || accumulation_.size() != sz) {
+      accumulation_.resize(sz);
+    }
+    accumulation_.setMaxSamples(accumulation_max_samples_);
+    if(new_snapshot || accumulated_samples_ == 0) {
+      accumulation_.reset();
+    }
+  }
+  // a converged image is presented without rendering the scene again
+  const bool render_scene = !accumulate || !accumulation_.converged();
+  const bool scale_resolution =
+    !accumulate && dynamic_resolution_enabled_ && offscreen_pipelines_.shaded;
+  if(scale_resolution &&
+     (!dynamic_resolution_.ready() || dynamic_resolution_.size() != sz)) {
+    dynamic_resolution_.resize(sz);
+  }
+
+  // Every accumulated sample shifts the projection by a sub-pixel offset,
+  // a translation in clip space.
+  math::Mat4 projection = projection_;
+  if(accumulate && render_scene) {
+    float jitter_x, jitter_y;
+    accumulation_.jitter(&jitter_x, &jitter_y);
+    math::Mat4 jitter = math::Mat4::identity();
+    jitter(0, 3) = 2.0f * jitter_x / sz.width();
+    jitter(1, 3) = 2.0f * jitter_y / sz.height();
+    math::multiply(jitter, projection_, &projection);
+  }
+
+  CameraUniform* camera = reinterpret_cast<CameraUniform*>(
+    uniform_data_ + camera_buffer_info_[current_frame].offset);
+  memcpy(camera->v, snapshot.view.m, sizeof(camera->v));
+  memcpy(camera->p, projection.m, sizeof(camera->p));
+  math::Mat4 view_projection;
+  math::multiply(projection, snapshot.view, &view_projection);
+  memcpy(camera->vp, view_projection.m, sizeof(camera->vp));
+  // lines are expanded in pixels of the scene's render targets
+  const QSize render_size =
+    scale_resolution ? dynamic_resolution_.renderSize() : sz;
+  camera->viewport[0] = render_size.width();
+  camera->viewport[1] = render_size.height();
+  camera->viewport[2] = 1.0f / std::max(render_size.width(), 1);
+  camera->viewport[3] = 1.0f / std::max(render_size.height(), 1);
+
+  if(render_scene) {
+    const bool gpu_culled = gpu_culling_ && culling_.ready();
+    cullAndSort(snapshot, view_projection, !gpu_culled);
+    measureVisibleMeshes(current_frame, snapshot);
+    streamMeshes();
+    streamTextures(cb, sz);
+    updateMaterials(current_frame, snapshot);
+    updateTransforms(current_frame, snapshot);
+    updateInstances(current_frame, snapshot, view_projection);
+    if(gpu_culled && async_compute_.async()) {
+      // submitted ahead of the frame, which waits for it only where the
+      // draws read the results
+      culling_.record(async_compute_.begin(current_frame));
+      async_compute_.submit(current_frame,
+                            VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT |
+                              VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+                            VK_ACCESS_INDIRECT_COMMAND_READ_BIT |
+                              VK_ACCESS_SHADER_READ_BIT);
+    }
+  } else {
+    indirect_buffer_ = VK_NULL_HANDLE;
+  }
+  bindless_set_ = bindless_.update(cb, current_frame);
+
+  LightsUniform* lights = reinterpret_cast<LightsUniform*>(
+    uniform_data_ + lights_buffer_info_[current_frame].offset);
+  lights->count = snapshot.lights.size();
+  for(size_t i = 0; i < snapshot.lights.size(); ++i) {
+    const LightData& light_data = snapshot.lights[i];
+    LightUniform& light = lights->light[i];
+    light.position[0] = light_data.position[0];
+    light.position[1] = light_data.position[1];
+    light.position[2] = light_data.position[2];
+    light.position[3] = light_data.directional ? 0.0f : 1.0f;
+    light.color[0] = light_data.color[0];
+    light.color[1] = light_data.color[1];
+    light.color[2] = light_data.color[2];
+    light.color[3] = 1.0f;
+  }
+
+  recordFrame(cb, accumulate, render_scene, scale_resolution);
+  if(accumulate) {
+    accumulated_samples_ = accumulation_.samples();
+  }
+
+  if(timestamp_pool_) {
+    funcs_->vkCmdWriteTimestamp(cb, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                                timestamp_pool_, 2 * current_frame + 1);
+    timestamps_written_[current_frame] = true;
+  }
+
+  surface_->frameReady();
+  capture_.submitted(surface_->graphicsQueue());
+
+  // signaled once the frame has completed, for its input latency and the
+  // frames in flight limit
+  const std::chrono::steady_clock::time_point input_time =
+    new_snapshot ? snapshot.input_time
+                 : std::chrono::steady_clock::time_point();
+  if(input_time.time_since_epoch().count() != 0) {
+    input_latency_.submitted.add(
+      std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - input_time)
+        .count());
+  }
+  frame_input_time_[current_frame] = input_time;
+  VkResult err = funcs_->vkQueueSubmit(surface_->graphicsQueue(), 0, nullptr,
+                                       frame_fences_[current_frame]);
+  if(err != VK_SUCCESS) {
+    qFatal("Failed to submit frame fence: %d", err);
+  }
+  frame_fence_pending_[current_frame] = true;
+  const int frame_count = surface_->concurrentFrameCount();
+  if(max_frames_in_flight_ > 0 && max_frames_in_flight_ < frame_count) {
+    // the frames after the oldest one allowed may stay in flight
+    waitFrameFence((current_frame + frame_count - max_frames_in_flight_ + 1) %
+                   frame_count);
+  }
+  if(resizing_) {
+    resizing_ = false;
+    const double ms = std::chrono::duration<double, std::milli>(
+                        std::chrono::steady_clock::now() - resize_start_)
+                        .count();
+    ++resize_stats_.resizes;
+    resize_stats_.last_ms = ms;
+    resize_stats_.max_ms = std::max(resize_stats_.max_ms, ms);
+  }
+  if(!on_demand_) {
+    surface_->requestUpdate(); // render continuously, throttled by the
+                               // presentation rate
+  } else if(accumulate && !accumulation_.converged()) {
+    invalidate(); // keep refining the still image
+  } else if((mesh_streamer_ && mesh_streamer_->pending()) ||
+            textures_.pending()) {
+    invalidate(); // draw what is streamed in
+  }
+}
+
+void vulkan_engine::VulkanEngine::waitFrameFence(int frame) {
+  if(!frame_fence_pending_[frame]) {
+    return;
+  }
+  VkDevice device = surface_->device();
+  funcs_->vkWaitForFences(device, 1, &frame_fences_[frame], VK_TRUE,
+                          UINT64_MAX);
+  funcs_->vkResetFences(device, 1, &frame_fences_[frame]);
+  frame_fence_pending_[frame] = false;
+  // Without a frames in flight limit the fence is only checked once the
+  // slot is reused, which bounds the completion from above.
+  const std::chrono::steady_clock::time_point input_time =
+    frame_input_time_[frame];
+  if(input_time.time_since_epoch().count() != 0) {
+    input_latency_.completed.add(
+      std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - input_time)
+        .count());
+  }
 }
 
 float vulkan_engine::VulkanEngine::height() {
-  const QSize sz = window_->swapChainImageSize();
+  const QSize sz = surface_->swapChainImageSize();
   return sz.height();
 }
 
 float vulkan_engine::VulkanEngine::width()  {
-  const QSize sz = window_->swapChainImageSize();
+  const QSize sz = surface_->swapChainImageSize();
   return sz.width();
 }
- 
@@ -1,15 +1,127 @@
 #ifndef SHIFT_GUI_VULKANRENDERER_H_
 #define SHIFT_GUI_VULKANRENDERER_H_
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
 #include <QVulkanWindow>
 
+#include "vulkan-engine/AccumulationPass.h"
+#include "vulkan-engine/AsyncCompute.h"
+#include "vulkan-engine/BindlessTable.h"
+#include "vulkan-engine/DeletionQueue.h"
+#include "vulkan-engine/DynamicResolution.h"
+#include "vulkan-engine/GeometryBuffer.h"
+#include "vulkan-engine/EntityStore.h"
+#include "vulkan-engine/FrameCapture.h"
+#include "vulkan-engine/GpuCulling.h"
+#include "vulkan-engine/LatencyHistogram.h"
+#include "vulkan-engine/Material.h"
+#include "vulkan-engine/MeshCache.h"
 #include "vulkan-engine/MeshData.h"
+#include "vulkan-engine/MeshStreamer.h"
+#include "vulkan-engine/RenderGraph.h"
+#include "vulkan-engine/RenderSurface.h"
+#include "vulkan-engine/SceneGraph.h"
+#include "vulkan-engine/SceneSnapshot.h"
+#include "vulkan-engine/SimdMath.h"
+#include "vulkan-engine/TextureManager.h"
+#include "vulkan-engine/TransformTable.h"
+#include "vulkan-engine/TripleBuffer.h"
 
 namespace vulkan_engine {
 
+/*! Renders the scene held in a scene graph and entity store.
+
+ Frames are rendered from immutable scene snapshots. By default
+ startNextFrame() updates the scene and takes the snapshot itself; with
+ startUpdateThread() the scene is updated and snapshotted on a separate
+ thread instead and frames pick up the latest snapshot without locking, so
+ scene updates and command recording run in parallel. All scene accessors
+ may be called from any thread.
+
+ In RenderMode::OnDemand no frame is scheduled unless something changed:
+ the scene, the view, the swapchain, an animation run by the update
+ function, or a caller that invalidate()s.
+
+ With progressive accumulation enabled, frames of a static view are
+ rendered with a sub-pixel jittered projection and averaged, so the image
+ converges to an anti-aliased still without MSAA. Any new snapshot, e.g.
+ from a camera move, restarts the accumulation.
+
+ With dynamic resolution enabled (and no accumulation), the scene is
+ rendered at a resolution that follows the measured GPU frame time and
+ upscaled into the surface.
+
+ Meshes of a MeshCache are streamed in by I/O threads as they become
+ visible, closest and largest on screen first, and evicted least recently
+ used first once the mesh budget is exceeded. Until a mesh is resident its
+ objects are drawn as their bounding boxes. The texture maps of meshes are
+ loaded and their mip levels streamed the same way, by their size on
+ screen.
+
+ Materials are converted to a metallic-roughness layout and kept,
+ deduplicated, in one storage buffer indexed by the draws, together with
+ the bindless texture slots of their mesh. Each frame the material data is
+ compared against the table, so edits are picked up and only the changed
+ entries uploaded. World transforms live in a storage buffer as well, sized
+ to the scene, and only those of moved objects are uploaded.
+
+ With multisampling the scene is drawn into multisampled color and depth
+ attachments of the render graph, resolved into the swap chain image at the
+ end of the render pass. They are transient attachments in lazily allocated
+ memory where the device has it, so tile-based GPUs keep them on chip.
+
+ With GPU culling the draw list is frustum culled by a compute shader into
+ indirect draws. On devices with a compute-only queue family the culling
+ runs on a queue of its own, overlapping with the graphics work of the
+ previous frame, otherwise it is a pass of the frame. */
 class VulkanEngine : public QVulkanWindowRenderer {
 public:
+  enum class RenderMode { Continuous, OnDemand };
+
+  struct ResizeStats {
+    size_t resizes = 0;   // swap chain recreations
+    double last_ms = 0.0; // from the release of the swap chain resources
+    double max_ms = 0.0;  // to the submission of the next frame
+  };
+
+  /*! Latencies from the input a view was set for to the first frame
+   showing it. */
+  struct InputLatency {
+    LatencyHistogram submitted; // until the frame was submitted (presented)
+    LatencyHistogram completed; // until the frame completed on the GPU
+  };
+
+  /*! Called on the update thread with exclusive access to the scene graph
+   and the view matrix. dt is the time since the previous call in seconds.
+   Returns whether anything was changed, e.g. while an animation runs. */
+  typedef std::function<bool(SceneGraph& scene_graph, math::Mat4& view,
+                             double dt)>
+    UpdateFunction;
+
+  /*! Called on the render thread at the start of every frame, before the
+   scene is snapshotted, to apply the input gathered since the last one. */
+  typedef std::function<void()> InputFunction;
+
+  /*! With msaa the scene is rendered with the highest sample count the
+   window supports, up to 16. Adds a queue of a compute-only family to the
+   device of the window (with Qt 5.15 or later), so it has to be created
+   before the window is exposed. */
   VulkanEngine(QVulkanWindow* w, bool msaa = false);
+  /*! Renders the scene with sample_count samples, or the highest count
+   below that the device supports. A multisampled surface is rendered into
+   with its own sample count instead. */
+  VulkanEngine(RenderSurface* surface, int sample_count = 1);
+  ~VulkanEngine() override;
 
   void initResources() override;
   void initSwapChainResources() override;
@@ -19,34 +131,614 @@ public:
   float height();
   float width();
 
+  /*! Adds an object to the scene as a child of the given scene graph node
+   and returns its node. The mesh and material data are not copied and must
+   outlive the engine or the next call to clearScene(). Meshes are uploaded
+   to the GPU on the first frame that references them. Material data may be
+   edited in place, followed by invalidate(). */
+  SceneGraph::NodeId
+  addRenderObject(MeshData* mesh_data, MaterialData* material_data,
+                  const QMatrix4x4& transform,
+                  SceneGraph::NodeId parent = SceneGraph::INVALID_NODE);
+
+  /*! Streams the meshes of cache, which has to outlive the engine or the
+   frame rendered after the next call, with io_threads reading threads.
+   Clears the scene. */
+  void setMeshCache(const MeshCache* cache, int io_threads = 2);
+
+  /*! Adds an object drawing mesh cache_mesh of the mesh cache, which is
+   loaded once the object is visible. */
+  SceneGraph::NodeId
+  addCachedObject(uint32_t cache_mesh, MaterialData* material_data,
+                  const QMatrix4x4& transform,
+                  SceneGraph::NodeId parent = SceneGraph::INVALID_NODE);
+
+  /*! Device memory for streamed meshes in bytes, unlimited by default. Call
+   on the render thread. */
+  void setMeshBudget(VkDeviceSize bytes);
+
+  MeshStreamer::Stats meshStreamingStats() const;
+
+  /*! Device memory for the mip levels of textures in bytes, unlimited by
+   default. */
+  void setTextureBudget(VkDeviceSize bytes);
+
+  /*! Reads textures block compressed from a cache in directory, baking
+   missing ones on first use. Applies to textures loaded afterwards. */
+  inline void setTextureCache(const std::string& directory) {
+    textures_.setCacheDirectory(directory);
+  }
+
+  inline TextureManager::Stats textureStats() const {
+    return textures_.stats();
+  }
+
+  /*! Transform table statistics of the last frame. Render thread only. */
+  inline TransformTable::Stats transformStats() const {
+    return transform_table_.stats();
+  }
+
+  /*! Geometry buffer statistics of the last frame. Render thread only. */
+  inline GeometryBuffer::Stats geometryStats() const {
+    return geometry_.stats();
+  }
+
+  /*! Material table statistics of the last frame. Render thread only. */
+  inline MaterialTable::Stats materialStats() const {
+    return material_table_.stats();
+  }
+
+  /*! Render graph statistics of the last frame. Render thread only. */
+  inline const RenderGraph::Stats& renderGraphStats() const {
+    return render_graph_.stats();
+  }
+
+  /*! The render graph of the last frame in Graphviz dot format. Render
+   thread only. */
+  inline std::string renderGraphDump() const {
+    return render_graph_.dump();
+  }
+
+  /*! Adds a node without geometry, e.g. for an assembly. */
+  SceneGraph::NodeId
+  addNode(const QMatrix4x4& transform,
+          SceneGraph::NodeId parent = SceneGraph::INVALID_NODE);
+
+  /*! Sets the transform of a node relative to its parent. World transforms
+   of the node's subtree are updated with the next snapshot. */
+  void setTransform(SceneGraph::NodeId node, const QMatrix4x4& transform);
+
+  /*! Only safe to use while no update thread is running. */
+  inline const SceneGraph& sceneGraph() const {
+    return scene_graph_;
+  }
+
+  /*! Only safe to use while no update thread is running. */
+  inline const EntityStore& entities() const {
+    return entities_;
+  }
+
+  /*! Shows or hides the object attached to a node. */
+  void setVisible(SceneGraph::NodeId node, bool visible);
+
+  void addLight(const LightData& light);
+
+  /*! Removes all objects and lights. Geometry and textures the frames in
+   flight still draw are retired, without waiting for the device. */
+  void clearScene();
+
+  void setViewMatrix(const QMatrix4x4& view);
+  /*! Sets the view for input that happened at input_time, whose latency
+   until it is on screen is measured by inputLatency(). Of views set before
+   the next snapshot the latest wins, with the time of the oldest input. */
+  void setViewMatrix(const QMatrix4x4& view,
+                     std::chrono::steady_clock::time_point input_time);
+  QMatrix4x4 viewMatrix();
+
+  /*! See InputFunction, e.g. to coalesce camera input to one update per
+   frame. Call on the render thread. */
+  inline void setInputFunction(const InputFunction& input) {
+    input_function_ = input;
+  }
+
+  /*! Starts updating the scene on a separate thread, calling update (if
+   set) before every snapshot. With a rate of 0 one snapshot is produced per
+   rendered frame, otherwise rate snapshots are produced per second. */
+  void startUpdateThread(const UpdateFunction& update, double rate = 0.0);
+  void stopUpdateThread();
+
+  inline bool updateThreadRunning() const {
+    return update_thread_.joinable();
+  }
+
+  /*! Time spent updating the scene for the snapshot of the last frame, in
+   ms. */
+  inline float lastUpdateTime() const {
+    return last_update_time_;
+  }
+
+  /*! Samples per pixel of the scene, once the resources are initialized. */
+  inline int sampleCount() const {
+    return samples_;
+  }
+
+  inline QMatrix4x4 projectionMatrix() const {
+    return math::toQt(projection_);
+  }
+
+  /*! Device memory currently allocated by the engine, in bytes. */
+  inline VkDeviceSize deviceMemoryUsage() const {
+    return device_memory_usage_ + geometry_.memorySize() +
+           accumulation_.memorySize() + dynamic_resolution_.memorySize() +
+           render_graph_.memorySize() + textures_.memorySize() +
+           culling_.memorySize() + deletion_queue_.memorySize();
+  }
+
+  /*! Number of objects that passed frustum culling in the last frame, all
+   visible objects with GPU culling. */
+  inline size_t lastDrawCount() const {
+    return draw_keys_.size();
+  }
+
+  /*! Number of instanced draw calls recorded in the last frame, one per
+   visible mesh. */
+  inline size_t lastDrawCallCount() const {
+    return batches_.size();
+  }
+
+  void setRenderMode(RenderMode mode);
+
+  inline RenderMode renderMode() const {
+    return on_demand_ ? RenderMode::OnDemand : RenderMode::Continuous;
+  }
+
+  /*! Schedules a frame in on-demand mode, for changes the engine does not
+   see itself. May be called from any thread. */
+  void invalidate();
+
+  inline uint64_t framesRendered() const {
+    return frames_rendered_;
+  }
+
+  /*! Frames that continuous rendering would have drawn at the refresh rate
+   of the surface while on-demand rendering was idle. */
+  uint64_t framesSkipped() const;
+
+  void resetFrameCounters();
+
+  /*! Accumulates up to max_samples jittered frames while the scene and view
+   are unchanged. Once converged the accumulated image is presented without
+   rendering the scene. In on-demand mode frames are scheduled until then. */
+  void setProgressiveAccumulation(bool enabled, int max_samples = 64);
+
+  inline bool progressiveAccumulation() const {
+    return accumulate_;
+  }
+
+  /*! Number of samples averaged in the last frame, 0 without accumulation.
+   */
+  inline int accumulatedSamples() const {
+    return accumulated_samples_;
+  }
+
+  /*! Renders the scene at a resolution scaled between the bounds of the
+   settings so that the GPU frame time stays within the target. Requires GPU
+   timestamps, without them the scale stays at its maximum. Call on the
+   render thread. */
+  void setDynamicResolution(bool enabled);
+  void setDynamicResolution(bool enabled,
+                            const DynamicResolution::Settings& settings);
+
+  inline bool dynamicResolution() const {
+    return dynamic_resolution_enabled_;
+  }
+
+  /*! Current scale, render size and frame times of dynamic resolution. */
+  inline const DynamicResolution::Metrics& dynamicResolutionMetrics() const {
+    return dynamic_resolution_.metrics();
+  }
+
+  /*! GPU time of the most recent completed frame in ms, measured with
+   timestamp queries, or a negative value if they are not supported. */
+  inline float lastGpuFrameTime() const {
+    return gpu_frame_time_;
+  }
+
+  /*! Frustum culls the draw list with a compute shader and draws it
+   indirectly, on the compute queue of the surface if it has one. Meshes
+   and textures are then streamed by the visibility found by the GPU a few
+   frames earlier. Call on the render thread. */
+  void setGpuCulling(bool enabled);
+
+  inline bool gpuCulling() const {
+    return gpu_culling_;
+  }
+
+  /*! Culling statistics of the last frame. Render thread only. */
+  inline const GpuCulling::Stats& gpuCullingStats() const {
+    return culling_.stats();
+  }
+
+  /*! Whether the culling ran on a queue of its own, its GPU time and how
+   much of it overlapped with graphics work. Render thread only. */
+  inline const AsyncCompute::Stats& asyncComputeStats() const {
+    return async_compute_.stats();
+  }
+
+  /*! Width in pixels of the lines of LINE and WIREFRAME meshes and of the
+   edges of the wireframe overlay. Call on the render thread. */
+  void setLineWidth(float pixels);
+
+  inline float lineWidth() const {
+    return line_width_;
+  }
+
+  /*! Draws the edges of the triangles of shaded meshes over them, in the
+   same pass. Requires the geometryShader device feature, without it the
+   meshes are drawn shaded only. Call on the render thread. */
+  void setWireframeOverlay(bool enabled);
+
+  inline bool wireframeOverlay() const {
+    return wireframe_overlay_;
+  }
+
+  /*! Line segments drawn in the last frame by LINE and WIREFRAME meshes,
+   the upper bound with GPU culling. */
+  inline size_t lastLineSegmentCount() const {
+    return line_segments_;
+  }
+
+  /*! Copies the next frame back, once the GPU has rendered it, without
+   waiting for it. May be called from any thread, for the window as well
+   as the offscreen surface. */
+  std::future<QImage> captureFrame();
+
+  /*! Writes the next frame to path on a worker thread, see
+   FrameCapture::save(). Once all staging buffers wait to be written the
+   render thread waits for the oldest. May be called from any thread. */
+  std::future<bool> saveFrame(const std::string& path);
+
+  inline FrameCapture::Stats captureStats() const {
+    return capture_.stats();
+  }
+
+  /*! Lets at most frames frames be in flight on the GPU when the next one
+   starts, waiting for the oldest after submitting a frame, instead of the
+   surface's concurrent frame count. Fewer frames in flight sample the
+   input later, so it is shown sooner, at the cost of CPU and GPU no longer
+   overlapping across frames. 0 for no limit. Render thread only. */
+  inline void setMaxFramesInFlight(int frames) {
+    max_frames_in_flight_ = std::max(frames, 0);
+  }
+
+  inline int maxFramesInFlight() const {
+    return max_frames_in_flight_;
+  }
+
+  /*! Render thread only. */
+  inline const InputLatency& inputLatency() const {
+    return input_latency_;
+  }
+
+  inline void resetInputLatency() {
+    input_latency_.submitted.clear();
+    input_latency_.completed.clear();
+  }
+
+  /*! How long swap chain recreations took until the next frame was
+   submitted, e.g. while a window is resized. Render thread only. */
+  inline const ResizeStats& resizeStats() const {
+    return resize_stats_;
+  }
+
 protected:
 
+  // The pipelines drawing the scene into one render pass. They share the
+  // pipeline layout, so descriptor sets and push constants stay bound when
+  // switching between them. wireframe is null without geometry shaders.
+  struct ScenePipelines {
+    VkPipeline shaded = VK_NULL_HANDLE;
+    VkPipeline wireframe = VK_NULL_HANDLE; // shaded with edges on top
+    VkPipeline lines = VK_NULL_HANDLE;
+  };
+  enum class PipelineKind { Shaded, Wireframe, Lines };
+
   VkShaderModule createShader(const QString& name);
+  VkPipeline createScenePipeline(VkRenderPass render_pass,
+                                 VkSampleCountFlagBits samples,
+                                 PipelineKind kind);
+  void createScenePipelines(VkRenderPass render_pass,
+                            VkSampleCountFlagBits samples,
+                            ScenePipelines* pipelines);
+  void destroyScenePipelines(ScenePipelines* pipelines);
+  void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                    uint32_t memory_index, VkBuffer* buffer,
+                    VkDeviceMemory* memory, VkDeviceSize* memory_size);
+  uint32_t meshHandle(MeshData* mesh_data);
+  uint32_t materialHandle(MaterialData* material_data, uint32_t mesh);
+  uint32_t cachedMeshHandle(uint32_t cache_mesh);
+  void syncMeshes(const SceneSnapshot& snapshot);
+  void loadMeshTextures(const MeshData* mesh_data);
+  void releaseMeshes();
+  void measureVisibleMeshes(int current_frame, const SceneSnapshot& snapshot);
+  void streamMeshes();
+  void streamTextures(VkCommandBuffer cb, const QSize& size);
+  void updateMaterials(int current_frame, const SceneSnapshot& snapshot);
+  void updateTransforms(int current_frame, const SceneSnapshot& snapshot);
+  void writeStorageDescriptor(int current_frame, uint32_t binding,
+                              VkBuffer buffer, VkDeviceSize size);
+  void updateInstances(int current_frame, const SceneSnapshot& snapshot,
+                       const math::Mat4& view_projection);
+  void createInstanceBuffer(int frame, size_t capacity);
+  void releaseInstanceBuffer(int frame);
+  void cullAndSort(const SceneSnapshot& snapshot,
+                   const math::Mat4& view_projection, bool frustum_cull);
+  void recordState(VkCommandBuffer cb, int current_frame, const QSize& size,
+                   VkPipeline pipeline);
+  void recordDraws(VkCommandBuffer cb, const ScenePipelines& pipelines,
+                   size_t first, size_t last, bool lines);
+  void recordParallel(int current_frame, const QSize& size,
+                      VkRenderPass render_pass, VkFramebuffer framebuffer,
+                      const ScenePipelines& pipelines);
+  void recordScene(VkRenderPass render_pass, VkFramebuffer framebuffer,
+                   const ScenePipelines& pipelines, const QSize& size);
+  void presentOffscreen(VkCommandBuffer cb, bool accumulated);
+  void recordFrame(VkCommandBuffer cb, bool accumulate, bool render_scene,
+                   bool scale_resolution);
+  void readTimestamps(int current_frame);
+  void produceSnapshot(const std::chrono::steady_clock::time_point& start);
+  void waitFrameFence(int frame);
+  void updateLoop();
 
   struct Material {
     VkPipeline pipeline = VK_NULL_HANDLE;
     VkPipelineLayout pipeline_layout = VK_NULL_HANDLE;
   };
 
-  struct RenderObject {
-    Material* material = nullptr;
-    vulkan_engine::MeshData* mesh_data = nullptr;
-    vulkan_engine::MaterialData* material_data = nullptr;
-    QMatrix4x4 transform = QMatrix4x4();
+  /*! GPU copy of a MeshData: positions, normals, texture coordinates and
+   indices stored back-to-back in a range of the geometry buffer. Offsets
+   are in floats within the page, -1 for missing attributes. */
+  struct Mesh {
+    GeometryBuffer::Allocation allocation;
+    qint32 position_offset = 0;
+    qint32 normal_offset = -1;
+    qint32 uv_offset = -1;
+    uint32_t first_index = 0;
+    uint32_t index_count = 0;
+    // LINE and WIREFRAME meshes are drawn by the line pipeline, their
+    // indices are pairs, one per segment
+    bool lines = false;
+    // mesh of the mesh cache, UINT32_MAX for meshes added as MeshData.
+    // Streamed meshes are drawn as a box of their bounds while not resident.
+    uint32_t cache_mesh = UINT32_MAX;
+    float center[3] = {0.0f, 0.0f, 0.0f};
+    float half_extent[3] = {0.0f, 0.0f, 0.0f};
+
+    inline bool resident() const {
+      return allocation.valid();
+    }
+    inline bool streamed() const {
+      return cache_mesh != UINT32_MAX;
+    }
   };
 
-  std::vector<RenderObject> renderables_;
+  void uploadMesh(const MeshData& mesh_data, Mesh* mesh);
+  void releaseMesh(Mesh* mesh);
+  void retireMesh(Mesh* mesh);
+
+  // Scene state shared with the update thread, guarded by scene_mutex_.
+  // The render path only reads snapshots.
+  std::mutex scene_mutex_;
+  SceneGraph scene_graph_;
+  EntityStore entities_;
+  std::vector<LightData> lights_;
+  math::Mat4 view_ = math::Mat4::identity();
+  // changes under scene_mutex_ when the scene is cleared
+  std::atomic<uint64_t> scene_generation_{0};
+  bool scene_changed_ = true; // since the last snapshot
+
+  // Meshes and materials are referred to by entities through their index
+  // in these tables, which only grow until the scene is cleared. The render
+  // thread copies the entries of the acquired snapshot in syncMeshes().
+  std::vector<MeshData*> mesh_data_;
+  std::unordered_map<const MeshData*, uint32_t> mesh_handles_;
+  math::BoundsArray mesh_bounds_;
+  std::vector<MaterialInstance> material_instances_;
+  std::map<std::pair<const MaterialData*, uint32_t>, uint32_t>
+    material_handles_;
 
+  // Mesh streaming. mesh_cache_index_ maps mesh handles to meshes of the
+  // cache (UINT32_MAX for meshes added as MeshData), cached_handles_ the
+  // other way around.
+  const MeshCache* mesh_cache_ = nullptr;
+  std::vector<uint32_t> mesh_cache_index_;
+  std::vector<uint32_t> cached_handles_;
 
+  // renderer state changed on behalf of the scene, e.g. the tables dropped
+  // by clearScene(), run on the render thread by syncMeshes()
+  std::vector<std::function<void()>> render_jobs_;
 
+  // Render thread copies of the mesh tables up to the acquired snapshot and
+  // the scene generation they belong to. streamed_handles_ maps meshes of
+  // streamed_cache_, the render thread's view of mesh_cache_, to their mesh
+  // handle.
+  uint64_t render_generation_ = 0;
+  std::vector<Mesh> meshes_; // GPU copies, uploaded lazily
+  const MeshCache* streamed_cache_ = nullptr;
+  std::vector<uint32_t> streamed_handles_;
+  std::unique_ptr<MeshStreamer> mesh_streamer_;
+  VkDeviceSize mesh_budget_ = VkDeviceSize(-1);
+  Mesh placeholder_mesh_;
 
-  QVulkanWindow* window_ = nullptr;
+  // texture maps of every mesh handle the render thread has a copy of and
+  // those sampled by materials (UINT32_MAX if missing), render thread only
+  struct MaterialMaps {
+    TextureManager::Handle albedo;
+    TextureManager::Handle normal;
+  };
+  TextureManager textures_;
+  std::vector<std::vector<TextureManager::Handle>> mesh_textures_;
+  std::vector<MaterialMaps> mesh_material_maps_;
+  BindlessTable bindless_;
+  GeometryBuffer geometry_;
+
+  // resources replaced while frames in flight may still use them
+  DeletionQueue deletion_queue_;
+
+  // material table entry of every material handle, render thread only,
+  // and the table generation each descriptor set refers to
+  MaterialTable material_table_;
+  std::vector<MaterialTable::Handle> material_entries_;
+  uint64_t
+    material_set_generation_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+
+  // world transforms by dense entity index, as of snapshot
+  // transforms_sequence_, and the table generation each descriptor set
+  // refers to
+  TransformTable transform_table_;
+  bool transforms_uploaded_ = false;
+  uint64_t transforms_sequence_ = 0;
+  uint64_t transforms_scene_generation_ = 0;
+  uint64_t
+    transform_set_generation_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+  VkDescriptorSet bindless_set_ = VK_NULL_HANDLE; // of the current frame
+
+  // per frame, visible mesh handles and the largest bounding radius over
+  // distance to the eye of their objects
+  std::vector<std::pair<uint32_t, float>> visible_meshes_;
+
+  TripleBuffer<SceneSnapshot> snapshots_;
+  uint64_t snapshot_sequence_ = 0;
+  // update time of the snapshot the render thread acquired last
+  std::atomic<float> last_update_time_{0.0f};
+
+  std::thread update_thread_;
+  std::atomic<bool> update_running_{false};
+  UpdateFunction update_function_;
+  double update_rate_ = 0.0;
+  std::mutex consumed_mutex_;
+  std::condition_variable consumed_condition_;
+  std::atomic<bool> snapshot_consumed_{false};
+
+  std::atomic<bool> on_demand_{false};
+  std::atomic<bool> frame_requested_{false};
+  uint64_t frames_rendered_ = 0;
+  uint64_t frames_skipped_ = 0;
+  std::chrono::steady_clock::time_point last_frame_time_;
+
+  // progressive accumulation, the pass itself is only used on the render
+  // thread
+  std::atomic<bool> accumulate_{false};
+  std::atomic<int> accumulation_max_samples_{64};
+  std::atomic<int> accumulated_samples_{0};
+  AccumulationPass accumulation_;
+
+  bool dynamic_resolution_enabled_ = false;
+  DynamicResolution dynamic_resolution_;
+
+  // single-sampled scene pipelines for the engine's own RGBA16F targets,
+  // the scene passes of accumulation and dynamic resolution are compatible
+  ScenePipelines offscreen_pipelines_;
+
+  float line_width_ = 1.0f;
+  bool wireframe_overlay_ = false;
+  bool geometry_shader_ = false; // device feature of the overlay
+  size_t line_segments_ = 0;
+
+  // requested and used sample count, and the render pass of the scene
+  // resolving into the swap chain image if multisampled
+  int sample_count_ = 1;
+  VkSampleCountFlagBits samples_ = VK_SAMPLE_COUNT_1_BIT;
+  VkRenderPass resolve_pass_ = VK_NULL_HANDLE;
+
+  // passes of the current frame, and the depth and multisampled color
+  // attachments of the scene passes as transient images
+  RenderGraph render_graph_;
+
+  // Input latency: the time of the oldest input of the view not yet in a
+  // snapshot, guarded by scene_mutex_, and per frame slot a fence signaled
+  // after the frame with the input time of its snapshot.
+  InputFunction input_function_;
+  std::chrono::steady_clock::time_point view_input_time_;
+  int max_frames_in_flight_ = 0;
+  VkFence frame_fences_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+  bool frame_fence_pending_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+  std::chrono::steady_clock::time_point
+    frame_input_time_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+  InputLatency input_latency_;
+
+  // swap chain recreation at a new size in progress, since resize_start_,
+  // and the size of the released swap chain until it is recreated
+  bool resizing_ = false;
+  std::chrono::steady_clock::time_point resize_start_;
+  QSize released_size_;
+  ResizeStats resize_stats_;
+
+  // GPU frame time, two timestamps per frame in flight
+  VkQueryPool timestamp_pool_ = VK_NULL_HANDLE;
+  float timestamp_period_ = 0.0f; // ns per tick
+  bool timestamps_written_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+  float gpu_frame_time_ = -1.0f;
+  quint64 graphics_timestamps_[4]; // of the last two completed frames
+
+  // per frame draw list of visible entities, (mesh << 32 | dense index)
+  std::vector<uint64_t> draw_keys_;
+  std::vector<std::vector<uint64_t>> chunk_keys_;
+
+  // Visible objects of the same mesh are drawn as instances of one draw,
+  // reading their object and material from a host visible buffer per frame
+  // in flight in draw key order.
+  struct Batch {
+    const Mesh* mesh;
+    bool placeholder; // drawn as the bounding box of mesh
+    uint32_t first_instance;
+    uint32_t instance_count;
+  };
+  struct InstanceBuffer {
+    VkBuffer buffer = VK_NULL_HANDLE;
+    VkDeviceMemory memory = VK_NULL_HANDLE;
+    VkDeviceSize memory_size = 0;
+    size_t capacity = 0; // instances
+    quint8* data = nullptr;
+  };
+  std::vector<Batch> batches_;
+  InstanceBuffer instance_buffers_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+
+  // With GPU culling the batches are indirect draws, instance_count is
+  // the upper bound, reading the instances culled into the buffer of
+  // GpuCulling. The instance binding of each frame's set refers to it as
+  // of generation instance_set_generation_, or to the instance buffer of
+  // the frame. gpu_cull_generation_ is the scene generation of the draw
+  // list culled by the last use of a frame slot, UINT64_MAX if the CPU
+  // culled it.
+  bool gpu_culling_ = false;
+  VkBuffer indirect_buffer_ = VK_NULL_HANDLE; // of the current frame
+  GpuCulling culling_;
+  AsyncCompute async_compute_;
+  bool instance_set_culled_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+  uint64_t instance_set_generation_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+  uint64_t gpu_cull_generation_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+
+  // readback of captured frames, recorded last into the frame
+  FrameCapture capture_;
+
+  // secondary command buffers for parallel recording, frame-major
+  int record_chunks_ = 0;
+  std::vector<VkCommandPool> record_pools_;
+  std::vector<VkCommandBuffer> record_buffers_;
+
+  std::unique_ptr<WindowSurface> window_surface_;
+  RenderSurface* surface_ = nullptr;
   QVulkanDeviceFunctions* funcs_ = nullptr;
 
   VkDeviceMemory buffer_memory_ = VK_NULL_HANDLE;
+  VkDeviceSize buffer_memory_size_ = 0;
   VkBuffer buffer_ = VK_NULL_HANDLE;
+  quint8* uniform_data_ = nullptr;
+  VkDescriptorBufferInfo
+    camera_buffer_info_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
   VkDescriptorBufferInfo
-    uniform_buffer_info_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
+    lights_buffer_info_[QVulkanWindow::MAX_CONCURRENT_FRAME_COUNT];
 
   VkDescriptorPool descriptor_pool_ = VK_NULL_HANDLE;
   VkDescriptorSetLayout descriptor_set_layout_ = VK_NULL_HANDLE;
@@ -54,12 +746,11 @@ protected:
 
   VkPipelineCache pipeline_cache_ = VK_NULL_HANDLE;
   VkPipelineLayout pipeline_layout_ = VK_NULL_HANDLE;
-  VkPipeline pipeline_ = VK_NULL_HANDLE;
+  ScenePipelines pipelines_;
 
-  QMatrix4x4 view_ = QMatrix4x4();
-  QMatrix4x4 projection_ = QMatrix4x4();
+  VkDeviceSize device_memory_usage_ = 0;
 
-  float rotation_ = 0.0f;
+  math::Mat4 projection_ = math::Mat4::identity();
 };
 
 }
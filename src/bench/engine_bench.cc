@@ -0,0 +1,746 @@
+#include "vulkan-engine/MeshCache.h"
+#include "vulkan-engine/MeshDeduplicator.h"
+#include "vulkan-engine/OffscreenSurface.h"
+#include "vulkan-engine/SceneGenerator.h"
+#include "vulkan-engine/VulkanEngine.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <future>
+
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QGuiApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QVulkanInstance>
+
+/*! Headless scene stress benchmark.
+
+ Renders a suite of procedurally generated scenes through VulkanEngine on an
+ OffscreenSurface and reports, per scene, the startup time (scene generation,
+ resource creation and first frame), the CPU time spent recording and
+ submitting a frame, the GPU time of a frame and the memory in use. Results
+ are written as JSON and, when a baseline is given, compared against it; any
+ metric exceeding the baseline by more than the tolerance fails the run. */
+
+struct BenchCase {
+  QString name;
+  vulkan_engine::SceneDescription scene;
+};
+
+struct BenchOptions {
+  QSize size = QSize(1280, 720);
+  int samples = 1;
+  int warmup_frames = 10;
+  int frames = 200;
+  // streams the meshes from a mesh cache within this budget, in MB, if
+  // not negative
+  double stream_budget = -1.0;
+  // objects whose mesh is a moved copy of an earlier one draw that instead
+  bool deduplicate = false;
+  // writes the render graph of each scene's last frame there, if not empty
+  QString dump_graph;
+  // frustum culls on the GPU, on the compute queue if there is one
+  bool gpu_culling = false;
+  // writes every measured frame there as <name>_<frame>.<capture_format>,
+  // if not empty
+  QString capture;
+  QString capture_format = "png";
+  // swap chain recreations at changing sizes after the measured frames
+  int resizes = 0;
+  // orbits the view a little every measured frame, as camera input
+  bool moving_camera = false;
+  // "lines" draws every mesh as WIREFRAME, "overlay" draws the edges over
+  // the shaded meshes, if not empty
+  QString wireframe;
+  float line_width = 1.0f;
+};
+
+static std::vector<BenchCase> defaultSuite() {
+  std::vector<BenchCase> suite(4);
+
+  suite[0].name = "small";
+  suite[0].scene.object_count = 100;
+  suite[0].scene.mesh_count = 4;
+  suite[0].scene.light_count = 1;
+  suite[0].scene.min_triangles = 64;
+  suite[0].scene.max_triangles = 1024;
+
+  suite[1].name = "medium";
+  suite[1].scene.object_count = 2000;
+  suite[1].scene.mesh_count = 16;
+  suite[1].scene.light_count = 4;
+  suite[1].scene.min_triangles = 64;
+  suite[1].scene.max_triangles = 4096;
+
+  suite[2].name = "many_objects";
+  suite[2].scene.object_count = 20000;
+  suite[2].scene.mesh_count = 64;
+  suite[2].scene.light_count = 16;
+  suite[2].scene.min_triangles = 32;
+  suite[2].scene.max_triangles = 1024;
+
+  suite[3].name = "dense_meshes";
+  suite[3].scene.object_count = 200;
+  suite[3].scene.mesh_count = 8;
+  suite[3].scene.light_count = 4;
+  suite[3].scene.min_triangles = 50000;
+  suite[3].scene.max_triangles = 200000;
+
+  return suite;
+}
+
+static double percentile(std::vector<double> samples, double p) {
+  if(samples.empty()) {
+    return 0.0;
+  }
+  std::sort(samples.begin(), samples.end());
+  const size_t i = std::min(samples.size() - 1,
+                            size_t(std::floor(p * (samples.size() - 1) + 0.5)));
+  return samples[i];
+}
+
+static QJsonObject statistics(const std::vector<double>& samples) {
+  double sum = 0.0;
+  for(double sample : samples) {
+    sum += sample;
+  }
+  QJsonObject stats;
+  stats["mean"] = samples.empty() ? 0.0 : sum / samples.size();
+  stats["p50"] = percentile(samples, 0.50);
+  stats["p95"] = percentile(samples, 0.95);
+  stats["max"] = percentile(samples, 1.00);
+  return stats;
+}
+
+static QJsonObject
+statistics(const vulkan_engine::LatencyHistogram& histogram) {
+  QJsonObject stats;
+  stats["count"] = double(histogram.count());
+  stats["mean"] = histogram.mean();
+  stats["p50"] = histogram.percentile(0.50);
+  stats["p95"] = histogram.percentile(0.95);
+  stats["p99"] = histogram.percentile(0.99);
+  stats["max"] = histogram.max();
+  return stats;
+}
+
+// Resident set size of the process in kB as reported by the kernel, or -1
+// where /proc is not available.
+static qint64 residentMemory(const char* field) {
+  QFile file(QStringLiteral("/proc/self/status"));
+  if(!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+    return -1;
+  }
+  while(!file.atEnd()) {
+    const QByteArray line = file.readLine();
+    if(line.startsWith(field)) {
+      return line.mid(qstrlen(field)).trimmed().split(' ').first().toLongLong();
+    }
+  }
+  return -1;
+}
+
+static QJsonObject runCase(QVulkanInstance* inst, const BenchCase& bench_case,
+                           const BenchOptions& options) {
+  QElapsedTimer startup_timer;
+  startup_timer.start();
+
+  vulkan_engine::GeneratedScene scene =
+    vulkan_engine::SceneGenerator::generate(bench_case.scene);
+  if(options.wireframe == "lines") {
+    for(vulkan_engine::MeshData& mesh : scene.meshes) {
+      mesh.shading_type = vulkan_engine::ShadingType::WIREFRAME;
+    }
+  }
+
+  vulkan_engine::MeshDeduplicator deduplicator;
+  if(options.deduplicate) {
+    for(vulkan_engine::SceneObject& object : scene.objects) {
+      const vulkan_engine::MeshDeduplicator::Result unique =
+        deduplicator.add(&scene.meshes[object.mesh_index]);
+      object.mesh_index = unique.mesh - scene.meshes.data();
+      object.transform = object.transform * unique.transform;
+    }
+  }
+
+  const bool stream = options.stream_budget >= 0.0;
+  vulkan_engine::MeshCache cache;
+  const std::string cache_path =
+    QDir::temp()
+      .filePath(QStringLiteral("engine_bench_%1.vemc").arg(bench_case.name))
+      .toStdString();
+  if(stream) {
+    std::vector<const vulkan_engine::MeshData*> meshes;
+    for(const vulkan_engine::MeshData& mesh : scene.meshes) {
+      meshes.push_back(&mesh);
+    }
+    if(!vulkan_engine::MeshCache::write(cache_path, meshes) ||
+       !cache.open(cache_path)) {
+      qFatal("Failed to create mesh cache %s", cache_path.c_str());
+    }
+  }
+
+  // the engine multisamples into its own attachments, the surface only
+  // holds the resolved image
+  vulkan_engine::OffscreenSurface surface(inst, options.size);
+  surface.create();
+
+  vulkan_engine::VulkanEngine engine(&surface, options.samples);
+  engine.setGpuCulling(options.gpu_culling);
+  engine.setWireframeOverlay(options.wireframe == "overlay");
+  engine.setLineWidth(options.line_width);
+  if(stream) {
+    engine.setMeshCache(&cache);
+    engine.setMeshBudget(VkDeviceSize(options.stream_budget * (1 << 20)));
+  }
+  for(vulkan_engine::SceneObject& object : scene.objects) {
+    if(stream) {
+      engine.addCachedObject(object.mesh_index,
+                             &scene.materials[object.material_index],
+                             object.transform);
+    } else {
+      engine.addRenderObject(&scene.meshes[object.mesh_index],
+                             &scene.materials[object.material_index],
+                             object.transform);
+    }
+  }
+  for(const vulkan_engine::LightData& light : scene.lights) {
+    engine.addLight(light);
+  }
+
+  // look at the whole object grid from a fixed position
+  const float extent =
+    3.0f * std::cbrt(float(std::max(bench_case.scene.object_count, 1)));
+  QMatrix4x4 view;
+  view.lookAt(QVector3D(0.0f, 0.5f * extent, 1.5f * extent + 5.0f),
+              QVector3D(0.0f, 0.0f, 0.0f), QVector3D(0.0f, 1.0f, 0.0f));
+  engine.setViewMatrix(view);
+
+  engine.initResources();
+  engine.initSwapChainResources();
+
+  surface.beginFrame();
+  engine.startNextFrame();
+  surface.waitForFrame();
+  const double startup_time = startup_timer.nsecsElapsed() * 1e-6;
+
+  std::vector<double> cpu_times;
+  std::vector<double> gpu_times;
+  cpu_times.reserve(options.frames);
+  gpu_times.reserve(options.frames);
+  QElapsedTimer frame_timer;
+  std::vector<std::future<bool>> captures;
+  for(int i = 0; i < options.warmup_frames + options.frames; ++i) {
+    // waits for the previous frame, which is not part of the CPU time
+    surface.beginFrame();
+    if(i > options.warmup_frames && surface.lastGpuTime() >= 0.0) {
+      gpu_times.push_back(surface.lastGpuTime());
+    }
+
+    frame_timer.start();
+    if(!options.capture.isEmpty() && i >= options.warmup_frames) {
+      const QString file = QString("%1_%2.%3")
+                             .arg(bench_case.name)
+                             .arg(i - options.warmup_frames, 4, 10,
+                                  QLatin1Char('0'))
+                             .arg(options.capture_format);
+      captures.push_back(engine.saveFrame(
+        QDir(options.capture).filePath(file).toStdString()));
+    }
+    if(options.moving_camera && i >= options.warmup_frames) {
+      if(i == options.warmup_frames) {
+        engine.resetInputLatency();
+      }
+      QMatrix4x4 orbit;
+      orbit.rotate(0.5f, 0.0f, 1.0f, 0.0f);
+      view = view * orbit;
+      engine.setViewMatrix(view, std::chrono::steady_clock::now());
+    }
+    engine.startNextFrame();
+    if(i >= options.warmup_frames) {
+      cpu_times.push_back(frame_timer.nsecsElapsed() * 1e-6);
+    }
+  }
+  surface.waitForFrame();
+  if(surface.lastGpuTime() >= 0.0) {
+    gpu_times.push_back(surface.lastGpuTime());
+  }
+  // the frames still being written once rendering is done
+  QElapsedTimer drain_timer;
+  drain_timer.start();
+  int captured = 0;
+  for(std::future<bool>& capture : captures) {
+    captured += capture.get();
+  }
+  const double drain_time = drain_timer.nsecsElapsed() * 1e-6;
+
+  QJsonObject result;
+  result["name"] = bench_case.name;
+  result["objects"] = bench_case.scene.object_count;
+  result["meshes"] = bench_case.scene.mesh_count;
+  result["lights"] = int(scene.lights.size());
+  result["triangles"] = double(scene.triangleCount());
+  result["draw_calls"] = double(engine.lastDrawCallCount());
+  result["startup_ms"] = startup_time;
+  result["cpu_frame_ms"] = statistics(cpu_times);
+  result["gpu_frame_ms"] = statistics(gpu_times);
+  result["device_memory_bytes"] =
+    double(engine.deviceMemoryUsage() + surface.attachmentMemory());
+  result["resident_memory_kb"] = double(residentMemory("VmRSS:"));
+  const vulkan_engine::GeometryBuffer::Stats geometry_stats =
+    engine.geometryStats();
+  QJsonObject geometry;
+  geometry["pages"] = double(geometry_stats.pages);
+  geometry["capacity_bytes"] = double(geometry_stats.capacity);
+  geometry["used_bytes"] = double(geometry_stats.used);
+  geometry["meshes"] = double(geometry_stats.allocations);
+  result["geometry"] = geometry;
+  const vulkan_engine::RenderGraph::Stats& graph_stats =
+    engine.renderGraphStats();
+  QJsonObject render_graph;
+  render_graph["passes"] = double(graph_stats.passes);
+  render_graph["culled"] = double(graph_stats.culled);
+  render_graph["barriers"] = double(graph_stats.barriers);
+  render_graph["image_barriers"] = double(graph_stats.image_barriers);
+  render_graph["buffer_barriers"] = double(graph_stats.buffer_barriers);
+  render_graph["transient_bytes"] = double(graph_stats.transient_bytes);
+  render_graph["transient_memory_bytes"] =
+    double(graph_stats.transient_memory);
+  result["render_graph"] = render_graph;
+  // lazily allocated memory is only backed as far as it is committed
+  QJsonObject attachments;
+  attachments["samples"] = engine.sampleCount();
+  attachments["surface_bytes"] = double(surface.attachmentMemory());
+  attachments["transient_bytes"] =
+    double(graph_stats.transient_memory - graph_stats.lazy_committed);
+  attachments["lazy_bytes"] =
+    double(surface.lazyAttachmentMemory() + graph_stats.lazy_memory);
+  attachments["lazy_committed_bytes"] = double(graph_stats.lazy_committed);
+  result["attachments"] = attachments;
+  if(options.gpu_culling) {
+    const vulkan_engine::GpuCulling::Stats& culling_stats =
+      engine.gpuCullingStats();
+    const vulkan_engine::AsyncCompute::Stats& compute_stats =
+      engine.asyncComputeStats();
+    QJsonObject gpu_culling;
+    gpu_culling["async"] = compute_stats.async;
+    gpu_culling["candidates"] = double(culling_stats.candidates);
+    gpu_culling["visible"] = double(culling_stats.visible);
+    gpu_culling["compute_ms"] = compute_stats.compute_time;
+    gpu_culling["overlap_ms"] = compute_stats.overlap_time;
+    result["gpu_culling"] = gpu_culling;
+  }
+  if(!options.wireframe.isEmpty()) {
+    QJsonObject lines;
+    lines["mode"] = options.wireframe;
+    lines["width"] = options.line_width;
+    lines["segments"] = double(engine.lastLineSegmentCount());
+    result["lines"] = lines;
+  }
+  if(options.moving_camera) {
+    // completion is seen when the next frame starts, an upper bound
+    const vulkan_engine::VulkanEngine::InputLatency& latency =
+      engine.inputLatency();
+    QJsonObject input_latency;
+    input_latency["submitted_ms"] = statistics(latency.submitted);
+    input_latency["completed_ms"] = statistics(latency.completed);
+    result["input_latency"] = input_latency;
+  }
+  if(!options.capture.isEmpty()) {
+    const vulkan_engine::FrameCapture::Stats capture_stats =
+      engine.captureStats();
+    QJsonObject capture;
+    capture["frames"] = double(captures.size());
+    capture["saved"] = captured;
+    capture["buffers"] = double(capture_stats.buffers);
+    capture["waits"] = double(capture_stats.waits);
+    capture["drain_ms"] = drain_time;
+    result["capture"] = capture;
+  }
+  if(!options.dump_graph.isEmpty()) {
+    QFile file(QDir(options.dump_graph).filePath(bench_case.name + ".dot"));
+    if(file.open(QIODevice::WriteOnly)) {
+      file.write(engine.renderGraphDump().c_str());
+    } else {
+      qWarning("Failed to write %s", qPrintable(file.fileName()));
+    }
+  }
+  if(stream) {
+    const vulkan_engine::MeshStreamer::Stats stats =
+      engine.meshStreamingStats();
+    QJsonObject streaming;
+    streaming["budget_bytes"] = double(stats.budget);
+    streaming["resident_bytes"] = double(stats.resident_bytes);
+    streaming["resident_meshes"] = double(stats.resident_meshes);
+    streaming["pending_meshes"] = double(stats.pending);
+    streaming["loads"] = double(stats.loads);
+    streaming["evictions"] = double(stats.evictions);
+    streaming["rejected"] = double(stats.rejected);
+    result["streaming"] = streaming;
+  }
+  if(options.deduplicate) {
+    const vulkan_engine::MeshDeduplicator::Stats& stats = deduplicator.stats();
+    QJsonObject deduplication;
+    deduplication["meshes"] = double(stats.meshes);
+    deduplication["unique"] = double(stats.unique);
+    deduplication["identical"] = double(stats.identical);
+    deduplication["moved"] = double(stats.moved);
+    deduplication["bytes"] = double(stats.bytes);
+    deduplication["saved_bytes"] = double(stats.savedBytes());
+    result["deduplication"] = deduplication;
+  }
+
+  if(options.resizes > 0) {
+    // a window dragged down to half its size and back, a frame per size
+    std::vector<double> resize_times;
+    for(int r = 1; r <= options.resizes; ++r) {
+      const double t = double(r) / options.resizes;
+      const double scale = 0.5 + std::fabs(t - 0.5);
+      surface.waitForFrame();
+      const size_t resizes = engine.resizeStats().resizes;
+      engine.releaseSwapChainResources();
+      surface.resize(QSize(std::max(1, int(options.size.width() * scale)),
+                           std::max(1, int(options.size.height() * scale))));
+      engine.initSwapChainResources();
+      surface.beginFrame();
+      engine.startNextFrame();
+      // a step to the current size recreates the swap chain without
+      // counting as a resize
+      if(engine.resizeStats().resizes > resizes) {
+        resize_times.push_back(engine.resizeStats().last_ms);
+      }
+    }
+    surface.waitForFrame();
+    if(!resize_times.empty()) {
+      result["resize_ms"] = statistics(resize_times);
+    }
+  }
+
+  engine.releaseSwapChainResources();
+  engine.releaseResources();
+  surface.destroy();
+  if(stream) {
+    QFile::remove(QString::fromStdString(cache_path));
+  }
+
+  return result;
+}
+
+// Returns the value of a metric, "a.b" addresses member b of object a.
+static double metric(const QJsonObject& result, const QString& name) {
+  const QStringList path = name.split('.');
+  QJsonValue value = result.value(path[0]);
+  for(int i = 1; i < path.size(); ++i) {
+    value = value.toObject().value(path[i]);
+  }
+  return value.toDouble(-1.0);
+}
+
+// Everything besides the scene that changes what a run measures. Results
+// are only compared with a baseline recorded with the same configuration.
+static QJsonObject configuration(const BenchOptions& options,
+                                 const BenchCase& bench_case) {
+  QJsonObject config;
+  config["width"] = options.size.width();
+  config["height"] = options.size.height();
+  config["samples"] = options.samples;
+  config["frames"] = options.frames;
+  config["warmup_frames"] = options.warmup_frames;
+  config["seed"] = double(bench_case.scene.seed);
+  config["duplicate_meshes"] = bench_case.scene.duplicate_meshes;
+  config["deduplicate"] = options.deduplicate;
+  config["stream_budget"] = options.stream_budget;
+  config["gpu_culling"] = options.gpu_culling;
+  config["capture"] = !options.capture.isEmpty();
+  config["capture_format"] = options.capture_format;
+  config["moving_camera"] = options.moving_camera;
+  config["wireframe"] = options.wireframe;
+  config["line_width"] = options.line_width;
+  return config;
+}
+
+static int compareToBaseline(const QJsonObject& report,
+                             const QJsonObject& baseline_report,
+                             double tolerance) {
+  if(report["configuration"] != baseline_report["configuration"]) {
+    fprintf(stderr,
+            "The baseline was recorded with a different configuration:\n"
+            "%s\nthan this run:\n%s",
+            QJsonDocument(baseline_report["configuration"].toObject())
+              .toJson()
+              .constData(),
+            QJsonDocument(report["configuration"].toObject())
+              .toJson()
+              .constData());
+    return -1;
+  }
+  const QJsonArray results = report["results"].toArray();
+  const QJsonArray baseline = baseline_report["results"].toArray();
+  // the scene of a case, custom ones may differ in every run
+  const char* scene_keys[] = {"objects", "meshes", "lights", "triangles"};
+
+  // timings below the noise floor (in ms) are never reported as regressions
+  const double noise_floor = 0.05;
+  const char* time_metrics[] = {"startup_ms", "cpu_frame_ms.p50",
+                                "cpu_frame_ms.p95", "gpu_frame_ms.p50"};
+  const char* memory_metrics[] = {"device_memory_bytes"};
+
+  int regressions = 0;
+  for(const QJsonValue& value : results) {
+    const QJsonObject result = value.toObject();
+    QJsonObject reference;
+    for(const QJsonValue& baseline_value : baseline) {
+      if(baseline_value.toObject().value("name") == result.value("name")) {
+        reference = baseline_value.toObject();
+      }
+    }
+    if(reference.isEmpty()) {
+      fprintf(stderr, "%s: not in baseline, skipped\n",
+              qPrintable(result.value("name").toString()));
+      continue;
+    }
+    bool same_scene = true;
+    for(const char* key : scene_keys) {
+      same_scene = same_scene && result.value(key) == reference.value(key);
+    }
+    if(!same_scene) {
+      fprintf(stderr, "%s: scene differs from the baseline\n",
+              qPrintable(result.value("name").toString()));
+      return -1;
+    }
+
+    for(const char* name : time_metrics) {
+      const double current = metric(result, name);
+      const double expected = metric(reference, name);
+      if(expected <= 0.0 || current < 0.0) {
+        continue;
+      }
+      const bool regressed = current > expected * (1.0 + tolerance) &&
+                             current - expected > noise_floor;
+      fprintf(stderr, "%s %-20s %10.3f ms (baseline %10.3f ms) %s\n",
+              qPrintable(result.value("name").toString()), name, current,
+              expected, regressed ? "REGRESSION" : "ok");
+      regressions += regressed;
+    }
+
+    for(const char* name : memory_metrics) {
+      const double current = metric(result, name);
+      const double expected = metric(reference, name);
+      if(expected <= 0.0 || current < 0.0) {
+        continue;
+      }
+      const bool regressed = current > expected * (1.0 + tolerance);
+      fprintf(stderr, "%s %-20s %10.0f B  (baseline %10.0f B)  %s\n",
+              qPrintable(result.value("name").toString()), name, current,
+              expected, regressed ? "REGRESSION" : "ok");
+      regressions += regressed;
+    }
+  }
+  return regressions;
+}
+
+int main(int argc, char* argv[]) {
+  QGuiApplication app(argc, argv);
+  QGuiApplication::setApplicationName("engine_bench");
+
+  Q_INIT_RESOURCE(shaders);
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription("Headless scene stress benchmark");
+  parser.addHelpOption();
+  QCommandLineOption objects_option("objects", "Number of objects.", "n");
+  QCommandLineOption meshes_option("meshes", "Number of unique meshes.", "m");
+  QCommandLineOption lights_option("lights", "Number of lights.", "l");
+  QCommandLineOption min_triangles_option(
+    "min-triangles", "Triangles of the coarsest mesh.", "n", "64");
+  QCommandLineOption max_triangles_option(
+    "max-triangles", "Triangles of the finest mesh.", "n", "4096");
+  QCommandLineOption seed_option("seed", "Scene generator seed.", "seed", "1");
+  QCommandLineOption frames_option("frames", "Measured frames per scene.", "n",
+                                   "200");
+  QCommandLineOption warmup_option("warmup", "Warm-up frames per scene.", "n",
+                                   "10");
+  QCommandLineOption width_option("width", "Framebuffer width.", "px", "1280");
+  QCommandLineOption height_option("height", "Framebuffer height.", "px",
+                                   "720");
+  QCommandLineOption samples_option("samples", "MSAA sample count.", "n", "1");
+  QCommandLineOption output_option("output", "Write JSON results to file.",
+                                   "file");
+  QCommandLineOption baseline_option(
+    "baseline", "Compare results against baseline file.", "file");
+  QCommandLineOption tolerance_option(
+    "tolerance", "Relative slowdown tolerated before failing.", "fraction",
+    "0.10");
+  QCommandLineOption stream_budget_option(
+    "stream-budget",
+    "Stream meshes from a mesh cache within a device memory budget.", "MB");
+  QCommandLineOption duplicate_meshes_option(
+    "duplicate-meshes",
+    "Give every object its own rigidly moved copy of its mesh.");
+  QCommandLineOption deduplicate_option(
+    "deduplicate", "Draw copies of a mesh as instances of one mesh.");
+  QCommandLineOption dump_graph_option(
+    "dump-graph",
+    "Write the render graph of each scene's last frame as <name>.dot.",
+    "directory");
+  QCommandLineOption gpu_culling_option(
+    "gpu-culling", "Frustum cull on the GPU, on an async compute queue.");
+  QCommandLineOption capture_option(
+    "capture", "Write every measured frame as <name>_<frame>.<format>.",
+    "directory");
+  QCommandLineOption capture_format_option(
+    "capture-format", "Image format of --capture, e.g. png or exr.", "format",
+    "png");
+  QCommandLineOption resizes_option(
+    "resizes", "Resize the surface n times after the measured frames.", "n",
+    "0");
+  QCommandLineOption moving_camera_option(
+    "moving-camera",
+    "Orbit the view every measured frame and report the input latency.");
+  QCommandLineOption wireframe_option(
+    "wireframe",
+    "Draw the meshes as wide lines (lines) or with their edges on top "
+    "(overlay).",
+    "mode");
+  QCommandLineOption line_width_option(
+    "line-width", "Width of lines and edges.", "px", "1");
+  QCommandLineOption update_baseline_option(
+    "update-baseline", "Overwrite the baseline file with the results.");
+  parser.addOptions({objects_option, meshes_option, lights_option,
+                     min_triangles_option, max_triangles_option, seed_option,
+                     frames_option, warmup_option, width_option, height_option,
+                     samples_option, output_option, baseline_option,
+                     tolerance_option, stream_budget_option,
+                     duplicate_meshes_option, deduplicate_option,
+                     dump_graph_option, gpu_culling_option, capture_option,
+                     capture_format_option, resizes_option,
+                     moving_camera_option, wireframe_option,
+                     line_width_option, update_baseline_option});
+  parser.process(app);
+
+  BenchOptions options;
+  options.size = QSize(parser.value(width_option).toInt(),
+                       parser.value(height_option).toInt());
+  options.samples = parser.value(samples_option).toInt();
+  options.frames = std::max(1, parser.value(frames_option).toInt());
+  options.warmup_frames = std::max(0, parser.value(warmup_option).toInt());
+  options.deduplicate = parser.isSet(deduplicate_option);
+  options.dump_graph = parser.value(dump_graph_option);
+  options.gpu_culling = parser.isSet(gpu_culling_option);
+  options.capture = parser.value(capture_option);
+  options.capture_format = parser.value(capture_format_option);
+  options.resizes = std::max(0, parser.value(resizes_option).toInt());
+  options.moving_camera = parser.isSet(moving_camera_option);
+  options.wireframe = parser.value(wireframe_option);
+  if(!options.wireframe.isEmpty() && options.wireframe != "lines" &&
+     options.wireframe != "overlay") {
+    qFatal("Unknown wireframe mode %s", qPrintable(options.wireframe));
+  }
+  options.line_width = parser.value(line_width_option).toFloat();
+  if(!options.capture.isEmpty() && !QDir().mkpath(options.capture)) {
+    qFatal("Failed to create %s", qPrintable(options.capture));
+  }
+  if(parser.isSet(stream_budget_option)) {
+    options.stream_budget =
+      std::max(0.0, parser.value(stream_budget_option).toDouble());
+  }
+
+  // a custom scene replaces the default suite
+  std::vector<BenchCase> suite;
+  if(parser.isSet(objects_option) || parser.isSet(meshes_option) ||
+     parser.isSet(lights_option)) {
+    BenchCase custom;
+    custom.name = "custom";
+    if(parser.isSet(objects_option))
+      custom.scene.object_count = parser.value(objects_option).toInt();
+    if(parser.isSet(meshes_option))
+      custom.scene.mesh_count = parser.value(meshes_option).toInt();
+    if(parser.isSet(lights_option))
+      custom.scene.light_count = parser.value(lights_option).toInt();
+    custom.scene.min_triangles = parser.value(min_triangles_option).toInt();
+    custom.scene.max_triangles = parser.value(max_triangles_option).toInt();
+    suite.push_back(custom);
+  } else {
+    suite = defaultSuite();
+  }
+  for(BenchCase& bench_case : suite) {
+    bench_case.scene.seed = parser.value(seed_option).toUInt();
+    bench_case.scene.duplicate_meshes = parser.isSet(duplicate_meshes_option);
+  }
+
+  QVulkanInstance inst;
+  // lets the offscreen surface query descriptor indexing for bindless
+  // textures
+  const QByteArray properties2 =
+    VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME;
+  if(inst.supportedExtensions().contains(properties2)) {
+    inst.setExtensions(QByteArrayList() << properties2);
+  }
+  if(!inst.create()) {
+    qFatal("Failed to create Vulkan instance: %d", inst.errorCode());
+  }
+
+  QJsonArray results;
+  for(const BenchCase& bench_case : suite) {
+    fprintf(stderr, "running %s...\n", qPrintable(bench_case.name));
+    results.append(runCase(&inst, bench_case, options));
+  }
+
+  QJsonObject report;
+  // the seed and mesh duplication are the same for every case
+  report["configuration"] = configuration(options, suite.front());
+  report["peak_resident_memory_kb"] = double(residentMemory("VmHWM:"));
+  report["results"] = results;
+  const QByteArray json = QJsonDocument(report).toJson();
+
+  if(parser.isSet(output_option)) {
+    QFile file(parser.value(output_option));
+    if(!file.open(QIODevice::WriteOnly)) {
+      qWarning("Failed to write %s", qPrintable(parser.value(output_option)));
+      return 1;
+    }
+    file.write(json);
+  } else {
+    fwrite(json.constData(), 1, json.size(), stdout);
+  }
+
+  if(!parser.isSet(baseline_option)) {
+    return 0;
+  }
+
+  QFile baseline_file(parser.value(baseline_option));
+  if(parser.isSet(update_baseline_option)) {
+    if(!baseline_file.open(QIODevice::WriteOnly)) {
+      qWarning("Failed to write %s", qPrintable(baseline_file.fileName()));
+      return 1;
+    }
+    baseline_file.write(json);
+    return 0;
+  }
+
+  // without a baseline nothing is checked, which must not pass silently
+  if(!baseline_file.open(QIODevice::ReadOnly)) {
+    qWarning("No baseline at %s, run with --update-baseline to record one",
+             qPrintable(baseline_file.fileName()));
+    return 1;
+  }
+  const QJsonObject baseline =
+    QJsonDocument::fromJson(baseline_file.readAll()).object();
+  const int regressions = compareToBaseline(
+    report, baseline, parser.value(tolerance_option).toDouble());
+  if(regressions < 0) {
+    return 1;
+  }
+  if(regressions > 0) {
+    fprintf(stderr, "%d metric(s) regressed\n", regressions);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,207 @@
+#include "vulkan-engine/EntityStore.h"
+#include "vulkan-engine/MeshData.h"
+#include "vulkan-engine/SimdMath.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QMatrix4x4>
+
+/*! Microbenchmark of the per-frame loops over all renderable objects
+ (frustum culling, building sort keys and copying transforms for upload),
+ comparing a vector of render object structs holding pointers to their mesh
+ and material with the dense component arrays of EntityStore. */
+
+using namespace vulkan_engine;
+
+static volatile uint64_t sink = 0;
+
+// the layout the engine used before EntityStore
+struct RenderObject {
+  MeshData* mesh_data = nullptr;
+  MaterialData* material_data = nullptr;
+  QMatrix4x4 transform;
+  math::Bounds bounds;
+  bool visible = true;
+};
+
+template<class F>
+static double nanosecondsPerObject(F f, size_t count, int repetitions) {
+  f(); // warm up caches
+  QElapsedTimer timer;
+  timer.start();
+  for(int i = 0; i < repetitions; ++i) {
+    f();
+  }
+  return double(timer.nsecsElapsed()) / (double(count) * repetitions);
+}
+
+static void report(const char* name, double objects, double entities) {
+  printf("%-20s %10.2f %10.2f %8.2fx\n", name, objects, entities,
+         objects / entities);
+}
+
+// Removing a node must leave no changed range past the end of the graph,
+// which updateTransforms() would read. Returns false if it does.
+static bool checkRemoval() {
+  SceneGraph scene_graph;
+  EntityStore entities;
+  const math::Bounds bounds = {};
+  const SceneGraph::NodeId first =
+    scene_graph.addNode(SceneGraph::INVALID_NODE, math::Mat4::identity());
+  const SceneGraph::NodeId second =
+    scene_graph.addNode(SceneGraph::INVALID_NODE, math::Mat4::identity());
+  entities.create(first, 0, 0);
+  scene_graph.removeNode(second);
+  scene_graph.update();
+  for(const SceneGraph::Range& range : scene_graph.changedRanges()) {
+    if(range.first + range.count > scene_graph.size()) {
+      return false;
+    }
+  }
+  entities.updateTransforms(scene_graph, &bounds);
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  if(!checkRemoval()) {
+    fprintf(stderr, "Changed ranges reach past the removed nodes\n");
+    return 1;
+  }
+
+  const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 100000;
+  const size_t mesh_count = argc > 2 ? strtoul(argv[2], nullptr, 10) : 100;
+  const int repetitions = argc > 3 ? atoi(argv[3]) : 50;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  std::uniform_int_distribution<size_t> pick(0, mesh_count - 1);
+
+  std::vector<std::unique_ptr<MeshData>> meshes;
+  std::vector<std::unique_ptr<MaterialData>> materials;
+  math::BoundsArray mesh_bounds;
+  for(size_t i = 0; i < mesh_count; ++i) {
+    meshes.emplace_back(new MeshData());
+    materials.emplace_back(new MaterialData());
+    const float cube[] = {-1, -1, -1, 1, 1, 1};
+    mesh_bounds.push_back(math::computeBounds(cube, 2));
+  }
+
+  // objects and entities get the same meshes, materials and transforms
+  SceneGraph scene_graph;
+  EntityStore entities;
+  std::vector<RenderObject> objects(count);
+  for(size_t i = 0; i < count; ++i) {
+    const size_t mesh = pick(rng);
+    QMatrix4x4 transform;
+    transform.translate(100.0f * unit(rng), 100.0f * unit(rng),
+                        100.0f * unit(rng));
+    objects[i].mesh_data = meshes[mesh].get();
+    objects[i].material_data = materials[mesh].get();
+    objects[i].transform = transform;
+    math::transformBounds(math::fromQt(transform), mesh_bounds[mesh],
+                          &objects[i].bounds);
+
+    entities.create(scene_graph.addNode(SceneGraph::INVALID_NODE,
+                                        math::fromQt(transform)),
+                    mesh, mesh);
+  }
+  scene_graph.update();
+  entities.updateTransforms(scene_graph, mesh_bounds.data());
+  scene_graph.clearChangedRanges();
+
+  QMatrix4x4 qt_view_projection;
+  qt_view_projection.perspective(45.0f, 16.0f / 9.0f, 0.01f, 1000.0f);
+  qt_view_projection.lookAt(QVector3D(0, 0, 150), QVector3D(0, 0, 0),
+                            QVector3D(0, 1, 0));
+  const math::Frustum frustum =
+    math::frustumFromMatrix(math::fromQt(qt_view_projection));
+
+  std::vector<uint32_t> visible;
+  visible.reserve(count);
+  std::vector<uint64_t> keys;
+  keys.reserve(count);
+  std::vector<float> upload(count * 16);
+
+  printf("%zu objects, %zu meshes, %d repetitions, ns per object\n", count,
+         mesh_count, repetitions);
+  printf("%-20s %10s %10s %9s\n", "", "objects", "entities", "speedup");
+
+  const double objects_cull = nanosecondsPerObject(
+    [&]() {
+      visible.clear();
+      for(uint32_t i = 0; i < count; ++i) {
+        if(objects[i].visible && math::intersects(frustum, objects[i].bounds)) {
+          visible.push_back(i);
+        }
+      }
+      sink = sink + visible.size();
+    },
+    count, repetitions);
+  const double entities_cull = nanosecondsPerObject(
+    [&]() {
+      visible.clear();
+      const math::Bounds* bounds = entities.bounds();
+      const uint32_t* flags = entities.flags();
+      for(uint32_t i = 0; i < count; ++i) {
+        if((flags[i] & ENTITY_VISIBLE) && math::intersects(frustum, bounds[i])) {
+          visible.push_back(i);
+        }
+      }
+      sink = sink + visible.size();
+    },
+    count, repetitions);
+  report("frustum cull", objects_cull, entities_cull);
+
+  // Without a table the objects can only be grouped by mesh through their
+  // pointers, which is what a renderer without handles ends up doing.
+  // both sides reuse their key storage, only the sorting is timed
+  std::vector<std::pair<const MeshData*, uint32_t>> pairs;
+  pairs.reserve(count);
+  const double objects_sort = nanosecondsPerObject(
+    [&]() {
+      pairs.clear();
+      for(uint32_t i = 0; i < count; ++i) {
+        pairs.push_back(std::make_pair(objects[i].mesh_data, i));
+      }
+      std::sort(pairs.begin(), pairs.end());
+      sink = sink + pairs[count / 2].second;
+    },
+    count, repetitions);
+  const double entities_sort = nanosecondsPerObject(
+    [&]() {
+      keys.clear();
+      const uint32_t* mesh = entities.meshes();
+      for(uint32_t i = 0; i < count; ++i) {
+        keys.push_back(uint64_t(mesh[i]) << 32 | i);
+      }
+      std::sort(keys.begin(), keys.end());
+      sink = sink + keys[count / 2];
+    },
+    count, repetitions);
+  report("sort keys", objects_sort, entities_sort);
+
+  const double objects_upload = nanosecondsPerObject(
+    [&]() {
+      for(size_t i = 0; i < count; ++i) {
+        memcpy(&upload[i * 16], objects[i].transform.constData(),
+               16 * sizeof(float));
+      }
+      sink = sink + uint64_t(upload[count * 8]);
+    },
+    count, repetitions);
+  const double entities_upload = nanosecondsPerObject(
+    [&]() {
+      memcpy(upload.data(), entities.transforms(),
+             count * sizeof(math::Mat4));
+      sink = sink + uint64_t(upload[count * 8]);
+    },
+    count, repetitions);
+  report("transform upload", objects_upload, entities_upload);
+
+  return 0;
+}
@@ -0,0 +1,127 @@
+#include "vulkan-engine/JobSystem.h"
+#include "vulkan-engine/SimdMath.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <QElapsedTimer>
+
+/*! Scaling benchmark of the job system from one thread to all hardware
+ threads: frustum culling with sort key generation, batched matrix
+ multiplication and the overhead of scheduling many small jobs. */
+
+using namespace vulkan_engine;
+
+static volatile uint64_t sink = 0;
+
+template<class F>
+static double milliseconds(F f, int repetitions) {
+  f(); // warm up caches and wake the workers
+  QElapsedTimer timer;
+  timer.start();
+  for(int i = 0; i < repetitions; ++i) {
+    f();
+  }
+  return timer.nsecsElapsed() * 1e-6 / repetitions;
+}
+
+int main(int argc, char* argv[]) {
+  const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 1000000;
+  const int repetitions = argc > 2 ? atoi(argv[2]) : 20;
+  const int max_threads =
+    argc > 3 ? atoi(argv[3])
+             : std::max(int(std::thread::hardware_concurrency()), 1);
+  const size_t grain = 8192;
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+  math::Mat4Array models(count);
+  math::Mat4Array results(count);
+  math::BoundsArray bounds(count);
+  std::vector<uint32_t> meshes(count);
+  const float cube[] = {-1, -1, -1, 1, 1, 1};
+  const math::Bounds mesh_bounds = math::computeBounds(cube, 2);
+  for(size_t i = 0; i < count; ++i) {
+    models[i] = math::Mat4::identity();
+    models[i](0, 3) = 500.0f * unit(rng);
+    models[i](1, 3) = 500.0f * unit(rng);
+    models[i](2, 3) = 500.0f * unit(rng);
+    math::transformBounds(models[i], mesh_bounds, &bounds[i]);
+    meshes[i] = rng() % 256;
+  }
+
+  math::Mat4 view_projection = math::Mat4::identity();
+  view_projection(0, 0) = 0.002f;
+  view_projection(1, 1) = 0.002f;
+  view_projection(2, 2) = 0.001f;
+  view_projection(2, 3) = 0.5f;
+  const math::Frustum frustum = math::frustumFromMatrix(view_projection);
+
+  printf("%zu objects, %d repetitions, ms per run (speedup over 1 thread)\n",
+         count, repetitions);
+  printf("%8s %20s %20s %20s\n", "threads", "cull + sort keys", "multiply",
+         "ns per empty job");
+
+  double cull_1 = 0.0;
+  double multiply_1 = 0.0;
+  for(int threads = 1; threads <= max_threads; threads *= 2) {
+    JobSystem jobs(threads - 1);
+
+    const size_t chunks = (count + grain - 1) / grain;
+    std::vector<std::vector<uint64_t>> chunk_keys(chunks);
+    const double cull = milliseconds(
+      [&]() {
+        jobs.parallelFor(0, chunks, 1, [&](size_t first, size_t last) {
+          for(size_t c = first; c < last; ++c) {
+            std::vector<uint64_t>& keys = chunk_keys[c];
+            keys.clear();
+            const size_t end = std::min((c + 1) * grain, count);
+            for(size_t i = c * grain; i < end; ++i) {
+              if(math::intersects(frustum, bounds[i])) {
+                keys.push_back(uint64_t(meshes[i]) << 32 | i);
+              }
+            }
+            std::sort(keys.begin(), keys.end());
+          }
+        });
+        sink = sink + chunk_keys[0].size();
+      },
+      repetitions);
+
+    const double multiply = milliseconds(
+      [&]() {
+        jobs.parallelFor(0, count, grain, [&](size_t first, size_t last) {
+          math::multiply(view_projection, models.data() + first,
+                         results.data() + first, last - first);
+        });
+        sink = sink + uint64_t(results[count / 2].m[0]);
+      },
+      repetitions);
+
+    const int job_count = 100000;
+    std::atomic<int> counter{0};
+    const double schedule = milliseconds(
+      [&]() {
+        std::vector<JobSystem::JobHandle> all;
+        all.reserve(job_count);
+        for(int i = 0; i < job_count; ++i) {
+          all.push_back(jobs.schedule([&counter]() { ++counter; }));
+        }
+        jobs.wait(jobs.schedule([]() {}, all));
+      },
+      1);
+
+    if(threads == 1) {
+      cull_1 = cull;
+      multiply_1 = multiply;
+    }
+    printf("%8d %11.3f (%5.2fx) %11.3f (%5.2fx) %20.1f\n", threads, cull,
+           cull_1 / cull, multiply, multiply_1 / multiply,
+           schedule * 1e6 / job_count);
+  }
+
+  return 0;
+}
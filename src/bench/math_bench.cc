@@ -0,0 +1,126 @@
+#include "vulkan-engine/SimdMath.h"
+
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include <QElapsedTimer>
+#include <QGenericMatrix>
+
+/*! Microbenchmark of the batched math routines against QMatrix4x4 for the
+ per-frame workloads of the engine: view-projection times every model
+ matrix, parent times local transforms and normal matrices. */
+
+using namespace vulkan_engine;
+
+static volatile float sink = 0.0f;
+
+template<class F>
+static double nanosecondsPerMatrix(F f, size_t count, int repetitions) {
+  f(); // warm up caches
+  QElapsedTimer timer;
+  timer.start();
+  for(int i = 0; i < repetitions; ++i) {
+    f();
+  }
+  return double(timer.nsecsElapsed()) / (double(count) * repetitions);
+}
+
+static void report(const char* name, double qt, double simd) {
+  printf("%-28s %10.2f %10.2f %8.2fx\n", name, qt, simd, qt / simd);
+}
+
+int main(int argc, char* argv[]) {
+  const size_t count = argc > 1 ? strtoul(argv[1], nullptr, 10) : 10000;
+  const int repetitions = argc > 2 ? atoi(argv[2]) : 200;
+  // the chained products need two matrices, results are read in the middle
+  if(count < 2 || repetitions < 1) {
+    fprintf(stderr, "usage: math_bench [count >= 2] [repetitions >= 1]\n");
+    return 1;
+  }
+
+  std::mt19937 rng(1);
+  std::uniform_real_distribution<float> angle(0.0f, 360.0f);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  std::vector<QMatrix4x4> qt_models(count);
+  std::vector<QMatrix4x4> qt_results(count);
+  math::Mat4Array models(count);
+  math::Mat4Array results(count);
+  math::Mat3x4Array normal_matrices(count);
+  for(size_t i = 0; i < count; ++i) {
+    qt_models[i].translate(100.0f * unit(rng), 100.0f * unit(rng),
+                           100.0f * unit(rng));
+    qt_models[i].rotate(angle(rng), unit(rng), unit(rng), 1.0f);
+    qt_models[i].scale(1.0f + unit(rng) * 0.5f, 1.0f, 1.0f);
+    models[i] = math::fromQt(qt_models[i]);
+  }
+
+  QMatrix4x4 qt_view_projection;
+  qt_view_projection.perspective(45.0f, 16.0f / 9.0f, 0.01f, 1000.0f);
+  qt_view_projection.lookAt(QVector3D(0, 0, 300), QVector3D(0, 0, 0),
+                            QVector3D(0, 1, 0));
+  const math::Mat4 view_projection = math::fromQt(qt_view_projection);
+
+  printf("%zu matrices, %d repetitions, ns per matrix\n", count, repetitions);
+#if defined(VULKAN_ENGINE_AVX)
+  printf("math core: AVX\n");
+#elif defined(VULKAN_ENGINE_SSE)
+  printf("math core: SSE\n");
+#else
+  printf("math core: scalar\n");
+#endif
+  printf("%-28s %10s %10s %9s\n", "", "QMatrix4x4", "math", "speedup");
+
+  const double qt_vp = nanosecondsPerMatrix(
+    [&]() {
+      for(size_t i = 0; i < count; ++i) {
+        qt_results[i] = qt_view_projection * qt_models[i];
+      }
+      sink = sink + qt_results[count / 2](0, 0);
+    },
+    count, repetitions);
+  const double simd_vp = nanosecondsPerMatrix(
+    [&]() {
+      math::multiply(view_projection, models.data(), results.data(), count);
+      sink = sink + results[count / 2].m[0];
+    },
+    count, repetitions);
+  report("view-projection * model", qt_vp, simd_vp);
+
+  const double qt_pairwise = nanosecondsPerMatrix(
+    [&]() {
+      for(size_t i = 1; i < count; ++i) {
+        qt_results[i] = qt_models[i - 1] * qt_models[i];
+      }
+      sink = sink + qt_results[count / 2](0, 0);
+    },
+    count, repetitions);
+  const double simd_pairwise = nanosecondsPerMatrix(
+    [&]() {
+      math::multiply(models.data(), models.data() + 1, results.data() + 1,
+                     count - 1);
+      sink = sink + results[count / 2].m[0];
+    },
+    count, repetitions);
+  report("parent * local", qt_pairwise, simd_pairwise);
+
+  const double qt_normal = nanosecondsPerMatrix(
+    [&]() {
+      float sum = 0.0f;
+      for(size_t i = 0; i < count; ++i) {
+        sum += qt_models[i].normalMatrix()(0, 0);
+      }
+      sink = sink + sum;
+    },
+    count, repetitions);
+  const double simd_normal = nanosecondsPerMatrix(
+    [&]() {
+      math::normalMatrices(models.data(), normal_matrices.data(), count);
+      sink = sink + normal_matrices[count / 2].m[0];
+    },
+    count, repetitions);
+  report("normal matrix", qt_normal, simd_normal);
+
+  return 0;
+}
@@ -0,0 +1,36 @@
+#version 450 core
+/* accumulate.glsl */
+
+/* Blends the current frame into the history of previous frames:
+   history * (1 - weight) + current * weight. With a weight of 1 / (n + 1)
+   for the n-th frame the history is the average of all frames so far. A
+   weight of 1 copies the current image, which is used for presenting. */
+
+layout(push_constant) uniform PushConstants {
+  float weight;
+}
+push_constants_;
+
+#ifdef VERTEX_SHADER
+layout(location = 0) out vec2 uv_;
+
+void main() {
+  /* a single triangle covering the viewport */
+  uv_ = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+  gl_Position = vec4(uv_ * 2.0 - 1.0, 0.0, 1.0);
+}
+#endif
+
+#ifdef FRAGMENT_SHADER
+layout(set = 0, binding = 0) uniform sampler2D current_;
+layout(set = 0, binding = 1) uniform sampler2D history_;
+
+layout(location = 0) in vec2 uv_;
+
+layout(location = 0) out vec4 color_frag_;
+
+void main() {
+  color_frag_ = mix(texture(history_, uv_), texture(current_, uv_),
+                    push_constants_.weight);
+}
+#endif
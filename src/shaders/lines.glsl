@@ -0,0 +1,154 @@
+#version 450 core
+/* lines.glsl */
+
+/* Line segments drawn as screen-space quads. Every segment of a draw is
+   six vertices, two triangles, without an index buffer: the pair of indices
+   of the segment is read from the geometry page and both ends are expanded
+   sideways and along the segment by half the line width plus a pixel, over
+   which the edge is antialiased. Push constants and bindings are the ones
+   of scene.glsl. */
+
+layout(push_constant) uniform PushConstants {
+  int textured;
+  int position_offset;
+  int normal_offset;
+  int uv_offset;
+  vec4 scale;
+  vec4 offset;
+  int first_index; /* of the first segment in the geometry page */
+  float line_width; /* in pixels */
+}
+push_constants_;
+
+layout(set = 0, binding = 0) uniform Camera {
+  mat4 v;
+  mat4 p;
+  mat4 vp;
+  vec4 viewport; /* width, height, 1 / width, 1 / height in pixels */
+}
+camera_;
+
+struct Material {
+  vec3 albedo;
+  float occlusion;
+  float roughness;
+  float metalness;
+  float alpha;
+  int albedo_texture_index;
+  int occlusion_roughness_metalness_texture_index;
+  int normal_texture_index;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Materials {
+  Material material[];
+}
+materials_;
+
+struct Transform {
+  vec4 rows[3];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Transforms {
+  Transform transform[];
+}
+transforms_;
+
+struct Instance {
+  int object;
+  int material;
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer Instances {
+  Instance instance[];
+}
+instances_;
+
+layout(std430, set = 2, binding = 0) readonly buffer Geometry {
+  float data[];
+}
+geometry_;
+
+#ifdef VERTEX_SHADER
+/* signed distance from the center of the line in pixels */
+layout(location = 0) noperspective out float edge_distance_;
+layout(location = 1) flat out int material_frag_;
+
+/* corners of the two triangles of a segment, at its first or second end
+   and on either side */
+const int ends_[6] = int[6](0, 1, 1, 0, 1, 0);
+const float sides_[6] = float[6](-1.0, -1.0, 1.0, -1.0, 1.0, 1.0);
+
+vec4 clipPosition(uint index, Transform t) {
+  int i = push_constants_.position_offset + 3 * int(index);
+  vec4 position =
+    vec4(vec3(geometry_.data[i], geometry_.data[i + 1],
+              geometry_.data[i + 2]) *
+             push_constants_.scale.xyz +
+           push_constants_.offset.xyz,
+         1.0);
+  return camera_.vp * vec4(dot(t.rows[0], position),
+                           dot(t.rows[1], position),
+                           dot(t.rows[2], position), 1.0);
+}
+
+void main() {
+  int segment = gl_VertexIndex / 6;
+  int corner = gl_VertexIndex % 6;
+  Instance instance = instances_.instance[gl_InstanceIndex];
+  material_frag_ = instance.material;
+  Transform t = transforms_.transform[instance.object];
+  int i = push_constants_.first_index + 2 * segment;
+  vec4 a = clipPosition(floatBitsToUint(geometry_.data[i]), t);
+  vec4 b = clipPosition(floatBitsToUint(geometry_.data[i + 1]), t);
+
+  /* clipped against the near plane, so that both ends project */
+  edge_distance_ = 0.0;
+  if(a.z < 0.0 && b.z < 0.0) {
+    gl_Position = vec4(0.0, 0.0, -1.0, 1.0);
+    return;
+  }
+  if(a.z < 0.0) {
+    a = mix(a, b, a.z / (a.z - b.z));
+  } else if(b.z < 0.0) {
+    b = mix(b, a, b.z / (b.z - a.z));
+  }
+
+  vec2 half_viewport = 0.5 * camera_.viewport.xy;
+  vec2 direction = b.xy / b.w * half_viewport - a.xy / a.w * half_viewport;
+  float length_pixels = length(direction);
+  direction =
+    length_pixels > 1e-6 ? direction / length_pixels : vec2(1.0, 0.0);
+  vec2 normal = vec2(-direction.y, direction.x);
+
+  /* the ends are extended as well, so that the segments of a polyline
+     join without gaps */
+  float extent = 0.5 * push_constants_.line_width + 1.0;
+  bool end = ends_[corner] == 1;
+  vec4 position = end ? b : a;
+  vec2 offset =
+    extent * (sides_[corner] * normal + (end ? direction : -direction));
+  gl_Position =
+    vec4(position.xy + 2.0 * offset * camera_.viewport.zw * position.w,
+         position.zw);
+  edge_distance_ = sides_[corner] * extent;
+}
+#endif
+
+#ifdef FRAGMENT_SHADER
+layout(location = 0) noperspective in float edge_distance_;
+layout(location = 1) flat in int material_frag_;
+
+layout(location = 0) out vec4 color_frag_;
+
+void main() {
+  /* coverage of the pixel, falling off over one pixel at the edge */
+  float coverage = clamp(0.5 * push_constants_.line_width + 0.5 -
+                           abs(edge_distance_),
+                         0.0, 1.0);
+  if(coverage <= 0.0) {
+    discard;
+  }
+  Material material = materials_.material[material_frag_];
+  color_frag_ = vec4(material.albedo, material.alpha * coverage);
+}
+#endif
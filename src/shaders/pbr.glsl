@@ -1,14 +1,15 @@
 #version 450 core
 /* pbr.glsl */
 
-layout(constant_id = 0) const int max_transforms_ = 1024;
 layout(constant_id = 1) const int max_lights_ = 16;
 layout(constant_id = 2) const int max_materials_ = 1024;
 layout(constant_id = 3) const int shadow_texture_size_ = 2048;
 layout(constant_id = 4) const int max_textures_ = 2048;
 
 layout(push_constant) uniform PushConstants {
-  int index;
+  int index; /* into transforms_ */
+  int material_index;
+  int receive_shadows;
 }
 push_constants_;
 
@@ -37,19 +38,28 @@ layout(set = 1, binding = 0) uniform sampler2DArrayShadow texture_2d_shadow_;
 layout(set = 1,
        binding = 1) uniform samplerCubeArrayShadow texture_2d_shadow_cube_;
 
+/* GpuTransform of TransformTable.h, the upper rows of the world matrix */
 struct Transform {
-  mat4 m;
-  mat3 nm;
-  int material_index;
-  int cast_shadows;
-  int receive_shadows;
+  vec4 rows[3];
 };
 
-layout(set = 2, binding = 0) uniform Transforms {
-  Transform transform[max_transforms_];
+layout(std430, set = 2, binding = 0) readonly buffer Transforms {
+  Transform transform[];
 }
 transforms_;
 
+mat4 world_matrix(int index) {
+  Transform t = transforms_.transform[index];
+  return transpose(mat4(t.rows[0], t.rows[1], t.rows[2], vec4(0, 0, 0, 1)));
+}
+
+/* the cofactor matrix of the linear part, its inverse transpose up to
+   scale */
+mat3 normal_matrix(mat4 m) {
+  return mat3(cross(m[1].xyz, m[2].xyz), cross(m[2].xyz, m[0].xyz),
+              cross(m[0].xyz, m[1].xyz));
+}
+
 struct Material {
   vec3 albedo;
   float occlusion;
@@ -86,16 +96,15 @@ layout(location = 5) out vec4 shadow_coord_[max_lights_];
 
 void main() {
   int index_ = push_constants_.index;
-  normal_frag_ = normalize(transforms_.transform[index_].nm * normal_);
+  mat4 m = world_matrix(index_);
+  normal_frag_ = normalize(normal_matrix(m) * normal_);
   position_frag_ = position_;
-  gl_Position =
-    camera_.p * camera_.v * transforms_.transform[index_].m * position_;
+  gl_Position = camera_.p * camera_.v * m * position_;
   if(lights_.draw_shadows == 1) {
     for(int i = 0; i < lights_.count; i++) {
       shadow_coord_[i] = lights_.light[i].shadow_matrix * position_;
     }
-    eye_direction_camera_space_ =
-      -camera_.v * transforms_.transform[index_].m * position_;
+    eye_direction_camera_space_ = -camera_.v * m * position_;
   }
 }
 #endif
@@ -170,9 +179,9 @@ float offset_lookup(sampler2DArrayShadow texture_shadow, int index,
 void main() {
   int index_ = push_constants_.index;
   vec3 V = vec3(0.0, 0.0, 1.0);
-  mat4 mv = camera_.v * transforms_.transform[index_].m;
+  mat4 mv = camera_.v * world_matrix(index_);
 
-  int material_index = transforms_.transform[index_].material_index;
+  int material_index = push_constants_.material_index;
 
   vec3 albedo;
   int albedo_index = materials_.material[material_index].albedo_texture_index;
@@ -231,7 +240,7 @@ void main() {
 
     float shadow_test = 1.f;
     if(lights_.draw_shadows == 1 &&
-       transforms_.transform[index_].receive_shadows == 1) {
+       push_constants_.receive_shadows == 1) {
       shadow_test = 0.0;
       for(float y = -1.5; y <= 1.5; y += 1.0) {
         for(float x = -1.5; x <= 1.5; x += 1.0) {
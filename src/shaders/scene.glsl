@@ -0,0 +1,227 @@
+#version 450 core
+/* scene.glsl */
+
+layout(constant_id = 0) const int max_lights_ = 16;
+layout(constant_id = 1) const int max_textures_ = 4096;
+/* edges drawn over the shaded surface, with the geometry shader */
+layout(constant_id = 2) const bool wireframe_ = false;
+
+layout(push_constant) uniform PushConstants {
+  int textured; /* 0 for bounding box placeholders without UVs */
+  /* attribute offsets in the geometry page in floats, -1 if missing */
+  int position_offset;
+  int normal_offset;
+  int uv_offset;
+  /* object space scale and offset, of the bounding box for placeholders */
+  vec4 scale;
+  vec4 offset;
+  int first_index; /* of the draw in the geometry page, lines.glsl only */
+  float line_width; /* in pixels, of lines and wireframe edges */
+}
+push_constants_;
+
+layout(set = 0, binding = 0) uniform Camera {
+  mat4 v;
+  mat4 p;
+  mat4 vp; /* p * v, computed once per frame on the CPU */
+  vec4 viewport; /* width, height, 1 / width, 1 / height in pixels */
+}
+camera_;
+
+struct Light {
+  vec4 position; /* w == 0 for directional lights */
+  vec4 color;
+};
+
+layout(set = 0, binding = 1) uniform Lights {
+  int count;
+  Light light[max_lights_];
+}
+lights_;
+
+/* GpuMaterial of Material.h, texture indices are bindless slots */
+struct Material {
+  vec3 albedo;
+  float occlusion;
+  float roughness;
+  float metalness;
+  float alpha;
+  int albedo_texture_index;
+  int occlusion_roughness_metalness_texture_index;
+  int normal_texture_index;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer Materials {
+  Material material[];
+}
+materials_;
+
+/* GpuTransform of TransformTable.h, the upper rows of the world matrix */
+struct Transform {
+  vec4 rows[3];
+};
+
+layout(std430, set = 0, binding = 3) readonly buffer Transforms {
+  Transform transform[];
+}
+transforms_;
+
+/* instances of all draws, a draw of n instances reads n consecutive ones
+   starting at its first instance */
+struct Instance {
+  int object; /* index into transforms_ */
+  int material;
+};
+
+layout(std430, set = 0, binding = 4) readonly buffer Instances {
+  Instance instance[];
+}
+instances_;
+
+/* bindless table, indexed by the slots of BindlessTable */
+layout(set = 1, binding = 0) uniform sampler2D textures_[max_textures_];
+
+/* page of GeometryBuffer holding the vertices of the draw */
+layout(std430, set = 2, binding = 0) readonly buffer Geometry {
+  float data[];
+}
+geometry_;
+
+#ifdef VERTEX_SHADER
+layout(location = 0) out vec3 normal_frag_;
+layout(location = 1) out vec3 world_position_;
+layout(location = 2) out vec2 uv_frag_;
+layout(location = 3) flat out int material_frag_;
+/* pixels to the edges of the triangle, set by the geometry shader of the
+   wireframe pipeline */
+layout(location = 4) noperspective out vec3 edge_distance_;
+
+vec3 fetch3(int offset) {
+  int i = offset + 3 * gl_VertexIndex;
+  return vec3(geometry_.data[i], geometry_.data[i + 1], geometry_.data[i + 2]);
+}
+
+void main() {
+  /* vertex pulling, meshes without normals use their positions */
+  vec3 vertex_position = fetch3(push_constants_.position_offset);
+  vec3 vertex_normal = push_constants_.normal_offset >= 0
+                   ? fetch3(push_constants_.normal_offset)
+                   : vertex_position;
+  uv_frag_ = vec2(0.0);
+  if(push_constants_.uv_offset >= 0) {
+    int i = push_constants_.uv_offset + 2 * gl_VertexIndex;
+    uv_frag_ = vec2(geometry_.data[i], geometry_.data[i + 1]);
+  }
+  Instance instance = instances_.instance[gl_InstanceIndex];
+  material_frag_ = instance.material;
+  Transform t = transforms_.transform[instance.object];
+  vec4 position = vec4(vertex_position * push_constants_.scale.xyz +
+                         push_constants_.offset.xyz,
+                       1.0);
+  vec4 world_position = vec4(dot(t.rows[0], position),
+                             dot(t.rows[1], position),
+                             dot(t.rows[2], position), 1.0);
+  world_position_ = world_position.xyz;
+  /* the cofactor matrix of the linear part is its inverse transpose up to
+     scale, normals are renormalized in the fragment shader */
+  mat3 m = transpose(mat3(t.rows[0].xyz, t.rows[1].xyz, t.rows[2].xyz));
+  normal_frag_ =
+    mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1])) *
+    vertex_normal;
+  gl_Position = camera_.vp * world_position;
+  edge_distance_ = vec3(1e6);
+}
+#endif
+
+#ifdef GEOMETRY_SHADER
+/* Single-pass wireframe: every corner gets its distance in pixels to the
+   opposite edge, interpolated linearly in screen space these are the
+   distances of each fragment to the three edges. */
+layout(triangles) in;
+layout(triangle_strip, max_vertices = 3) out;
+
+layout(location = 0) in vec3 normal_geom_[];
+layout(location = 1) in vec3 world_position_geom_[];
+layout(location = 2) in vec2 uv_geom_[];
+layout(location = 3) flat in int material_geom_[];
+
+layout(location = 0) out vec3 normal_frag_;
+layout(location = 1) out vec3 world_position_;
+layout(location = 2) out vec2 uv_frag_;
+layout(location = 3) flat out int material_frag_;
+layout(location = 4) noperspective out vec3 edge_distance_;
+
+void main() {
+  /* triangles crossing the eye plane do not project, they get no wire */
+  vec2 p[3];
+  bool projected = true;
+  for(int i = 0; i < 3; i++) {
+    vec4 c = gl_in[i].gl_Position;
+    projected = projected && c.w > 0.0;
+    p[i] = 0.5 * c.xy / max(c.w, 1e-6) * camera_.viewport.xy;
+  }
+  /* twice the area over the length of the opposite edge is the height */
+  vec2 e0 = p[2] - p[1];
+  vec2 e1 = p[2] - p[0];
+  vec2 e2 = p[1] - p[0];
+  float area = abs(e1.x * e2.y - e1.y * e2.x);
+  vec3 heights = area / max(vec3(length(e0), length(e1), length(e2)),
+                            vec3(1e-6));
+
+  for(int i = 0; i < 3; i++) {
+    gl_Position = gl_in[i].gl_Position;
+    normal_frag_ = normal_geom_[i];
+    world_position_ = world_position_geom_[i];
+    uv_frag_ = uv_geom_[i];
+    material_frag_ = material_geom_[i];
+    edge_distance_ = vec3(1e6);
+    if(projected) {
+      edge_distance_ = vec3(0.0);
+      edge_distance_[i] = heights[i];
+    }
+    EmitVertex();
+  }
+  EndPrimitive();
+}
+#endif
+
+#ifdef FRAGMENT_SHADER
+layout(location = 0) in vec3 normal_frag_;
+layout(location = 1) in vec3 world_position_;
+layout(location = 2) in vec2 uv_frag_;
+layout(location = 3) flat in int material_frag_;
+layout(location = 4) noperspective in vec3 edge_distance_;
+
+layout(location = 0) out vec4 color_frag_;
+
+void main() {
+  vec3 N = normalize(normal_frag_);
+  Material material = materials_.material[material_frag_];
+  vec3 albedo = material.albedo;
+  if(push_constants_.textured != 0 && material.albedo_texture_index >= 0) {
+    albedo *= texture(textures_[material.albedo_texture_index], uv_frag_).rgb;
+  }
+  vec3 color = 0.05 * albedo * material.occlusion;
+
+  for(int i = 0; i < lights_.count; i++) {
+    vec3 L;
+    if(lights_.light[i].position.w == 0.0) {
+      L = normalize(lights_.light[i].position.xyz);
+    } else {
+      L = normalize(lights_.light[i].position.xyz - world_position_);
+    }
+    /* two-sided lighting, back faces are not culled */
+    color += albedo * lights_.light[i].color.rgb * abs(dot(N, L));
+  }
+
+  if(wireframe_) {
+    /* the nearest edge, antialiased over one pixel */
+    float d = min(min(edge_distance_.x, edge_distance_.y), edge_distance_.z);
+    float wire =
+      clamp(0.5 * push_constants_.line_width + 0.5 - d, 0.0, 1.0);
+    color = mix(color, vec3(0.02), wire);
+  }
+
+  color_frag_ = vec4(color, material.alpha);
+}
+#endif
@@ -0,0 +1,58 @@
+#version 450 core
+/* upscale.glsl */
+
+/* Upscales the scene rendered into the top left part of a larger target to
+   the whole viewport with bilinear filtering, followed by a sharpening
+   filter that is clamped to the local contrast so it does not ring. */
+
+layout(push_constant) uniform PushConstants {
+  vec2 uv_scale;   // rendered part of the source, in texture coordinates
+  vec2 texel_size; // of the source
+  float sharpness;
+}
+push_constants_;
+
+#ifdef VERTEX_SHADER
+layout(location = 0) out vec2 uv_;
+
+void main() {
+  /* a single triangle covering the viewport */
+  uv_ = vec2((gl_VertexIndex << 1) & 2, gl_VertexIndex & 2);
+  gl_Position = vec4(uv_ * 2.0 - 1.0, 0.0, 1.0);
+}
+#endif
+
+#ifdef FRAGMENT_SHADER
+layout(set = 0, binding = 0) uniform sampler2D source_;
+
+layout(location = 0) in vec2 uv_;
+
+layout(location = 0) out vec4 color_frag_;
+
+/* bilinear filtering never picks up pixels outside the rendered part */
+vec3 fetch(vec2 uv) {
+  vec2 uv_max =
+    push_constants_.uv_scale - 0.5 * push_constants_.texel_size;
+  return texture(source_, min(uv, uv_max)).rgb;
+}
+
+void main() {
+  vec2 uv = uv_ * push_constants_.uv_scale;
+  vec2 dx = vec2(push_constants_.texel_size.x, 0.0);
+  vec2 dy = vec2(0.0, push_constants_.texel_size.y);
+
+  vec3 color = fetch(uv);
+  if(push_constants_.sharpness > 0.0) {
+    vec3 n = fetch(uv - dy);
+    vec3 s = fetch(uv + dy);
+    vec3 w = fetch(uv - dx);
+    vec3 e = fetch(uv + dx);
+    vec3 lo = min(color, min(min(n, s), min(w, e)));
+    vec3 hi = max(color, max(max(n, s), max(w, e)));
+    vec3 sharpened =
+      color + push_constants_.sharpness * (4.0 * color - n - s - w - e);
+    color = clamp(sharpened, lo, hi);
+  }
+  color_frag_ = vec4(color, 1.0);
+}
+#endif
@@ -0,0 +1,91 @@
+// Bakes textures into the block compressed texture cache ahead of time, so
+// the engine never transcodes at load time.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+#include "vulkan-engine/JobSystem.h"
+#include "vulkan-engine/TextureCache.h"
+
+int main(int argc, char* argv[]) {
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName("texture_bake");
+
+  QCommandLineParser parser;
+  parser.setApplicationDescription(
+    "Transcodes images into the block compressed texture cache");
+  parser.addHelpOption();
+  parser.addPositionalArgument("files", "Images to bake.", "files...");
+  QCommandLineOption cache_option("cache", "Cache directory.", "dir",
+                                  "texture_cache");
+  QCommandLineOption kind_option(
+    "kind", "Texture kind: color (BC1/BC3), normal (BC5) or mask (BC4).",
+    "kind", "color");
+  parser.addOptions({cache_option, kind_option});
+  parser.process(app);
+
+  const QStringList files = parser.positionalArguments();
+  if(files.isEmpty()) {
+    parser.showHelp(1);
+  }
+
+  typedef vulkan_engine::TextureCache TextureCache;
+  TextureCache::Kind kind;
+  const QString kind_name = parser.value(kind_option);
+  if(kind_name == "color") {
+    kind = TextureCache::COLOR;
+  } else if(kind_name == "normal") {
+    kind = TextureCache::NORMAL;
+  } else if(kind_name == "mask") {
+    kind = TextureCache::MASK;
+  } else {
+    fprintf(stderr, "Unknown texture kind %s\n", qPrintable(kind_name));
+    return 1;
+  }
+
+  const QString directory = parser.value(cache_option);
+  if(!QDir().mkpath(directory)) {
+    fprintf(stderr, "Failed to create %s\n", qPrintable(directory));
+    return 1;
+  }
+  const TextureCache cache(directory.toStdString());
+
+  QElapsedTimer timer;
+  timer.start();
+
+  // one file per job, the blocks of each level are spread over the job
+  // system as well
+  std::vector<std::string> sources;
+  for(const QString& file : files) {
+    sources.push_back(file.toStdString());
+  }
+  std::atomic<int> failed(0);
+  vulkan_engine::JobSystem::global().parallelFor(
+    0, sources.size(), 1, [&](size_t first, size_t last) {
+      for(size_t i = first; i < last; ++i) {
+        if(!cache.bake(sources[i], kind, nullptr)) {
+          ++failed;
+          continue;
+        }
+        const std::string path = cache.cachePath(sources[i], kind);
+        printf("%s -> %s (%lld -> %lld bytes)\n", sources[i].c_str(),
+               path.c_str(),
+               static_cast<long long>(
+                 QFileInfo(QString::fromStdString(sources[i])).size()),
+               static_cast<long long>(
+                 QFileInfo(QString::fromStdString(path)).size()));
+      }
+    });
+
+  printf("baked %d of %d textures in %.1f s\n", int(sources.size()) - failed,
+         int(sources.size()), timer.elapsed() / 1000.0);
+  return failed ? 1 : 0;
+}